@@ -0,0 +1,328 @@
+/**
+ * @file async.c
+ * @brief Implements the asynchronous integration API on top of the worker
+ * pool.
+ *
+ * Parsing, cache lookups and all memory management happen on the owner
+ * thread in async_submit() and async_dispatch(); the workers only integrate
+ * and signal the eventfd of the engine.
+ */
+
+
+#include "async.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * Makes the eventfd of an engine readable.
+ *
+ * @param engine The engine.
+ */
+static void signal_engine(const AsyncEngine* engine) {
+    const uint64_t increment = 1;
+    if (write(engine->event_fd, &increment, sizeof(increment)) !=
+        (ssize_t)sizeof(increment))
+        perror("Error signalling a completed job");
+}
+
+
+/**
+ * Completes a job without the worker pool; the completion is delivered by
+ * the next async_dispatch().
+ *
+ * @param engine The engine.
+ * @param handle The handle of the job, with its result filled in.
+ */
+static void complete_now(AsyncEngine* engine, AsyncHandle* handle) {
+    handle->next_ready = nullptr;
+    if (engine->last_ready != NULL)
+        engine->last_ready->next_ready = handle;
+    else
+        engine->ready = handle;
+    engine->last_ready = handle;
+    signal_engine(engine);
+}
+
+
+/**
+ * Initialises an engine and starts its worker threads.
+ *
+ * @param engine The engine to initialise.
+ * @param threads The number of worker threads, clamped to
+ * [1 ; MAX_THREADS]. Every job additionally runs on `job->threads` threads of
+ * its own.
+ * @return true on success, false if the eventfd or the workers could not be
+ * created.
+ */
+bool async_init(AsyncEngine* engine, const int threads) {
+    engine->ready = nullptr;
+    engine->last_ready = nullptr;
+    engine->pending = 0;
+
+    engine->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (engine->event_fd < 0) {
+        perror("Error creating the completion eventfd");
+        return false;
+    }
+
+    if (!pool_init(&engine->pool, threads)) {
+        close(engine->event_fd);
+        engine->event_fd = -1;
+        return false;
+    }
+    pool_set_completion_fd(&engine->pool, engine->event_fd);
+    return true;
+}
+
+
+/**
+ * Returns the eventfd of an engine, which becomes readable when jobs
+ * complete. Wait for it with poll(), epoll or the event loop of choice, then
+ * call async_dispatch(). The descriptor stays owned by the engine.
+ *
+ * @param engine The engine.
+ * @return The eventfd.
+ */
+int async_fd(const AsyncEngine* engine) {
+    return engine->event_fd;
+}
+
+
+/**
+ * Submits an integration and returns without waiting for it.
+ *
+ * The integrand is validated and parsed at once; an invalid integrand or an
+ * exact repeat served from the result cache completes without reaching the
+ * workers, but is still delivered through async_dispatch() like any other
+ * completion.
+ *
+ * @param engine The engine.
+ * @param integrand The integrand in Reverse Polish Notation. It is copied, so
+ * the caller keeps ownership of the string.
+ * @param job The description of the integration. `cancel` is ignored: the
+ * job is cancelled with async_cancel().
+ * @param callback Called with the result when the job is dispatched, or NULL
+ * to poll the handle with async_done() and async_result() instead.
+ * @param user_data Passed to the callback.
+ * @return The handle of the job, or NULL if no memory could be allocated.
+ * A handle without a callback must be released with async_release().
+ */
+AsyncHandle* async_submit(AsyncEngine* engine, const char* integrand,
+                          const IntegrationJob* job,
+                          const AsyncCallback callback, void* user_data) {
+    AsyncHandle* handle = malloc(sizeof(AsyncHandle));
+    if (handle == NULL) {
+        perror("Error allocating memory for an asynchronous job");
+        return nullptr;
+    }
+
+    memset(handle, 0, sizeof(*handle));
+    cancel_token_init(&handle->cancel);
+    handle->callback = callback;
+    handle->user_data = user_data;
+    handle->task.job = *job;
+    handle->task.job.cancel = &handle->cancel;
+    handle->task.context = handle;
+    handle->task.result = (IntegrationResult){.start = job->start,
+                                              .end = job->end,
+                                              .tolerance = job->tolerance};
+    engine->pending++;
+
+    char* text = malloc(strlen(integrand) + 1);
+    if (text == NULL) {
+        perror("Did not manage to allocate memory");
+        handle->task.status = handle->task.result.status = INTEGRATION_ERROR;
+        complete_now(engine, handle);
+        return handle;
+    }
+    strcpy(text, integrand);
+    remove_spaces(text);
+
+    if (!validate_integrand(text) || !validate_expression(text)) {
+        free(text);
+        handle->task.status = handle->task.result.status =
+            INTEGRATION_INVALID_INTEGRAND;
+        complete_now(engine, handle);
+        return handle;
+    }
+
+    handle->task.expression = parse(text);
+    free(text);
+    if (handle->task.expression == NULL) {
+        handle->task.status = handle->task.result.status = INTEGRATION_ERROR;
+        complete_now(engine, handle);
+        return handle;
+    }
+
+    // A deadline makes the result depend on when the job ran
+    handle->keyed = cache_is_open() && !(job->deadline_ms > 0) &&
+                    cache_make_key(&handle->key, handle->task.expression,
+                                   &handle->task.job);
+    if (handle->keyed && cache_lookup(&handle->key, &handle->task.result)) {
+        handle->keyed = false;
+        handle->task.status = handle->task.result.status;
+        complete_now(engine, handle);
+        return handle;
+    }
+
+    pool_submit(&engine->pool, &handle->task);
+    return handle;
+}
+
+
+/**
+ * Finishes a completed job: stores its result in the cache, releases its
+ * expression and delivers it to its callback.
+ *
+ * @param engine The engine.
+ * @param handle The handle of the job.
+ */
+static void finish(AsyncEngine* engine, AsyncHandle* handle) {
+    engine->pending--;
+    handle->done = true;
+
+    if (handle->keyed)
+        cache_store(&handle->key, &handle->task.result);
+    if (handle->task.expression != NULL) {
+        free_tree(handle->task.expression);
+        handle->task.expression = nullptr;
+    }
+
+    if (handle->detached) {
+        free(handle);
+    } else if (handle->callback != NULL) {
+        handle->callback(handle, &handle->task.result, handle->user_data);
+        free(handle);
+    }
+}
+
+
+/**
+ * Delivers the jobs completed since the last call: marks their handles done
+ * and invokes their callbacks, in the order the jobs completed. Callbacks may
+ * submit new jobs.
+ *
+ * @param engine The engine.
+ * @param wait If true and no completion is available, blocks until a job
+ * completes, unless none is pending.
+ * @return The number of jobs delivered.
+ */
+size_t async_dispatch(AsyncEngine* engine, const bool wait) {
+    uint64_t count;
+    while (read(engine->event_fd, &count, sizeof(count)) < 0 &&
+           errno == EINTR) {
+    }
+
+    size_t delivered = 0;
+    AsyncHandle* ready = engine->ready;
+    engine->ready = nullptr;
+    engine->last_ready = nullptr;
+    while (ready != NULL) {
+        AsyncHandle* next = ready->next_ready;
+        finish(engine, ready);
+        delivered++;
+        ready = next;
+    }
+
+    PoolTask* task;
+    while ((task = pool_collect(&engine->pool,
+                                wait && delivered == 0)) != NULL) {
+        finish(engine, task->context);
+        delivered++;
+    }
+
+    return delivered;
+}
+
+
+/**
+ * Tells whether the job of a handle without a callback has been delivered by
+ * async_dispatch().
+ *
+ * @param handle The handle.
+ * @return true if the result is available.
+ */
+bool async_done(const AsyncHandle* handle) {
+    return handle->done;
+}
+
+
+/**
+ * Returns the result of a delivered job.
+ *
+ * @param handle The handle.
+ * @return The result, or NULL if the job is not done yet. It stays valid
+ * until the handle is released.
+ */
+const IntegrationResult* async_result(const AsyncHandle* handle) {
+    return handle->done ? &handle->task.result : nullptr;
+}
+
+
+/**
+ * Asks a job to stop. A running job stops at its next chunk boundary and
+ * completes with INTEGRATION_PARTIAL; a job still queued completes as soon
+ * as a worker takes it. The completion is delivered as usual.
+ *
+ * @param handle The handle of a job that is not done yet.
+ */
+void async_cancel(AsyncHandle* handle) {
+    cancel_token_cancel(&handle->cancel);
+}
+
+
+/**
+ * Releases a handle submitted without a callback. A job that is not done
+ * yet is cancelled, and its handle is freed once it completes.
+ *
+ * @param handle The handle, or NULL.
+ */
+void async_release(AsyncHandle* handle) {
+    if (handle == NULL)
+        return;
+
+    if (handle->done) {
+        free(handle);
+        return;
+    }
+
+    cancel_token_cancel(&handle->cancel);
+    handle->detached = true;
+}
+
+
+/**
+ * Returns the number of jobs submitted to an engine but not delivered yet.
+ *
+ * @param engine The engine.
+ * @return The number of pending jobs.
+ */
+size_t async_pending(const AsyncEngine* engine) {
+    return engine->pending;
+}
+
+
+/**
+ * Delivers the jobs still pending, waiting for them to complete, then stops
+ * the workers and closes the eventfd. Cancel the jobs first to stop them
+ * early. Handles without a callback stay valid until they are released.
+ *
+ * @param engine The engine.
+ */
+void async_destroy(AsyncEngine* engine) {
+    while (engine->pending > 0)
+        async_dispatch(engine, true);
+
+    pool_destroy(&engine->pool);
+    close(engine->event_fd);
+    engine->event_fd = -1;
+}
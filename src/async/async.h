@@ -0,0 +1,115 @@
+/**
+ * @file async.h
+ * @brief Header file for the asynchronous integration API, which lets an
+ * event loop integrate without a blocking thread per request.
+ *
+ * async_submit() validates and parses the integrand, hands the job to the
+ * worker pool of an AsyncEngine and returns a handle at once. Completions are
+ * signalled on a pollable eventfd; the owner then calls async_dispatch(),
+ * which invokes the completion callback of every finished job with its
+ * IntegrationResult. Jobs submitted without a callback are polled through
+ * their handle instead.
+ *
+ * An engine and its handles must only be used from the thread that created
+ * the engine; callbacks run on that thread as well, never on a worker.
+ */
+
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cache.h"
+#include "expression_parser.h"
+#include "integral.h"
+#include "worker_pool.h"
+
+
+typedef struct AsyncHandle AsyncHandle;
+
+
+/**
+ * @brief Called by async_dispatch() when a job has completed.
+ *
+ * `result->status` tells the outcome. The handle is released when the
+ * callback returns, so neither the handle nor the result may be used after
+ * that.
+ *
+ * @param handle The handle of the completed job.
+ * @param result The result of the job.
+ * @param user_data The pointer passed to async_submit().
+ */
+typedef void (*AsyncCallback)(AsyncHandle* handle,
+                              const IntegrationResult* result,
+                              void* user_data);
+
+
+/**
+ * @struct AsyncHandle
+ * @brief A job submitted to an AsyncEngine.
+ *
+ * The fields are owned by the engine and only read through the functions
+ * below. `task` is the worker pool task, whose parsed expression is released
+ * once the job is dispatched, and `cancel` the token the job is cancelled
+ * with. `key` is the cache key of the job if `keyed` is set. A handle is
+ * `done` once async_dispatch() has seen its completion; a `detached` handle
+ * was released by its owner while running and is freed when it completes.
+ */
+struct AsyncHandle {
+    PoolTask task;
+    CacheKey key;
+    bool keyed;
+    CancelToken cancel;
+    AsyncCallback callback;
+    void* user_data;
+    bool done;
+    bool detached;
+    AsyncHandle* next_ready;
+};
+
+
+/**
+ * @struct AsyncEngine
+ * @brief The worker pool and completion eventfd behind the asynchronous API.
+ *
+ * `event_fd` becomes readable whenever jobs complete. `ready` holds the jobs
+ * that completed without reaching the pool (rejected integrands and cache
+ * hits) until the next dispatch; `pending` counts the jobs not dispatched
+ * yet.
+ */
+typedef struct AsyncEngine {
+    WorkerPool pool;
+    int event_fd;
+    AsyncHandle* ready;
+    AsyncHandle* last_ready;
+    size_t pending;
+} AsyncEngine;
+
+
+bool async_init(AsyncEngine* engine, int threads);
+
+int async_fd(const AsyncEngine* engine);
+
+AsyncHandle* async_submit(AsyncEngine* engine, const char* integrand,
+                          const IntegrationJob* job, AsyncCallback callback,
+                          void* user_data);
+
+size_t async_dispatch(AsyncEngine* engine, bool wait);
+
+bool async_done(const AsyncHandle* handle);
+
+const IntegrationResult* async_result(const AsyncHandle* handle);
+
+void async_cancel(AsyncHandle* handle);
+
+void async_release(AsyncHandle* handle);
+
+size_t async_pending(const AsyncEngine* engine);
+
+void async_destroy(AsyncEngine* engine);
+
+
+#endif /* ASYNC_H */
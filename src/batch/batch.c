@@ -0,0 +1,551 @@
+/**
+ * @file batch.c
+ * @brief Implementation of the streaming batch runner.
+ *
+ * Every input line holds one job, either as a flat JSON object or as a CSV
+ * record with the columns id, integrand, start, end, method, refinement and
+ * tolerance. Parsing, expression building, output and memory management all
+ * happen on the calling thread; the worker pool threads only integrate.
+ */
+
+
+#include "batch.h"
+
+#include "debugmalloc.h"
+
+
+/**
+ * @brief The columns of a CSV job record, in order.
+ */
+static const char* const CSV_COLUMNS[] = {
+    "id",         "integrand", "start",      "end",
+    "method",     "refinement", "tolerance", "deadline_ms"};
+
+
+/**
+ * Copies a string into a fixed-size buffer.
+ *
+ * @param destination The buffer to copy into.
+ * @param size The size of the buffer in bytes.
+ * @param source The string to copy.
+ * @return true if the whole string fit into the buffer, false otherwise.
+ */
+static bool copy_field(char* destination, const size_t size,
+                       const char* source) {
+    const size_t length = strlen(source);
+    if (length >= size)
+        return false;
+
+    memcpy(destination, source, length + 1);
+    return true;
+}
+
+
+/**
+ * Converts a whole string to a finite double.
+ *
+ * @param text The string to convert.
+ * @param value Output pointer for the converted value.
+ * @return true if the whole string is a finite number, false otherwise.
+ */
+static bool to_double(const char* text, double* value) {
+    char* endptr;
+    *value = strtod(text, &endptr);
+    return endptr != text && *endptr == '\0' && isfinite(*value);
+}
+
+
+/**
+ * Stores a field of a job read from the input.
+ *
+ * Unknown fields are ignored, so job files may carry additional data.
+ *
+ * @param job The job to update.
+ * @param key The name of the field.
+ * @param value The value of the field.
+ * @param is_string true if the value was given as a JSON string.
+ * @return true if the value is valid for the field, false otherwise.
+ */
+static bool apply_field(BatchJob* job, const char* key, const char* value,
+                        const bool is_string) {
+    IntegrationJob* params = &job->task.job;
+
+    if (strcmp(key, "id") == 0) {
+        double number;
+        job->id_is_number = !is_string && to_double(value, &number);
+        return copy_field(job->id, sizeof(job->id), value);
+    }
+
+    if (strcmp(key, "integrand") == 0 || strcmp(key, "function") == 0) {
+        if (!copy_field(job->integrand, sizeof(job->integrand), value)) {
+            fprintf(stderr, "The integrand is too long.\n");
+            return false;
+        }
+        return true;
+    }
+
+    if (strcmp(key, "interval") == 0)
+        return validate_interval(value, &params->start, &params->end);
+
+    if (strcmp(key, "start") == 0)
+        return to_double(value, &params->start);
+
+    if (strcmp(key, "end") == 0)
+        return to_double(value, &params->end);
+
+    if (strcmp(key, "method") == 0 || strcmp(key, "methods") == 0)
+        return parse_methods(value, &params->methods);
+
+    if (strcmp(key, "refinement") == 0) {
+        double refinement;
+        if (!to_double(value, &refinement) || refinement != floor(refinement) ||
+            refinement < INT_MIN || refinement > INT_MAX)
+            return false;
+        params->refinement = (int)refinement;
+        return true;
+    }
+
+    if (strcmp(key, "tolerance") == 0)
+        return to_double(value, &params->tolerance) && params->tolerance >= 0;
+
+    if (strcmp(key, "deadline_ms") == 0)
+        return to_double(value, &params->deadline_ms) &&
+               params->deadline_ms >= 0;
+
+    return true;
+}
+
+
+/**
+ * Skips whitespace characters.
+ *
+ * @param text The text to skip in.
+ * @return Pointer to the first character that is not whitespace.
+ */
+static const char* skip_whitespace(const char* text) {
+    while (isspace((unsigned char)*text))
+        text++;
+    return text;
+}
+
+
+/**
+ * Reads a JSON string starting at its opening quote and unescapes it. Unicode
+ * escapes are accepted for ASCII characters only.
+ *
+ * @param text Pointer to the opening quote.
+ * @param out The buffer receiving the unescaped string.
+ * @param size The size of the buffer in bytes.
+ * @return Pointer past the closing quote, or NULL if the string is malformed
+ * or does not fit into the buffer.
+ */
+static const char* read_json_string(const char* text, char* out,
+                                    const size_t size) {
+    size_t length = 0;
+    text++;
+
+    while (*text != '"') {
+        char character = *text++;
+
+        if (character == '\0')
+            return nullptr;
+
+        if (character == '\\') {
+            const char escape = *text++;
+            switch (escape) {
+                case '"':
+                case '\\':
+                case '/':
+                    character = escape;
+                    break;
+                case 'b':
+                    character = '\b';
+                    break;
+                case 'f':
+                    character = '\f';
+                    break;
+                case 'n':
+                    character = '\n';
+                    break;
+                case 'r':
+                    character = '\r';
+                    break;
+                case 't':
+                    character = '\t';
+                    break;
+                case 'u': {
+                    unsigned code;
+                    if (sscanf(text, "%4x", &code) != 1 || code > 0x7F)
+                        return nullptr;
+                    character = (char)code;
+                    text += 4;
+                    break;
+                }
+                default:
+                    return nullptr;
+            }
+        }
+
+        if (length + 1 >= size)
+            return nullptr;
+        out[length++] = character;
+    }
+
+    out[length] = '\0';
+    return text + 1;
+}
+
+
+/**
+ * Reads a JSON value: a string, or a bare number or literal.
+ *
+ * @param text Pointer to the first character of the value.
+ * @param out The buffer receiving the value.
+ * @param size The size of the buffer in bytes.
+ * @param is_string Output pointer set to true if the value is a string.
+ * @return Pointer past the value, or NULL if it is malformed or too long.
+ */
+static const char* read_json_value(const char* text, char* out,
+                                   const size_t size, bool* is_string) {
+    *is_string = *text == '"';
+    if (*is_string)
+        return read_json_string(text, out, size);
+
+    const size_t length = strcspn(text, ",} \t\r\n");
+    if (length == 0 || length >= size)
+        return nullptr;
+
+    memcpy(out, text, length);
+    out[length] = '\0';
+    return text + length;
+}
+
+
+/**
+ * Parses a job given as a flat JSON object.
+ *
+ * @param line The input line holding the object.
+ * @param job The job receiving the fields of the object.
+ * @return true if the object is well-formed and every field is valid.
+ */
+static bool parse_json_job(const char* line, BatchJob* job) {
+    char key[BATCH_FIELD_MAX], value[BATCH_FIELD_MAX];
+    const char* cursor = skip_whitespace(line) + 1;
+
+    cursor = skip_whitespace(cursor);
+    if (*cursor == '}')
+        return true;
+
+    while (true) {
+        bool is_string;
+        if (*cursor != '"' ||
+            (cursor = read_json_string(cursor, key, sizeof(key))) == NULL)
+            return false;
+
+        cursor = skip_whitespace(cursor);
+        if (*cursor != ':')
+            return false;
+
+        cursor = skip_whitespace(cursor + 1);
+        cursor = read_json_value(cursor, value, sizeof(value), &is_string);
+        if (cursor == NULL || !apply_field(job, key, value, is_string))
+            return false;
+
+        cursor = skip_whitespace(cursor);
+        if (*cursor == '}')
+            return *skip_whitespace(cursor + 1) == '\0';
+        if (*cursor != ',')
+            return false;
+        cursor = skip_whitespace(cursor + 1);
+    }
+}
+
+
+/**
+ * Parses a job given as a CSV record. Fields may be enclosed in double quotes,
+ * in which case a doubled quote stands for a quote character. Empty fields
+ * keep their default values.
+ *
+ * @param line The input line holding the record.
+ * @param job The job receiving the fields of the record.
+ * @return true if the record is well-formed and every field is valid.
+ */
+static bool parse_csv_job(const char* line, BatchJob* job) {
+    constexpr size_t column_count =
+        sizeof(CSV_COLUMNS) / sizeof(CSV_COLUMNS[0]);
+    const char* cursor = line;
+
+    for (size_t column = 0; *cursor != '\0'; column++) {
+        char value[BATCH_FIELD_MAX];
+        size_t length = 0;
+        const bool quoted = *cursor == '"';
+
+        if (quoted)
+            cursor++;
+
+        while (*cursor != '\0' && (quoted || *cursor != ',')) {
+            if (quoted && *cursor == '"') {
+                if (cursor[1] != '"') {
+                    cursor++;
+                    break;
+                }
+                cursor++;
+            }
+            if (length + 1 >= sizeof(value))
+                return false;
+            value[length++] = *cursor++;
+        }
+        value[length] = '\0';
+
+        if (*cursor == ',')
+            cursor++;
+        else if (*cursor != '\0')
+            return false;
+
+        if (column >= column_count)
+            return false;
+        if (length > 0 && !apply_field(job, CSV_COLUMNS[column], value, quoted))
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Creates a job from an input line and builds its expression tree.
+ *
+ * A job whose line is malformed or whose integrand is invalid is returned
+ * without an expression; it is reported without being submitted.
+ *
+ * @param line The input line without its line terminator.
+ * @param line_number The number of the line, used as the default id.
+ * @param defaults The parameters used for fields missing from the line.
+ * @return The new job, or NULL if memory could not be allocated.
+ */
+static BatchJob* create_job(const char* line, const long long line_number,
+                            const IntegrationJob* defaults) {
+    BatchJob* job = (BatchJob*)malloc(sizeof(BatchJob));
+    if (job == NULL) {
+        perror("Did not manage to allocate memory");
+        return nullptr;
+    }
+
+    job->task = (PoolTask){.expression = nullptr,
+                           .job = *defaults,
+                           .status = INTEGRATION_OK,
+                           .context = job,
+                           .batch = nullptr,
+                           .next = nullptr};
+    job->task.job.threads = 1;
+    job->keyed = false;
+    snprintf(job->id, sizeof(job->id), "%lld", line_number);
+    job->id_is_number = true;
+    job->integrand[0] = '\0';
+
+    const char* first = skip_whitespace(line);
+    job->malformed = !(*first == '{' ? parse_json_job(line, job)
+                                     : parse_csv_job(line, job));
+    if (job->malformed)
+        return job;
+
+    remove_spaces(job->integrand);
+    if (job->integrand[0] == '\0' || !validate_expression(job->integrand)) {
+        job->task.status = INTEGRATION_INVALID_INTEGRAND;
+        return job;
+    }
+
+    // parse() splits its argument in place, the integrand is kept for output
+    char tokens[MAX_INTEGRAND_LENGTH + 1];
+    strcpy(tokens, job->integrand);
+    job->task.expression = parse(tokens);
+    job->keyed =
+        cache_is_open() &&
+        cache_make_key(&job->key, job->task.expression, &job->task.job);
+    return job;
+}
+
+
+/**
+ * Writes the result of a job. Jobs that were not integrated get a result
+ * holding only their parameters and status.
+ *
+ * @param writer The result writer.
+ * @param job The finished job.
+ */
+static void write_result(ResultWriter* writer, BatchJob* job) {
+    IntegrationResult* result = &job->task.result;
+    if (job->task.expression == NULL) {
+        result->status = job->task.status;
+        result->start = job->task.job.start;
+        result->end = job->task.job.end;
+        result->tolerance = job->task.job.tolerance;
+    }
+
+    const ResultRecord record = {
+        .id = job->id,
+        .id_is_number = job->id_is_number,
+        .integrand = job->malformed ? nullptr : job->integrand,
+        .label = job->malformed ? "invalid_job" : nullptr,
+        .result = result};
+    report_write(writer, &record);
+    journal_append(&record);
+}
+
+
+/**
+ * Reports a finished job and releases it.
+ *
+ * @param writer The result writer.
+ * @param job The finished job.
+ * @param stats The counters of the batch run.
+ */
+static void finish_job(ResultWriter* writer, BatchJob* job,
+                       BatchStats* stats) {
+    write_result(writer, job);
+    if (job->keyed && !job->task.result.cached)
+        cache_store(&job->key, &job->task.result);
+
+    stats->jobs++;
+    if (job->malformed || job->task.status != INTEGRATION_OK)
+        stats->failed++;
+    if (job->task.result.cached)
+        stats->cached++;
+
+    free_tree(job->task.expression);
+    free(job);
+}
+
+
+/**
+ * Reports completed jobs. If `keep` jobs or more are still in flight, blocks
+ * until fewer remain; the output is flushed before blocking, so results keep
+ * streaming while the workers are busy.
+ *
+ * @param pool The worker pool.
+ * @param writer The result writer.
+ * @param keep The number of jobs that may remain in flight.
+ * @param stats The counters of the batch run.
+ */
+static void drain(WorkerPool* pool, ResultWriter* writer, const size_t keep,
+                  BatchStats* stats) {
+    PoolTask* task;
+
+    while ((task = pool_collect(pool, false)) != NULL)
+        finish_job(writer, (BatchJob*)task->context, stats);
+
+    while (pool_in_flight(pool) > keep) {
+        report_flush(writer);
+        task = pool_collect(pool, true);
+        finish_job(writer, (BatchJob*)task->context, stats);
+    }
+}
+
+
+/**
+ * Discards the rest of an input line that did not fit into the line buffer.
+ *
+ * @param input The stream to read from.
+ */
+static void skip_line(FILE* input) {
+    int character;
+    do {
+        character = fgetc(input);
+    } while (character != '\n' && character != EOF);
+}
+
+
+/**
+ * Runs every job of a job file and writes the results to the standard output
+ * in completion order.
+ *
+ * Empty lines, lines starting with '#' and a CSV header starting with "id"
+ * are skipped. At most `BATCH_IN_FLIGHT_PER_WORKER` jobs per worker are kept
+ * in memory at any time. If the result cache is open, exact repeats of earlier
+ * jobs are answered from it without being submitted, and new results are
+ * stored in it.
+ *
+ * @param path The path of the job file, "-" reads the standard input.
+ * @param defaults The parameters used for fields missing from a job.
+ * @param workers The number of worker threads.
+ * @param format The format of the results, one of the machine-readable
+ * formats.
+ * @param stats Output pointer for the counters of the run.
+ * @return true if the whole input was processed, false if it could not be
+ * read or memory ran out.
+ */
+bool run_batch(const char* path, const IntegrationJob* defaults,
+               const int workers, const ReportFormat format,
+               BatchStats* stats) {
+    *stats = (BatchStats){0, 0, 0};
+
+    FILE* input = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (input == NULL) {
+        perror("Error opening job file");
+        return false;
+    }
+
+    ResultWriter writer;
+    WorkerPool pool;
+    if (!report_begin(&writer, stdout, format) || !pool_init(&pool, workers)) {
+        if (input != stdin)
+            fclose(input);
+        return false;
+    }
+
+    const size_t max_in_flight =
+        (size_t)pool.thread_count * BATCH_IN_FLIGHT_PER_WORKER;
+    char line[BATCH_LINE_MAX];
+    long long line_number = 0;
+    bool success = true;
+
+    while (fgets(line, sizeof(line), input) != NULL) {
+        line_number++;
+        const bool complete = strchr(line, '\n') != NULL || feof(input);
+        if (!complete) {
+            skip_line(input);
+            line[0] = '\0';
+            fprintf(stderr, "Error: Line %lld is too long.\n", line_number);
+        } else {
+            line[strcspn(line, "\r\n")] = '\0';
+            const char* first = skip_whitespace(line);
+            if (*first == '\0' || *first == '#' ||
+                strncmp(first, "id,", 3) == 0)
+                continue;
+        }
+
+        BatchJob* job = create_job(line, line_number, defaults);
+        if (job == NULL) {
+            success = false;
+            break;
+        }
+        job->malformed |= !complete;
+
+        if (job->task.expression == NULL) {
+            finish_job(&writer, job, stats);
+            continue;
+        }
+
+        if (job->keyed && cache_lookup(&job->key, &job->task.result)) {
+            job->task.status = job->task.result.status;
+            finish_job(&writer, job, stats);
+            continue;
+        }
+
+        drain(&pool, &writer, max_in_flight - 1, stats);
+        pool_submit(&pool, &job->task);
+    }
+
+    if (ferror(input)) {
+        perror("Error reading job file");
+        success = false;
+    }
+
+    drain(&pool, &writer, 0, stats);
+    success &= report_flush(&writer);
+    pool_destroy(&pool);
+
+    if (input != stdin)
+        fclose(input);
+    return success;
+}
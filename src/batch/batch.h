@@ -0,0 +1,67 @@
+/**
+ * @file batch.h
+ * @brief Header file for the batch runner, which streams integration jobs from
+ * a JSON Lines or CSV file through the worker pool.
+ *
+ * Jobs are read one line at a time, integrated concurrently with a bounded
+ * number of jobs in flight, and their results are written in one of the
+ * machine-readable formats of the report module in completion order, tagged
+ * with the id of the job. Memory use therefore does not depend on the number
+ * of jobs in the input.
+ */
+
+
+#ifndef BATCH_H
+#define BATCH_H
+
+
+#include <stdbool.h>
+
+#include "cache.h"
+#include "integral.h"
+#include "journal.h"
+#include "report.h"
+#include "worker_pool.h"
+
+
+#define BATCH_LINE_MAX 4096
+#define BATCH_ID_MAX 64
+#define BATCH_FIELD_MAX 256
+#define BATCH_IN_FLIGHT_PER_WORKER 4
+
+
+/**
+ * @struct BatchJob
+ * @brief A job read from the batch input, together with its pool task.
+ *
+ * `malformed` is set for lines that could not be parsed as a job; such jobs
+ * are reported without being integrated. Jobs without an id are identified by
+ * their line number. `keyed` is set once the cache key of the job is built.
+ */
+typedef struct BatchJob {
+    PoolTask task;
+    CacheKey key;
+    bool keyed;
+    char id[BATCH_ID_MAX + 1];
+    bool id_is_number;
+    char integrand[MAX_INTEGRAND_LENGTH + 1];
+    bool malformed;
+} BatchJob;
+
+
+/**
+ * @struct BatchStats
+ * @brief Counters of a batch run.
+ */
+typedef struct BatchStats {
+    long long jobs;
+    long long failed;
+    long long cached;
+} BatchStats;
+
+
+bool run_batch(const char* path, const IntegrationJob* defaults, int workers,
+               ReportFormat format, BatchStats* stats);
+
+
+#endif /* BATCH_H */
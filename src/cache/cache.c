@@ -0,0 +1,480 @@
+/**
+ * @file cache.c
+ * @brief Implements the persistent result cache.
+ *
+ * The cache file starts with a header, followed by a fixed number of entries
+ * grouped into sets of `CACHE_WAYS`. The set of a key is selected by its hash
+ * and read with a single `pread`; within a full set, the oldest entry is
+ * replaced. The file is created sparse at its full size, so its size is bounded
+ * from the start and disk space is only used by entries actually written.
+ *
+ * In front of the file sits a direct-mapped table of recently used entries in
+ * memory, which answers repeated lookups without any system call.
+ */
+
+
+#include "cache.h"
+
+#include <fcntl.h>
+#include <float.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+#define CACHE_STRINGIFY(text) #text
+#define CACHE_EXPAND(macro) CACHE_STRINGIFY(macro)
+#define FNV_OFFSET UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME UINT64_C(0x100000001b3)
+
+
+/**
+ * The build mode of the program. Results computed by a build with different
+ * floating-point behaviour are never served, since they live under different
+ * keys.
+ */
+static const char BUILD_MODE[] = "numint-cache-" CACHE_EXPAND(CACHE_VERSION)
+#ifdef __FAST_MATH__
+    " fast-math"
+#endif
+#ifdef __FP_FAST_FMA
+    " fma"
+#endif
+    " flt-eval-" CACHE_EXPAND(FLT_EVAL_METHOD)
+#ifdef __VERSION__
+    " " __VERSION__
+#endif
+    ;
+
+
+/**
+ * The file descriptor of the cache file, -1 while the cache is closed.
+ */
+static int cache_fd = -1;
+
+/**
+ * The number of entries in the cache file, a multiple of `CACHE_WAYS`.
+ */
+static long long cache_entries = 0;
+
+/**
+ * The in-memory front of the cache, indexed by the hash of the key.
+ */
+static CacheEntry memory_front[CACHE_MEMORY_ENTRIES];
+
+/**
+ * The counters of the cache since it was opened.
+ */
+static CacheStats counters;
+
+
+/**
+ * Computes the 64-bit FNV-1a hash of a byte string.
+ *
+ * @param data The bytes to hash.
+ * @param size The number of bytes.
+ * @param hash The hash to continue from, `FNV_OFFSET` for a new hash.
+ * @return The hash of the bytes.
+ */
+static uint64_t fnv1a(const void* data, const size_t size, uint64_t hash) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+
+/**
+ * Computes the checksum of an entry, which covers every byte of the entry
+ * except the checksum itself.
+ *
+ * @param entry The entry.
+ * @return The checksum of the entry.
+ */
+static uint64_t entry_checksum(const CacheEntry* entry) {
+    const size_t offset = offsetof(CacheEntry, checksum);
+    const size_t after = offset + sizeof(entry->checksum);
+
+    uint64_t hash = fnv1a(entry, offset, FNV_OFFSET);
+    return fnv1a((const unsigned char*)entry + after, sizeof(*entry) - after,
+                 hash);
+}
+
+
+/**
+ * Tells whether an entry is valid and holds the result of a key.
+ *
+ * @param entry The entry.
+ * @param key The key.
+ * @return true if the entry matches the key and is intact.
+ */
+static bool entry_matches(const CacheEntry* entry, const CacheKey* key) {
+    return entry->stamp != 0 && entry->hash == key->hash &&
+           entry->key_length == key->length &&
+           memcmp(entry->key, key->data, key->length) == 0 &&
+           entry->checksum == entry_checksum(entry);
+}
+
+
+/**
+ * Returns the offset of the first entry of the set of a key in the cache
+ * file.
+ *
+ * @param key The key.
+ * @return The offset of the set.
+ */
+static off_t set_offset(const CacheKey* key) {
+    const uint64_t sets = (uint64_t)(cache_entries / CACHE_WAYS);
+    return CACHE_HEADER_SIZE +
+           (off_t)(key->hash % sets) * CACHE_WAYS * (off_t)sizeof(CacheEntry);
+}
+
+
+/**
+ * Reads the set of a key from the cache file.
+ *
+ * @param key The key.
+ * @param set Output array for the `CACHE_WAYS` entries of the set.
+ * @return true on success, false if the set could not be read.
+ */
+static bool read_set(const CacheKey* key, CacheEntry set[CACHE_WAYS]) {
+    const size_t size = CACHE_WAYS * sizeof(CacheEntry);
+    const ssize_t count = pread(cache_fd, set, size, set_offset(key));
+    if (count < 0) {
+        perror("Error reading the result cache");
+        return false;
+    }
+
+    // A set beyond the end of a truncated file reads as empty entries
+    memset((char*)set + count, 0, size - (size_t)count);
+    return true;
+}
+
+
+/**
+ * Writes a fresh header to the cache file and sizes it for its entries,
+ * discarding any previous contents.
+ *
+ * @param header The header to write.
+ * @return true on success, false otherwise.
+ */
+static bool initialise_file(const CacheHeader* header) {
+    const off_t size =
+        CACHE_HEADER_SIZE + (off_t)header->entries * (off_t)sizeof(CacheEntry);
+
+    if (ftruncate(cache_fd, 0) != 0 ||
+        pwrite(cache_fd, header, sizeof(*header), 0) !=
+            (ssize_t)sizeof(*header) ||
+        ftruncate(cache_fd, size) != 0) {
+        perror("Error initialising the result cache");
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Opens the process-wide result cache, creating the cache file if needed.
+ *
+ * The file is recreated if it was written by a different version of the
+ * program or with a different number of entries.
+ *
+ * @param path The path of the cache file.
+ * @param entries The number of entries of the cache file. It is clamped to
+ * [CACHE_MIN_ENTRIES ; CACHE_MAX_ENTRIES] and rounded down to a multiple of
+ * `CACHE_WAYS`.
+ * @return true if the cache is open, false otherwise.
+ */
+bool cache_open(const char* path, long long entries) {
+    cache_close();
+
+    if (entries < CACHE_MIN_ENTRIES)
+        entries = CACHE_MIN_ENTRIES;
+    if (entries > CACHE_MAX_ENTRIES)
+        entries = CACHE_MAX_ENTRIES;
+    entries -= entries % CACHE_WAYS;
+
+    cache_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (cache_fd < 0) {
+        perror("Error opening the result cache");
+        return false;
+    }
+
+    const CacheHeader expected = {.magic = CACHE_MAGIC,
+                                  .version = CACHE_VERSION,
+                                  .entry_size = sizeof(CacheEntry),
+                                  .entries = (uint64_t)entries};
+    CacheHeader header;
+    const bool current =
+        pread(cache_fd, &header, sizeof(header), 0) ==
+            (ssize_t)sizeof(header) &&
+        memcmp(&header, &expected, sizeof(header)) == 0;
+
+    if (!current && !initialise_file(&expected)) {
+        close(cache_fd);
+        cache_fd = -1;
+        return false;
+    }
+
+    cache_entries = entries;
+    memset(memory_front, 0, sizeof(memory_front));
+    memset(&counters, 0, sizeof(counters));
+    return true;
+}
+
+
+/**
+ * Closes the process-wide result cache. Entries already stored remain in the
+ * cache file.
+ */
+void cache_close(void) {
+    if (cache_fd >= 0)
+        close(cache_fd);
+    cache_fd = -1;
+    cache_entries = 0;
+}
+
+
+/**
+ * Tells whether the result cache is open.
+ *
+ * @return true if the cache is open.
+ */
+bool cache_is_open(void) {
+    return cache_fd >= 0;
+}
+
+
+/**
+ * Appends bytes to a key.
+ *
+ * @param key The key.
+ * @param data The bytes to append.
+ * @param size The number of bytes.
+ * @return true on success, false if the key is full.
+ */
+static bool append_key(CacheKey* key, const void* data, const size_t size) {
+    if (key->length + size > sizeof(key->data))
+        return false;
+    memcpy(key->data + key->length, data, size);
+    key->length += (uint32_t)size;
+    return true;
+}
+
+
+/**
+ * Appends the bit pattern of a double to a key. Negative and positive zero
+ * are kept apart, since they may lead to different results.
+ *
+ * @param key The key.
+ * @param value The value to append.
+ * @return true on success, false if the key is full.
+ */
+static bool append_double(CacheKey* key, const double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return append_key(key, &bits, sizeof(bits));
+}
+
+
+/**
+ * Appends an expression tree to a key in postfix order. Every node is
+ * written as a tag byte followed by its number, function name or operator
+ * symbol.
+ *
+ * @param key The key.
+ * @param node The root of the tree.
+ * @return true on success, false if the key is full.
+ */
+static bool append_tree(CacheKey* key, const Node* node) {
+    if (node == NULL)
+        return true;
+
+    if (!append_tree(key, node->left) || !append_tree(key, node->right))
+        return false;
+
+    switch (node->type) {
+        case NODE_VARIABLE:
+            return append_key(key, "x", 1);
+        case NODE_NUMBER:
+            return append_key(key, "n", 1) &&
+                   append_double(key, node->data.number.value);
+        case NODE_FUNCTION:
+            return append_key(key, "f", 1) &&
+                   append_key(key, node->data.function.name,
+                              strlen(node->data.function.name) + 1);
+        case NODE_OPERATOR:
+            return append_key(key, "o", 1) &&
+                   append_key(key, &node->data.operator.symbol, 1);
+    }
+    return false;
+}
+
+
+/**
+ * Builds the canonical key of a job.
+ *
+ * The number of threads is not part of the key, since the results do not
+ * depend on it. The method mask is the one actually computed, so a tolerance
+ * always includes the Darboux sums.
+ *
+ * @param key Output pointer for the key.
+ * @param expression The parsed integrand.
+ * @param job The job.
+ * @return true on success, false if the key does not fit into
+ * `CACHE_KEY_MAX` bytes; such jobs are not cached.
+ */
+bool cache_make_key(CacheKey* key, const Node* expression,
+                    const IntegrationJob* job) {
+    key->length = 0;
+
+    uint32_t methods = job->methods ? job->methods : METHOD_ALL;
+    if (job->tolerance > 0)
+        methods |= METHOD_FLAG(METHOD_LOWER_DARBOUX) |
+                   METHOD_FLAG(METHOD_UPPER_DARBOUX);
+    const int32_t refinement = job->refinement;
+    const double tolerance = job->tolerance > 0 ? job->tolerance : 0;
+
+    if (!append_key(key, BUILD_MODE, sizeof(BUILD_MODE)) ||
+        !append_tree(key, expression) || !append_double(key, job->start) ||
+        !append_double(key, job->end) || !append_double(key, tolerance) ||
+        !append_key(key, &methods, sizeof(methods)) ||
+        !append_key(key, &refinement, sizeof(refinement)))
+        return false;
+
+    key->hash = fnv1a(key->data, key->length, FNV_OFFSET);
+    return true;
+}
+
+
+/**
+ * Looks up the result of a key, first in memory, then in the cache file.
+ *
+ * @param key The key.
+ * @param result Output pointer for the cached result, marked as cached.
+ * @return true on a hit, false on a miss or if the cache is closed.
+ */
+bool cache_lookup(const CacheKey* key, IntegrationResult* result) {
+    if (cache_fd < 0)
+        return false;
+
+    CacheEntry* front = &memory_front[key->hash % CACHE_MEMORY_ENTRIES];
+    if (entry_matches(front, key)) {
+        *result = front->result;
+        result->cached = true;
+        counters.memory_hits++;
+        return true;
+    }
+
+    CacheEntry set[CACHE_WAYS];
+    if (!read_set(key, set)) {
+        counters.misses++;
+        return false;
+    }
+
+    for (int way = 0; way < CACHE_WAYS; way++) {
+        if (entry_matches(&set[way], key)) {
+            *front = set[way];
+            *result = set[way].result;
+            result->cached = true;
+            counters.disk_hits++;
+            return true;
+        }
+    }
+
+    counters.misses++;
+    return false;
+}
+
+
+/**
+ * Stores the result of a key in memory and in the cache file.
+ *
+ * Only successful and unconverged results are stored, since only those are
+ * reproducible. The entry replaces an earlier entry of the same key, an empty
+ * entry, or else the oldest entry of its set.
+ *
+ * @param key The key.
+ * @param result The result to store.
+ */
+void cache_store(const CacheKey* key, const IntegrationResult* result) {
+    if (cache_fd < 0 || (result->status != INTEGRATION_OK &&
+                         result->status != INTEGRATION_NOT_CONVERGED))
+        return;
+
+    CacheEntry set[CACHE_WAYS];
+    if (!read_set(key, set))
+        return;
+
+    int victim = 0;
+    uint64_t newest = 0;
+    for (int way = 0; way < CACHE_WAYS; way++) {
+        if (set[way].stamp > newest)
+            newest = set[way].stamp;
+        if (set[way].stamp < set[victim].stamp)
+            victim = way;
+    }
+    for (int way = 0; way < CACHE_WAYS; way++)
+        if (entry_matches(&set[way], key))
+            victim = way;
+
+    CacheEntry* entry = &memory_front[key->hash % CACHE_MEMORY_ENTRIES];
+    memset(entry, 0, sizeof(*entry));
+    entry->hash = key->hash;
+    entry->stamp = newest + 1;
+    entry->key_length = key->length;
+    memcpy(&entry->result, result, sizeof(*result));
+    entry->result.cached = false;
+    memcpy(entry->key, key->data, key->length);
+    entry->checksum = entry_checksum(entry);
+
+    const off_t offset =
+        set_offset(key) + (off_t)victim * (off_t)sizeof(CacheEntry);
+    if (pwrite(cache_fd, entry, sizeof(*entry), offset) !=
+        (ssize_t)sizeof(*entry)) {
+        perror("Error writing the result cache");
+        return;
+    }
+    counters.stores++;
+}
+
+
+/**
+ * Returns the counters of the cache since it was opened.
+ *
+ * @param stats Output pointer for the counters.
+ */
+void cache_stats(CacheStats* stats) {
+    *stats = counters;
+}
+
+
+/**
+ * Integrates a parsed expression, serving exact repeats from the result cache.
+ *
+ * If the cache is closed or the job cannot be keyed, this is the same as
+ * integrate_expression().
+ *
+ * @param expression The parsed expression to integrate.
+ * @param job The description of the integration.
+ * @param result Output pointer for the results; `cached` tells whether they
+ * were served from the cache.
+ * @return The status of the integration, see integrate_expression().
+ */
+IntegrationStatus integrate_cached(Node* expression, const IntegrationJob* job,
+                                   IntegrationResult* result) {
+    CacheKey key;
+    const bool keyed = cache_fd >= 0 && cache_make_key(&key, expression, job);
+
+    if (keyed && cache_lookup(&key, result))
+        return result->status;
+
+    const IntegrationStatus status =
+        integrate_expression(expression, job, result);
+    if (keyed)
+        cache_store(&key, result);
+    return status;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file cache.h
+ * @brief Header file for the result cache, which memoizes integrations across
+ * runs of the program.
+ *
+ * Results are addressed by a canonical key built from the parsed integrand,
+ * the interval, the method parameters and the build mode of the program, so
+ * an exact repeat of a job is answered without evaluating the integrand. The
+ * cache consists of a size-bounded, set-associative file and a direct-mapped
+ * in-memory front holding the most recently used entries.
+ *
+ * The cache is a single process-wide instance and must only be used from one
+ * thread.
+ */
+
+
+#ifndef CACHE_H
+#define CACHE_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "expression_parser.h"
+#include "integral.h"
+
+
+#define CACHE_DEFAULT_PATH "results.cache"
+#define CACHE_DEFAULT_ENTRIES 16384
+#define CACHE_MIN_ENTRIES 64
+#define CACHE_MAX_ENTRIES (1 << 24)
+#define CACHE_WAYS 4
+#define CACHE_MEMORY_ENTRIES 256
+#define CACHE_KEY_MAX 512
+#define CACHE_HEADER_SIZE 4096
+#define CACHE_MAGIC UINT64_C(0x3145484341434e49) // "INCACHE1"
+#define CACHE_VERSION 2
+
+
+/**
+ * @struct CacheKey
+ * @brief The canonical key of an integration and its hash.
+ *
+ * The key is a byte string made of the build mode, the expression tree in
+ * postfix order with every number as its bit pattern, the bit patterns of the
+ * interval bounds and tolerance, the effective method mask and the
+ * refinement. Integrands that differ only in spacing or in the spelling of
+ * their numbers therefore share a key.
+ */
+typedef struct CacheKey {
+    uint64_t hash;
+    uint32_t length;
+    unsigned char data[CACHE_KEY_MAX];
+} CacheKey;
+
+
+/**
+ * @struct CacheEntry
+ * @brief A slot of the cache, both in the file and in memory.
+ *
+ * A slot with a zero stamp is empty. `checksum` covers the whole entry with
+ * the checksum field set to zero, so torn writes of concurrent processes are
+ * recognised and treated as misses.
+ */
+typedef struct CacheEntry {
+    uint64_t hash;
+    uint64_t stamp;
+    uint64_t checksum;
+    uint32_t key_length;
+    uint32_t reserved;
+    IntegrationResult result;
+    unsigned char key[CACHE_KEY_MAX];
+} CacheEntry;
+
+
+/**
+ * @struct CacheHeader
+ * @brief The header at the beginning of the cache file.
+ *
+ * A file whose header does not match the running program is discarded and
+ * recreated.
+ */
+typedef struct CacheHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint64_t entries;
+} CacheHeader;
+
+
+/**
+ * @struct CacheStats
+ * @brief Counters of the cache since it was opened.
+ */
+typedef struct CacheStats {
+    long long memory_hits;
+    long long disk_hits;
+    long long misses;
+    long long stores;
+} CacheStats;
+
+
+bool cache_open(const char* path, long long entries);
+
+void cache_close(void);
+
+bool cache_is_open(void);
+
+bool cache_make_key(CacheKey* key, const Node* expression,
+                    const IntegrationJob* job);
+
+bool cache_lookup(const CacheKey* key, IntegrationResult* result);
+
+void cache_store(const CacheKey* key, const IntegrationResult* result);
+
+void cache_stats(CacheStats* stats);
+
+IntegrationStatus integrate_cached(Node* expression, const IntegrationJob* job,
+                                   IntegrationResult* result);
+
+
+#endif /* CACHE_H */
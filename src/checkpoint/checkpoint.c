@@ -0,0 +1,330 @@
+/**
+ * @file checkpoint.c
+ * @brief Implementation of checkpoints of long integrations.
+ *
+ * Checkpoints are written without allocating memory, as they may be written
+ * by any chunk thread of the integration.
+ */
+
+
+#include "checkpoint.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+#define CHECKPOINT_FNV_OFFSET UINT64_C(0xcbf29ce484222325)
+#define CHECKPOINT_FNV_PRIME UINT64_C(0x100000001b3)
+
+
+/**
+ * Computes the checksum of a checkpoint, which covers every byte except the
+ * checksum itself.
+ *
+ * @param file The checkpoint.
+ * @return The checksum.
+ */
+static uint64_t file_checksum(const CheckpointFile* file) {
+    const unsigned char* bytes = (const unsigned char*)file;
+    const size_t skipped = offsetof(CheckpointFile, checksum);
+    uint64_t hash = CHECKPOINT_FNV_OFFSET;
+
+    for (size_t i = 0; i < sizeof(*file); i++) {
+        if (i >= skipped && i < skipped + sizeof(file->checksum))
+            continue;
+        hash = (hash ^ bytes[i]) * CHECKPOINT_FNV_PRIME;
+    }
+    return hash;
+}
+
+
+/**
+ * Returns the current monotonic time in nanoseconds.
+ *
+ * @return The time.
+ */
+static long long now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/**
+ * Prepares a checkpoint for a job. Call before integrating, then install it
+ * into the job.
+ *
+ * @param checkpoint The checkpoint to initialise.
+ * @param path The checkpoint file. The string must outlive the checkpoint.
+ * @param interval_ms The least number of milliseconds between checkpoints.
+ * @param resume true to continue from the checkpoint in the file, if it
+ * belongs to the same job.
+ * @return true on success, false if the path is too long.
+ */
+bool checkpoint_init(Checkpoint* checkpoint, const char* path,
+                     const double interval_ms, const bool resume) {
+    memset(checkpoint, 0, sizeof(*checkpoint));
+    if (snprintf(checkpoint->temporary, sizeof(checkpoint->temporary),
+                 "%s.tmp", path) >= (int)sizeof(checkpoint->temporary)) {
+        fprintf(stderr, "Error: The checkpoint path is too long.\n");
+        return false;
+    }
+
+    checkpoint->path = path;
+    checkpoint->interval_ms = interval_ms;
+    checkpoint->resume = resume;
+    atomic_flag_clear(&checkpoint->saving);
+    return true;
+}
+
+
+/**
+ * Reads the checkpoint file and verifies that it is intact and belongs to
+ * the key of the checkpoint.
+ *
+ * @param checkpoint The checkpoint.
+ * @return true if `saved` holds a checkpoint to resume.
+ */
+static bool load(Checkpoint* checkpoint) {
+    const int fd = open(checkpoint->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            perror("Error opening the checkpoint");
+        return false;
+    }
+
+    CheckpointFile* saved = &checkpoint->saved;
+    const ssize_t count = read(fd, saved, sizeof(*saved));
+    close(fd);
+
+    if (count != (ssize_t)sizeof(*saved) || saved->magic != CHECKPOINT_MAGIC ||
+        saved->version != CHECKPOINT_VERSION ||
+        saved->checksum != file_checksum(saved)) {
+        fprintf(stderr, "Warning: The checkpoint %s is damaged; starting "
+                        "from the beginning.\n",
+                checkpoint->path);
+        return false;
+    }
+
+    if (saved->key.length != checkpoint->key.length ||
+        saved->key.hash != checkpoint->key.hash ||
+        memcmp(saved->key.data, checkpoint->key.data, saved->key.length) !=
+            0) {
+        fprintf(stderr, "Warning: The checkpoint %s belongs to another "
+                        "integration; starting from the beginning.\n",
+                checkpoint->path);
+        return false;
+    }
+
+    return saved->refinement >= MIN_REFINEMENT &&
+           saved->refinement <= MAX_REFINEMENT &&
+           saved->method <= METHOD_COUNT && saved->chunk_count >= 0 &&
+           saved->chunk_count <= CHUNK_MAX_COUNT;
+}
+
+
+/**
+ * Starts checkpointing an integration, reading the checkpoint to resume if
+ * one was asked for. Called by the integration core.
+ *
+ * @param checkpoint The checkpoint of the job.
+ * @param expression The parsed integrand.
+ * @param job The job.
+ * @return true if the integration is checkpointed, false if its key does not
+ * fit into a checkpoint.
+ */
+bool checkpoint_begin(Checkpoint* checkpoint, const Node* expression,
+                      const IntegrationJob* job) {
+    checkpoint->active = cache_make_key(&checkpoint->key, expression, job);
+    checkpoint->resumed = false;
+    checkpoint->partials = nullptr;
+    atomic_store(&checkpoint->next_save_ns,
+                 now_ns() + (long long)(checkpoint->interval_ms * 1E+06));
+
+    if (!checkpoint->active) {
+        fprintf(stderr, "Warning: The integrand is too large to be "
+                        "checkpointed.\n");
+        return false;
+    }
+
+    if (checkpoint->resume)
+        checkpoint->resumed = load(checkpoint);
+    return true;
+}
+
+
+/**
+ * Records the progress of the integration before or after a method. Only
+ * called while no chunk thread is running.
+ *
+ * @param checkpoint The checkpoint.
+ * @param result The result of the integration so far.
+ * @param refinement The refinement in progress.
+ * @param method The method about to be computed, or METHOD_COUNT once every
+ * method of the refinement is complete.
+ * @param previous_values The values of the previous refinement.
+ * @param previous_gap The difference of the Darboux sums of the previous
+ * refinement.
+ */
+void checkpoint_track(Checkpoint* checkpoint, const IntegrationResult* result,
+                      const int refinement, const int method,
+                      const double previous_values[],
+                      const double previous_gap) {
+    checkpoint->result = result;
+    checkpoint->refinement = refinement;
+    checkpoint->method = method;
+    checkpoint->previous_values = previous_values;
+    checkpoint->previous_gap = previous_gap;
+    checkpoint->partials = nullptr;
+}
+
+
+/**
+ * Starts the chunks of the method in progress. If the checkpoint being
+ * resumed stopped within this method, its completed chunks and their partial
+ * sums are restored, and the chunk threads skip them.
+ *
+ * @param checkpoint The checkpoint.
+ * @param plan The chunk plan of the method.
+ * @param partials The array of partial sums of the method, indexed by chunk.
+ */
+void checkpoint_prepare(Checkpoint* checkpoint, const ChunkPlan* plan,
+                        double partials[]) {
+    const CheckpointFile* saved = &checkpoint->saved;
+    const bool restore = checkpoint->resumed &&
+                         saved->refinement == checkpoint->refinement &&
+                         (int)saved->method == checkpoint->method &&
+                         saved->chunk_count == plan->chunk_count;
+
+    for (int chunk = 0; chunk < plan->chunk_count; chunk++) {
+        const bool done = restore && saved->done[chunk];
+        if (done)
+            partials[chunk] = saved->partials[chunk];
+        atomic_store_explicit(&checkpoint->done[chunk], done,
+                              memory_order_relaxed);
+    }
+
+    if (restore)
+        checkpoint->resumed = false;
+    checkpoint->chunk_count = plan->chunk_count;
+    checkpoint->partials = partials;
+}
+
+
+/**
+ * Tells whether a chunk of the method in progress was restored from the
+ * checkpoint being resumed.
+ *
+ * @param checkpoint The checkpoint.
+ * @param chunk The chunk.
+ * @return true if the chunk is complete.
+ */
+bool checkpoint_is_done(const Checkpoint* checkpoint, const int chunk) {
+    return atomic_load_explicit(&checkpoint->done[chunk],
+                                memory_order_relaxed);
+}
+
+
+/**
+ * Marks a chunk of the method in progress as complete, once its partial sum
+ * is stored, and writes a checkpoint if one is due. Called by the chunk
+ * threads.
+ *
+ * @param checkpoint The checkpoint.
+ * @param chunk The chunk.
+ */
+void checkpoint_chunk_done(Checkpoint* checkpoint, const int chunk) {
+    atomic_store_explicit(&checkpoint->done[chunk], 1, memory_order_release);
+    checkpoint_save(checkpoint, false);
+}
+
+
+/**
+ * Writes a checkpoint if the interval has passed since the last one, or
+ * unconditionally. The file is replaced atomically. If another thread is
+ * writing a checkpoint already, nothing happens.
+ *
+ * @param checkpoint The checkpoint.
+ * @param force true to write the checkpoint even if it is not due.
+ * @return true if a checkpoint was written.
+ */
+bool checkpoint_save(Checkpoint* checkpoint, const bool force) {
+    const long long now = now_ns();
+    if (!force && now < atomic_load_explicit(&checkpoint->next_save_ns,
+                                             memory_order_relaxed))
+        return false;
+    if (atomic_flag_test_and_set_explicit(&checkpoint->saving,
+                                          memory_order_acquire))
+        return false;
+
+    atomic_store_explicit(&checkpoint->next_save_ns,
+                          now + (long long)(checkpoint->interval_ms * 1E+06),
+                          memory_order_relaxed);
+
+    CheckpointFile file;
+    memset(&file, 0, sizeof(file));
+    file.magic = CHECKPOINT_MAGIC;
+    file.version = CHECKPOINT_VERSION;
+    file.method = (uint32_t)checkpoint->method;
+    file.key = checkpoint->key;
+    file.refinement = checkpoint->refinement;
+    memcpy(file.previous_values, checkpoint->previous_values,
+           sizeof(file.previous_values));
+    file.previous_gap = checkpoint->previous_gap;
+    memcpy(file.methods, checkpoint->result->methods, sizeof(file.methods));
+
+    if (checkpoint->partials != NULL) {
+        file.chunk_count = checkpoint->chunk_count;
+        for (int chunk = 0; chunk < checkpoint->chunk_count; chunk++) {
+            file.done[chunk] = atomic_load_explicit(&checkpoint->done[chunk],
+                                                    memory_order_acquire);
+            if (file.done[chunk])
+                file.partials[chunk] = checkpoint->partials[chunk];
+        }
+    }
+    file.checksum = file_checksum(&file);
+
+    bool written = false;
+    const int fd = open(checkpoint->temporary,
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        written = write(fd, &file, sizeof(file)) == (ssize_t)sizeof(file) &&
+                  fsync(fd) == 0;
+        written = close(fd) == 0 && written;
+        written = written &&
+                  rename(checkpoint->temporary, checkpoint->path) == 0;
+    }
+    if (!written)
+        perror("Error writing the checkpoint");
+    else
+        atomic_fetch_add_explicit(&checkpoint->saves, 1, memory_order_relaxed);
+
+    atomic_flag_clear_explicit(&checkpoint->saving, memory_order_release);
+    return written;
+}
+
+
+/**
+ * Ends checkpointing an integration. A finished integration removes its
+ * checkpoint; a stopped one keeps the final checkpoint written when it
+ * stopped, to be resumed later.
+ *
+ * @param checkpoint The checkpoint.
+ * @param status The status of the integration.
+ */
+void checkpoint_finish(Checkpoint* checkpoint, const IntegrationStatus status) {
+    if (!checkpoint->active)
+        return;
+
+    if (status != INTEGRATION_PARTIAL && unlink(checkpoint->path) != 0 &&
+        errno != ENOENT)
+        perror("Error removing the checkpoint");
+    checkpoint->partials = nullptr;
+}
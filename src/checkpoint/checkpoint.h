@@ -0,0 +1,125 @@
+/**
+ * @file checkpoint.h
+ * @brief Header file for checkpoints, which let a long integration continue
+ * after the process died or was stopped.
+ *
+ * While an integration with a checkpoint runs, its progress is written to a
+ * small binary file at most once per interval: the refinement and method in
+ * progress, the completed methods, the state of the tolerance loop, and the
+ * completed chunks of the current method with their partial sums. A resumed
+ * integration skips everything the checkpoint holds; since the partial sums
+ * are restored bit for bit and still added up in chunk order, its result is
+ * bitwise identical to that of an uninterrupted run.
+ *
+ * A checkpoint is written to a temporary file that is synced and renamed over
+ * the previous one, so the file always holds a complete checkpoint. It is
+ * removed once the integration has finished.
+ */
+
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "expression_parser.h"
+#include "integral.h"
+
+
+#define CHECKPOINT_MAGIC UINT64_C(0x31544e504b484349) // "ICHKPNT1"
+#define CHECKPOINT_VERSION 3
+#define CHECKPOINT_DEFAULT_INTERVAL_MS 10000
+#define CHECKPOINT_PATH_MAX 4096
+
+
+/**
+ * @struct CheckpointFile
+ * @brief The layout of a checkpoint file, in the byte order of the host.
+ *
+ * `key` is the canonical key of the job, so a checkpoint is only resumed by
+ * the same integration. `method` is the method in progress at `refinement`,
+ * or METHOD_COUNT if every method of that refinement is complete; `methods`
+ * holds the results of the completed methods and the measurements so far.
+ * `done` marks the chunks of the method in progress whose partial sums are
+ * in `partials`. `checksum` covers every other byte.
+ */
+typedef struct CheckpointFile {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t method;
+    uint64_t checksum;
+    CacheKey key;
+    int32_t refinement;
+    int32_t chunk_count;
+    double previous_values[METHOD_COUNT];
+    double previous_gap;
+    MethodResult methods[METHOD_COUNT];
+    uint8_t done[CHUNK_MAX_COUNT];
+    double partials[CHUNK_MAX_COUNT];
+} CheckpointFile;
+
+
+/**
+ * @struct Checkpoint
+ * @brief The checkpoint of an integration, installed into its job.
+ *
+ * `path` is the checkpoint file, `interval_ms` the least time between two
+ * checkpoints and `resume` whether an existing checkpoint is continued. The
+ * other fields are maintained by the integration core: `saved` is the
+ * checkpoint read on resume, and `result`, `refinement`, `method`,
+ * `previous_values` and `previous_gap` point to or copy the progress of the
+ * integration. `partials` and `done` are the chunks of the method in
+ * progress, which any chunk thread may write out once `next_save_ns` has
+ * passed; `saving` lets only one of them do it at a time. `saves` counts the
+ * checkpoints written.
+ */
+struct Checkpoint {
+    const char* path;
+    char temporary[CHECKPOINT_PATH_MAX];
+    double interval_ms;
+    bool resume;
+    bool active;
+    bool resumed;
+    CheckpointFile saved;
+    CacheKey key;
+    const IntegrationResult* result;
+    int refinement;
+    int method;
+    const double* previous_values;
+    double previous_gap;
+    int chunk_count;
+    const double* partials;
+    atomic_uchar done[CHUNK_MAX_COUNT];
+    atomic_llong next_save_ns;
+    atomic_flag saving;
+    atomic_ullong saves;
+};
+
+
+bool checkpoint_init(Checkpoint* checkpoint, const char* path,
+                     double interval_ms, bool resume);
+
+bool checkpoint_begin(Checkpoint* checkpoint, const Node* expression,
+                      const IntegrationJob* job);
+
+void checkpoint_track(Checkpoint* checkpoint, const IntegrationResult* result,
+                      int refinement, int method,
+                      const double previous_values[], double previous_gap);
+
+void checkpoint_prepare(Checkpoint* checkpoint, const ChunkPlan* plan,
+                        double partials[]);
+
+bool checkpoint_is_done(const Checkpoint* checkpoint, int chunk);
+
+void checkpoint_chunk_done(Checkpoint* checkpoint, int chunk);
+
+bool checkpoint_save(Checkpoint* checkpoint, bool force);
+
+void checkpoint_finish(Checkpoint* checkpoint, IntegrationStatus status);
+
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,931 @@
+/**
+ * @file cli.c
+ * @brief Implementation of the headless command-line mode.
+ *
+ * This file parses the command-line arguments describing an integration,
+ * reads missing inputs from the standard input, runs the non-interactive
+ * integration core and reports the results in the requested format. It never
+ * prompts and never initialises GTK.
+ */
+
+
+#include "cli.h"
+
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * The token a local integration is cancelled with on SIGINT.
+ */
+static CancelToken interrupt_token;
+
+
+/**
+ * Prints the usage of the command-line mode.
+ *
+ * @param stream The stream to print to.
+ * @param program The name of the executable.
+ */
+static void print_usage(FILE* stream, const char* program) {
+    fprintf(stream,
+            "Usage: %s [options]\n"
+            "Integrates a function given in Reverse Polish Notation without "
+            "user interaction.\n\n"
+            "  -f, --function EXPR     the integrand, '-' reads it from the "
+            "standard input\n"
+            "  -i, --interval INTERVAL the interval as \"[start ; end]\"\n"
+            "  -a, --start VALUE       the start of the interval\n"
+            "  -b, --end VALUE         the end of the interval\n"
+            "  -m, --method LIST       comma separated list of riemann, "
+            "lower, upper or all\n"
+            "  -r, --refinement N      the number of subintervals in [%d ; "
+            "%d] (default %d)\n"
+            "  -t, --tolerance VALUE   refine until the Darboux sums differ "
+            "by at most VALUE\n"
+            "  -d, --deadline MS       stop after MS milliseconds and report "
+            "the partial\n"
+            "                          estimate; SIGINT stops a local "
+            "integration the same way\n"
+            "  -j, --threads N         the number of threads, 0 uses every "
+            "online CPU (default 1)\n"
+            "  -o, --format FORMAT     text, value, json, csv or binary "
+            "(default text,\n"
+            "                          json for --batch)\n"
+            "  -B, --batch FILE        run the JSON Lines or CSV jobs of FILE, "
+            "'-' reads the\n"
+            "                          standard input; the options above "
+            "become defaults and\n"
+            "                          --threads sets the number of workers\n"
+            "  -c, --cache FILE        the result cache file (default "
+            "%s)\n"
+            "  -C, --cache-entries N   the number of entries of the result "
+            "cache (default %d)\n"
+            "  -n, --no-cache          neither read nor write the result "
+            "cache\n"
+            "  -J, --journal FILE      the results journal (default %s)\n"
+            "  -N, --no-journal        do not append results to the journal\n"
+            "  -s, --sync-interval MS  make journal records durable within "
+            "MS milliseconds\n"
+            "                          (default %d)\n"
+            "  -S, --sync-records N    sync the journal once N records are "
+            "pending (default %d)\n"
+            "  -R, --read-journal FILE verify a results journal; text prints "
+            "a summary, json,\n"
+            "                          csv and binary print its records\n"
+            "  -L, --serve SOCKET      run as a daemon answering integrations "
+            "on SOCKET until\n"
+            "                          SIGINT or SIGTERM; --threads sets the "
+            "number of workers\n"
+            "  -U, --connect SOCKET    send the integration to the daemon on "
+            "SOCKET\n"
+            "  -Q, --bench N           with --connect, measure the latency of "
+            "N distinct and N\n"
+            "                          repeated integrations\n"
+            "  -K, --ring              with --connect, exchange requests with "
+            "the daemon\n"
+            "                          through shared memory\n"
+            "  -P, --priority CLASS    with --connect, the class of the "
+            "integration: interactive,\n"
+            "                          normal (default) or bulk\n"
+            "  -M, --max-cost COST     with --serve, reject jobs estimated "
+            "to cost more than COST\n"
+            "                          node evaluations, 0 for no limit "
+            "(default %g)\n"
+            "  -W, --shard-worker ADDR run as a shard worker on the TCP "
+            "address host:port, or\n"
+            "                          port on the loopback interface, until "
+            "SIGINT or SIGTERM\n"
+            "  -D, --shard LIST        compute the integration on the "
+            "comma separated shard\n"
+            "                          workers of LIST\n"
+            "  -k, --checkpoint FILE   write the progress of the integration "
+            "to FILE, removed\n"
+            "                          once it finishes\n"
+            "  -I, --checkpoint-interval MS\n"
+            "                          write a checkpoint at most every MS "
+            "milliseconds\n"
+            "                          (default %d)\n"
+            "  -u, --resume            continue from the checkpoint in the "
+            "--checkpoint file\n"
+            "  -p, --perf              print the hardware counters of the "
+            "parsing and of each\n"
+            "                          method to the standard error\n"
+            "  -T, --trace FILE        write the spans of the run to FILE as "
+            "Chrome trace-event\n"
+            "                          JSON, for Perfetto or chrome://tracing\n"
+            "  -h, --help              print this help and exit\n\n"
+            "Missing integrand and interval are read from the standard input, "
+            "one per line.\n"
+            "Exit status: 0 success, 1 failure, 2 usage error, 3 invalid "
+            "integrand, 4 invalid interval,\n"
+            "5 invalid refinement or tolerance, 6 tolerance not reached, 7 "
+            "some batch jobs failed,\n"
+            "8 corrupt journal records, 9 stopped by the deadline or SIGINT, "
+            "10 rejected by the\n"
+            "daemon as too costly.\n",
+            program, MIN_REFINEMENT, MAX_REFINEMENT, DEFAULT_REFINEMENT,
+            CACHE_DEFAULT_PATH, CACHE_DEFAULT_ENTRIES, JOURNAL_DEFAULT_PATH,
+            JOURNAL_DEFAULT_SYNC_INTERVAL_MS, JOURNAL_DEFAULT_SYNC_RECORDS,
+            DAEMON_MAX_COST, CHECKPOINT_DEFAULT_INTERVAL_MS);
+}
+
+
+/**
+ * Converts a whole string to a finite double.
+ *
+ * @param text The string to convert.
+ * @param value Output pointer for the converted value.
+ * @return true if the whole string is a finite number, false otherwise.
+ */
+static bool parse_double(const char* text, double* value) {
+    char* endptr;
+    *value = strtod(text, &endptr);
+    return endptr != text && *endptr == '\0' && isfinite(*value);
+}
+
+
+/**
+ * Converts a whole string to an int.
+ *
+ * @param text The string to convert.
+ * @param value Output pointer for the converted value.
+ * @return true if the whole string is an integer in the range of int, false
+ * otherwise.
+ */
+static bool parse_int(const char* text, int* value) {
+    char* endptr;
+    const long converted = strtol(text, &endptr, 10);
+
+    if (endptr == text || *endptr != '\0' || converted < INT_MIN ||
+        converted > INT_MAX)
+        return false;
+
+    *value = (int)converted;
+    return true;
+}
+
+
+/**
+ * Parses the command-line arguments of the headless mode.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments.
+ * @param options Output pointer for the parsed options.
+ * @return CLI_SUCCESS if the arguments are valid, CLI_USAGE_ERROR if they are
+ * not, or CLI_FAILURE with `options` untouched if help was requested.
+ */
+static CliStatus parse_options(const int argc, char* argv[],
+                               CliOptions* options) {
+    static const char SHORT_OPTIONS[] =
+        "f:i:a:b:m:r:t:d:j:o:B:c:C:nJ:Ns:S:R:L:U:Q:KP:M:W:D:k:I:upT:h";
+    static const struct option long_options[] = {
+        {"function", required_argument, nullptr, 'f'},
+        {"interval", required_argument, nullptr, 'i'},
+        {"start", required_argument, nullptr, 'a'},
+        {"end", required_argument, nullptr, 'b'},
+        {"method", required_argument, nullptr, 'm'},
+        {"refinement", required_argument, nullptr, 'r'},
+        {"tolerance", required_argument, nullptr, 't'},
+        {"deadline", required_argument, nullptr, 'd'},
+        {"threads", required_argument, nullptr, 'j'},
+        {"format", required_argument, nullptr, 'o'},
+        {"batch", required_argument, nullptr, 'B'},
+        {"cache", required_argument, nullptr, 'c'},
+        {"cache-entries", required_argument, nullptr, 'C'},
+        {"no-cache", no_argument, nullptr, 'n'},
+        {"journal", required_argument, nullptr, 'J'},
+        {"no-journal", no_argument, nullptr, 'N'},
+        {"sync-interval", required_argument, nullptr, 's'},
+        {"sync-records", required_argument, nullptr, 'S'},
+        {"read-journal", required_argument, nullptr, 'R'},
+        {"serve", required_argument, nullptr, 'L'},
+        {"connect", required_argument, nullptr, 'U'},
+        {"bench", required_argument, nullptr, 'Q'},
+        {"ring", no_argument, nullptr, 'K'},
+        {"priority", required_argument, nullptr, 'P'},
+        {"max-cost", required_argument, nullptr, 'M'},
+        {"shard-worker", required_argument, nullptr, 'W'},
+        {"shard", required_argument, nullptr, 'D'},
+        {"checkpoint", required_argument, nullptr, 'k'},
+        {"checkpoint-interval", required_argument, nullptr, 'I'},
+        {"resume", no_argument, nullptr, 'u'},
+        {"perf", no_argument, nullptr, 'p'},
+        {"trace", required_argument, nullptr, 'T'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    *options = (CliOptions){.batch = nullptr,
+                            .cache = CACHE_DEFAULT_PATH,
+                            .cache_entries = CACHE_DEFAULT_ENTRIES,
+                            .journal = JOURNAL_DEFAULT_PATH,
+                            .sync_interval_ms =
+                                JOURNAL_DEFAULT_SYNC_INTERVAL_MS,
+                            .sync_records = JOURNAL_DEFAULT_SYNC_RECORDS,
+                            .read_journal = nullptr,
+                            .serve = nullptr,
+                            .connect = nullptr,
+                            .bench = 0,
+                            .ring = false,
+                            .priority = POOL_PRIORITY_NORMAL,
+                            .max_cost = DAEMON_MAX_COST,
+                            .shard_worker = nullptr,
+                            .shard = nullptr,
+                            .checkpoint = nullptr,
+                            .checkpoint_interval_ms =
+                                CHECKPOINT_DEFAULT_INTERVAL_MS,
+                            .resume = false,
+                            .perf = false,
+                            .trace = nullptr,
+                            .integrand = nullptr,
+                            .interval = nullptr,
+                            .has_start = false,
+                            .has_end = false,
+                            .job = {.start = 0,
+                                    .end = 0,
+                                    .refinement = DEFAULT_REFINEMENT,
+                                    .tolerance = 0,
+                                    .methods = METHOD_ALL,
+                                    .threads = 1},
+                            .format = REPORT_TEXT};
+
+    bool format_given = false;
+    int option;
+    while ((option = getopt_long(argc, argv, SHORT_OPTIONS, long_options,
+                                 nullptr)) != -1) {
+        bool valid = true;
+
+        switch (option) {
+            case 'f':
+                options->integrand = optarg;
+                break;
+            case 'i':
+                options->interval = optarg;
+                break;
+            case 'a':
+                valid = options->has_start =
+                    parse_double(optarg, &options->job.start);
+                break;
+            case 'b':
+                valid = options->has_end =
+                    parse_double(optarg, &options->job.end);
+                break;
+            case 'm':
+                valid = parse_methods(optarg, &options->job.methods);
+                break;
+            case 'r':
+                valid = parse_int(optarg, &options->job.refinement);
+                break;
+            case 't':
+                valid = parse_double(optarg, &options->job.tolerance) &&
+                        options->job.tolerance > 0;
+                break;
+            case 'd':
+                valid = parse_double(optarg, &options->job.deadline_ms) &&
+                        options->job.deadline_ms > 0;
+                break;
+            case 'j':
+                valid = parse_int(optarg, &options->job.threads) &&
+                        options->job.threads >= 0;
+                break;
+            case 'o':
+                valid = format_given =
+                    parse_report_format(optarg, &options->format);
+                break;
+            case 'B':
+                options->batch = optarg;
+                break;
+            case 'c':
+                options->cache = optarg;
+                break;
+            case 'C':
+                valid = parse_int(optarg, &options->cache_entries) &&
+                        options->cache_entries > 0;
+                break;
+            case 'n':
+                options->cache = nullptr;
+                break;
+            case 'J':
+                options->journal = optarg;
+                break;
+            case 'N':
+                options->journal = nullptr;
+                break;
+            case 's':
+                valid = parse_int(optarg, &options->sync_interval_ms) &&
+                        options->sync_interval_ms > 0;
+                break;
+            case 'S':
+                valid = parse_int(optarg, &options->sync_records) &&
+                        options->sync_records > 0 &&
+                        options->sync_records <= JOURNAL_BUFFER_RECORDS;
+                break;
+            case 'R':
+                options->read_journal = optarg;
+                break;
+            case 'L':
+                options->serve = optarg;
+                break;
+            case 'U':
+                options->connect = optarg;
+                break;
+            case 'Q': {
+                int bench = 0;
+                valid = parse_int(optarg, &bench) && bench > 0;
+                if (valid)
+                    options->bench = bench;
+                break;
+            }
+            case 'K':
+                options->ring = true;
+                break;
+            case 'P':
+                valid = parse_pool_priority(optarg, &options->priority);
+                break;
+            case 'M':
+                valid = parse_double(optarg, &options->max_cost) &&
+                        options->max_cost >= 0;
+                break;
+            case 'W':
+                options->shard_worker = optarg;
+                break;
+            case 'D':
+                options->shard = optarg;
+                break;
+            case 'k':
+                options->checkpoint = optarg;
+                break;
+            case 'I':
+                valid = parse_int(optarg, &options->checkpoint_interval_ms) &&
+                        options->checkpoint_interval_ms > 0;
+                break;
+            case 'u':
+                options->resume = true;
+                break;
+            case 'p':
+                options->perf = true;
+                break;
+            case 'T':
+                options->trace = optarg;
+                break;
+            case 'h':
+                print_usage(stdout, argv[0]);
+                return CLI_FAILURE;
+            default:
+                print_usage(stderr, argv[0]);
+                return CLI_USAGE_ERROR;
+        }
+
+        if (!valid) {
+            fprintf(stderr, "Error: Invalid value '%s' for option -%c.\n",
+                    optarg, option);
+            return CLI_USAGE_ERROR;
+        }
+    }
+
+    if (optind < argc) {
+        fprintf(stderr, "Error: Unexpected argument '%s'.\n", argv[optind]);
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->interval != NULL &&
+        (options->has_start || options->has_end)) {
+        fprintf(stderr, "Error: Use either --interval or --start and --end.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->batch != NULL &&
+        (options->integrand != NULL || options->interval != NULL ||
+         options->has_start)) {
+        fprintf(stderr, "Error: A batch run takes its functions and intervals "
+                        "from the job file.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->batch != NULL &&
+        !report_is_machine_readable(options->format)) {
+        if (format_given) {
+            fprintf(stderr, "Error: A batch run writes json, csv or binary "
+                            "results.\n");
+            return CLI_USAGE_ERROR;
+        }
+        options->format = REPORT_JSON;
+    }
+
+    if (options->bench > 0 && options->connect == NULL) {
+        fprintf(stderr, "Error: --bench requires --connect.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->ring && options->connect == NULL) {
+        fprintf(stderr, "Error: --ring requires --connect.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->serve != NULL &&
+        (options->connect != NULL || options->batch != NULL)) {
+        fprintf(stderr, "Error: A daemon takes its jobs from its clients.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->shard != NULL &&
+        (options->connect != NULL || options->serve != NULL ||
+         options->batch != NULL || options->shard_worker != NULL)) {
+        fprintf(stderr, "Error: --shard cannot be combined with --connect, "
+                        "--serve, --batch or --shard-worker.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->shard != NULL && options->job.deadline_ms > 0) {
+        fprintf(stderr, "Error: A sharded integration cannot be stopped by "
+                        "a deadline.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->shard_worker != NULL &&
+        (options->connect != NULL || options->serve != NULL ||
+         options->batch != NULL)) {
+        fprintf(stderr, "Error: A shard worker takes its work from its "
+                        "coordinators.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->checkpoint == NULL &&
+        (options->resume ||
+         options->checkpoint_interval_ms != CHECKPOINT_DEFAULT_INTERVAL_MS)) {
+        fprintf(stderr, "Error: --resume and --checkpoint-interval require "
+                        "--checkpoint.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->checkpoint != NULL &&
+        (options->connect != NULL || options->serve != NULL ||
+         options->batch != NULL || options->shard != NULL ||
+         options->shard_worker != NULL)) {
+        fprintf(stderr, "Error: Only a local integration of a single "
+                        "function can be checkpointed.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->perf &&
+        (options->connect != NULL || options->serve != NULL ||
+         options->batch != NULL || options->shard != NULL ||
+         options->shard_worker != NULL)) {
+        fprintf(stderr, "Error: Only a local integration of a single "
+                        "function can be profiled.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->has_start != options->has_end) {
+        fprintf(stderr, "Error: Both --start and --end must be given.\n");
+        return CLI_USAGE_ERROR;
+    }
+
+    if (options->job.threads == 0)
+        options->job.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    return CLI_SUCCESS;
+}
+
+
+/**
+ * Reads a line from the standard input and removes its line terminator.
+ *
+ * @param buffer The buffer receiving the line.
+ * @param size The size of the buffer in bytes.
+ * @return true if a line was read, false at the end of the input.
+ */
+static bool read_line(char* buffer, const size_t size) {
+    if (fgets(buffer, (int)size, stdin) == NULL)
+        return false;
+
+    buffer[strcspn(buffer, "\r\n")] = '\0';
+    return true;
+}
+
+
+/**
+ * Maps the status of the integration core to an exit status.
+ *
+ * @param status The status returned by the integration core.
+ * @return The corresponding exit status of the command-line mode.
+ */
+static CliStatus exit_status(const IntegrationStatus status) {
+    switch (status) {
+        case INTEGRATION_OK:
+            return CLI_SUCCESS;
+        case INTEGRATION_INVALID_INTEGRAND:
+            return CLI_INVALID_INTEGRAND;
+        case INTEGRATION_INVALID_INTERVAL:
+            return CLI_INVALID_INTERVAL;
+        case INTEGRATION_INVALID_REFINEMENT:
+            return CLI_INVALID_REFINEMENT;
+        case INTEGRATION_NOT_CONVERGED:
+            return CLI_NOT_CONVERGED;
+        case INTEGRATION_PARTIAL:
+            return CLI_PARTIAL;
+        case INTEGRATION_REJECTED:
+            return CLI_REJECTED;
+        default:
+            return CLI_FAILURE;
+    }
+}
+
+
+/**
+ * Runs every job of the job file given with `--batch`.
+ *
+ * @param options The options of the command-line mode.
+ * @return CLI_SUCCESS if every job succeeded, CLI_JOB_FAILURES if some failed,
+ * or CLI_FAILURE if the job file could not be processed.
+ */
+static CliStatus run_batch_mode(const CliOptions* options) {
+    BatchStats stats;
+    if (!run_batch(options->batch, &options->job, options->job.threads,
+                   options->format, &stats))
+        return CLI_FAILURE;
+    return stats.failed > 0 ? CLI_JOB_FAILURES : CLI_SUCCESS;
+}
+
+
+/**
+ * Scans the journal given with `--read-journal`.
+ *
+ * The machine-readable formats write every valid record to the standard
+ * output and the summary to the standard error; the text formats only print
+ * the summary, which then measures the pure scanning speed.
+ *
+ * @param options The options of the command-line mode.
+ * @return CLI_SUCCESS if every record is intact, CLI_CORRUPT_JOURNAL if some
+ * are not, or CLI_FAILURE if the journal could not be read.
+ */
+static CliStatus run_journal_reader(const CliOptions* options) {
+    const bool records = report_is_machine_readable(options->format);
+    FILE* summary = records ? stderr : stdout;
+
+    ResultWriter writer;
+    if (records && !report_begin(&writer, stdout, options->format))
+        return CLI_FAILURE;
+
+    struct timespec start_time, end_time;
+    JournalScan scan;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    const bool scanned =
+        journal_scan(options->read_journal, records ? &writer : nullptr, &scan);
+    if (records && !report_flush(&writer))
+        return CLI_FAILURE;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    if (!scanned)
+        return CLI_FAILURE;
+
+    const double elapsed_ms = timespec_diff_ms(&start_time, &end_time);
+    fprintf(summary, "Records: %lld\n", scan.records);
+    for (int status = 0; status < INTEGRATION_STATUS_COUNT; status++)
+        if (scan.statuses[status] > 0)
+            fprintf(summary, "  %s: %lld\n", status_name(status),
+                    scan.statuses[status]);
+    if (scan.invalid_jobs > 0)
+        fprintf(summary, "  invalid_job: %lld\n", scan.invalid_jobs);
+    fprintf(summary, "Served from the cache: %lld\n", scan.cached);
+    fprintf(summary, "Corrupt records: %lld\n", scan.corrupt);
+    fprintf(summary, "Trailing bytes: %lld\n", scan.trailing_bytes);
+    fprintf(summary, "Scanned %.1f MiB in %.3f ms (%.1f MiB/s)\n",
+            (double)scan.bytes / (1024.0 * 1024.0), elapsed_ms,
+            elapsed_ms > 0 ? (double)scan.bytes / (1024.0 * 1024.0) /
+                                 (elapsed_ms / 1000.0)
+                           : 0.0);
+
+    return scan.corrupt > 0 || scan.trailing_bytes > 0 ? CLI_CORRUPT_JOURNAL
+                                                       : CLI_SUCCESS;
+}
+
+
+/**
+ * Prints the outcome of a benchmark phase.
+ *
+ * @param name The name of the phase.
+ * @param latency The measurements of the phase.
+ */
+static void print_latency(const char* name, const ClientLatency* latency) {
+    printf("%s: %lld requests in %.3f ms (%.0f requests/s), %lld cached, "
+           "%lld failed\n",
+           name, latency->requests, latency->elapsed_ms,
+           latency->elapsed_ms > 0
+               ? (double)latency->requests / (latency->elapsed_ms / 1000.0)
+               : 0.0,
+           latency->cached, latency->failures);
+    printf("  latency p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+           latency->p50_us, latency->p99_us, latency->p999_us,
+           latency->max_us);
+}
+
+
+/**
+ * Measures the round-trip latency of the daemon given with `--connect`, first
+ * with distinct jobs that are computed, then with a repeated job answered from
+ * the daemon's result cache, and prints the daemon's counters. Through a ring,
+ * the latency with the submission ring kept full is measured as well.
+ *
+ * @param client The connected client.
+ * @param ring The ring client of the connection, or NULL to use the socket.
+ * @param options The options of the command-line mode.
+ * @return CLI_SUCCESS if every request was answered, CLI_FAILURE otherwise.
+ */
+static CliStatus run_benchmark(Client* client, RingClient* ring,
+                               const CliOptions* options) {
+    ClientLatency distinct, repeated, pipelined;
+    if (!client_benchmark(client, ring, options->integrand, &options->job,
+                          options->bench, true, &distinct) ||
+        !client_benchmark(client, ring, options->integrand, &options->job,
+                          options->bench, false, &repeated))
+        return CLI_FAILURE;
+
+    print_latency("distinct", &distinct);
+    print_latency("repeated", &repeated);
+
+    if (ring != NULL) {
+        if (!client_ring_pipeline(ring, options->integrand, &options->job,
+                                  options->bench, &pipelined))
+            return CLI_FAILURE;
+        print_latency("pipelined", &pipelined);
+    }
+
+    ProtocolStats stats;
+    if (!client_stats(client, &stats))
+        return CLI_FAILURE;
+    printf("daemon: %llu requests, %llu integrations, %llu result cache "
+           "hits, %llu coalesced (largest group %llu), %llu/%llu compiled "
+           "expression hits/misses, %llu jobs in %llu batches, %llu "
+           "rejected, %llu downgraded\n",
+           (unsigned long long)stats.requests,
+           (unsigned long long)stats.integrations,
+           (unsigned long long)stats.result_cache_hits,
+           (unsigned long long)stats.coalesced,
+           (unsigned long long)stats.largest_coalesced_group,
+           (unsigned long long)stats.expression_hits,
+           (unsigned long long)stats.expression_misses,
+           (unsigned long long)stats.batched_jobs,
+           (unsigned long long)stats.batches,
+           (unsigned long long)stats.rejected,
+           (unsigned long long)stats.downgraded);
+    if (ring != NULL)
+        printf("daemon rings: %llu attached, %llu requests\n",
+               (unsigned long long)stats.ring_clients,
+               (unsigned long long)stats.ring_requests);
+
+    return CLI_SUCCESS;
+}
+
+
+/**
+ * Cancels the local integration in progress, see integrate_interruptible().
+ *
+ * @param signal The signal number, unused.
+ */
+static void cancel_on_interrupt(const int signal) {
+    (void)signal;
+    cancel_token_cancel(&interrupt_token);
+}
+
+
+/**
+ * Integrates the function of the options locally, letting SIGINT stop the
+ * integration at the next chunk boundary with a partial result. The handler
+ * is reset on delivery, so a second SIGINT terminates the program as usual.
+ *
+ * @param options The options of the command-line mode.
+ * @param result Output pointer for the result.
+ * @return The status of the integration.
+ */
+static IntegrationStatus integrate_interruptible(CliOptions* options,
+                                                 IntegrationResult* result) {
+    cancel_token_init(&interrupt_token);
+    struct sigaction action = {.sa_handler = cancel_on_interrupt,
+                               .sa_flags = SA_RESETHAND};
+    sigemptyset(&action.sa_mask);
+    struct sigaction previous;
+    const bool installed = sigaction(SIGINT, &action, &previous) == 0;
+    if (installed)
+        options->job.cancel = &interrupt_token;
+
+    const IntegrationStatus status =
+        integrate_job(options->integrand, &options->job, result);
+
+    options->job.cancel = nullptr;
+    if (installed)
+        sigaction(SIGINT, &previous, nullptr);
+    return status;
+}
+
+
+/**
+ * Integrates the single function described by the options.
+ *
+ * The integrand and the interval are taken from the arguments; whichever is
+ * missing is read from the standard input, the integrand first, then the
+ * interval, one per line. With `--connect`, the function is integrated by the
+ * daemon instead, or benchmarked with `--bench`, and with `--shard`, its
+ * chunks are computed by shard workers. With `--checkpoint`, a local
+ * integration is checkpointed, and with `--resume`, continued from its
+ * checkpoint. With `--perf`, the hardware counters of a local integration are
+ * printed to the standard error after the result.
+ *
+ * @param options The options of the command-line mode.
+ * @return The exit status of the program, see CliStatus.
+ */
+static CliStatus run_single(CliOptions* options) {
+    char integrand_line[CLI_LINE_MAX];
+    char interval_line[CLI_LINE_MAX];
+
+    if (options->integrand == NULL || strcmp(options->integrand, "-") == 0) {
+        if (!read_line(integrand_line, sizeof(integrand_line))) {
+            fprintf(stderr, "Error: The integrand is missing.\n");
+            return CLI_USAGE_ERROR;
+        }
+        options->integrand = integrand_line;
+    }
+
+    if (!options->has_start) {
+        if (options->interval == NULL) {
+            if (!read_line(interval_line, sizeof(interval_line))) {
+                fprintf(stderr, "Error: The interval is missing.\n");
+                return CLI_USAGE_ERROR;
+            }
+            options->interval = interval_line;
+        }
+
+        if (!validate_interval(options->interval, &options->job.start,
+                               &options->job.end))
+            return CLI_INVALID_INTERVAL;
+    }
+
+    IntegrationResult result;
+    IntegrationStatus status;
+    PerfProfile profile;
+    perf_profile_init(&profile);
+    if (options->connect != NULL) {
+        RingClient ring_client;
+        Client* client = &ring_client.client;
+        RingClient* ring = options->ring ? &ring_client : nullptr;
+        if (ring != NULL ? !client_ring_attach(ring, options->connect)
+                         : !client_connect(client, options->connect))
+            return CLI_FAILURE;
+        client->priority = options->priority;
+
+        if (options->bench > 0) {
+            const CliStatus bench_status =
+                run_benchmark(client, ring, options);
+            if (ring != NULL)
+                client_ring_detach(ring);
+            else
+                client_close(client);
+            return bench_status;
+        }
+
+        if (ring != NULL) {
+            status = client_ring_integrate(ring, options->integrand,
+                                           &options->job, &result);
+            client_ring_detach(ring);
+        } else {
+            status = client_integrate(client, options->integrand,
+                                      &options->job, &result);
+            client_close(client);
+        }
+    } else if (options->shard != NULL) {
+        ShardCoordinator coordinator;
+        if (!shard_connect(&coordinator, options->shard,
+                           options->job.threads))
+            return CLI_FAILURE;
+        status = shard_integrate(&coordinator, options->integrand,
+                                 &options->job, &result);
+        shard_close(&coordinator);
+    } else {
+        Checkpoint checkpoint;
+        if (options->checkpoint != NULL) {
+            if (!checkpoint_init(&checkpoint, options->checkpoint,
+                                 options->checkpoint_interval_ms,
+                                 options->resume))
+                return CLI_FAILURE;
+            options->job.checkpoint = &checkpoint;
+        }
+        if (options->perf)
+            options->job.perf = &profile;
+        status = integrate_interruptible(options, &result);
+        options->job.checkpoint = nullptr;
+        options->job.perf = nullptr;
+    }
+
+    const ResultRecord record = {.id = nullptr,
+                                 .id_is_number = false,
+                                 .integrand = options->integrand,
+                                 .label = nullptr,
+                                 .result = &result};
+    journal_append(&record);
+
+    // The text formats only report values, failures go to the error stream
+    ResultWriter writer;
+    if (!report_begin(&writer, stdout, options->format))
+        return CLI_FAILURE;
+    if ((report_is_machine_readable(options->format) ||
+         status == INTEGRATION_OK || status == INTEGRATION_NOT_CONVERGED ||
+         status == INTEGRATION_PARTIAL) &&
+        (!report_write(&writer, &record) || !report_flush(&writer)))
+        return CLI_FAILURE;
+
+    if (status == INTEGRATION_INVALID_REFINEMENT)
+        fprintf(stderr,
+                "Error: The scale of refinement must be between %d and %d.\n",
+                MIN_REFINEMENT, MAX_REFINEMENT);
+    else if (status == INTEGRATION_NOT_CONVERGED)
+        fprintf(stderr,
+                "Error: The tolerance was not reached with the finest "
+                "refinement.\n");
+    else if (status == INTEGRATION_REJECTED)
+        fprintf(stderr,
+                "Error: The daemon rejected the integration, its estimated "
+                "cost exceeds the limit.\n");
+    else if (status == INTEGRATION_PARTIAL)
+        fprintf(stderr,
+                "Warning: The integration was stopped before completing; the "
+                "values are estimates.\n");
+
+    if (options->perf)
+        perf_profile_print(&profile, stderr);
+
+    return exit_status(status);
+}
+
+
+/**
+ * Runs the mode of the command line selected by the options.
+ *
+ * A single function is integrated, or with `--batch`, every job of the job
+ * file, or with `--read-journal`, a journal is scanned, or with `--serve`, the
+ * program runs as a daemon, or with `--shard-worker`, as a shard worker, which
+ * opens neither the cache nor the journal. Unless disabled, the result cache
+ * and the results journal are open for the duration of the run, so exact
+ * repeats are not recomputed and every result is recorded. A client of a
+ * daemon opens neither; the daemon does.
+ *
+ * @param options The options of the command-line mode.
+ * @return The exit status of the program, see CliStatus.
+ */
+static CliStatus run_mode(CliOptions* options) {
+    if (options->read_journal != NULL)
+        return run_journal_reader(options);
+    if (options->shard_worker != NULL)
+        return run_shard_worker(options->shard_worker, options->job.threads)
+                   ? CLI_SUCCESS
+                   : CLI_FAILURE;
+    if (options->connect != NULL)
+        return run_single(options);
+
+    // Without a usable cache or journal file the jobs are simply computed
+    if (options->cache != NULL)
+        cache_open(options->cache, options->cache_entries);
+    if (options->journal != NULL)
+        journal_open(options->journal, options->sync_interval_ms,
+                     options->sync_records);
+
+    CliStatus status;
+    if (options->serve != NULL)
+        status = run_daemon(options->serve, options->job.threads,
+                            options->max_cost)
+                     ? CLI_SUCCESS
+                     : CLI_FAILURE;
+    else if (options->batch != NULL)
+        status = run_batch_mode(options);
+    else
+        status = run_single(options);
+    cache_close();
+    if (!journal_close() && status == CLI_SUCCESS)
+        status = CLI_FAILURE;
+    return status;
+}
+
+
+/**
+ * Runs the headless command-line mode. With `--trace`, the spans of the whole
+ * run are recorded and written to the trace file once it has finished.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments.
+ * @return The exit status of the program, see CliStatus.
+ */
+int run_cli(const int argc, char* argv[]) {
+    CliOptions options;
+    const CliStatus parse_status = parse_options(argc, argv, &options);
+    if (parse_status != CLI_SUCCESS)
+        return parse_status == CLI_FAILURE ? CLI_SUCCESS : parse_status;
+
+    if (options.trace != NULL && !trace_open(options.trace))
+        return CLI_FAILURE;
+
+    CliStatus status = run_mode(&options);
+    if (!trace_close() && status == CLI_SUCCESS)
+        status = CLI_FAILURE;
+    return status;
+}
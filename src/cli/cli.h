@@ -0,0 +1,124 @@
+/**
+ * @file cli.h
+ * @brief Header file for the headless command-line mode of the program.
+ *
+ * The command-line mode integrates a single function described entirely by
+ * command-line arguments (or by the standard input) without any prompt and
+ * without initialising the graphical user interface. The outcome is reported
+ * through the exit status of the process.
+ */
+
+
+#ifndef CLI_H
+#define CLI_H
+
+
+#include <stdbool.h>
+
+#include "batch.h"
+#include "cache.h"
+#include "checkpoint.h"
+#include "client.h"
+#include "daemon.h"
+#include "integral.h"
+#include "journal.h"
+#include "perf.h"
+#include "report.h"
+#include "shard.h"
+#include "trace.h"
+
+
+#define CLI_LINE_MAX 4096
+
+
+/**
+ * @enum CliStatus
+ * @brief Exit statuses of the command-line mode.
+ */
+typedef enum CliStatus {
+    CLI_SUCCESS = 0,
+    CLI_FAILURE = 1,
+    CLI_USAGE_ERROR = 2,
+    CLI_INVALID_INTEGRAND = 3,
+    CLI_INVALID_INTERVAL = 4,
+    CLI_INVALID_REFINEMENT = 5,
+    CLI_NOT_CONVERGED = 6,
+    CLI_JOB_FAILURES = 7,
+    CLI_CORRUPT_JOURNAL = 8,
+    CLI_PARTIAL = 9,
+    CLI_REJECTED = 10
+} CliStatus;
+
+
+/**
+ * @struct CliOptions
+ * @brief The parsed command-line arguments of the headless mode.
+ *
+ * If `integrand` is NULL or "-", the integrand is read from the first line of
+ * the standard input. If `interval` is NULL and neither `--start` nor `--end`
+ * is given, the interval is read from the next line of the standard input, in
+ * the format of the saved functions file.
+ *
+ * If `batch` is set, jobs are read from that file instead and the job
+ * parameters serve as defaults for fields missing from a job. A batch run
+ * always writes one of the machine-readable formats.
+ *
+ * `cache` is the path of the result cache file and `journal` the path of the
+ * results journal, either NULL if disabled. If `read_journal` is set, that
+ * journal is scanned instead of integrating anything.
+ *
+ * If `serve` is set, the program runs as an integration daemon listening on
+ * that socket. If `connect` is set, the integration is sent to the daemon
+ * listening on that socket instead of being computed locally, or with
+ * `bench` greater than zero, that many requests of each benchmark phase are
+ * sent. With `ring`, they go through a shared-memory segment attached to the
+ * connection instead of the socket. `priority` is the class asked of the
+ * daemon, and `max_cost` the estimated cost above which a daemon rejects jobs.
+ *
+ * If `shard_worker` is set, the program runs as a shard worker listening on
+ * that TCP address. If `shard` is set, the chunks of the integration are
+ * computed by the shard workers of that comma separated list of addresses.
+ *
+ * If `checkpoint` is set, a local integration writes its progress to that
+ * file at most every `checkpoint_interval_ms` milliseconds, and with `resume`,
+ * continues from the checkpoint in it.
+ *
+ * If `perf` is set, the hardware counters of a local integration of a single
+ * function are printed to the standard error after its result. If `trace` is
+ * set, the spans of the run are written to that file as Chrome trace-event
+ * JSON when it finishes.
+ */
+typedef struct CliOptions {
+    const char* batch;
+    const char* cache;
+    int cache_entries;
+    const char* journal;
+    int sync_interval_ms;
+    int sync_records;
+    const char* read_journal;
+    const char* serve;
+    const char* connect;
+    long long bench;
+    bool ring;
+    PoolPriority priority;
+    double max_cost;
+    const char* shard_worker;
+    const char* shard;
+    const char* checkpoint;
+    int checkpoint_interval_ms;
+    bool resume;
+    bool perf;
+    const char* trace;
+    const char* integrand;
+    const char* interval;
+    bool has_start;
+    bool has_end;
+    IntegrationJob job;
+    ReportFormat format;
+} CliOptions;
+
+
+int run_cli(int argc, char* argv[]);
+
+
+#endif /* CLI_H */
@@ -0,0 +1,702 @@
+/**
+ * @file client.c
+ * @brief Implementation of the client of the integration daemon.
+ *
+ * On the fast path of a ring client, submitting a request and polling for a
+ * response only read and write shared memory. System calls are made only to
+ * wake a sleeping daemon or to sleep once spinning found nothing.
+ */
+
+
+#define _GNU_SOURCE // MSG_CMSG_CLOEXEC
+
+#include "client.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * Connects to a daemon.
+ *
+ * @param client The client to initialise.
+ * @param path The path of the daemon's Unix domain socket.
+ * @return true on success, false otherwise.
+ */
+bool client_connect(Client* client, const char* path) {
+    client->fd = -1;
+    client->next_tag = 1;
+    client->priority = POOL_PRIORITY_NORMAL;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->fd < 0) {
+        perror("Error creating socket");
+        return false;
+    }
+
+    if (connect(client->fd, (struct sockaddr*)&address, sizeof(address)) !=
+        0) {
+        perror("Error connecting to daemon");
+        close(client->fd);
+        client->fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Closes the connection of a client.
+ *
+ * @param client The client.
+ */
+void client_close(Client* client) {
+    if (client->fd >= 0)
+        close(client->fd);
+    client->fd = -1;
+}
+
+
+/**
+ * Sends a request with a single system call.
+ *
+ * @param client The client.
+ * @param type The type of the request.
+ * @param job The description of the integration, or NULL.
+ * @param integrand The integrand, or NULL.
+ * @param tag Output pointer for the tag of the request.
+ * @return true on success, false if the request could not be sent.
+ */
+static bool client_send(Client* client, const ProtocolType type,
+                        const IntegrationJob* job, const char* integrand,
+                        uint64_t* tag) {
+    unsigned char frame[sizeof(ProtocolRequest) + PROTOCOL_INTEGRAND_MAX];
+    const size_t length = integrand != NULL ? strlen(integrand) : 0;
+    if (length > PROTOCOL_INTEGRAND_MAX)
+        return false;
+
+    *tag = client->next_tag++;
+    ProtocolRequest request;
+    protocol_encode_request(&request, type, *tag, job, length);
+    request.priority = (uint32_t)client->priority;
+    memcpy(frame, &request, sizeof(request));
+    if (length > 0)
+        memcpy(frame + sizeof(request), integrand, length);
+
+    const size_t total = sizeof(request) + length;
+    size_t sent = 0;
+    while (sent < total) {
+        const ssize_t written =
+            send(client->fd, frame + sent, total - sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0) {
+            perror("Error sending request");
+            return false;
+        }
+        sent += (size_t)written;
+    }
+
+    return true;
+}
+
+
+/**
+ * Receives the response to a request.
+ *
+ * @param client The client.
+ * @param tag The tag of the request.
+ * @param response Output pointer for the response.
+ * @return true on success, false if the connection failed or the response
+ * does not belong to the request.
+ */
+static bool client_receive(Client* client, const uint64_t tag,
+                           ProtocolResponse* response) {
+    unsigned char* buffer = (unsigned char*)response;
+    size_t received = 0;
+
+    while (received < sizeof(*response)) {
+        const ssize_t count = recv(client->fd, buffer + received,
+                                   sizeof(*response) - received, 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0) {
+            if (count < 0)
+                perror("Error receiving response");
+            else
+                fprintf(stderr, "Error: The daemon closed the connection.\n");
+            return false;
+        }
+        received += (size_t)count;
+    }
+
+    if (!protocol_check_response(response) || response->tag != tag) {
+        fprintf(stderr, "Error: Unexpected response from the daemon.\n");
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Receives the response to an attach request together with the descriptor of
+ * the shared-memory segment, which arrives with its first byte.
+ *
+ * @param client The client.
+ * @param tag The tag of the request.
+ * @param response Output pointer for the response.
+ * @param fd Output pointer for the received descriptor, -1 if none came.
+ * @return true on success, false if the connection failed or the response
+ * does not belong to the request.
+ */
+static bool client_receive_attach(Client* client, const uint64_t tag,
+                                  ProtocolResponse* response, int* fd) {
+    *fd = -1;
+
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec data = {.iov_base = response, .iov_len = sizeof(*response)};
+    struct msghdr message = {.msg_iov = &data,
+                             .msg_iovlen = 1,
+                             .msg_control = control.buffer,
+                             .msg_controllen = sizeof(control.buffer)};
+
+    ssize_t received;
+    do {
+        received = recvmsg(client->fd, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        if (received < 0)
+            perror("Error receiving response");
+        else
+            fprintf(stderr, "Error: The daemon closed the connection.\n");
+        return false;
+    }
+
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header != NULL;
+         header = CMSG_NXTHDR(&message, header))
+        if (header->cmsg_level == SOL_SOCKET &&
+            header->cmsg_type == SCM_RIGHTS &&
+            header->cmsg_len == CMSG_LEN(sizeof(int)))
+            memcpy(fd, CMSG_DATA(header), sizeof(int));
+
+    unsigned char* buffer = (unsigned char*)response;
+    size_t total = (size_t)received;
+    while (total < sizeof(*response)) {
+        const ssize_t count =
+            recv(client->fd, buffer + total, sizeof(*response) - total, 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0) {
+            fprintf(stderr, "Error: The daemon closed the connection.\n");
+            return false;
+        }
+        total += (size_t)count;
+    }
+
+    if (!protocol_check_response(response) || response->tag != tag ||
+        response->type != PROTOCOL_ATTACH) {
+        fprintf(stderr, "Error: Unexpected response from the daemon.\n");
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Checks that the daemon answers.
+ *
+ * @param client The client.
+ * @return true if the daemon answered, false otherwise.
+ */
+bool client_ping(Client* client) {
+    uint64_t tag;
+    ProtocolResponse response;
+    return client_send(client, PROTOCOL_PING, nullptr, nullptr, &tag) &&
+           client_receive(client, tag, &response);
+}
+
+
+/**
+ * Retrieves the counters of the daemon.
+ *
+ * @param client The client.
+ * @param stats Output pointer for the counters.
+ * @return true on success, false otherwise.
+ */
+bool client_stats(Client* client, ProtocolStats* stats) {
+    uint64_t tag;
+    ProtocolResponse response;
+    if (!client_send(client, PROTOCOL_STATS, nullptr, nullptr, &tag) ||
+        !client_receive(client, tag, &response))
+        return false;
+
+    *stats = response.body.stats;
+    return true;
+}
+
+
+/**
+ * Fills in the result of an integration the daemon could not be asked for.
+ *
+ * @param job The parameters of the integration.
+ * @param result Output pointer for the result.
+ * @return INTEGRATION_ERROR.
+ */
+static IntegrationStatus transport_failure(const IntegrationJob* job,
+                                           IntegrationResult* result) {
+    memset(result, 0, sizeof(*result));
+    result->status = INTEGRATION_ERROR;
+    result->start = job->start;
+    result->end = job->end;
+    result->tolerance = job->tolerance;
+    result->refinement = job->refinement;
+    return INTEGRATION_ERROR;
+}
+
+
+/**
+ * Integrates a function on the daemon.
+ *
+ * @param client The client.
+ * @param integrand The integrand in Reverse Polish Notation.
+ * @param job The parameters of the integration.
+ * @param result Output pointer for the result.
+ * @return The status of the integration, or INTEGRATION_ERROR if the daemon
+ * could not be reached.
+ */
+IntegrationStatus client_integrate(Client* client, const char* integrand,
+                                   const IntegrationJob* job,
+                                   IntegrationResult* result) {
+    uint64_t tag;
+    ProtocolResponse response;
+
+    if (!client_send(client, PROTOCOL_INTEGRATE, job, integrand, &tag) ||
+        !client_receive(client, tag, &response))
+        return transport_failure(job, result);
+
+    return protocol_decode_result(&response, result);
+}
+
+
+/**
+ * Connects to a daemon and attaches a shared-memory segment to the
+ * connection.
+ *
+ * @param ring The ring client to initialise.
+ * @param path The path of the daemon's Unix domain socket.
+ * @return true on success, false otherwise.
+ */
+bool client_ring_attach(RingClient* ring, const char* path) {
+    ring->fd = -1;
+    ring->segment = nullptr;
+    ring->submit_head = 0;
+    ring->complete_tail = 0;
+    ring->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? CLIENT_RING_SPIN : 0;
+
+    if (!client_connect(&ring->client, path))
+        return false;
+
+    uint64_t tag;
+    ProtocolResponse response;
+    if (!client_send(&ring->client, PROTOCOL_ATTACH, nullptr, nullptr, &tag) ||
+        !client_receive_attach(&ring->client, tag, &response, &ring->fd)) {
+        client_ring_detach(ring);
+        return false;
+    }
+
+    if (response.body.attach.status != 0 || ring->fd < 0) {
+        fprintf(stderr, "Error attaching shared memory: %s\n",
+                strerror(response.body.attach.status != 0
+                             ? response.body.attach.status
+                             : EPROTO));
+        client_ring_detach(ring);
+        return false;
+    }
+
+    ring->segment = ring_map(ring->fd);
+    if (ring->segment == NULL) {
+        client_ring_detach(ring);
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Unmaps the segment of a ring client and closes its connection, which makes
+ * the daemon detach the segment.
+ *
+ * @param ring The ring client.
+ */
+void client_ring_detach(RingClient* ring) {
+    ring_unmap(ring->segment);
+    ring->segment = nullptr;
+    if (ring->fd >= 0)
+        close(ring->fd);
+    ring->fd = -1;
+    client_close(&ring->client);
+}
+
+
+/**
+ * Tells whether the daemon has detached the segment of a ring client.
+ *
+ * @param ring The ring client.
+ * @return true if no more responses will arrive.
+ */
+static bool ring_closed(const RingClient* ring) {
+    return atomic_load_explicit(&ring->segment->closed,
+                                memory_order_acquire) != 0;
+}
+
+
+/**
+ * Places an integration request into the submission ring without blocking.
+ *
+ * @param ring The ring client.
+ * @param integrand The integrand in Reverse Polish Notation.
+ * @param job The parameters of the integration.
+ * @param tag Output pointer for the tag of the request.
+ * @return true if the request was submitted, false if the ring is full, the
+ * integrand is too long or the daemon detached the segment.
+ */
+bool client_ring_submit(RingClient* ring, const char* integrand,
+                        const IntegrationJob* job, uint64_t* tag) {
+    RingSegment* segment = ring->segment;
+    const size_t length = strlen(integrand);
+    if (length > PROTOCOL_INTEGRAND_MAX || ring_closed(ring))
+        return false;
+
+    const uint32_t tail =
+        atomic_load_explicit(&segment->submit_tail, memory_order_acquire);
+    if (ring->submit_head - tail >= RING_ENTRIES)
+        return false;
+
+    RingRequest* entry = &segment->requests[ring->submit_head % RING_ENTRIES];
+    *tag = ring->client.next_tag++;
+    protocol_encode_request(&entry->header, PROTOCOL_INTEGRATE, *tag, job,
+                            length);
+    entry->header.priority = (uint32_t)ring->client.priority;
+    memcpy(entry->integrand, integrand, length);
+
+    ring->submit_head++;
+    atomic_store_explicit(&segment->submit_head, ring->submit_head,
+                          memory_order_release);
+    ring_notify(&segment->daemon);
+    return true;
+}
+
+
+/**
+ * Takes a response from the completion ring without blocking.
+ *
+ * @param ring The ring client.
+ * @param response Output pointer for the response.
+ * @return true if a response was taken, false if none is available.
+ */
+bool client_ring_poll(RingClient* ring, ProtocolResponse* response) {
+    RingSegment* segment = ring->segment;
+    const uint32_t head =
+        atomic_load_explicit(&segment->complete_head, memory_order_acquire);
+    if (head == ring->complete_tail)
+        return false;
+
+    memcpy(response, &segment->responses[ring->complete_tail % RING_ENTRIES],
+           sizeof(*response));
+    ring->complete_tail++;
+    atomic_store_explicit(&segment->complete_tail, ring->complete_tail,
+                          memory_order_release);
+
+    // The daemon may be waiting for room in the completion ring.
+    ring_notify(&segment->daemon);
+    return true;
+}
+
+
+/**
+ * Waits for a response from the completion ring. Polls for `spin` rounds
+ * first, then sleeps on the client's doorbell.
+ *
+ * @param ring The ring client.
+ * @param response Output pointer for the response.
+ * @return true if a response was taken, false if the daemon detached the
+ * segment.
+ */
+bool client_ring_wait(RingClient* ring, ProtocolResponse* response) {
+    for (int spin = 0; spin < ring->spin && !ring_closed(ring); spin++) {
+        if (client_ring_poll(ring, response))
+            return true;
+        ring_cpu_relax();
+    }
+
+    RingDoorbell* doorbell = &ring->segment->client;
+    while (!ring_closed(ring)) {
+        const uint32_t sequence = ring_arm(doorbell);
+        const bool received = client_ring_poll(ring, response);
+        if (!received && !ring_closed(ring))
+            ring_sleep(doorbell, sequence);
+        ring_disarm(doorbell);
+        if (received)
+            return true;
+    }
+
+    fprintf(stderr, "Error: The daemon detached the shared memory.\n");
+    return false;
+}
+
+
+/**
+ * Integrates a function on the daemon through the rings and waits for the
+ * result.
+ *
+ * @param ring The ring client, with no other requests in flight.
+ * @param integrand The integrand in Reverse Polish Notation.
+ * @param job The parameters of the integration.
+ * @param result Output pointer for the result.
+ * @return The status of the integration, or INTEGRATION_ERROR if the request
+ * could not be submitted or the daemon detached the segment.
+ */
+IntegrationStatus client_ring_integrate(RingClient* ring,
+                                        const char* integrand,
+                                        const IntegrationJob* job,
+                                        IntegrationResult* result) {
+    uint64_t tag;
+    if (!client_ring_submit(ring, integrand, job, &tag))
+        return transport_failure(job, result);
+
+    ProtocolResponse response;
+    do {
+        if (!client_ring_wait(ring, &response))
+            return transport_failure(job, result);
+    } while (response.tag != tag);
+
+    return protocol_decode_result(&response, result);
+}
+
+
+/**
+ * Compares two latencies for qsort().
+ *
+ * @param a The first latency.
+ * @param b The second latency.
+ * @return A negative, zero or positive value as in strcmp().
+ */
+static int compare_latencies(const void* a, const void* b) {
+    const double x = *(const double*)a;
+    const double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * Returns a percentile of sorted latencies.
+ *
+ * @param samples The sorted latencies.
+ * @param count The number of latencies, at least 1.
+ * @param fraction The percentile as a fraction in [0 ; 1].
+ * @return The latency below which `fraction` of the samples lie.
+ */
+static double percentile(const double* samples, const size_t count,
+                         const double fraction) {
+    size_t index = (size_t)(fraction * (double)count);
+    if (index >= count)
+        index = count - 1;
+    return samples[index];
+}
+
+
+/**
+ * Sends `count` integration requests one after the other and measures the
+ * latency of each round trip.
+ *
+ * With `distinct` set, the end of the interval is shifted by
+ * `CLIENT_BENCH_SHIFT` per request, so every request misses the daemon's
+ * result cache but hits its table of parsed integrands. Otherwise the same
+ * job is sent every time and all but the first are answered from the cache.
+ *
+ * @param client The client, used if `ring` is NULL.
+ * @param ring The ring client to send the requests through, or NULL.
+ * @param integrand The integrand in Reverse Polish Notation.
+ * @param job The parameters of the integration.
+ * @param count The number of requests.
+ * @param distinct Whether every request should be a different job.
+ * @param latency Output pointer for the measurements.
+ * @return true on success, false if memory ran out or the daemon could not be
+ * reached.
+ */
+bool client_benchmark(Client* client, RingClient* ring, const char* integrand,
+                      const IntegrationJob* job, const long long count,
+                      const bool distinct, ClientLatency* latency) {
+    memset(latency, 0, sizeof(*latency));
+    if (count <= 0)
+        return true;
+
+    const size_t capacity = count < CLIENT_BENCH_MAX_SAMPLES
+                                ? (size_t)count
+                                : CLIENT_BENCH_MAX_SAMPLES;
+    double* samples = malloc(capacity * sizeof(double));
+    if (samples == NULL) {
+        perror("Error allocating memory for latencies");
+        return false;
+    }
+
+    struct timespec start_time, end_time, sent_time, received_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    size_t recorded = 0;
+    for (long long i = 0; i < count; i++) {
+        IntegrationJob request = *job;
+        if (distinct)
+            request.end += (double)i * CLIENT_BENCH_SHIFT;
+
+        IntegrationResult result;
+        clock_gettime(CLOCK_MONOTONIC, &sent_time);
+        const IntegrationStatus status =
+            ring != NULL
+                ? client_ring_integrate(ring, integrand, &request, &result)
+                : client_integrate(client, integrand, &request, &result);
+        clock_gettime(CLOCK_MONOTONIC, &received_time);
+
+        if (status == INTEGRATION_ERROR) {
+            free(samples);
+            return false;
+        }
+
+        latency->requests++;
+        if (status != INTEGRATION_OK)
+            latency->failures++;
+        if (result.cached)
+            latency->cached++;
+
+        const double elapsed_us =
+            timespec_diff_ms(&sent_time, &received_time) * 1000.0;
+        if (elapsed_us > latency->max_us)
+            latency->max_us = elapsed_us;
+        if (recorded < capacity)
+            samples[recorded++] = elapsed_us;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    latency->elapsed_ms = timespec_diff_ms(&start_time, &end_time);
+
+    qsort(samples, recorded, sizeof(double), compare_latencies);
+    latency->p50_us = percentile(samples, recorded, 0.50);
+    latency->p99_us = percentile(samples, recorded, 0.99);
+    latency->p999_us = percentile(samples, recorded, 0.999);
+
+    free(samples);
+    return true;
+}
+
+
+/**
+ * Keeps the submission ring full with distinct integration requests and
+ * measures the latency of each from submission to the arrival of its
+ * response. The start of the interval is shifted by `CLIENT_BENCH_SHIFT` per
+ * request, so the jobs differ from those of client_benchmark().
+ *
+ * @param ring The ring client.
+ * @param integrand The integrand in Reverse Polish Notation.
+ * @param job The parameters of the integration.
+ * @param count The number of requests.
+ * @param latency Output pointer for the measurements.
+ * @return true on success, false if memory ran out or the daemon detached
+ * the segment.
+ */
+bool client_ring_pipeline(RingClient* ring, const char* integrand,
+                          const IntegrationJob* job, const long long count,
+                          ClientLatency* latency) {
+    memset(latency, 0, sizeof(*latency));
+    if (count <= 0)
+        return true;
+
+    const size_t capacity = count < CLIENT_BENCH_MAX_SAMPLES
+                                ? (size_t)count
+                                : CLIENT_BENCH_MAX_SAMPLES;
+    double* samples = malloc(capacity * sizeof(double));
+    if (samples == NULL) {
+        perror("Error allocating memory for latencies");
+        return false;
+    }
+
+    // At most RING_ENTRIES requests are in flight, so their tags modulo
+    // RING_ENTRIES are distinct.
+    struct timespec sent_times[RING_ENTRIES];
+    struct timespec start_time, end_time, received_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    long long submitted = 0;
+    size_t recorded = 0;
+    while (latency->requests < count) {
+        while (submitted < count &&
+               submitted - latency->requests < RING_ENTRIES) {
+            IntegrationJob request = *job;
+            request.start -= (double)submitted * CLIENT_BENCH_SHIFT;
+
+            const uint64_t tag = ring->client.next_tag;
+            clock_gettime(CLOCK_MONOTONIC, &sent_times[tag % RING_ENTRIES]);
+            uint64_t submitted_tag;
+            if (!client_ring_submit(ring, integrand, &request, &submitted_tag))
+                break;
+            submitted++;
+        }
+
+        ProtocolResponse response;
+        if (!client_ring_wait(ring, &response)) {
+            free(samples);
+            return false;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &received_time);
+
+        IntegrationResult result;
+        const IntegrationStatus status =
+            protocol_decode_result(&response, &result);
+        latency->requests++;
+        if (status != INTEGRATION_OK)
+            latency->failures++;
+        if (result.cached)
+            latency->cached++;
+
+        const double elapsed_us =
+            timespec_diff_ms(&sent_times[response.tag % RING_ENTRIES],
+                             &received_time) *
+            1000.0;
+        if (elapsed_us > latency->max_us)
+            latency->max_us = elapsed_us;
+        if (recorded < capacity)
+            samples[recorded++] = elapsed_us;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    latency->elapsed_ms = timespec_diff_ms(&start_time, &end_time);
+
+    qsort(samples, recorded, sizeof(double), compare_latencies);
+    latency->p50_us = percentile(samples, recorded, 0.50);
+    latency->p99_us = percentile(samples, recorded, 0.99);
+    latency->p999_us = percentile(samples, recorded, 0.999);
+
+    free(samples);
+    return true;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file client.h
+ * @brief Header file for the client of the integration daemon.
+ *
+ * A client holds one connection to a daemon and sends requests over it one at
+ * a time, waiting for each response before returning. A ring client
+ * additionally attaches a shared-memory segment to its connection and
+ * exchanges requests and responses through its rings, without system calls
+ * while the daemon is awake. This module also contains the latency benchmark
+ * driven by the `--bench` option.
+ */
+
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "integral.h"
+#include "protocol.h"
+#include "ring.h"
+#include "worker_pool.h"
+
+
+#define CLIENT_BENCH_MAX_SAMPLES 100000
+#define CLIENT_BENCH_SHIFT 1E-09
+#define CLIENT_RING_SPIN 20000
+
+
+/**
+ * @struct Client
+ * @brief A connection to the integration daemon.
+ *
+ * `priority` is the PoolPriority class requested for the integrations sent
+ * through the connection, POOL_PRIORITY_NORMAL unless the caller changes it.
+ */
+typedef struct Client {
+    int fd;
+    uint64_t next_tag;
+    PoolPriority priority;
+} Client;
+
+
+/**
+ * @struct RingClient
+ * @brief A connection to the integration daemon with an attached
+ * shared-memory segment.
+ *
+ * `submit_head` and `complete_tail` are the client's copies of the ring
+ * positions it owns. `spin` is the number of polls before waiting sleeps:
+ * `CLIENT_RING_SPIN`, or zero on a single processor. The connection stays
+ * open while the segment is in use; closing it detaches the segment.
+ */
+typedef struct RingClient {
+    Client client;
+    int fd;
+    RingSegment* segment;
+    uint32_t submit_head;
+    uint32_t complete_tail;
+    int spin;
+} RingClient;
+
+
+/**
+ * @struct ClientLatency
+ * @brief The outcome of a benchmark phase. Latencies are in microseconds and
+ * measured from sending a request to receiving its response.
+ *
+ * Percentiles are computed over the first `CLIENT_BENCH_MAX_SAMPLES`
+ * requests.
+ */
+typedef struct ClientLatency {
+    long long requests;
+    long long failures;
+    long long cached;
+    double elapsed_ms;
+    double p50_us;
+    double p99_us;
+    double p999_us;
+    double max_us;
+} ClientLatency;
+
+
+bool client_connect(Client* client, const char* path);
+
+void client_close(Client* client);
+
+bool client_ping(Client* client);
+
+bool client_stats(Client* client, ProtocolStats* stats);
+
+IntegrationStatus client_integrate(Client* client, const char* integrand,
+                                   const IntegrationJob* job,
+                                   IntegrationResult* result);
+
+bool client_ring_attach(RingClient* ring, const char* path);
+
+void client_ring_detach(RingClient* ring);
+
+bool client_ring_submit(RingClient* ring, const char* integrand,
+                        const IntegrationJob* job, uint64_t* tag);
+
+bool client_ring_poll(RingClient* ring, ProtocolResponse* response);
+
+bool client_ring_wait(RingClient* ring, ProtocolResponse* response);
+
+IntegrationStatus client_ring_integrate(RingClient* ring,
+                                        const char* integrand,
+                                        const IntegrationJob* job,
+                                        IntegrationResult* result);
+
+bool client_benchmark(Client* client, RingClient* ring, const char* integrand,
+                      const IntegrationJob* job, long long count,
+                      bool distinct, ClientLatency* latency);
+
+bool client_ring_pipeline(RingClient* ring, const char* integrand,
+                          const IntegrationJob* job, long long count,
+                          ClientLatency* latency);
+
+
+#endif /* CLIENT_H */
@@ -0,0 +1,171 @@
+/**
+ * @file coalesce.c
+ * @brief Implements request coalescing.
+ */
+
+
+#include "coalesce.h"
+
+#include <string.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * Initialises an empty coalescing table.
+ *
+ * @param table The table.
+ */
+void coalesce_init(CoalesceTable* table) {
+    memset(table, 0, sizeof(*table));
+}
+
+
+/**
+ * Tells whether two entries have the same canonical key.
+ *
+ * @param entry An entry.
+ * @param other Another entry.
+ * @return true if the keys are equal.
+ */
+static bool same_key(const CoalesceEntry* entry, const CoalesceEntry* other) {
+    return entry->key.hash == other->key.hash &&
+           entry->key.length == other->key.length &&
+           memcmp(entry->key.data, other->key.data, entry->key.length) == 0;
+}
+
+
+/**
+ * Adds a request to the table. If a leader with the same key is in flight,
+ * the request becomes its follower; otherwise it becomes a leader itself and
+ * must be computed and passed to coalesce_finish().
+ *
+ * @param table The table.
+ * @param entry The entry of the request, with `key`, `keyed` and `context`
+ * filled in.
+ * @return The leader the request was attached to, or NULL if the request is
+ * a leader.
+ */
+CoalesceEntry* coalesce_join(CoalesceTable* table, CoalesceEntry* entry) {
+    entry->next = nullptr;
+    entry->followers = nullptr;
+    entry->last_follower = nullptr;
+    entry->next_follower = nullptr;
+    entry->group = 1;
+
+    if (entry->keyed) {
+        CoalesceEntry** bucket =
+            &table->buckets[entry->key.hash % COALESCE_BUCKETS];
+        for (CoalesceEntry* leader = *bucket; leader != NULL;
+             leader = leader->next) {
+            if (!same_key(leader, entry))
+                continue;
+
+            if (leader->last_follower != NULL)
+                leader->last_follower->next_follower = entry;
+            else
+                leader->followers = entry;
+            leader->last_follower = entry;
+            leader->group++;
+
+            table->stats.coalesced++;
+            if (leader->group > table->stats.largest_group)
+                table->stats.largest_group = leader->group;
+            return leader;
+        }
+
+        entry->next = *bucket;
+        *bucket = entry;
+    }
+
+    table->stats.computations++;
+    table->stats.in_flight++;
+    if (table->stats.largest_group < 1)
+        table->stats.largest_group = 1;
+    return nullptr;
+}
+
+
+/**
+ * Removes a computed leader from the table, so later requests of its key
+ * start a new computation.
+ *
+ * @param table The table.
+ * @param leader The leader, as passed to coalesce_join().
+ * @return The first of the leader's followers in arrival order, linked
+ * through `next_follower`, or NULL if none attached.
+ */
+CoalesceEntry* coalesce_finish(CoalesceTable* table, CoalesceEntry* leader) {
+    table->stats.in_flight--;
+    if (!leader->keyed)
+        return nullptr;
+
+    CoalesceEntry** link = &table->buckets[leader->key.hash % COALESCE_BUCKETS];
+    while (*link != NULL && *link != leader)
+        link = &(*link)->next;
+    if (*link != NULL)
+        *link = leader->next;
+
+    CoalesceEntry* followers = leader->followers;
+    leader->next = nullptr;
+    leader->followers = nullptr;
+    leader->last_follower = nullptr;
+    return followers;
+}
+
+
+/**
+ * Integrates several requests, computing every distinct canonical request
+ * only once. Each computation is answered from the result cache if it is
+ * open and stored in it otherwise, as in integrate_cached().
+ *
+ * @param requests The requests, with `expression` and `job` filled in; every
+ * expression must be a valid parsed tree.
+ * @param count The number of requests.
+ * @param stats Output pointer for the coalescing counters of the call, or
+ * NULL.
+ */
+void integrate_requests(CoalesceRequest requests[], const size_t count,
+                        CoalesceStats* stats) {
+    CoalesceTable table;
+    coalesce_init(&table);
+
+    for (size_t i = 0; i < count; i++) {
+        CoalesceRequest* request = &requests[i];
+        request->entry.context = request;
+        const bool stoppable =
+            request->job.deadline_ms > 0 || request->job.cancel != NULL;
+        request->entry.keyed = cache_make_key(&request->entry.key,
+                                              request->expression,
+                                              &request->job) &&
+                               !stoppable;
+        request->coalesced =
+            coalesce_join(&table, &request->entry) != NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        CoalesceRequest* leader = &requests[i];
+        if (leader->coalesced)
+            continue;
+
+        if (leader->entry.keyed &&
+            cache_lookup(&leader->entry.key, &leader->result)) {
+            leader->status = leader->result.status;
+        } else {
+            leader->status = integrate_expression(
+                leader->expression, &leader->job, &leader->result);
+            if (leader->entry.keyed)
+                cache_store(&leader->entry.key, &leader->result);
+        }
+
+        for (CoalesceEntry* entry = coalesce_finish(&table, &leader->entry);
+             entry != NULL; entry = entry->next_follower) {
+            CoalesceRequest* follower = entry->context;
+            follower->result = leader->result;
+            follower->status = leader->status;
+        }
+    }
+
+    if (stats != NULL)
+        *stats = table.stats;
+}
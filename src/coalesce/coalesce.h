@@ -0,0 +1,107 @@
+/**
+ * @file coalesce.h
+ * @brief Header file for request coalescing, which lets identical integrations
+ * that are in flight at the same time share one computation.
+ *
+ * Requests are identified by their canonical cache key, so integrands that
+ * differ only in spacing or in the spelling of their numbers coalesce. The
+ * first request of a key becomes the leader and is computed; requests of the
+ * same key that arrive before it completes become its followers and receive a
+ * copy of its result.
+ *
+ * The table is intrusive: entries are embedded in the caller's requests and
+ * nothing is allocated. A table must only be used from one thread.
+ */
+
+
+#ifndef COALESCE_H
+#define COALESCE_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cache.h"
+#include "expression_parser.h"
+#include "integral.h"
+
+
+#define COALESCE_BUCKETS 1024
+
+
+/**
+ * @struct CoalesceEntry
+ * @brief The coalescing state of one request.
+ *
+ * `key` is the canonical key of the request; requests without a key
+ * (`keyed` false) are always computed on their own. A leader is linked into
+ * its bucket through `next` and holds its followers through `followers`,
+ * which are linked through `next_follower`. `group` counts the requests a
+ * leader serves, itself included. `context` is left to the caller.
+ */
+typedef struct CoalesceEntry {
+    CacheKey key;
+    bool keyed;
+    struct CoalesceEntry* next;
+    struct CoalesceEntry* followers;
+    struct CoalesceEntry* last_follower;
+    struct CoalesceEntry* next_follower;
+    long long group;
+    void* context;
+} CoalesceEntry;
+
+
+/**
+ * @struct CoalesceStats
+ * @brief Counters of a coalescing table.
+ *
+ * `computations` counts the leaders, `coalesced` the followers attached to a
+ * leader, `largest_group` the most requests served by one computation and
+ * `in_flight` the leaders not finished yet.
+ */
+typedef struct CoalesceStats {
+    long long computations;
+    long long coalesced;
+    long long largest_group;
+    long long in_flight;
+} CoalesceStats;
+
+
+/**
+ * @struct CoalesceTable
+ * @brief The leaders in flight, chained by the hash of their key.
+ */
+typedef struct CoalesceTable {
+    CoalesceEntry* buckets[COALESCE_BUCKETS];
+    CoalesceStats stats;
+} CoalesceTable;
+
+
+/**
+ * @struct CoalesceRequest
+ * @brief A request of integrate_requests().
+ *
+ * `coalesced` is set if the result was copied from an identical request
+ * instead of being computed.
+ */
+typedef struct CoalesceRequest {
+    Node* expression;
+    IntegrationJob job;
+    IntegrationResult result;
+    IntegrationStatus status;
+    bool coalesced;
+    CoalesceEntry entry;
+} CoalesceRequest;
+
+
+void coalesce_init(CoalesceTable* table);
+
+CoalesceEntry* coalesce_join(CoalesceTable* table, CoalesceEntry* entry);
+
+CoalesceEntry* coalesce_finish(CoalesceTable* table, CoalesceEntry* leader);
+
+void integrate_requests(CoalesceRequest requests[], size_t count,
+                        CoalesceStats* stats);
+
+
+#endif /* COALESCE_H */
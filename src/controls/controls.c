@@ -1,73 +1,21 @@
 /**
  * @file controls.c
- * @brief Contains functions for validating integrands and intervals, managing
- * user input, and handling memory for numerical integration tasks.
+ * @brief Contains functions for managing user input, integrating the entered
+ * or saved functions and handling memory for numerical integration tasks.
  *
- * This file provides functionality to validate mathematical expressions, manage
- * user input, and perform numerical integration tasks. It includes functions
- * for validating integrands, intervals, and partition refinements, as well as
- * memory management for dynamically allocated resources.
+ * This file provides the interactive front end of the program: it prompts for
+ * the partition refinement, integrates the functions entered in the graphical
+ * user interface or saved in the functions file and prints the results. The
+ * validation, parsing and integration itself is done by the GTK-independent
+ * core in the parser and integrator modules.
  */
 
 
 #include "controls.h"
-#include "debugmalloc.h"
-
-
-double timespec_diff_ms(const struct timespec* start,
-                        const struct timespec* end) {
-    return (end->tv_sec - start->tv_sec) * 1000.0 +
-           (end->tv_nsec - start->tv_nsec) / 1000000.0;
-}
-
-
-/**
- * Validates the given integrand to ensure it meets the maximum allowed length
- * constraint.
- *
- * @param integrand A constant character pointer representing the mathematical
- * integrand to be validated.
- * @return true if the integrand length is within the allowed limit defined by
- * MAX_INTEGRAND_LENGTH, false otherwise.
- */
-bool validate_integrand(const char* integrand) {
-    if (strlen(integrand) > MAX_INTEGRAND_LENGTH) {
-        printf("The integrand is too long.\n");
-        return false;
-    }
-    return true;
-}
-
-
-/**
- * Validates a given interval string and extracts the start and end points.
- *
- * This function checks whether the interval string is properly defined and
- * parses the interval into numerical start and end points. If the start and end
- * points are equal, it considers the interval invalid for integration.
- *
- * @param interval The interval string in the format "[start ; end]". It should
- * contain numerical values for start and end separated by a semicolon.
- * @param start Pointer to a double where the parsed start value will be stored.
- * @param end Pointer to a double where the parsed end value will be stored.
- * @return Returns true if the interval is valid; otherwise, returns false.
- */
-bool validate_interval(const char* interval, double* start, double* end) {
-    if (strcmp(interval, "[ ; ]") == 0) {
-        printf("The interval is not defined.\n");
-        return false;
-    }
 
-    sscanf(interval, "[%lf ; %lf]", start, end);
+#include "gui.h"
 
-    if (*start == *end) {
-        printf(
-            "Integrating in a [c; c] interval is defined to be equal to 0.\n");
-        return false;
-    }
-
-    return true;
-}
+#include "debugmalloc.h"
 
 
 /**
@@ -99,88 +47,6 @@ int get_partition_refinement() {
 }
 
 
-/**
- * @brief Prints a signed value to the standard output.
- *
- * This function formats the output of a double value, allowing for
- * the possibility of negating the value based on the `minus` flag.
- *
- * @param minus A boolean flag indicating whether to negate the value.
- * @param value The double value to be printed.
- */
-void print_signed_value(const bool minus, const double value) {
-    printf("%.8f\n", minus ? -value : value);
-}
-
-
-/**
- * Logs the computed integral values to the standard output.
- *
- * This function prints the Riemann sum, lower Darboux sum, upper Darboux sum,
- * the difference between the upper and lower sums, and the average of the two
- * approximations. If the `minus` flag is set, it negates the output values.
- *
- * @param minus A boolean flag indicating whether to negate the output values.
- * @param Riemann_sum The computed Riemann sum of the integral.
- * @param lower_Darboux_sum The computed lower Darboux sum of the integral.
- * @param upper_Darboux_sum The computed upper Darboux sum of the integral.
- * @param times_elapsed Optional pointer to a double array where the elapsed
- * times can be stored.
- */
-void log_integral_values(const bool minus, const double Riemann_sum,
-                         const double lower_Darboux_sum,
-                         const double upper_Darboux_sum,
-                         const double* times_elapsed) {
-    printf("Riemann-sum = ");
-    print_signed_value(minus, Riemann_sum);
-    printf("Time spent on Riemann-sum calculation = %.4f ms (= %.6f sec)\n\n",
-           times_elapsed[0], times_elapsed[0] / 1000.0);
-
-    printf("Lower Darboux-sum = ");
-    print_signed_value(minus, lower_Darboux_sum);
-    printf("Time spent on lower Darboux-sum calculation = %.4f ms (= %.6f "
-           "sec)\n\n",
-           times_elapsed[1], times_elapsed[1] / 1000.0);
-
-    printf("Upper Darboux-sum = ");
-    print_signed_value(minus, upper_Darboux_sum);
-    printf("Time spent on upper Darboux-sum calculation = %.4f ms (= %.6f "
-           "sec)\n\n",
-           times_elapsed[2], times_elapsed[2] / 1000.0);
-
-    const double Darboux_difference =
-        fabs(upper_Darboux_sum - lower_Darboux_sum);
-    printf("Difference between Darboux-sums = %.6f\n", Darboux_difference);
-
-    const double average = (upper_Darboux_sum + lower_Darboux_sum) / 2;
-    printf("Average of the Darboux-sums = %.6f\n\n",
-           minus ? -average : average);
-
-    const double difference = fabs(average - Riemann_sum);
-    printf("Difference between Riemann-sum and average of the Darboux-sums = "
-           "%.6f\n\n",
-           difference);
-}
-
-
-/**
- * Recursively deallocates memory associated with nodes of a binary tree.
- * This function traverses the binary tree in a post-order manner,
- * freeing memory for each left subtree, right subtree, and finally the parent
- * node.
- *
- * @param node Pointer to the root node of the binary tree to be freed.
- */
-void free_tree(Node* node) {
-    if (node) {
-        free_tree(node->left);
-        free_tree(node->right);
-        free(node);
-        node = nullptr;
-    }
-}
-
-
 /**
  * Frees allocated memory for the given resources.
  *
@@ -199,92 +65,6 @@ void free_resources(char* integrand, char* interval, Node* expression) {
 }
 
 
-/**
- * Reads the last two lines of a file and stores them in the provided pointers.
- * Memory for the lines is dynamically allocated and must be freed by the
- * caller.
- *
- * @param filename Name of the file to read from.
- * @param last Pointer to a char pointer where the last line of the file will be
- * stored.
- * @param second_last Pointer to a char pointer where the second-to-last line of
- * the file will be stored.
- */
-void read_last_two_lines(const char* filename, char** last,
-                         char** second_last) {
-    FILE* file = fopen(filename, "r");
-
-    if (file == NULL) {
-        perror("Error opening file");
-        return;
-    }
-
-    char* last_line = nullptr;
-    char* second_last_line = nullptr;
-    int size = INITIAL_SIZE;
-
-    last_line = (char*)malloc(size * sizeof(char) + 1);
-    second_last_line = (char*)malloc(size * sizeof(char) + 1);
-
-    if (last_line == NULL || second_last_line == NULL) {
-        perror("Did not manage to allocate memory");
-        return;
-    }
-
-    last_line[0] = '\0';
-    second_last_line[0] = '\0';
-
-    while (fgets(last_line, size, file) != NULL) {
-        if (last_line[strlen(last_line) - 1] == '\n') {
-            char* temp = last_line;
-            last_line = second_last_line;
-            second_last_line = temp;
-        } else {
-            size *= 2;
-            last_line = (char*)realloc(last_line, size * sizeof(char));
-            second_last_line =
-                (char*)realloc(second_last_line, size * sizeof(char));
-
-            if (last_line == NULL || second_last_line == NULL) {
-                perror("Did not manage to allocate memory");
-                return;
-            }
-        }
-    }
-
-    *last = last_line;
-    *second_last = second_last_line;
-
-    fclose(file);
-}
-
-
-/**
- * @brief Removes leading and trailing spaces from a given string and compresses
- * the string. The trimmed string is stored in the same memory location as the
- * input string.
- *
- * @param str The input string from which spaces are to be removed.
- *            After execution, the string will no longer contain leading or
- * trailing spaces.
- */
-void remove_spaces(char* str) {
-    size_t start = 0;
-    size_t end = strlen(str) - 1;
-
-    while (isspace(str[start]))
-        start++;
-
-    while (end > start && isspace(str[end]))
-        end--;
-
-    size_t i, j;
-    for (i = start, j = 0; i <= end; i++, j++)
-        str[j] = str[i];
-    str[j] = '\0';
-}
-
-
 /**
  * @brief Prints the rules and guidelines for using the numerical integration
  * program.
@@ -329,8 +109,12 @@ void print_rules() {
  *
  * The menu includes:
  * - Option 1: Perform numerical integration.
- * - Option 2: List the functions that have been saved.
- * - Option 9: Exit the program.
+ * - Option 2: Integrate the last saved function.
+ * - Option 3: List the functions that have been saved.
+ * - Option 4: Integrate a saved function selected by its number.
+ * - Option 5: List a range of the saved functions.
+ * - Option 6: Search the saved functions for a piece of text.
+ * - Other: Exit the program.
  *
  * It provides clear instructions for interacting with the program's interface.
  */
@@ -339,64 +123,210 @@ void print_menu() {
            "\t 1. Numerical integration\n"
            "\t 2. Integrate the last saved function\n"
            "\t 3. List the functions that have been saved\n"
+           "\t 4. Integrate a saved function by its number\n"
+           "\t 5. List a range of the saved functions\n"
+           "\t 6. Search the saved functions\n"
            "\t Other: Exit\n\n"
            "To execute a task, enter a number chosen from above: ");
 }
 
 
 /**
- * Performs numerical integration by reading configuration from a file and
- * processing the integrand and interval through a graphical user interface.
+ * @brief Computes the numerical integral of a given mathematical expression.
+ *
+ * This function performs numerical integration for a given mathematical
+ * expression (`integrand`) over a specified interval (`interval`). It
+ * validates the input, interprets the function, and calculates the
+ * integral using numerical methods. If the input is invalid or any errors
+ * occur during computation, the function will free the associated resources
+ * and terminate gracefully.
+ *
+ * The function allows integration over intervals, and handles cases where the
+ * start of the interval is greater than the end by adjusting the interval and
+ * returning the negated result as needed.
+ *
+ * @param integrand A string representing the mathematical function to be
+ *                  integrated. The function is expected to be a valid
+ *                  mathematical expression.
+ * @param interval A string representing the interval over which the integral
+ *                 is to be computed, formatted as "[start ; end]".
+ */
+void integrate(char* integrand, char* interval) {
+    remove_spaces(integrand);
+
+    if (!validate_integrand(integrand) || !validate_expression(integrand)) {
+        free_resources(integrand, interval, nullptr);
+        return;
+    }
+
+    double start, end;
+
+    if (!validate_interval(interval, &start, &end)) {
+        free_resources(integrand, interval, nullptr);
+        return;
+    }
+
+    // The number of subintervals for the partitioning of the interval
+    const int refinement = get_partition_refinement();
+    if (refinement == -1) {
+        free_resources(integrand, interval, nullptr);
+        return;
+    }
+
+    // parse() splits its argument in place, the text is kept for the journal
+    char integrand_text[MAX_INTEGRAND_LENGTH + 1];
+    strcpy(integrand_text, integrand);
+
+    Node* expression = parse(integrand);
+    if (!expression) {
+        perror("Error parsing expression.\n");
+        free_resources(integrand, interval, nullptr);
+        return;
+    }
+
+    const IntegrationJob job = {.start = start,
+                                .end = end,
+                                .refinement = refinement,
+                                .tolerance = 0,
+                                .methods = METHOD_ALL,
+                                .threads = 1};
+    IntegrationResult result;
+    integrate_cached(expression, &job, &result);
+
+    const ResultRecord record = {.id = nullptr,
+                                 .id_is_number = false,
+                                 .integrand = integrand_text,
+                                 .label = nullptr,
+                                 .result = &result};
+    ResultWriter writer;
+    report_begin(&writer, stdout, REPORT_TEXT);
+    report_write(&writer, &record);
+    journal_append(&record);
+    free_resources(integrand, interval, expression);
+}
+
+/**
+ * Performs numerical integration through the graphical user interface. The
+ * interface saves every integrand and interval it integrates to the file,
+ * integrates them in the background and shows the results itself; this
+ * function returns once its window is closed.
  *
  * @param argc The number of command-line arguments passed to the program.
  * @param argv An array of command-line arguments passed to the program.
- * @param filename The path to the file containing the integrand and interval
- *        for integration.
+ * @param filename The path to the file the interface saves the integrands and
+ *        intervals to.
  */
 void numerical_integration(int argc, char* argv[], const char* filename) {
-    run_gui(&argc, &argv);
-    char *integrand, *interval;
-    read_last_two_lines(filename, &integrand, &interval);
-    integrate(integrand, interval);
+    run_gui(&argc, &argv, filename);
 }
 
 
 /**
- * Reads the content of a file and writes it to the standard output stream.
+ * Writes the content of a file to the standard output stream. The file is
+ * mapped into memory and written directly, without line-by-line copies.
  *
  * @param filename A pointer to a null-terminated string specifying the path to
  * the file to be read.
- * @return Returns 0 on successful completion. On failure to open the file, it
- * produces an error message via `perror`.
  */
 void log_file_content(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        perror("Error opening file.\n");
-        return;
-    }
-
-    char buffer[1024];
-    while (fgets(buffer, sizeof(buffer), file) != NULL)
-        printf("%s", buffer);
-
-    fclose(file);
+    history_dump(filename);
 }
 
 
 /**
  * Integrates the last saved function from a file by reading the integrand and
- * interval, and then performing the integration.
+ * interval of its last complete record, and then performing the integration.
  *
  * @param filename The path to the file containing the last saved integrand and
  * interval.
  */
 void integrate_last(const char* filename) {
     char *integrand, *interval;
-    read_last_two_lines(filename, &integrand, &interval);
+    if (!history_get_last(filename, &integrand, &interval))
+        return;
 
-    printf("Function to integrate: %s", integrand);
+    printf("Function to integrate: %s\n", integrand);
     printf("Interval: %s\n", interval);
 
     integrate(integrand, interval);
 }
+
+
+/**
+ * Integrates a saved function selected by its number. The user is prompted for
+ * the number of the record, which is then fetched through the history index
+ * without scanning the file.
+ *
+ * @param filename The path to the file containing the saved integrands and
+ * intervals.
+ */
+void integrate_saved(const char* filename) {
+    const long long count = history_count(filename);
+    if (count <= 0) {
+        printf("There are no saved functions.\n");
+        return;
+    }
+
+    long long number;
+    printf("Enter the number of the saved function (x in [1 ; %lld]): ",
+           count);
+    if (scanf("%lld", &number) != 1) {
+        printf("Error: The number of the saved function is invalid.\n");
+        return;
+    }
+
+    char *integrand, *interval;
+    if (!history_get(filename, number, &integrand, &interval))
+        return;
+
+    printf("Function to integrate: %s\n", integrand);
+    printf("Interval: %s\n", interval);
+
+    integrate(integrand, interval);
+}
+
+
+/**
+ * Lists a range of the saved functions. The user is prompted for the numbers
+ * of the first and last records, and only that page of the file is read.
+ *
+ * @param filename The path to the file containing the saved integrands and
+ * intervals.
+ */
+void list_saved_range(const char* filename) {
+    const long long count = history_count(filename);
+    if (count <= 0) {
+        printf("There are no saved functions.\n");
+        return;
+    }
+
+    long long first, last;
+    printf("Enter the range of saved functions to list (first and last in "
+           "[1 ; %lld]): ",
+           count);
+    if (scanf("%lld %lld", &first, &last) != 2) {
+        printf("Error: The range of saved functions is invalid.\n");
+        return;
+    }
+
+    history_list(filename, first, last, nullptr);
+}
+
+
+/**
+ * Lists the saved functions whose integrand or interval contains a pattern
+ * entered by the user. The records are filtered by scanning the mapped file.
+ *
+ * @param filename The path to the file containing the saved integrands and
+ * intervals.
+ */
+void search_saved(const char* filename) {
+    char pattern[MAX_INTEGRAND_LENGTH + 1];
+    printf("Enter the text to search for: ");
+    if (scanf(" %100[^\n]", pattern) != 1) {
+        printf("Error: The search text is invalid.\n");
+        return;
+    }
+
+    history_list(filename, 1, LLONG_MAX, pattern);
+}
@@ -1,8 +1,8 @@
 /**
  * @file controls.h
  * @brief Header file for the controls module, which includes function
- * declarations for validating input, performing numerical integration, and
- * managing resources.
+ * declarations for prompting for input, performing interactive numerical
+ * integration, and managing resources.
  *
  * This module is part of a numerical integration program that allows users to
  * compute integrals using various methods and manage input/output operations.
@@ -13,36 +13,25 @@
 #define CONTROLS_H
 
 
+#include <limits.h>
+
+#include "cache.h"
 #include "expression_parser.h"
-#include "gui.h"
+#include "history.h"
 #include "integral.h"
+#include "journal.h"
+#include "report.h"
 
 
-#define INITIAL_SIZE 256
-
-
-// Used for the integrator module:
-
-double timespec_diff_ms(const struct timespec* start,
-                        const struct timespec* end);
-
-bool validate_integrand(const char* integrand);
-
-bool validate_interval(const char* interval, double* start, double* end);
+// Used for the interactive integration:
 
 int get_partition_refinement();
 
-void print_signed_value(bool minus, double value);
-
-void log_integral_values(bool minus, double Riemann_sum,
-                         double lower_Darboux_sum, double upper_Darboux_sum,
-                         const double* times_elapsed);
+void integrate(char* integrand, char* interval);
 
 
 // Resource memory deallocation:
 
-void free_tree(Node* node);
-
 void free_resources(char* integrand, char* interval, Node* expression);
 
 
@@ -56,14 +45,16 @@ void numerical_integration(int argc, char* argv[], const char* filename);
 
 void integrate_last(const char* filename);
 
+void integrate_saved(const char* filename);
 
-// File and string operations:
+void list_saved_range(const char* filename);
 
-void log_file_content(const char* filename);
+void search_saved(const char* filename);
 
-void read_last_two_lines(const char* filename, char** last, char** second_last);
 
-void remove_spaces(char* str);
+// File operations:
+
+void log_file_content(const char* filename);
 
 
 #endif /* CONTROLS_H */
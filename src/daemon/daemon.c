@@ -0,0 +1,1429 @@
+/**
+ * @file daemon.c
+ * @brief Implementation of the integration daemon.
+ *
+ * One thread runs an epoll event loop over the listening socket, the client
+ * connections, an eventfd signalled by the workers, an eventfd signalled by
+ * the handler of SIGINT and SIGTERM and an eventfd signalled by the doorbell
+ * threads of attached shared-memory segments. All allocation, parsing, cache
+ * and journal access happens on this thread; the workers only evaluate the
+ * parsed trees.
+ */
+
+
+#define _GNU_SOURCE // accept4
+
+#include "daemon.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+/* The daemon is a process-wide singleton, like the cache and the journal. */
+static Daemon server;
+
+/* Addresses identifying the non-connection descriptors in epoll events. */
+static char listener_marker;
+static char completion_marker;
+static char signal_marker;
+static char doorbell_marker;
+
+
+/**
+ * Hashes an integrand with FNV-1a to pick its slot in the expression table.
+ *
+ * @param text The integrand without spaces.
+ * @return The 64-bit hash.
+ */
+static uint64_t hash_text(const char* text) {
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    for (const unsigned char* c = (const unsigned char*)text; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+
+/**
+ * Fills in a Unix domain socket address.
+ *
+ * @param address The address to fill in.
+ * @param path The path of the socket.
+ * @return true on success, false if the path is too long.
+ */
+static bool socket_address(struct sockaddr_un* address, const char* path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+
+/**
+ * Creates the listening socket. A socket file left behind by a daemon that
+ * no longer runs is replaced; a socket with a live daemon behind it is not.
+ *
+ * @param path The path of the socket.
+ * @return true on success, false otherwise.
+ */
+static bool open_listener(const char* path) {
+    struct sockaddr_un address;
+    if (!socket_address(&address, path))
+        return false;
+
+    const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) {
+        perror("Error creating socket");
+        return false;
+    }
+    const int connected =
+        connect(probe, (struct sockaddr*)&address, sizeof(address));
+    const int probe_error = errno;
+    close(probe);
+
+    if (connected == 0) {
+        fprintf(stderr, "A daemon is already listening on %s\n", path);
+        return false;
+    }
+    if (probe_error == ECONNREFUSED && unlink(path) != 0) {
+        perror("Error removing stale socket");
+        return false;
+    }
+
+    server.listen_fd =
+        socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server.listen_fd < 0) {
+        perror("Error creating socket");
+        return false;
+    }
+
+    // Only the owner may connect.
+    const mode_t mask = umask(0177);
+    const int bound =
+        bind(server.listen_fd, (struct sockaddr*)&address, sizeof(address));
+    umask(mask);
+
+    if (bound != 0 || listen(server.listen_fd, DAEMON_LISTEN_BACKLOG) != 0) {
+        perror("Error listening on socket");
+        close(server.listen_fd);
+        server.listen_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Adds a descriptor to the epoll set.
+ *
+ * @param fd The descriptor.
+ * @param data The pointer returned with its events.
+ * @param events The events of interest.
+ * @return true on success, false otherwise.
+ */
+static bool watch(const int fd, void* data, const uint32_t events) {
+    struct epoll_event event = {.events = events, .data.ptr = data};
+    if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        perror("Error adding descriptor to epoll");
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Queues a connection to be serviced at the end of the current iteration.
+ *
+ * @param connection The connection.
+ */
+static void mark_dirty(DaemonConnection* connection) {
+    if (connection->dirty)
+        return;
+
+    connection->dirty = true;
+    connection->next_dirty = server.dirty;
+    server.dirty = connection;
+}
+
+
+/**
+ * Forwards the wake-ups of the daemon's doorbell in a shared-memory segment to
+ * the event loop. The client only rings the doorbell while the event loop is
+ * about to sleep, so this thread is idle while the daemon polls the rings.
+ *
+ * @param argument The connection the segment is attached to.
+ * @return NULL.
+ */
+static void* ring_doorbell(void* argument) {
+    DaemonConnection* connection = argument;
+    RingDoorbell* doorbell = &connection->segment->daemon;
+    uint32_t seen =
+        atomic_load_explicit(&doorbell->sequence, memory_order_acquire);
+
+    for (;;) {
+        ring_sleep(doorbell, seen);
+        if (atomic_load(&connection->detaching))
+            return nullptr;
+
+        const uint32_t sequence =
+            atomic_load_explicit(&doorbell->sequence, memory_order_acquire);
+        if (sequence == seen)
+            continue;
+        seen = sequence;
+
+        const uint64_t increment = 1;
+        if (write(server.doorbell_fd, &increment, sizeof(increment)) < 0)
+            perror("Error signalling the event loop");
+    }
+}
+
+
+/**
+ * Creates a shared-memory segment for a connection and starts its doorbell
+ * thread.
+ *
+ * @param connection The connection.
+ * @return 0 on success, otherwise an errno value.
+ */
+static int attach_ring(DaemonConnection* connection) {
+    connection->segment = ring_create(&connection->segment_fd);
+    if (connection->segment == NULL)
+        return ENOMEM;
+
+    connection->submit_tail = 0;
+    connection->complete_head = 0;
+    connection->ring_in_flight = 0;
+    atomic_store(&connection->detaching, false);
+
+    const int error = pthread_create(&connection->doorbell, nullptr,
+                                     ring_doorbell, connection);
+    if (error != 0) {
+        ring_unmap(connection->segment);
+        close(connection->segment_fd);
+        connection->segment = nullptr;
+        connection->segment_fd = -1;
+        return error;
+    }
+
+    server.rings++;
+    return 0;
+}
+
+
+/**
+ * Detaches the shared-memory segment of a connection: marks it closed for the
+ * client, stops the doorbell thread and unmaps it. Responses to ring requests
+ * still in flight are dropped.
+ *
+ * @param connection The connection.
+ */
+static void detach_ring(DaemonConnection* connection) {
+    if (connection->segment == NULL)
+        return;
+
+    RingSegment* segment = connection->segment;
+    atomic_store(&connection->detaching, true);
+    atomic_store_explicit(&segment->closed, 1, memory_order_release);
+    ring_wake(&segment->daemon);
+    ring_wake(&segment->client);
+    pthread_join(connection->doorbell, nullptr);
+
+    ring_unmap(segment);
+    close(connection->segment_fd);
+    connection->segment = nullptr;
+    connection->segment_fd = -1;
+    server.rings--;
+}
+
+
+/**
+ * Closes the socket of a connection and detaches its shared-memory segment.
+ * The connection itself is released once it has no jobs in flight.
+ *
+ * @param connection The connection.
+ */
+static void close_connection(DaemonConnection* connection) {
+    if (connection->closed)
+        return;
+
+    detach_ring(connection);
+
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    close(connection->fd);
+    connection->closed = true;
+    connection->output_length = 0;
+    server.stats.open_connections--;
+    mark_dirty(connection);
+}
+
+
+/**
+ * Unlinks a closed connection from the list of connections and frees it.
+ *
+ * @param connection The connection.
+ */
+static void free_connection(DaemonConnection* connection) {
+    if (connection->previous != NULL)
+        connection->previous->next = connection->next;
+    else
+        server.connections = connection->next;
+    if (connection->next != NULL)
+        connection->next->previous = connection->previous;
+
+    free(connection);
+}
+
+
+/**
+ * Accepts every pending connection.
+ */
+static void accept_connections(void) {
+    for (;;) {
+        const int fd = accept4(server.listen_fd, nullptr, nullptr,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("Error accepting connection");
+            return;
+        }
+
+        DaemonConnection* connection = malloc(sizeof(DaemonConnection));
+        if (connection == NULL) {
+            perror("Error allocating memory for connection");
+            close(fd);
+            continue;
+        }
+
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+        connection->closed = false;
+        connection->dirty = false;
+        connection->in_flight = 0;
+        pool_client_init(&connection->pool_client);
+        connection->segment = nullptr;
+        connection->segment_fd = -1;
+        connection->ring_in_flight = 0;
+        connection->input_length = 0;
+        connection->output_length = 0;
+        connection->next_dirty = nullptr;
+
+        if (!watch(fd, connection, connection->events)) {
+            close(fd);
+            free(connection);
+            continue;
+        }
+
+        connection->previous = nullptr;
+        connection->next = server.connections;
+        if (server.connections != NULL)
+            server.connections->previous = connection;
+        server.connections = connection;
+
+        server.stats.connections++;
+        server.stats.open_connections++;
+    }
+}
+
+
+/**
+ * Reads everything available on a connection into its input buffer.
+ *
+ * @param connection The connection.
+ */
+static void read_connection(DaemonConnection* connection) {
+    while (connection->input_length < DAEMON_INPUT_BUFFER) {
+        const ssize_t received =
+            recv(connection->fd, connection->input + connection->input_length,
+                 DAEMON_INPUT_BUFFER - connection->input_length, 0);
+
+        if (received > 0) {
+            connection->input_length += (size_t)received;
+            continue;
+        }
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        close_connection(connection);
+        return;
+    }
+
+    mark_dirty(connection);
+}
+
+
+/**
+ * Publishes a response in the completion ring of a connection and wakes the
+ * client if it sleeps. Requests are only taken from the submission ring while
+ * their responses are guaranteed to fit.
+ *
+ * @param connection The connection.
+ * @param response The response.
+ */
+static void publish_response(DaemonConnection* connection,
+                             const ProtocolResponse* response) {
+    RingSegment* segment = connection->segment;
+    if (segment == NULL)
+        return;
+
+    memcpy(&segment->responses[connection->complete_head % RING_ENTRIES],
+           response, sizeof(*response));
+    connection->complete_head++;
+    atomic_store_explicit(&segment->complete_head, connection->complete_head,
+                          memory_order_release);
+    ring_notify(&segment->client);
+}
+
+
+/**
+ * Sends a response back through the channel its request arrived on: appends
+ * it to the output buffer of the connection or publishes it in the completion
+ * ring. Responses to connections closed in the meantime are dropped.
+ *
+ * @param connection The connection.
+ * @param route The channel of the request.
+ * @param response The response.
+ */
+static void queue_response(DaemonConnection* connection,
+                           const DaemonRoute route,
+                           const ProtocolResponse* response) {
+    if (connection->closed)
+        return;
+
+    if (route == DAEMON_ROUTE_RING) {
+        publish_response(connection, response);
+        return;
+    }
+
+    memcpy(connection->output + connection->output_length, response,
+           sizeof(*response));
+    connection->output_length += sizeof(*response);
+    mark_dirty(connection);
+}
+
+
+/**
+ * Answers an integration request and records its result in the journal.
+ *
+ * @param connection The connection the request came from.
+ * @param route The channel of the request.
+ * @param tag The tag of the request.
+ * @param integrand The integrand as received.
+ * @param result The result of the integration.
+ * @param flags A combination of the PROTOCOL_FLAG_* values.
+ */
+static void respond(DaemonConnection* connection, const DaemonRoute route,
+                    const uint64_t tag, const char* integrand,
+                    const IntegrationResult* result, const unsigned flags) {
+    const ResultRecord record = {.id = nullptr,
+                                 .id_is_number = false,
+                                 .integrand = integrand,
+                                 .label = nullptr,
+                                 .result = result};
+    journal_append(&record);
+
+    ProtocolResponse response;
+    protocol_encode_result(&response, tag, result, flags);
+    queue_response(connection, route, &response);
+}
+
+
+/**
+ * Answers an integration request that cannot be run.
+ *
+ * @param connection The connection the request came from.
+ * @param route The channel of the request.
+ * @param tag The tag of the request.
+ * @param integrand The integrand as received.
+ * @param job The requested job.
+ * @param status The reason of the rejection.
+ */
+static void reject(DaemonConnection* connection, const DaemonRoute route,
+                   const uint64_t tag, const char* integrand,
+                   const IntegrationJob* job, const IntegrationStatus status) {
+    IntegrationResult result;
+    memset(&result, 0, sizeof(result));
+    result.status = status;
+    result.start = job->start;
+    result.end = job->end;
+    result.tolerance = job->tolerance;
+    result.refinement = job->refinement;
+
+    respond(connection, route, tag, integrand, &result, 0);
+}
+
+
+/**
+ * Returns the parsed tree of an integrand, parsing it only if it is not in the
+ * expression table yet.
+ *
+ * @param text The validated integrand without spaces.
+ * @param compiled Output pointer for the slot holding the tree, or NULL if the
+ * caller owns a private tree because the slot is in use by another integrand.
+ * @return The tree, or NULL if the integrand could not be parsed.
+ */
+static Node* compile(const char* text, CompiledExpression** compiled) {
+    const uint64_t hash = hash_text(text);
+    CompiledExpression* slot =
+        &server.expressions[hash % DAEMON_EXPRESSION_SLOTS];
+
+    if (slot->tree != NULL && slot->hash == hash &&
+        strcmp(slot->text, text) == 0) {
+        server.stats.expression_hits++;
+        slot->users++;
+        *compiled = slot;
+        return slot->tree;
+    }
+
+    server.stats.expression_misses++;
+
+    // parse() tokenizes its argument in place.
+    char tokens[MAX_INTEGRAND_LENGTH + 1];
+    strcpy(tokens, text);
+    Node* tree = parse(tokens);
+    *compiled = nullptr;
+    if (tree == NULL || slot->users > 0)
+        return tree;
+
+    free_tree(slot->tree);
+    slot->tree = tree;
+    slot->hash = hash;
+    strcpy(slot->text, text);
+    slot->users = 1;
+    *compiled = slot;
+    return tree;
+}
+
+
+/**
+ * Releases a tree returned by compile().
+ *
+ * @param compiled The slot holding the tree, or NULL for a private tree.
+ * @param tree The tree.
+ */
+static void release(CompiledExpression* compiled, Node* tree) {
+    if (compiled != NULL)
+        compiled->users--;
+    else
+        free_tree(tree);
+}
+
+
+/**
+ * Tells whether a job is small from its estimated number of integrand
+ * evaluations. Jobs refined until a tolerance is met have no fixed cost and
+ * are never considered small.
+ *
+ * @param job The job.
+ * @return true if the job is cheap enough to share a batch with others.
+ */
+static bool is_small_job(const IntegrationJob* job) {
+    return job->tolerance <= 0 &&
+           estimate_evaluations(job) <= DAEMON_SMALL_JOB_EVALUATIONS;
+}
+
+
+/**
+ * Submits the batch of small tasks collected so far, if any.
+ */
+static void submit_batch(void) {
+    if (server.batch_head == NULL)
+        return;
+
+    pool_submit(&server.pool, server.batch_head);
+    server.stats.batches++;
+    server.stats.batched_jobs += (uint64_t)server.batch_count;
+
+    server.batch_head = nullptr;
+    server.batch_tail = nullptr;
+    server.batch_count = 0;
+}
+
+
+/**
+ * Handles an integration request: answers it from the result cache if
+ * possible, rejects it if its estimated cost exceeds the limit, otherwise
+ * hands it to the worker pool in its priority class.
+ *
+ * @param connection The connection the request came from.
+ * @param route The channel of the request.
+ * @param request The request header.
+ * @param integrand The integrand following the header, not NUL-terminated.
+ */
+static void handle_integrate(DaemonConnection* connection,
+                             const DaemonRoute route,
+                             const ProtocolRequest* request,
+                             const unsigned char* integrand) {
+    const IntegrationJob job = {.start = request->start,
+                                .end = request->end,
+                                .refinement = request->refinement,
+                                .tolerance = request->tolerance,
+                                .methods = request->methods,
+                                .threads = 1,
+                                .deadline_ms = request->deadline_ms};
+
+    char received[PROTOCOL_INTEGRAND_MAX + 1];
+    memcpy(received, integrand, request->integrand_length);
+    received[request->integrand_length] = '\0';
+
+    char text[MAX_INTEGRAND_LENGTH + 1];
+    if (strlen(received) != request->integrand_length ||
+        request->integrand_length > MAX_INTEGRAND_LENGTH) {
+        reject(connection, route, request->tag, received, &job,
+               INTEGRATION_INVALID_INTEGRAND);
+        return;
+    }
+    strcpy(text, received);
+    remove_spaces(text);
+    if (text[0] == '\0' || !validate_expression(text)) {
+        reject(connection, route, request->tag, received, &job,
+               INTEGRATION_INVALID_INTEGRAND);
+        return;
+    }
+
+    CompiledExpression* compiled;
+    Node* tree = compile(text, &compiled);
+    if (tree == NULL) {
+        reject(connection, route, request->tag, received, &job,
+               INTEGRATION_INVALID_INTEGRAND);
+        return;
+    }
+
+    CoalesceEntry entry;
+    entry.keyed = cache_make_key(&entry.key, tree, &job);
+    IntegrationResult cached;
+    if (entry.keyed && cache_lookup(&entry.key, &cached)) {
+        server.stats.result_cache_hits++;
+        respond(connection, route, request->tag, received, &cached,
+                compiled != NULL ? PROTOCOL_FLAG_COMPILED : 0);
+        release(compiled, tree);
+        return;
+    }
+
+    // Admission control: the cost is known before the job takes a worker.
+    const double cost = estimate_cost(tree, &job);
+    if (server.max_cost > 0 && cost > server.max_cost) {
+        server.stats.rejected++;
+        release(compiled, tree);
+        reject(connection, route, request->tag, received, &job,
+               INTEGRATION_REJECTED);
+        return;
+    }
+
+    PoolPriority priority = request->priority < POOL_PRIORITY_COUNT
+                                ? (PoolPriority)request->priority
+                                : POOL_PRIORITY_NORMAL;
+    const bool downgraded =
+        priority != POOL_PRIORITY_BULK && cost > DAEMON_INTERACTIVE_COST;
+    if (downgraded) {
+        priority = POOL_PRIORITY_BULK;
+        server.stats.downgraded++;
+    }
+
+    DaemonTask* task = malloc(sizeof(DaemonTask));
+    if (task == NULL) {
+        perror("Error allocating memory for task");
+        release(compiled, tree);
+        reject(connection, route, request->tag, received, &job,
+               INTEGRATION_ERROR);
+        return;
+    }
+
+    task->task = (PoolTask){.expression = tree,
+                            .job = job,
+                            .status = INTEGRATION_OK,
+                            .context = task,
+                            .priority = priority,
+                            .client = &connection->pool_client,
+                            .batch = nullptr,
+                            .next = nullptr};
+    task->connection = connection;
+    task->route = route;
+    task->tag = request->tag;
+    task->keyed = entry.keyed;
+    task->downgraded = downgraded;
+    task->coalesce.key = entry.key;
+    task->coalesce.keyed = entry.keyed && !(job.deadline_ms > 0);
+    task->coalesce.context = task;
+    task->compiled = compiled;
+    strcpy(task->integrand, received);
+
+    connection->in_flight++;
+    if (route == DAEMON_ROUTE_RING)
+        connection->ring_in_flight++;
+
+    // An identical request in flight answers this one when it completes.
+    if (coalesce_join(&server.coalesce, &task->coalesce) != NULL)
+        return;
+    server.stats.integrations++;
+
+    if (!is_small_job(&job)) {
+        pool_submit(&server.pool, &task->task);
+        return;
+    }
+
+    // A batch is scheduled as one task, so it only holds tasks of one client
+    // and class.
+    if (server.batch_head != NULL &&
+        (server.batch_head->client != task->task.client ||
+         server.batch_head->priority != task->task.priority))
+        submit_batch();
+
+    if (server.batch_tail != NULL)
+        server.batch_tail->batch = &task->task;
+    else
+        server.batch_head = &task->task;
+    server.batch_tail = &task->task;
+
+    if (++server.batch_count == DAEMON_BATCH_MAX)
+        submit_batch();
+}
+
+
+/**
+ * Attaches a shared-memory segment to a connection and sends the response
+ * with the descriptor of the segment. The response bypasses the output
+ * buffer, so it is only sent while no other response is pending; clients
+ * attach right after connecting.
+ *
+ * @param connection The connection the request came from.
+ * @param request The request header.
+ */
+static void handle_attach(DaemonConnection* connection,
+                          const ProtocolRequest* request) {
+    ProtocolResponse response;
+    protocol_begin_response(&response, PROTOCOL_ATTACH, request->tag);
+
+    int status = connection->segment != NULL    ? EALREADY
+                 : connection->output_length > 0 ? EBUSY
+                                                 : attach_ring(connection);
+    if (status == 0) {
+        response.body.attach =
+            (ProtocolAttach){.status = 0,
+                             .entries = RING_ENTRIES,
+                             .size = sizeof(RingSegment)};
+
+        struct iovec data = {.iov_base = &response,
+                             .iov_len = sizeof(response)};
+        union {
+            struct cmsghdr header;
+            char buffer[CMSG_SPACE(sizeof(int))];
+        } control;
+        memset(&control, 0, sizeof(control));
+        struct msghdr message = {.msg_iov = &data,
+                                 .msg_iovlen = 1,
+                                 .msg_control = control.buffer,
+                                 .msg_controllen = sizeof(control.buffer)};
+        struct cmsghdr* rights = CMSG_FIRSTHDR(&message);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(rights), &connection->segment_fd, sizeof(int));
+
+        ssize_t sent;
+        do {
+            sent = sendmsg(connection->fd, &message, MSG_NOSIGNAL);
+        } while (sent < 0 && errno == EINTR);
+
+        if (sent == (ssize_t)sizeof(response))
+            return;
+        if (sent > 0) {
+            // The descriptor went out with the first byte; queue the rest.
+            memcpy(connection->output, (unsigned char*)&response + sent,
+                   sizeof(response) - (size_t)sent);
+            connection->output_length = sizeof(response) - (size_t)sent;
+            mark_dirty(connection);
+            return;
+        }
+
+        status = errno;
+        detach_ring(connection);
+        protocol_begin_response(&response, PROTOCOL_ATTACH, request->tag);
+    }
+
+    response.body.attach.status = status;
+    queue_response(connection, DAEMON_ROUTE_SOCKET, &response);
+}
+
+
+/**
+ * Handles one decoded request.
+ *
+ * @param connection The connection the request came from.
+ * @param route The channel of the request.
+ * @param request The request header.
+ * @param integrand The bytes following the header.
+ */
+static void handle_request(DaemonConnection* connection,
+                           const DaemonRoute route,
+                           const ProtocolRequest* request,
+                           const unsigned char* integrand) {
+    server.stats.requests++;
+
+    ProtocolResponse response;
+    switch (request->type) {
+        case PROTOCOL_PING:
+            protocol_begin_response(&response, PROTOCOL_PING, request->tag);
+            queue_response(connection, route, &response);
+            break;
+        case PROTOCOL_STATS:
+            protocol_begin_response(&response, PROTOCOL_STATS, request->tag);
+            response.body.stats = server.stats;
+            response.body.stats.in_flight = pool_in_flight(&server.pool);
+            response.body.stats.workers = (uint64_t)server.pool.thread_count;
+            response.body.stats.ring_clients = (uint64_t)server.rings;
+            response.body.stats.coalesced =
+                (uint64_t)server.coalesce.stats.coalesced;
+            response.body.stats.largest_coalesced_group =
+                (uint64_t)server.coalesce.stats.largest_group;
+            queue_response(connection, route, &response);
+            break;
+        case PROTOCOL_ATTACH:
+            handle_attach(connection, request);
+            break;
+        default:
+            handle_integrate(connection, route, request, integrand);
+            break;
+    }
+}
+
+
+/**
+ * Tells whether the response to one more socket request is guaranteed to fit
+ * into the output buffer of a connection, next to the responses pending and
+ * those of the socket requests in flight.
+ *
+ * @param connection The connection.
+ * @return true if another request may be decoded.
+ */
+static bool socket_has_room(const DaemonConnection* connection) {
+    const size_t in_flight =
+        connection->in_flight - connection->ring_in_flight;
+    return connection->output_length +
+               (in_flight + 1) * sizeof(ProtocolResponse) <=
+           DAEMON_OUTPUT_BUFFER;
+}
+
+
+/**
+ * Decodes the complete requests in the input buffer of a connection, as long
+ * as their responses are guaranteed to fit into its output buffer.
+ *
+ * @param connection The connection.
+ */
+static void decode_requests(DaemonConnection* connection) {
+    size_t offset = 0;
+
+    while (socket_has_room(connection)) {
+        const size_t available = connection->input_length - offset;
+        if (available < sizeof(ProtocolRequest))
+            break;
+
+        ProtocolRequest request;
+        memcpy(&request, connection->input + offset, sizeof(request));
+        if (!protocol_check_request(&request)) {
+            server.stats.protocol_errors++;
+            close_connection(connection);
+            return;
+        }
+
+        const size_t frame = sizeof(request) + request.integrand_length;
+        if (available < frame)
+            break;
+
+        handle_request(connection, DAEMON_ROUTE_SOCKET, &request,
+                       connection->input + offset + sizeof(request));
+        offset += frame;
+    }
+
+    if (offset > 0) {
+        memmove(connection->input, connection->input + offset,
+                connection->input_length - offset);
+        connection->input_length -= offset;
+    }
+}
+
+
+/**
+ * Writes as much of the output buffer of a connection as the socket accepts.
+ *
+ * @param connection The connection.
+ */
+static void flush_connection(DaemonConnection* connection) {
+    size_t written = 0;
+
+    while (written < connection->output_length) {
+        const ssize_t sent =
+            send(connection->fd, connection->output + written,
+                 connection->output_length - written, MSG_NOSIGNAL);
+
+        if (sent > 0) {
+            written += (size_t)sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        close_connection(connection);
+        return;
+    }
+
+    memmove(connection->output, connection->output + written,
+            connection->output_length - written);
+    connection->output_length -= written;
+}
+
+
+/**
+ * Updates the events a connection waits for: input only while there is room
+ * to buffer it and to answer it, output only while responses are pending.
+ *
+ * @param connection The connection.
+ */
+static void update_interest(DaemonConnection* connection) {
+    uint32_t events = 0;
+
+    if (connection->input_length < DAEMON_INPUT_BUFFER &&
+        socket_has_room(connection))
+        events |= EPOLLIN;
+    if (connection->output_length > 0)
+        events |= EPOLLOUT;
+
+    if (events == connection->events)
+        return;
+
+    struct epoll_event event = {.events = events, .data.ptr = connection};
+    if (epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, connection->fd, &event) !=
+        0) {
+        perror("Error updating epoll interest");
+        close_connection(connection);
+        return;
+    }
+    connection->events = events;
+}
+
+
+/**
+ * Services every connection marked during the current iteration: decodes new
+ * requests, writes pending responses and releases closed connections without
+ * jobs in flight.
+ */
+static void service_connections(void) {
+    DaemonConnection* connection;
+
+    while ((connection = server.dirty) != NULL) {
+        server.dirty = connection->next_dirty;
+
+        // Stays marked while serviced, so queued responses do not re-add it.
+        if (!connection->closed)
+            decode_requests(connection);
+        if (!connection->closed)
+            flush_connection(connection);
+        if (!connection->closed)
+            update_interest(connection);
+
+        connection->dirty = false;
+        if (connection->closed && connection->in_flight == 0)
+            free_connection(connection);
+    }
+}
+
+
+/**
+ * Answers a task and releases it.
+ *
+ * @param task The task.
+ * @param result The result of the task's computation.
+ * @param flags PROTOCOL_FLAG_COALESCED if the result was computed for another
+ * request, 0 otherwise.
+ */
+static void answer_task(DaemonTask* task, const IntegrationResult* result,
+                        const unsigned flags) {
+    DaemonConnection* connection = task->connection;
+
+    respond(connection, task->route, task->tag, task->integrand, result,
+            flags | (task->compiled != NULL ? PROTOCOL_FLAG_COMPILED : 0) |
+                (task->downgraded ? PROTOCOL_FLAG_DOWNGRADED : 0));
+    release(task->compiled, task->task.expression);
+
+    connection->in_flight--;
+    if (task->route == DAEMON_ROUTE_RING)
+        connection->ring_in_flight--;
+    mark_dirty(connection);
+    free(task);
+}
+
+
+/**
+ * Answers a completed task and every request coalesced with it.
+ *
+ * @param task The task.
+ */
+static void finish_task(DaemonTask* task) {
+    CoalesceEntry* follower =
+        coalesce_finish(&server.coalesce, &task->coalesce);
+    if (task->keyed)
+        cache_store(&task->coalesce.key, &task->task.result);
+
+    while (follower != NULL) {
+        CoalesceEntry* next = follower->next_follower;
+        answer_task(follower->context, &task->task.result,
+                    PROTOCOL_FLAG_COALESCED);
+        follower = next;
+    }
+
+    answer_task(task, &task->task.result, 0);
+}
+
+
+/**
+ * Answers every task of a completed batch.
+ *
+ * @param head The first task of the batch.
+ */
+static void finish_batch(PoolTask* head) {
+    while (head != NULL) {
+        PoolTask* next = head->batch;
+        finish_task((DaemonTask*)head->context);
+        head = next;
+    }
+}
+
+
+/**
+ * Answers every completed task. Called when the workers signal the eventfd.
+ */
+static void collect_completions(void) {
+    uint64_t count;
+    while (read(server.completion_fd, &count, sizeof(count)) < 0 &&
+           errno == EINTR) {
+    }
+
+    PoolTask* task;
+    while ((task = pool_collect(&server.pool, false)) != NULL)
+        finish_batch(task);
+}
+
+
+/**
+ * Returns the time of the monotonic clock, read without a system call.
+ *
+ * @return The time in nanoseconds.
+ */
+static int64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+/**
+ * Tells whether the response to one more ring request is guaranteed to fit
+ * into the completion ring of a connection, next to the responses the client
+ * has not consumed yet and those of the ring requests in flight.
+ *
+ * @param connection The connection with an attached segment.
+ * @return true if another request may be taken.
+ */
+static bool ring_has_room(const DaemonConnection* connection) {
+    const uint32_t consumed = atomic_load_explicit(
+        &connection->segment->complete_tail, memory_order_acquire);
+    const uint32_t unconsumed = connection->complete_head - consumed;
+    return unconsumed <= RING_ENTRIES &&
+           unconsumed + connection->ring_in_flight < RING_ENTRIES;
+}
+
+
+/**
+ * Tells whether the submission ring of a connection holds requests that can
+ * be taken now.
+ *
+ * @param connection The connection with an attached segment.
+ * @return true if there is work for the event loop.
+ */
+static bool ring_has_work(const DaemonConnection* connection) {
+    const uint32_t head = atomic_load_explicit(
+        &connection->segment->submit_head, memory_order_acquire);
+    return head != connection->submit_tail && ring_has_room(connection);
+}
+
+
+/**
+ * Takes the requests of the submission ring of a connection, as long as their
+ * responses are guaranteed to fit into the completion ring. Every request is
+ * copied out of shared memory before it is checked, as the client may still
+ * write to it.
+ *
+ * @param connection The connection with an attached segment.
+ * @return true if at least one request was taken.
+ */
+static bool service_ring(DaemonConnection* connection) {
+    RingSegment* segment = connection->segment;
+    const uint32_t head =
+        atomic_load_explicit(&segment->submit_head, memory_order_acquire);
+    if (head - connection->submit_tail > RING_ENTRIES) {
+        server.stats.protocol_errors++;
+        close_connection(connection);
+        return false;
+    }
+
+    bool taken = false;
+    while (connection->submit_tail != head && ring_has_room(connection)) {
+        const RingRequest* entry =
+            &segment->requests[connection->submit_tail % RING_ENTRIES];
+        ProtocolRequest request;
+        memcpy(&request, &entry->header, sizeof(request));
+        if (!protocol_check_request(&request) ||
+            request.type == PROTOCOL_ATTACH) {
+            server.stats.protocol_errors++;
+            close_connection(connection);
+            return taken;
+        }
+
+        server.stats.ring_requests++;
+        handle_request(connection, DAEMON_ROUTE_RING, &request,
+                       (const unsigned char*)entry->integrand);
+        connection->submit_tail++;
+        taken = true;
+    }
+
+    if (taken) {
+        atomic_store_explicit(&segment->submit_tail, connection->submit_tail,
+                              memory_order_release);
+        ring_notify(&segment->client);
+    }
+    return taken;
+}
+
+
+/**
+ * Takes the requests of every attached submission ring.
+ */
+static void service_rings(void) {
+    if (server.rings == 0)
+        return;
+
+    bool taken = false;
+    for (DaemonConnection* connection = server.connections; connection != NULL;
+         connection = connection->next)
+        if (connection->segment != NULL && service_ring(connection))
+            taken = true;
+
+    if (taken)
+        server.ring_active_ns = monotonic_ns();
+}
+
+
+/**
+ * Decides how long the event loop may sleep. While rings are attached and
+ * were active within the spin window, it keeps polling them. Before
+ * sleeping it arms the doorbell of every segment, so clients wake it, and
+ * checks the rings once more.
+ *
+ * @return The epoll timeout: 0 to keep polling, -1 to sleep.
+ */
+static int prepare_sleep(void) {
+    if (server.rings == 0)
+        return -1;
+    if (monotonic_ns() - server.ring_active_ns < server.ring_spin_ns)
+        return 0;
+
+    bool work = false;
+    for (DaemonConnection* connection = server.connections; connection != NULL;
+         connection = connection->next) {
+        if (connection->segment == NULL)
+            continue;
+        ring_arm(&connection->segment->daemon);
+        if (ring_has_work(connection))
+            work = true;
+    }
+
+    return work ? 0 : -1;
+}
+
+
+/**
+ * Disarms the doorbells armed by prepare_sleep(), so clients stop ringing
+ * them while the event loop is awake.
+ */
+static void finish_sleep(void) {
+    if (server.rings == 0)
+        return;
+
+    for (DaemonConnection* connection = server.connections; connection != NULL;
+         connection = connection->next)
+        if (connection->segment != NULL)
+            ring_disarm(&connection->segment->daemon);
+}
+
+
+/**
+ * Dispatches the events of a client connection.
+ *
+ * @param connection The connection.
+ * @param events The events reported by epoll.
+ */
+static void handle_connection(DaemonConnection* connection,
+                              const uint32_t events) {
+    if (connection->closed)
+        return;
+
+    if (events & EPOLLERR) {
+        close_connection(connection);
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLHUP)) {
+        if (connection->input_length == DAEMON_INPUT_BUFFER &&
+            !(events & EPOLLIN)) {
+            close_connection(connection);
+            return;
+        }
+        read_connection(connection);
+    }
+    if (events & EPOLLOUT)
+        mark_dirty(connection);
+}
+
+
+/**
+ * Wakes up the event loop when SIGINT or SIGTERM arrives. Other threads, such
+ * as the journal writer, may be running already and may receive the signal,
+ * so it is forwarded through an eventfd instead of relying on a signal mask.
+ *
+ * @param signal The number of the signal.
+ */
+static void handle_signal(const int signal) {
+    (void)signal;
+    const int saved_errno = errno;
+    const uint64_t increment = 1;
+    if (write(server.signal_fd, &increment, sizeof(increment)) < 0) {
+        // The counter cannot overflow from signals alone; nothing to do.
+    }
+    errno = saved_errno;
+}
+
+
+/**
+ * Creates the epoll set and the eventfds for completions and signals,
+ * installs the signal handlers and starts the worker pool.
+ *
+ * @param workers The number of worker threads.
+ * @param previous Output array for the handlers of SIGINT and SIGTERM to
+ * restore.
+ * @return true on success, false otherwise.
+ */
+static bool open_event_loop(const int workers, struct sigaction previous[2]) {
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server.completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server.signal_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server.doorbell_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server.epoll_fd < 0 || server.completion_fd < 0 ||
+        server.signal_fd < 0 || server.doorbell_fd < 0) {
+        perror("Error creating event loop");
+        return false;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGINT, &action, &previous[0]) != 0 ||
+        sigaction(SIGTERM, &action, &previous[1]) != 0) {
+        perror("Error installing signal handlers");
+        return false;
+    }
+
+    if (!pool_init(&server.pool, workers))
+        return false;
+    pool_set_completion_fd(&server.pool, server.completion_fd);
+
+    return watch(server.listen_fd, &listener_marker, EPOLLIN) &&
+           watch(server.completion_fd, &completion_marker, EPOLLIN) &&
+           watch(server.signal_fd, &signal_marker, EPOLLIN) &&
+           watch(server.doorbell_fd, &doorbell_marker, EPOLLIN);
+}
+
+
+/**
+ * Restores the handlers of SIGINT and SIGTERM replaced by open_event_loop().
+ *
+ * @param previous The handlers to restore.
+ */
+static void restore_signals(const struct sigaction previous[2]) {
+    sigaction(SIGINT, &previous[0], nullptr);
+    sigaction(SIGTERM, &previous[1], nullptr);
+}
+
+
+/**
+ * Waits for and answers the jobs still in flight, then releases every
+ * connection, the expression table and the descriptors of the daemon.
+ *
+ * @param pool_started Whether the worker pool was started.
+ */
+static void shut_down(const bool pool_started) {
+    if (pool_started) {
+        submit_batch();
+        while (pool_in_flight(&server.pool) > 0)
+            finish_batch(pool_collect(&server.pool, true));
+        pool_destroy(&server.pool);
+    }
+
+    // Best effort: deliver the last responses before closing.
+    service_connections();
+    for (DaemonConnection* connection = server.connections; connection != NULL;
+         connection = connection->next)
+        close_connection(connection);
+    service_connections();
+
+    for (int slot = 0; slot < DAEMON_EXPRESSION_SLOTS; slot++) {
+        free_tree(server.expressions[slot].tree);
+        server.expressions[slot].tree = nullptr;
+    }
+
+    if (server.listen_fd >= 0) {
+        close(server.listen_fd);
+        unlink(server.path);
+    }
+    if (server.signal_fd >= 0)
+        close(server.signal_fd);
+    if (server.doorbell_fd >= 0)
+        close(server.doorbell_fd);
+    if (server.completion_fd >= 0)
+        close(server.completion_fd);
+    if (server.epoll_fd >= 0)
+        close(server.epoll_fd);
+}
+
+
+/**
+ * Runs the daemon until it receives SIGINT or SIGTERM.
+ *
+ * The result cache and the journal are used if they are open. Jobs still in
+ * flight when the daemon is stopped are completed and answered before it
+ * returns.
+ *
+ * @param path The path of the Unix domain socket to listen on.
+ * @param workers The number of worker threads.
+ * @param max_cost The estimated cost above which jobs are rejected, or 0 for
+ * no limit.
+ * @return true if the daemon ran and was stopped by a signal, false if it
+ * could not be started.
+ */
+bool run_daemon(const char* path, const int workers, const double max_cost) {
+    memset(&server, 0, sizeof(server));
+    server.path = path;
+    server.max_cost = max_cost;
+    server.listen_fd = -1;
+    server.epoll_fd = -1;
+    server.completion_fd = -1;
+    server.signal_fd = -1;
+    server.doorbell_fd = -1;
+    coalesce_init(&server.coalesce);
+    // Spinning on one processor only delays the client being waited for.
+    server.ring_spin_ns =
+        sysconf(_SC_NPROCESSORS_ONLN) > 1 ? DAEMON_RING_SPIN_NS : 0;
+
+    if (!open_listener(path))
+        return false;
+
+    // Zeroed handlers restore the default actions if installing fails.
+    struct sigaction previous[2];
+    memset(previous, 0, sizeof(previous));
+    const bool started = open_event_loop(workers, previous);
+    const bool pool_started = server.pool.thread_count > 0;
+    if (!started) {
+        restore_signals(previous);
+        shut_down(pool_started);
+        return false;
+    }
+
+    fprintf(stderr, "Listening on %s with %d worker(s)\n", path,
+            server.pool.thread_count);
+
+    struct epoll_event events[DAEMON_EVENTS];
+    while (!server.stopping) {
+        const int timeout = prepare_sleep();
+        const int count =
+            epoll_wait(server.epoll_fd, events, DAEMON_EVENTS, timeout);
+        finish_sleep();
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Error waiting for events");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            void* source = events[i].data.ptr;
+
+            if (source == &listener_marker) {
+                accept_connections();
+            } else if (source == &completion_marker) {
+                collect_completions();
+            } else if (source == &signal_marker) {
+                uint64_t count;
+                if (read(server.signal_fd, &count, sizeof(count)) ==
+                    sizeof(count))
+                    server.stopping = true;
+            } else if (source == &doorbell_marker) {
+                uint64_t count;
+                if (read(server.doorbell_fd, &count, sizeof(count)) < 0 &&
+                    errno != EAGAIN)
+                    perror("Error reading doorbell");
+            } else {
+                handle_connection(source, events[i].events);
+            }
+        }
+
+        service_rings();
+        service_connections();
+        submit_batch();
+    }
+
+    const ProtocolStats stats = server.stats;
+    const long long coalesced = server.coalesce.stats.coalesced;
+    restore_signals(previous);
+    shut_down(true);
+
+    fprintf(stderr,
+            "Served %llu request(s) on %llu connection(s): %llu "
+            "integration(s), %llu result cache hit(s), %llu coalesced, "
+            "%llu batch(es), %llu rejected, %llu downgraded\n",
+            (unsigned long long)stats.requests,
+            (unsigned long long)stats.connections,
+            (unsigned long long)stats.integrations,
+            (unsigned long long)stats.result_cache_hits,
+            (unsigned long long)coalesced,
+            (unsigned long long)stats.batches,
+            (unsigned long long)stats.rejected,
+            (unsigned long long)stats.downgraded);
+    return true;
+}
@@ -0,0 +1,199 @@
+/**
+ * @file daemon.h
+ * @brief Header file for the integration daemon, a long-running server that
+ * answers integration requests over a Unix domain socket.
+ *
+ * The daemon pays process start-up once and keeps its state warm between
+ * requests: parsed integrands are kept in a table of compiled expressions,
+ * results in the result cache, and jobs run on a persistent worker pool. A
+ * single event loop thread accepts connections, decodes requests, answers
+ * cache hits immediately and groups small jobs into batches for the workers.
+ *
+ * A co-located client may attach a shared-memory segment to its connection
+ * and exchange requests and responses through its rings instead of the
+ * socket, see ring.h.
+ */
+
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "coalesce.h"
+#include "expression_parser.h"
+#include "integral.h"
+#include "journal.h"
+#include "protocol.h"
+#include "ring.h"
+#include "worker_pool.h"
+
+
+#define DAEMON_LISTEN_BACKLOG 128
+#define DAEMON_EVENTS 64
+#define DAEMON_INPUT_BUFFER 65536
+#define DAEMON_PIPELINE_DEPTH 256
+#define DAEMON_OUTPUT_BUFFER (DAEMON_PIPELINE_DEPTH * sizeof(ProtocolResponse))
+#define DAEMON_EXPRESSION_SLOTS 4096
+#define DAEMON_BATCH_MAX 64
+#define DAEMON_SMALL_JOB_EVALUATIONS 200000
+#define DAEMON_INTERACTIVE_COST 1E+08
+#define DAEMON_MAX_COST 1E+11
+#define DAEMON_RING_SPIN_NS 100000
+
+
+/**
+ * @enum DaemonRoute
+ * @brief The channel a request arrived on, which its response is sent back
+ * through.
+ */
+typedef enum DaemonRoute {
+    DAEMON_ROUTE_SOCKET,
+    DAEMON_ROUTE_RING
+} DaemonRoute;
+
+
+/**
+ * @struct CompiledExpression
+ * @brief A slot of the table of parsed integrands.
+ *
+ * `users` counts the jobs in flight that evaluate `tree`; a slot is only
+ * replaced while it has no users. Evaluation does not modify the tree, so any
+ * number of workers may share it.
+ */
+typedef struct CompiledExpression {
+    uint64_t hash;
+    Node* tree;
+    int users;
+    char text[MAX_INTEGRAND_LENGTH + 1];
+} CompiledExpression;
+
+
+/**
+ * @struct DaemonConnection
+ * @brief A client connection.
+ *
+ * Requests are decoded from `input` only while the responses of all requests
+ * in flight still fit into `output`, so a client that does not read its
+ * responses cannot make the daemon buffer without bound. A closed connection
+ * is kept until its last job in flight has completed.
+ *
+ * Connections are linked into the list of all connections through `previous`
+ * and `next`, and into the list of connections to service through
+ * `next_dirty` while `dirty` is set.
+ *
+ * `pool_client` queues the jobs of the connection in the worker pool, so
+ * every connection gets its fair share of the workers within a priority class.
+ *
+ * `segment` is the attached shared-memory segment, or NULL. `submit_tail` and
+ * `complete_head` are the daemon's copies of the ring positions it owns; the
+ * `doorbell` thread turns wake-ups of the segment's futex into events of the
+ * event loop until `detaching` is set. `ring_in_flight` counts the jobs in
+ * flight that arrived through the rings, which are included in `in_flight`.
+ */
+typedef struct DaemonConnection {
+    int fd;
+    uint32_t events;
+    bool closed;
+    bool dirty;
+    size_t in_flight;
+    PoolClient pool_client;
+    struct DaemonConnection* previous;
+    struct DaemonConnection* next;
+    struct DaemonConnection* next_dirty;
+    RingSegment* segment;
+    int segment_fd;
+    pthread_t doorbell;
+    atomic_bool detaching;
+    uint32_t submit_tail;
+    uint32_t complete_head;
+    size_t ring_in_flight;
+    size_t input_length;
+    size_t output_length;
+    unsigned char input[DAEMON_INPUT_BUFFER];
+    unsigned char output[DAEMON_OUTPUT_BUFFER];
+} DaemonConnection;
+
+
+/**
+ * @struct DaemonTask
+ * @brief An integration request waiting for or running on the worker pool.
+ *
+ * `compiled` is the slot whose tree the task evaluates, or NULL if the task
+ * owns a private tree because the slot was in use by another integrand.
+ * `coalesce` holds the canonical key of the task; a task that joined an
+ * identical task in flight is never submitted and is answered with the result
+ * of that task. `keyed` is set if the key is valid, so the result may be
+ * cached; tasks with a deadline are keyed but never coalesced, as their
+ * results depend on when they ran. `downgraded` is set if the task was moved
+ * to the bulk class because of its estimated cost.
+ */
+typedef struct DaemonTask {
+    PoolTask task;
+    DaemonConnection* connection;
+    DaemonRoute route;
+    uint64_t tag;
+    bool keyed;
+    bool downgraded;
+    CoalesceEntry coalesce;
+    CompiledExpression* compiled;
+    char integrand[MAX_INTEGRAND_LENGTH + 1];
+} DaemonTask;
+
+
+/**
+ * @struct Daemon
+ * @brief The state of the daemon.
+ *
+ * `batch` collects small tasks decoded during one iteration of the event
+ * loop; it is submitted to the pool as one chain at the end of the iteration
+ * or once it holds `DAEMON_BATCH_MAX` tasks. `dirty` lists the connections
+ * with new input, new responses or a state change to be handled at the end
+ * of the iteration.
+ *
+ * Workers and doorbell threads wake the event loop through `completion_fd`
+ * and `doorbell_fd`. While `rings` segments are attached, the loop keeps
+ * polling them without sleeping for `ring_spin_ns` after the last ring
+ * request, which was taken at `ring_active_ns`. The spin window is
+ * `DAEMON_RING_SPIN_NS`, or zero on a single processor.
+ *
+ * `coalesce` holds the tasks being computed, so identical requests arriving
+ * in the meantime attach to them instead of being computed again.
+ *
+ * Jobs whose estimated cost exceeds `max_cost` are rejected before they are
+ * queued, and interactive or normal jobs above `DAEMON_INTERACTIVE_COST` are
+ * downgraded to the bulk class, see estimate_cost().
+ */
+typedef struct Daemon {
+    const char* path;
+    int listen_fd;
+    int epoll_fd;
+    int completion_fd;
+    int signal_fd;
+    int doorbell_fd;
+    bool stopping;
+    WorkerPool pool;
+    CompiledExpression expressions[DAEMON_EXPRESSION_SLOTS];
+    PoolTask* batch_head;
+    PoolTask* batch_tail;
+    int batch_count;
+    DaemonConnection* connections;
+    DaemonConnection* dirty;
+    CoalesceTable coalesce;
+    double max_cost;
+    int rings;
+    int64_t ring_active_ns;
+    int64_t ring_spin_ns;
+    ProtocolStats stats;
+} Daemon;
+
+
+bool run_daemon(const char* path, int workers, double max_cost);
+
+
+#endif /* DAEMON_H */
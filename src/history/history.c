@@ -0,0 +1,944 @@
+/**
+ * @file history.c
+ * @brief Maintains the sidecar offset index of the saved functions file and
+ * provides random access to its records.
+ *
+ * The index file starts with a magic number followed by one 64-bit end offset
+ * per complete record of the saved functions file. The end offset of record N
+ * is the start offset of record N + 1, so every record can be located with at
+ * most two index reads. The index is brought up to date incrementally: only
+ * the part of the log appended since the last synchronisation is scanned.
+ *
+ * Listings map the requested part of the log into memory and write records
+ * straight from the mapping with vectored writes, so no record is copied
+ * through a user-space buffer or formatted with `printf`.
+ *
+ * Several instances of the program may share the files. A record is appended
+ * with a single `write` under an exclusive advisory lock of the log, while
+ * readers hold a shared lock, so a reader never sees half of a record and two
+ * records never interleave. The index is only modified under its own
+ * exclusive lock.
+ */
+
+
+#define _GNU_SOURCE // memmem, memrchr
+
+#include "history.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * Builds the path of the index file belonging to the given saved functions
+ * file.
+ *
+ * @param filename The path of the saved functions file.
+ * @param path Buffer receiving the path of the index file.
+ * @param size The size of the buffer in bytes.
+ * @return true on success, false if the path does not fit into the buffer.
+ */
+static bool index_path(const char* filename, char* path, const size_t size) {
+    const int length =
+        snprintf(path, size, "%s%s", filename, HISTORY_INDEX_SUFFIX);
+
+    if (length < 0 || (size_t)length >= size) {
+        fprintf(stderr, "Error: The path of the history index is too long.\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Places an advisory lock on a file, waiting until it is granted.
+ *
+ * @param fd The file descriptor of the file.
+ * @param operation `LOCK_SH` for a shared lock, `LOCK_EX` for an exclusive one.
+ * @return true on success, false if the lock could not be placed.
+ */
+static bool lock_file(const int fd, const int operation) {
+    while (flock(fd, operation) != 0) {
+        if (errno != EINTR) {
+            perror("Error locking file");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Opens the index file of the given saved functions file, creating it if it
+ * does not exist, and locks it exclusively until it is closed. An index with a
+ * missing or unknown header is reset, so it is rebuilt from the log on the
+ * next synchronisation.
+ *
+ * @param filename The path of the saved functions file.
+ * @return The file descriptor of the index, or -1 on failure.
+ */
+static int open_index(const char* filename) {
+    char path[HISTORY_PATH_MAX];
+    if (!index_path(filename, path, sizeof(path)))
+        return -1;
+
+    const int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        perror("Error opening history index");
+        return -1;
+    }
+
+    if (!lock_file(fd, LOCK_EX)) {
+        close(fd);
+        return -1;
+    }
+
+    uint64_t magic = 0;
+    if (pread(fd, &magic, sizeof(magic), 0) != (ssize_t)sizeof(magic) ||
+        magic != HISTORY_INDEX_MAGIC) {
+        magic = HISTORY_INDEX_MAGIC;
+        if (ftruncate(fd, 0) != 0 ||
+            pwrite(fd, &magic, sizeof(magic), 0) != (ssize_t)sizeof(magic)) {
+            perror("Error initialising history index");
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+
+/**
+ * Reads the end offset of a record from the index.
+ *
+ * @param index_fd The file descriptor of the index.
+ * @param number The 1-based number of the record.
+ * @param end Output pointer for the end offset of the record.
+ * @return true on success, false if the entry could not be read.
+ */
+static bool read_entry(const int index_fd, const long long number,
+                       uint64_t* end) {
+    const off_t offset = HISTORY_INDEX_HEADER_SIZE +
+                         (off_t)(number - 1) * (off_t)sizeof(uint64_t);
+
+    if (pread(index_fd, end, sizeof(*end), offset) != (ssize_t)sizeof(*end)) {
+        perror("Error reading history index");
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Appends a batch of end offsets to the index.
+ *
+ * @param index_fd The file descriptor of the index.
+ * @param count The number of records already stored in the index.
+ * @param entries The end offsets to append.
+ * @param pending The number of end offsets in `entries`.
+ * @return true on success, false if the entries could not be written.
+ */
+static bool write_entries(const int index_fd, const long long count,
+                          const uint64_t* entries, const size_t pending) {
+    const off_t offset =
+        HISTORY_INDEX_HEADER_SIZE + (off_t)count * (off_t)sizeof(uint64_t);
+    const ssize_t size = (ssize_t)(pending * sizeof(uint64_t));
+
+    if (pwrite(index_fd, entries, (size_t)size, offset) != size) {
+        perror("Error writing history index");
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Determines the byte range of a record in the saved functions file.
+ *
+ * @param index_fd The file descriptor of the index.
+ * @param number The 1-based number of the record.
+ * @param start Output pointer for the offset of the first byte of the record.
+ * @param end Output pointer for the offset just past the record.
+ * @return true on success, false if the index could not be read.
+ */
+static bool record_bounds(const int index_fd, const long long number,
+                          uint64_t* start, uint64_t* end) {
+    *start = 0;
+    if (number > 1 && !read_entry(index_fd, number - 1, start))
+        return false;
+
+    return read_entry(index_fd, number, end);
+}
+
+
+/**
+ * Brings an opened index up to date with the saved functions file.
+ *
+ * Only the bytes appended to the log since the last indexed record are
+ * scanned. A trailing record whose interval line has not been written yet is
+ * left unindexed until it is completed. If the log became shorter than the
+ * indexed range, the index is rebuilt from scratch.
+ *
+ * @param data_fd The file descriptor of the saved functions file.
+ * @param index_fd The file descriptor of the index.
+ * @return The number of complete records, or -1 on failure.
+ */
+static long long sync_index(const int data_fd, const int index_fd) {
+    struct stat data_stat, index_stat;
+    if (fstat(data_fd, &data_stat) != 0 || fstat(index_fd, &index_stat) != 0) {
+        perror("Error reading file status");
+        return -1;
+    }
+
+    long long count = (index_stat.st_size - HISTORY_INDEX_HEADER_SIZE) /
+                      (off_t)sizeof(uint64_t);
+    uint64_t indexed_end = 0;
+
+    if (count > 0 && !read_entry(index_fd, count, &indexed_end))
+        return -1;
+
+    if (indexed_end > (uint64_t)data_stat.st_size) {
+        count = 0;
+        indexed_end = 0;
+    }
+
+    // Drop torn or stale entries before appending new ones
+    const off_t valid_size =
+        HISTORY_INDEX_HEADER_SIZE + (off_t)count * (off_t)sizeof(uint64_t);
+    if (index_stat.st_size != valid_size &&
+        ftruncate(index_fd, valid_size) != 0) {
+        perror("Error truncating history index");
+        return -1;
+    }
+
+    char block[HISTORY_SCAN_BLOCK_SIZE];
+    uint64_t entries[HISTORY_ENTRY_BATCH];
+    size_t pending = 0;
+    bool interval_line = false;
+    off_t position = (off_t)indexed_end;
+    ssize_t length;
+
+    while ((length = pread(data_fd, block, sizeof(block), position)) > 0) {
+        for (ssize_t i = 0; i < length; i++) {
+            if (block[i] != '\n')
+                continue;
+
+            // Every second line closes a record
+            if (interval_line)
+                entries[pending++] = (uint64_t)(position + i + 1);
+            interval_line = !interval_line;
+
+            if (pending == HISTORY_ENTRY_BATCH) {
+                if (!write_entries(index_fd, count, entries, pending))
+                    return -1;
+                count += (long long)pending;
+                pending = 0;
+            }
+        }
+        position += length;
+    }
+
+    if (length == -1) {
+        perror("Error reading file");
+        return -1;
+    }
+
+    if (pending > 0) {
+        if (!write_entries(index_fd, count, entries, pending))
+            return -1;
+        count += (long long)pending;
+    }
+
+    return count;
+}
+
+
+/**
+ * Opens the saved functions file together with its index and synchronises
+ * the index. The log is locked for reading until its file descriptor is
+ * closed, so no record is appended while the caller reads it.
+ *
+ * @param filename The path of the saved functions file.
+ * @param data_fd Output pointer for the file descriptor of the log.
+ * @param index_fd Output pointer for the file descriptor of the index.
+ * @return The number of complete records, or -1 on failure, in which case no
+ * file descriptor is left open.
+ */
+static long long open_history(const char* filename, int* data_fd,
+                              int* index_fd) {
+    *data_fd = open(filename, O_RDONLY);
+    if (*data_fd == -1) {
+        perror("Error opening file");
+        return -1;
+    }
+
+    if (!lock_file(*data_fd, LOCK_SH)) {
+        close(*data_fd);
+        return -1;
+    }
+
+    *index_fd = open_index(filename);
+    if (*index_fd == -1) {
+        close(*data_fd);
+        return -1;
+    }
+
+    const long long count = sync_index(*data_fd, *index_fd);
+    if (count == -1) {
+        close(*index_fd);
+        close(*data_fd);
+    }
+
+    return count;
+}
+
+
+/**
+ * Synchronises the index of the saved functions file with its content.
+ *
+ * @param filename The path of the saved functions file.
+ * @return The number of complete records in the file, or -1 on failure.
+ */
+long long history_sync_index(const char* filename) {
+    int data_fd, index_fd;
+    const long long count = open_history(filename, &data_fd, &index_fd);
+
+    if (count != -1) {
+        close(index_fd);
+        close(data_fd);
+    }
+
+    return count;
+}
+
+
+/**
+ * Updates the index after a record has been appended to the saved functions
+ * file. Only the newly appended bytes are scanned, so the cost depends on the
+ * size of the record and not on the size of the file.
+ *
+ * @param filename The path of the saved functions file.
+ * @return true if the index is up to date, false otherwise.
+ */
+bool history_index_append(const char* filename) {
+    return history_sync_index(filename) != -1;
+}
+
+
+/**
+ * Returns the offset just past the last complete record of a synchronised
+ * log.
+ *
+ * @param index_fd The file descriptor of the synchronised index.
+ * @param count The number of records in the index.
+ * @param end Output pointer for the offset.
+ * @return true on success, false if the index could not be read.
+ */
+static bool records_end(const int index_fd, const long long count,
+                        uint64_t* end) {
+    *end = 0;
+    return count == 0 || read_entry(index_fd, count, end);
+}
+
+
+/**
+ * Tells whether the bytes after the last complete record of a log are a whole
+ * record that only lacks the newline closing its interval, as a legacy or
+ * hand-edited file may end. The interval line must be complete, from its
+ * opening `[` to its closing `]`; a record torn by an interrupted append
+ * always misses at least that closing bracket.
+ *
+ * @param data_fd The file descriptor of the log.
+ * @param end The offset just past the last complete record.
+ * @param size The size of the log.
+ * @return true if the tail is a whole record, false if it is torn or could
+ * not be read.
+ */
+static bool tail_is_whole_record(const int data_fd, const uint64_t end,
+                                 const off_t size) {
+    char tail[HISTORY_RECORD_MAX];
+    const off_t length = size - (off_t)end < (off_t)sizeof(tail)
+                             ? size - (off_t)end
+                             : (off_t)sizeof(tail);
+    if (pread(data_fd, tail, (size_t)length, size - length) != length)
+        return false;
+
+    // The integrand line is complete, the interval line follows it
+    const char* newline = memrchr(tail, '\n', (size_t)length);
+    if (newline == NULL)
+        return false;
+
+    const char* first = newline + 1;
+    const char* last = tail + length;
+    while (first < last && (*first == ' ' || *first == '\t'))
+        first++;
+    while (last > first &&
+           (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'))
+        last--;
+
+    return last - first >= 3 && *first == '[' && last[-1] == ']' &&
+           memchr(first, ';', (size_t)(last - first)) != NULL;
+}
+
+
+/**
+ * Appends a record to the saved functions file and indexes it.
+ *
+ * The integrand and the interval are formatted into one buffer and appended
+ * with a single `write` on a file opened with `O_APPEND`, while the log is
+ * locked exclusively. A whole last record that only lacks its final newline
+ * is completed and indexed first, while an incomplete record left behind by
+ * an interrupted writer is cut off, so the lines of the new record are paired
+ * correctly; a partially written record is removed again. The index is
+ * updated before the lock is released.
+ *
+ * @param filename The path of the saved functions file.
+ * @param integrand The integrand of the record.
+ * @param interval The interval of the record, in the format "[start ; end]".
+ * @return true if the record was appended, false otherwise.
+ */
+bool history_append(const char* filename, const char* integrand,
+                    const char* interval) {
+    if (strchr(integrand, '\n') != NULL || strchr(interval, '\n') != NULL) {
+        fprintf(stderr, "Error: A saved function must fit on one line.\n");
+        return false;
+    }
+
+    char record[HISTORY_RECORD_MAX];
+    const int length =
+        snprintf(record, sizeof(record), "%s\n%s\n", integrand, interval);
+    if (length < 0 || (size_t)length >= sizeof(record)) {
+        fprintf(stderr, "Error: The function is too long to be saved.\n");
+        return false;
+    }
+
+    const int data_fd = open(filename, O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (data_fd == -1) {
+        perror("Error opening file");
+        return false;
+    }
+
+    if (!lock_file(data_fd, LOCK_EX)) {
+        close(data_fd);
+        return false;
+    }
+
+    const int index_fd = open_index(filename);
+    if (index_fd == -1) {
+        close(data_fd);
+        return false;
+    }
+
+    long long count = sync_index(data_fd, index_fd);
+    uint64_t end;
+    struct stat data_stat;
+    bool success = count != -1 && records_end(index_fd, count, &end);
+
+    if (success && fstat(data_fd, &data_stat) != 0) {
+        perror("Error reading file status");
+        success = false;
+    }
+
+    if (success && (uint64_t)data_stat.st_size != end &&
+        tail_is_whole_record(data_fd, end, data_stat.st_size)) {
+        ssize_t written;
+        do {
+            written = write(data_fd, "\n", 1);
+        } while (written == -1 && errno == EINTR);
+
+        if (written != 1) {
+            perror("Error completing the last record");
+            success = false;
+        } else {
+            count = sync_index(data_fd, index_fd);
+            success = count != -1 && records_end(index_fd, count, &end);
+        }
+    } else if (success && (uint64_t)data_stat.st_size != end &&
+               ftruncate(data_fd, (off_t)end) != 0) {
+        perror("Error removing an incomplete record");
+        success = false;
+    }
+
+    if (success) {
+        ssize_t written;
+        do {
+            written = write(data_fd, record, (size_t)length);
+        } while (written == -1 && errno == EINTR);
+
+        if (written != length) {
+            perror("Error writing file");
+            if (written > 0 && ftruncate(data_fd, (off_t)end) != 0)
+                perror("Error removing an incomplete record");
+            success = false;
+        }
+    }
+
+    if (success)
+        success = sync_index(data_fd, index_fd) == count + 1;
+
+    // Closing the log releases the lock
+    close(index_fd);
+    close(data_fd);
+    return success;
+}
+
+
+/**
+ * Returns the number of complete records in the saved functions file.
+ *
+ * @param filename The path of the saved functions file.
+ * @return The number of records, or -1 on failure.
+ */
+long long history_count(const char* filename) {
+    return history_sync_index(filename);
+}
+
+
+/**
+ * Copies a byte range into a newly allocated, null-terminated string.
+ *
+ * @param source Pointer to the first byte of the range.
+ * @param length The number of bytes to copy.
+ * @return The allocated copy, or NULL if the allocation failed.
+ */
+static char* copy_range(const char* source, const size_t length) {
+    char* copy = (char*)malloc(length + 1);
+    if (copy == NULL)
+        return nullptr;
+
+    memcpy(copy, source, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+
+/**
+ * Reads a record from an opened saved functions file and splits it into its
+ * integrand and interval lines.
+ *
+ * @param data_fd The file descriptor of the saved functions file.
+ * @param index_fd The file descriptor of the synchronised index.
+ * @param number The 1-based number of an existing record.
+ * @param integrand Output pointer for the integrand of the record.
+ * @param interval Output pointer for the interval of the record.
+ * @return true on success, false if the record could not be read.
+ */
+static bool read_record(const int data_fd, const int index_fd,
+                        const long long number, char** integrand,
+                        char** interval) {
+    uint64_t start, end;
+    if (!record_bounds(index_fd, number, &start, &end))
+        return false;
+
+    const size_t length = (size_t)(end - start);
+    char* record = (char*)malloc(length + 1);
+    if (record == NULL) {
+        perror("Did not manage to allocate memory");
+        return false;
+    }
+
+    if (pread(data_fd, record, length, (off_t)start) != (ssize_t)length) {
+        perror("Error reading file");
+        free(record);
+        return false;
+    }
+
+    // An indexed record is the integrand line followed by the interval line
+    const char* separator = memchr(record, '\n', length);
+    const size_t split = (size_t)(separator - record);
+    *integrand = copy_range(record, split);
+    *interval = copy_range(separator + 1, length - split - 2);
+    free(record);
+
+    if (*integrand == NULL || *interval == NULL) {
+        perror("Did not manage to allocate memory");
+        free(*integrand);
+        free(*interval);
+        *integrand = nullptr;
+        *interval = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Fetches a saved record by its number without scanning the log.
+ *
+ * The integrand and the interval are returned without their trailing newline
+ * characters. Memory for both strings is dynamically allocated and must be
+ * freed by the caller.
+ *
+ * @param filename The path of the saved functions file.
+ * @param number The 1-based number of the record.
+ * @param integrand Output pointer for the integrand of the record.
+ * @param interval Output pointer for the interval of the record.
+ * @return true on success, false if the record does not exist or could not be
+ * read. On failure both pointers are set to NULL.
+ */
+bool history_get(const char* filename, const long long number,
+                 char** integrand, char** interval) {
+    *integrand = nullptr;
+    *interval = nullptr;
+
+    int data_fd, index_fd;
+    const long long count = open_history(filename, &data_fd, &index_fd);
+    if (count == -1)
+        return false;
+
+    bool success = false;
+    if (number < 1 || number > count)
+        fprintf(stderr, "Error: There is no saved function with number %lld.\n",
+                number);
+    else
+        success = read_record(data_fd, index_fd, number, integrand, interval);
+
+    close(index_fd);
+    close(data_fd);
+    return success;
+}
+
+
+/**
+ * Fetches the most recently saved record. As the record is located through
+ * the index while the log is locked, its integrand and interval always belong
+ * together, even if other instances of the program append records.
+ *
+ * Memory for both strings is dynamically allocated and must be freed by the
+ * caller.
+ *
+ * @param filename The path of the saved functions file.
+ * @param integrand Output pointer for the integrand of the record.
+ * @param interval Output pointer for the interval of the record.
+ * @return true on success, false if there is no record or it could not be
+ * read. On failure both pointers are set to NULL.
+ */
+bool history_get_last(const char* filename, char** integrand,
+                      char** interval) {
+    *integrand = nullptr;
+    *interval = nullptr;
+
+    int data_fd, index_fd;
+    const long long count = open_history(filename, &data_fd, &index_fd);
+    if (count == -1)
+        return false;
+
+    bool success = false;
+    if (count == 0)
+        fprintf(stderr, "Error: There are no saved functions.\n");
+    else
+        success = read_record(data_fd, index_fd, count, integrand, interval);
+
+    close(index_fd);
+    close(data_fd);
+    return success;
+}
+
+
+/**
+ * Writes a byte range to a file descriptor, retrying on partial writes and
+ * interrupted system calls.
+ *
+ * @param fd The file descriptor to write to.
+ * @param data Pointer to the first byte to write.
+ * @param length The number of bytes to write.
+ * @return true on success, false if the output could not be written.
+ */
+static bool write_all(const int fd, const char* data, size_t length) {
+    while (length > 0) {
+        const size_t chunk =
+            length > HISTORY_WRITE_CHUNK ? HISTORY_WRITE_CHUNK : length;
+        const ssize_t written = write(fd, data, chunk);
+
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("Error writing output");
+            return false;
+        }
+
+        data += written;
+        length -= (size_t)written;
+    }
+
+    return true;
+}
+
+
+/**
+ * Writes the gathered vectors of a batch to the standard output with as few
+ * `writev` calls as possible and empties the batch.
+ *
+ * @param batch The batch of output vectors to flush.
+ * @return true on success, false if the output could not be written.
+ */
+static bool flush_batch(OutputBatch* batch) {
+    struct iovec* vector = batch->vectors;
+    int remaining = batch->vector_count;
+
+    while (remaining > 0) {
+        ssize_t written = writev(STDOUT_FILENO, vector, remaining);
+
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("Error writing output");
+            return false;
+        }
+
+        // Skip the fully written vectors and trim a partially written one
+        while (remaining > 0 && (size_t)written >= vector->iov_len) {
+            written -= (ssize_t)vector->iov_len;
+            vector++;
+            remaining--;
+        }
+        if (remaining > 0) {
+            vector->iov_base = (char*)vector->iov_base + written;
+            vector->iov_len -= (size_t)written;
+        }
+    }
+
+    batch->vector_count = 0;
+    batch->prefix_count = 0;
+    return true;
+}
+
+
+/**
+ * Appends a vector to a batch. The batch must have room for it.
+ *
+ * @param batch The batch of output vectors.
+ * @param data Pointer to the first byte of the vector.
+ * @param length The number of bytes in the vector.
+ */
+static void push_vector(OutputBatch* batch, const char* data,
+                        const size_t length) {
+    batch->vectors[batch->vector_count].iov_base = (void*)data;
+    batch->vectors[batch->vector_count].iov_len = length;
+    batch->vector_count++;
+}
+
+
+/**
+ * Formats the number of a record as a right-aligned prefix followed by a dot
+ * and a space, without going through `printf`.
+ *
+ * @param prefix Buffer of `HISTORY_PREFIX_SIZE` bytes receiving the prefix.
+ * @param number The number of the record.
+ * @return The length of the prefix in bytes.
+ */
+static size_t format_prefix(char* prefix, long long number) {
+    char digits[HISTORY_PREFIX_SIZE];
+    size_t count = 0;
+
+    do {
+        digits[count++] = (char)('0' + number % 10);
+        number /= 10;
+    } while (number > 0 && count < sizeof(digits));
+
+    size_t length = 0;
+    for (size_t padding = count; padding < HISTORY_NUMBER_WIDTH; padding++)
+        prefix[length++] = ' ';
+    while (count > 0)
+        prefix[length++] = digits[--count];
+    prefix[length++] = '.';
+    prefix[length++] = ' ';
+
+    return length;
+}
+
+
+/**
+ * Queues a record for output. The record number, the integrand line, an
+ * indentation and the interval line are gathered as separate vectors, so the
+ * record bytes are written straight from the mapped file.
+ *
+ * @param batch The batch of output vectors.
+ * @param number The number of the record.
+ * @param record Pointer to the first byte of the record in the mapped file.
+ * @param length The length of the record in bytes, including both newlines.
+ * @return true on success, false if a full batch could not be flushed.
+ */
+static bool emit_record(OutputBatch* batch, const long long number,
+                        const char* record, const size_t length) {
+    static const char indent[HISTORY_NUMBER_WIDTH + 2] = "          ";
+
+    if (batch->vector_count + 4 > HISTORY_IOV_BATCH && !flush_batch(batch))
+        return false;
+
+    char* prefix = batch->prefixes[batch->prefix_count++];
+    const size_t prefix_length = format_prefix(prefix, number);
+
+    const char* separator = memchr(record, '\n', length);
+    const size_t split = (size_t)(separator - record) + 1;
+
+    push_vector(batch, prefix, prefix_length);
+    push_vector(batch, record, split);
+    push_vector(batch, indent, sizeof(indent));
+    push_vector(batch, record + split, length - split);
+
+    return true;
+}
+
+
+/**
+ * Maps a byte range of a file into memory read-only. The mapping starts at the
+ * page boundary preceding the range.
+ *
+ * @param fd The file descriptor of the file to map.
+ * @param start The offset of the first byte of the range.
+ * @param end The offset just past the range.
+ * @param mapping Output pointer for the start of the mapping.
+ * @param mapping_length Output pointer for the length of the mapping.
+ * @return Pointer to the first byte of the range inside the mapping, or NULL
+ * on failure.
+ */
+static const char* map_range(const int fd, const uint64_t start,
+                             const uint64_t end, void** mapping,
+                             size_t* mapping_length) {
+    const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+    const uint64_t aligned_start = start - start % page_size;
+
+    *mapping_length = (size_t)(end - aligned_start);
+    *mapping = mmap(nullptr, *mapping_length, PROT_READ, MAP_PRIVATE, fd,
+                    (off_t)aligned_start);
+
+    if (*mapping == MAP_FAILED) {
+        perror("Error mapping file");
+        return nullptr;
+    }
+
+    madvise(*mapping, *mapping_length, MADV_SEQUENTIAL);
+    return (const char*)*mapping + (start - aligned_start);
+}
+
+
+/**
+ * Prints a page of saved records to the standard output, prefixing every
+ * record with its number. Only the requested byte range of the log is mapped,
+ * and records are written directly from the mapping in batches of vectors.
+ *
+ * @param filename The path of the saved functions file.
+ * @param first The 1-based number of the first record to print.
+ * @param last The 1-based number of the last record to print. It is clamped to
+ * the number of saved records.
+ * @param filter If not NULL, only records whose integrand or interval contains
+ * this string are printed.
+ * @return true on success, false if the records could not be read or written.
+ */
+bool history_list(const char* filename, long long first, long long last,
+                  const char* filter) {
+    int data_fd, index_fd;
+    const long long count = open_history(filename, &data_fd, &index_fd);
+    if (count == -1)
+        return false;
+
+    if (first < 1)
+        first = 1;
+    if (last > count)
+        last = count;
+
+    if (first > last) {
+        printf("There are no saved functions in the given range.\n");
+        close(index_fd);
+        close(data_fd);
+        return true;
+    }
+
+    uint64_t start, unused, end;
+    const bool bounds_read = record_bounds(index_fd, first, &start, &unused) &&
+                             read_entry(index_fd, last, &end);
+    close(index_fd);
+    if (!bounds_read) {
+        close(data_fd);
+        return false;
+    }
+
+    void* mapping;
+    size_t mapping_length;
+    const char* cursor =
+        map_range(data_fd, start, end, &mapping, &mapping_length);
+    close(data_fd);
+    if (cursor == NULL)
+        return false;
+
+    const char* range_end = cursor + (end - start);
+    const size_t filter_length = filter ? strlen(filter) : 0;
+    OutputBatch batch = {.vector_count = 0, .prefix_count = 0};
+    bool success = true;
+
+    fflush(stdout);
+
+    for (long long number = first; success && number <= last; number++) {
+        const char* separator = memchr(cursor, '\n', range_end - cursor);
+        const char* record_end =
+            (const char*)memchr(separator + 1, '\n',
+                                range_end - separator - 1) +
+            1;
+        const size_t length = (size_t)(record_end - cursor);
+
+        if (filter == NULL ||
+            memmem(cursor, length, filter, filter_length) != NULL)
+            success = emit_record(&batch, number, cursor, length);
+
+        cursor = record_end;
+    }
+
+    if (success)
+        success = flush_batch(&batch);
+
+    munmap(mapping, mapping_length);
+    return success;
+}
+
+
+/**
+ * Writes every complete record of the saved functions file to the standard
+ * output. The records are mapped into memory and written with a single write
+ * path, without copying them through intermediate buffers.
+ *
+ * @param filename The path of the saved functions file.
+ * @return true on success, false if the file could not be read or written.
+ */
+bool history_dump(const char* filename) {
+    int data_fd, index_fd;
+    const long long count = open_history(filename, &data_fd, &index_fd);
+    if (count == -1)
+        return false;
+
+    uint64_t end;
+    const bool end_read = records_end(index_fd, count, &end);
+    close(index_fd);
+
+    if (!end_read || end == 0) {
+        close(data_fd);
+        return end_read;
+    }
+
+    void* mapping;
+    size_t mapping_length;
+    const char* content = map_range(data_fd, 0, end, &mapping, &mapping_length);
+    close(data_fd);
+    if (content == NULL)
+        return false;
+
+    fflush(stdout);
+    const bool success = write_all(STDOUT_FILENO, content, mapping_length);
+
+    munmap(mapping, mapping_length);
+    return success;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file history.h
+ * @brief Header file for the history module, which maintains a sidecar offset
+ * index for the file of saved functions.
+ *
+ * The saved functions file is a text log in which every record is a pair of
+ * lines: the integrand followed by the interval. The index file, stored next
+ * to it, holds the end offset of every complete record, so the N-th record can
+ * be located, counted or paged through without scanning the log.
+ *
+ * Records are appended atomically and read under advisory locks, so several
+ * instances of the program can share the files.
+ */
+
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+
+#define HISTORY_INDEX_SUFFIX ".idx"
+#define HISTORY_INDEX_MAGIC UINT64_C(0x3158444948544e49) // "INTHIDX1"
+#define HISTORY_INDEX_HEADER_SIZE ((off_t)sizeof(uint64_t))
+#define HISTORY_SCAN_BLOCK_SIZE 4096
+#define HISTORY_ENTRY_BATCH 512
+#define HISTORY_PATH_MAX 4096
+#define HISTORY_IOV_BATCH 1024
+#define HISTORY_NUMBER_WIDTH 8
+#define HISTORY_PREFIX_SIZE 24
+#define HISTORY_WRITE_CHUNK ((size_t)1 << 30)
+#define HISTORY_RECORD_MAX 4096
+
+
+/**
+ * @struct OutputBatch
+ * @brief Gathers output vectors of a listing before they are written.
+ *
+ * Record bytes are referenced directly inside the mapped log, while the
+ * formatted record numbers are kept in the batch itself until it is flushed
+ * with a single `writev` call.
+ */
+typedef struct OutputBatch {
+    struct iovec vectors[HISTORY_IOV_BATCH];
+    char prefixes[HISTORY_IOV_BATCH / 4][HISTORY_PREFIX_SIZE];
+    int vector_count;
+    int prefix_count;
+} OutputBatch;
+
+
+long long history_sync_index(const char* filename);
+
+bool history_index_append(const char* filename);
+
+bool history_append(const char* filename, const char* integrand,
+                    const char* interval);
+
+long long history_count(const char* filename);
+
+bool history_get(const char* filename, long long number, char** integrand,
+                 char** interval);
+
+bool history_get_last(const char* filename, char** integrand, char** interval);
+
+bool history_list(const char* filename, long long first, long long last,
+                  const char* filter);
+
+bool history_dump(const char* filename);
+
+
+#endif /* HISTORY_H */
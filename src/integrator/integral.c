@@ -6,21 +6,118 @@
  * This file contains functions to compute the Riemann sum, lower Darboux sum,
  * and upper Darboux sum of a mathematical expression over a specified interval.
  * It also includes functions to find the infimum and supremum of the expression
- * within that interval.
+ * within that interval, and the non-interactive integration core, which
+ * computes the methods chunk by chunk on one or more threads and can be
+ * stopped between chunks by a deadline or a cancellation token.
  */
 
 
 #include "integral.h"
+
+#include <pthread.h>
+
+#include "cache.h"
+#include "checkpoint.h"
+#include "perf.h"
+#include "trace.h"
+
 #include "debugmalloc.h"
 
 
+/**
+ * The number of integrand evaluations performed by the current thread. The
+ * chunk workers read it before and after their chunks, so every method can
+ * report how many evaluations it took.
+ */
+static thread_local long long evaluation_count = 0;
+
+
+/**
+ * Computes the difference between two points in time.
+ *
+ * @param start The earlier point in time.
+ * @param end The later point in time.
+ * @return The elapsed time in milliseconds.
+ */
+double timespec_diff_ms(const struct timespec* start,
+                        const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) * 1000.0 +
+           (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+
+/**
+ * Validates the given integrand to ensure it meets the maximum allowed length
+ * constraint.
+ *
+ * @param integrand A constant character pointer representing the mathematical
+ * integrand to be validated.
+ * @return true if the integrand length is within the allowed limit defined by
+ * MAX_INTEGRAND_LENGTH, false otherwise.
+ */
+bool validate_integrand(const char* integrand) {
+    if (strlen(integrand) > MAX_INTEGRAND_LENGTH) {
+        fprintf(stderr, "The integrand is too long.\n");
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Validates a given interval string and extracts the start and end points.
+ *
+ * This function checks whether the interval string is properly defined and
+ * parses the interval into numerical start and end points. If the start and end
+ * points are equal, it considers the interval invalid for integration. Error
+ * messages are written to the standard error stream.
+ *
+ * @param interval The interval string in the format "[start ; end]". It should
+ * contain numerical values for start and end separated by a semicolon.
+ * @param start Pointer to a double where the parsed start value will be stored.
+ * @param end Pointer to a double where the parsed end value will be stored.
+ * @return Returns true if the interval is valid; otherwise, returns false.
+ */
+bool validate_interval(const char* interval, double* start, double* end) {
+    if (strcmp(interval, "[ ; ]") == 0 ||
+        sscanf(interval, " [%lf ; %lf]", start, end) != 2) {
+        fprintf(stderr, "The interval is not defined.\n");
+        return false;
+    }
+
+    if (*start == *end) {
+        fprintf(stderr,
+            "Integrating in a [c; c] interval is defined to be equal to 0.\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Returns the number of subintervals of width `dx` covering an interval.
+ *
+ * @param start The starting point of the interval.
+ * @param end The ending point of the interval.
+ * @param dx The width of each subinterval.
+ * @return The number of subintervals, rounded to the nearest integer.
+ */
+static long long count_subintervals(const double start, const double end,
+                                    const double dx) {
+    return llround((end - start) / dx);
+}
+
+
 /**
  * Calculates the Riemann sum of a mathematical expression over a specified
  * interval.
  *
  * This function computes the Riemann sum by evaluating the expression at
  * discrete points within the interval defined by `start` and `end`, with a step
- * size of `dx`.
+ * size of `dx`. The points are computed from their index rather than by
+ * repeated addition, so the number of subintervals does not depend on the
+ * accumulated rounding error.
  *
  * @param expression A pointer to the `Node` representing the mathematical
  * expression to evaluate. The expression must be parsed and valid before being
@@ -35,14 +132,14 @@
  */
 double calculate_Riemann_sum(Node* expression, const double start,
                              const double end, const double dx) {
+    const long long subintervals = count_subintervals(start, end, dx);
     double Riemann_sum = 0;
-    double x = start;
 
-    while (x < end) {
-        Riemann_sum += evaluate(expression, x) * dx;
-        x += dx;
-    }
+    for (long long i = 0; i < subintervals; i++)
+        Riemann_sum += evaluate(expression, start + (double)i * dx) * dx;
 
+    if (subintervals > 0)
+        evaluation_count += subintervals;
     return Riemann_sum;
 }
 
@@ -73,14 +170,17 @@ double find_infimum(Node* expr, const double start, const double end,
 
     double x = start;
     double infimum = evaluate(expr, x);
+    long long evaluations = 1;
 
     while (x <= end) {
         const double value = evaluate(expr, x);
         if (value < infimum)
             infimum = value;
         x += step;
+        evaluations++;
     }
 
+    evaluation_count += evaluations;
     return infimum;
 }
 
@@ -111,12 +211,12 @@ double find_infimum(Node* expr, const double start, const double end,
 double calculate_lower_Darboux_sum(Node* expression, const double start,
                                    const double end, const double dx,
                                    const double step) {
+    const long long subintervals = count_subintervals(start, end, dx);
     double lower_Darboux_sum = 0;
-    double x = start;
 
-    while (x < end) {
+    for (long long i = 0; i < subintervals; i++) {
+        const double x = start + (double)i * dx;
         lower_Darboux_sum += find_infimum(expression, x, x + dx, step) * dx;
-        x += dx;
     }
 
     return lower_Darboux_sum;
@@ -149,14 +249,17 @@ double find_supremum(Node* expr, const double start, const double end,
 
     double x = start;
     double supremum = evaluate(expr, x);
+    long long evaluations = 1;
 
     while (x <= end) {
         const double value = evaluate(expr, x);
         if (value > supremum)
             supremum = value;
         x += step;
+        evaluations++;
     }
 
+    evaluation_count += evaluations;
     return supremum;
 }
 
@@ -187,12 +290,12 @@ double find_supremum(Node* expr, const double start, const double end,
 double calculate_upper_Darboux_sum(Node* expression, const double start,
                                    const double end, const double dx,
                                    const double step) {
+    const long long subintervals = count_subintervals(start, end, dx);
     double upper_Darboux_sum = 0;
-    double x = start;
 
-    while (x < end) {
+    for (long long i = 0; i < subintervals; i++) {
+        const double x = start + (double)i * dx;
         upper_Darboux_sum += find_supremum(expression, x, x + dx, step) * dx;
-        x += dx;
     }
 
     return upper_Darboux_sum;
@@ -200,33 +303,699 @@ double calculate_upper_Darboux_sum(Node* expression, const double start,
 
 
 /**
- * @brief Executes a calculation function and measures the CPU time taken.
+ * @brief Splits an interval into fixed chunks of subintervals.
  *
- * This helper wraps a numerical calculation function, recording the CPU time
- * required to execute it. The elapsed time in milliseconds is stored through
- * the `elapsed_ms` pointer if it is not null.
+ * The chunk size is chosen so that there are at most `CHUNK_MAX_COUNT` chunks
+ * and a chunk of a Darboux sum costs about `CHUNK_MIN_EVALUATIONS`
+ * evaluations, but no less than one subinterval. The extrema are scanned in
+ * steps of `step`, so a subinterval wider than a step costs more than one
+ * evaluation; counting that keeps the chunks of a wide interval at a small
+ * refinement short, so a stopped integration ends soon and the scan is shared
+ * by the threads.
  *
- * @param func Pointer to the calculation function to be timed.
- * @param expression Parsed expression on which the calculation operates.
+ * @param plan Output pointer for the chunk plan.
  * @param start The beginning of the interval.
- * @param end The end of the interval.
- * @param dx Width of each subinterval.
- * @param step Additional step parameter used by some calculations.
- * @param elapsed_ms Output pointer for the measured time in milliseconds.
- * @return The result of the calculation function.
- */
-static double calculate_with_cpu_time(const calculation_func func, Node* expression,
-                                      const double start, const double end, const double dx,
-                                      const double step, double* elapsed_ms) {
+ * @param end The end of the interval. It must be greater than `start`.
+ * @param refinement The number of subintervals.
+ * @param step The step size used for evaluating the extrema.
+ */
+static void plan_chunks(ChunkPlan* plan, const double start, const double end,
+                        const int refinement, const double step) {
+    const long long subintervals = refinement;
+    const double evaluations_per_subinterval =
+        fmax((end - start) / refinement / step, 1.0);
+    const long long cheapest_size =
+        (long long)ceil(CHUNK_MIN_EVALUATIONS / evaluations_per_subinterval);
+
+    long long chunk_size =
+        (subintervals + CHUNK_MAX_COUNT - 1) / CHUNK_MAX_COUNT;
+    if (chunk_size < cheapest_size)
+        chunk_size = cheapest_size;
+
+    plan->start = start;
+    plan->dx = (end - start) / refinement;
+    plan->step = step;
+    plan->subintervals = subintervals;
+    plan->chunk_size = chunk_size;
+    plan->chunk_count = (int)((subintervals + chunk_size - 1) / chunk_size);
+}
+
+
+/**
+ * @brief Returns the number of subintervals in a chunk of a plan.
+ *
+ * @param plan The chunk plan of the interval.
+ * @param chunk The index of the chunk.
+ * @return The number of subintervals, which is smaller than the chunk size
+ * only for the last chunk.
+ */
+static long long chunk_length(const ChunkPlan* plan, const int chunk) {
+    const long long first = (long long)chunk * plan->chunk_size;
+    const long long count = plan->subintervals - first;
+    return count < plan->chunk_size ? count : plan->chunk_size;
+}
+
+
+/**
+ * @brief Applies a calculation function to a single chunk of a plan.
+ *
+ * @param func The calculation function of the method.
+ * @param expression Parsed expression on which the calculation operates.
+ * @param plan The chunk plan of the interval.
+ * @param chunk The index of the chunk.
+ * @return The partial sum of the chunk.
+ */
+static double calculate_chunk(const calculation_func func, Node* expression,
+                              const ChunkPlan* plan, const int chunk) {
+    const long long first = (long long)chunk * plan->chunk_size;
+    const long long count = chunk_length(plan, chunk);
+
+    const double chunk_start = plan->start + (double)first * plan->dx;
+    const double chunk_end = plan->start + (double)(first + count) * plan->dx;
+
+    return func(expression, chunk_start, chunk_end, plan->dx, plan->step);
+}
+
+
+/**
+ * @brief Counts the nodes of an expression tree, the work of one evaluation.
+ *
+ * @param expression The root of the tree, or NULL.
+ * @return The number of nodes.
+ */
+long long count_nodes(const Node* expression) {
+    if (expression == NULL)
+        return 0;
+    return 1 + count_nodes(expression->left) + count_nodes(expression->right);
+}
+
+
+/**
+ * @brief Estimates the number of integrand evaluations of a job.
+ *
+ * The Riemann sum evaluates once per subinterval; each Darboux sum scans the
+ * interval with EXTREMUM_STEP and evaluates twice more per subinterval. With
+ * a tolerance, the number of refinements is not known in advance, so the
+ * estimate covers the first pass and one doubling.
+ *
+ * @param job The description of the integration.
+ * @return The estimated number of evaluations.
+ */
+double estimate_evaluations(const IntegrationJob* job) {
+    unsigned methods = job->methods ? job->methods : METHOD_ALL;
+    if (job->tolerance > 0)
+        methods |= METHOD_FLAG(METHOD_LOWER_DARBOUX) |
+                   METHOD_FLAG(METHOD_UPPER_DARBOUX);
+    const int passes = job->tolerance > 0 ? 2 : 1;
+    const double scan = fabs(job->end - job->start) / EXTREMUM_STEP;
+
+    double evaluations = 0;
+    double refinement = job->refinement;
+    for (int pass = 0; pass < passes; pass++, refinement *= 2) {
+        if (methods & METHOD_FLAG(METHOD_RIEMANN))
+            evaluations += refinement;
+        if (methods & METHOD_FLAG(METHOD_LOWER_DARBOUX))
+            evaluations += scan + 2 * refinement;
+        if (methods & METHOD_FLAG(METHOD_UPPER_DARBOUX))
+            evaluations += scan + 2 * refinement;
+    }
+    return evaluations;
+}
+
+
+/**
+ * @brief Estimates the cost of a job in node evaluations: the size of the
+ * expression times the evaluations of the selected methods at the requested
+ * refinement, see estimate_evaluations().
+ *
+ * @param expression The parsed integrand.
+ * @param job The description of the integration.
+ * @return The estimated cost.
+ */
+double estimate_cost(const Node* expression, const IntegrationJob* job) {
+    return (double)count_nodes(expression) * estimate_evaluations(job);
+}
+
+
+/**
+ * @brief Initialises a cancellation token that is not cancelled.
+ *
+ * @param token The token.
+ */
+void cancel_token_init(CancelToken* token) {
+    atomic_init(&token->cancelled, false);
+}
+
+
+/**
+ * @brief Cancels every integration using a token. Safe to call from a
+ * signal handler.
+ *
+ * @param token The token.
+ */
+void cancel_token_cancel(CancelToken* token) {
+    atomic_store_explicit(&token->cancelled, true, memory_order_relaxed);
+}
+
+
+/**
+ * @brief Tells whether a token has been cancelled.
+ *
+ * @param token The token.
+ * @return true once cancel_token_cancel() was called.
+ */
+bool cancel_token_is_cancelled(const CancelToken* token) {
+    return atomic_load_explicit(&token->cancelled, memory_order_relaxed);
+}
+
+
+/**
+ * @brief Initialises the progress of an integration that has not started.
+ *
+ * @param progress The progress.
+ */
+void integration_progress_init(IntegrationProgress* progress) {
+    atomic_init(&progress->chunks_done, 0);
+    atomic_init(&progress->chunks_total, 0);
+    atomic_init(&progress->refinement, 0);
+}
+
+
+/**
+ * @brief Returns the fraction of the chunks of the refinements started so
+ * far that are complete. Safe to call from any thread while the integration
+ * runs.
+ *
+ * @param progress The progress.
+ * @return The fraction in [0 ; 1], 0 before the first method starts.
+ */
+double integration_progress_fraction(const IntegrationProgress* progress) {
+    const long long total =
+        atomic_load_explicit(&progress->chunks_total, memory_order_relaxed);
+    const long long done =
+        atomic_load_explicit(&progress->chunks_done, memory_order_relaxed);
+    if (total <= 0)
+        return 0;
+    return done >= total ? 1 : (double)done / (double)total;
+}
+
+
+/**
+ * @brief Counts a completed chunk in the progress of an integration.
+ *
+ * @param progress The progress, or NULL.
+ * @param chunks The number of completed chunks.
+ */
+static void count_progress(IntegrationProgress* progress, const int chunks) {
+    if (progress != NULL)
+        atomic_fetch_add_explicit(&progress->chunks_done, chunks,
+                                  memory_order_relaxed);
+}
+
+
+/**
+ * @brief Tells whether the threads of an integration should stop taking
+ * chunks. Reads the clock only while the integration has not stopped yet.
+ *
+ * @param stop The stop conditions, or NULL.
+ * @return true if the token is cancelled or the deadline has passed.
+ */
+static bool integration_stopped(IntegrationStop* stop) {
+    if (stop == NULL)
+        return false;
+    if (atomic_load_explicit(&stop->stopped, memory_order_relaxed))
+        return true;
+
+    bool expired =
+        stop->cancel != NULL && cancel_token_is_cancelled(stop->cancel);
+    if (!expired && stop->has_deadline) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        expired = timespec_diff_ms(&stop->deadline, &now) >= 0;
+    }
+
+    if (expired)
+        atomic_store_explicit(&stop->stopped, true, memory_order_relaxed);
+    return expired;
+}
+
+
+/**
+ * @brief Orders the chunks of a plan by the bit-reversal of their index, so
+ * that any prefix of the order is spread evenly over the interval.
+ *
+ * @param order Output array for the chunk indices.
+ * @param count The number of chunks.
+ */
+static void interleave_chunks(int order[], const int count) {
+    int bits = 0;
+    while ((1 << bits) < count)
+        bits++;
+
+    int position = 0;
+    for (int i = 0; i < (1 << bits); i++) {
+        int reversed = 0;
+        for (int bit = 0; bit < bits; bit++)
+            if (i & (1 << bit))
+                reversed |= 1 << (bits - 1 - bit);
+        if (reversed < count)
+            order[position++] = reversed;
+    }
+}
+
+
+/**
+ * @brief Processes the chunks of the node shares of a task, starting with its
+ * home share and then helping with the others, always evaluating the replica
+ * of the home node.
+ *
+ * @param task The ChunkTask of the thread.
+ */
+static void work_through_shares(const ChunkTask* task) {
+    Node* expression = task->shares[task->home].expression;
+
+    for (int i = 0; i < task->share_count; i++) {
+        NodeShare* share = &task->shares[(task->home + i) % task->share_count];
+        int chunk;
+        while ((chunk = atomic_fetch_add(&share->next_chunk, 1)) <
+               share->end_chunk) {
+            const long long span = trace_begin();
+            share->partials[chunk - share->first_chunk] =
+                calculate_chunk(task->func, expression, task->plan, chunk);
+            trace_end(span, "chunk", "chunk", "chunk", chunk);
+            count_progress(task->progress, 1);
+        }
+    }
+}
+
+
+/**
+ * @brief Thread routine processing chunks until none are left or the
+ * integration is stopped. Every chunk is a span of the trace, and the thread
+ * gives its trace buffer back before returning.
+ *
+ * @param argument Pointer to the ChunkTask of the thread.
+ * @return Always NULL.
+ */
+static void* chunk_worker(void* argument) {
+    ChunkTask* task = (ChunkTask*)argument;
     struct timespec start_time, end_time;
+    if (task->pin != NULL)
+        numa_pin_thread(task->pin);
     clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start_time);
-    const double result = func(expression, start, end, dx, step);
+    const long long evaluations_before = evaluation_count;
+
+    int claimed;
+    if (task->shares != NULL)
+        work_through_shares(task);
+    else
+        while (!integration_stopped(task->stop) &&
+               (claimed = atomic_fetch_add(task->next_chunk, 1)) <
+                   task->plan->chunk_count) {
+            const int chunk =
+                task->order != NULL ? task->order[claimed] : claimed;
+            if (task->checkpoint == NULL ||
+                !checkpoint_is_done(task->checkpoint, chunk)) {
+                const long long span = trace_begin();
+                task->partials[chunk] = calculate_chunk(task->func,
+                                                        task->expression,
+                                                        task->plan, chunk);
+                trace_end(span, "chunk", "chunk", "chunk", chunk);
+                if (task->checkpoint != NULL)
+                    checkpoint_chunk_done(task->checkpoint, chunk);
+            }
+            count_progress(task->progress, 1);
+        }
+
     clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end_time);
+    task->cpu_ms = timespec_diff_ms(&start_time, &end_time);
+    task->evaluations = evaluation_count - evaluations_before;
+    trace_release_thread();
+    return nullptr;
+}
+
 
-    if (elapsed_ms != nullptr)
-        *elapsed_ms = timespec_diff_ms(&start_time, &end_time);
+/**
+ * @brief Copies an expression tree into an array of nodes.
+ *
+ * @param expression The root of the tree, or NULL.
+ * @param nodes The array, with room for count_nodes() nodes.
+ * @param used The number of nodes of the array in use, updated.
+ * @return The root of the copy, or NULL for an empty tree.
+ */
+static Node* copy_tree_into(const Node* expression, Node nodes[],
+                            long long* used) {
+    if (expression == NULL)
+        return nullptr;
 
-    return result;
+    Node* copy = &nodes[(*used)++];
+    *copy = *expression;
+    copy->left = copy_tree_into(expression->left, nodes, used);
+    copy->right = copy_tree_into(expression->right, nodes, used);
+    return copy;
+}
+
+
+/**
+ * @brief Splits the chunks of a plan into one contiguous share per NUMA node
+ * and places a replica of the expression and the partial sums of every share
+ * on its node.
+ *
+ * The shares start with the node of the calling thread, and each gets a
+ * number of chunks proportional to the threads assigned to it, thread `i`
+ * belonging to share `i % share_count`. The caller is moved to every node in
+ * turn, so its first touch places the arena there, and its affinity is
+ * restored afterwards.
+ *
+ * @param topology The NUMA topology.
+ * @param expression Parsed expression on which the calculation operates.
+ * @param plan The chunk plan of the interval.
+ * @param threads The number of threads, at least 2.
+ * @param partials The output array for the partial sums, used by shares
+ * whose arena cannot be mapped.
+ * @param shares Output array for the shares.
+ * @return The number of shares.
+ */
+static int split_across_nodes(const NumaTopology* topology, Node* expression,
+                              const ChunkPlan* plan, const int threads,
+                              double partials[], NodeShare shares[]) {
+    const int share_count =
+        threads < topology->node_count ? threads : topology->node_count;
+    int home = numa_current_node(topology);
+    if (home < 0)
+        home = 0;
+
+    unsigned long affinity[NUMA_MASK_WORDS];
+    const bool movable = numa_get_affinity(affinity);
+    const long long tree_size = count_nodes(expression);
+
+    int assigned = 0;
+    for (int i = 0; i < share_count; i++) {
+        NodeShare* share = &shares[i];
+        const int share_threads =
+            threads / share_count + (i < threads % share_count ? 1 : 0);
+
+        share->node = (home + i) % topology->node_count;
+        share->first_chunk =
+            (int)((long long)plan->chunk_count * assigned / threads);
+        assigned += share_threads;
+        share->end_chunk =
+            (int)((long long)plan->chunk_count * assigned / threads);
+        atomic_init(&share->next_chunk, share->first_chunk);
+
+        const size_t chunks = (size_t)(share->end_chunk - share->first_chunk);
+        share->arena_size =
+            chunks * sizeof(double) + (size_t)tree_size * sizeof(Node);
+        const NumaNode* node = &topology->nodes[share->node];
+        if (movable)
+            numa_pin_thread(node);
+        share->arena = numa_alloc_local(node, share->arena_size);
+
+        if (share->arena == NULL) {
+            share->expression = expression;
+            share->partials = partials + share->first_chunk;
+            continue;
+        }
+
+        long long used = 0;
+        share->partials = share->arena;
+        share->expression = copy_tree_into(
+            expression, (Node*)(share->partials + chunks), &used);
+    }
+
+    if (movable)
+        numa_set_affinity(affinity);
+    return share_count;
+}
+
+
+/**
+ * @brief Copies the partial sums of the node shares into the output array in
+ * chunk order and unmaps their arenas.
+ *
+ * @param shares The shares.
+ * @param share_count The number of shares.
+ * @param partials Output array for the partial sums, indexed by chunk.
+ */
+static void gather_shares(NodeShare shares[], const int share_count,
+                          double partials[]) {
+    for (int i = 0; i < share_count; i++) {
+        if (shares[i].arena == NULL)
+            continue;
+        memcpy(partials + shares[i].first_chunk, shares[i].partials,
+               (size_t)(shares[i].end_chunk - shares[i].first_chunk) *
+                   sizeof(double));
+        numa_free(shares[i].arena, shares[i].arena_size);
+    }
+}
+
+
+/**
+ * @brief Computes the partial sums of the chunks of a plan using several
+ * threads.
+ *
+ * The calling thread takes part in the work. If a thread cannot be started,
+ * the remaining threads process its share of the chunks. Every chunk a thread
+ * has taken is finished, so the completed chunks are always a prefix of the
+ * order in which they are handed out.
+ *
+ * An integration that cannot be stopped, is not checkpointed and has at least
+ * `CHUNK_NUMA_MIN_SUBINTERVALS` subintervals is split along the NUMA nodes of
+ * the machine: every started thread is pinned to the node of its share. The
+ * partial sums are the same either way, so the result does not depend on
+ * the topology.
+ *
+ * @param func The calculation function of the method.
+ * @param expression Parsed expression on which the calculation operates.
+ * @param plan The chunk plan of the interval.
+ * @param threads The number of threads to use.
+ * @param order The order to hand out the chunks in, or NULL for chunk order.
+ * @param stop The stop conditions, or NULL.
+ * @param checkpoint The checkpoint of the integration, or NULL.
+ * @param progress The progress to count the completed chunks in, or NULL.
+ * @param partials Output array for the partial sums, indexed by chunk.
+ * @param cpu_ms Output pointer for the CPU time summed over all threads.
+ * @param evaluations Output pointer for the number of evaluations summed over
+ * all threads.
+ * @return The number of completed chunks.
+ */
+static int run_chunks(const calculation_func func, Node* expression,
+                      const ChunkPlan* plan, int threads, const int* order,
+                      IntegrationStop* stop, Checkpoint* checkpoint,
+                      IntegrationProgress* progress, double partials[],
+                      double* cpu_ms, long long* evaluations) {
+    ChunkTask tasks[MAX_THREADS];
+    pthread_t workers[MAX_THREADS];
+    NodeShare shares[NUMA_MAX_NODES];
+    atomic_int next_chunk = 0;
+
+    if (threads > plan->chunk_count)
+        threads = plan->chunk_count;
+
+    const NumaTopology* topology = numa_topology();
+    int share_count = 0;
+    if (stop == NULL && order == NULL && checkpoint == NULL && threads > 1 &&
+        plan->subintervals >= CHUNK_NUMA_MIN_SUBINTERVALS &&
+        topology->node_count > 1)
+        share_count = split_across_nodes(topology, expression, plan, threads,
+                                         partials, shares);
+
+    for (int i = 0; i < threads; i++) {
+        tasks[i] = (ChunkTask){.func = func,
+                               .expression = expression,
+                               .plan = plan,
+                               .partials = partials,
+                               .order = order,
+                               .stop = stop,
+                               .checkpoint = checkpoint,
+                               .progress = progress,
+                               .next_chunk = &next_chunk,
+                               .shares = nullptr,
+                               .share_count = share_count,
+                               .home = 0,
+                               .pin = nullptr,
+                               .cpu_ms = 0,
+                               .evaluations = 0};
+        if (share_count > 0) {
+            tasks[i].shares = shares;
+            tasks[i].home = i % share_count;
+            // The caller keeps its own placement; it starts on share 0.
+            if (i > 0)
+                tasks[i].pin = &topology->nodes[shares[tasks[i].home].node];
+        }
+    }
+
+    int started = 1;
+    while (started < threads &&
+           pthread_create(&workers[started], nullptr, chunk_worker,
+                          &tasks[started]) == 0)
+        started++;
+
+    chunk_worker(&tasks[0]);
+
+    *cpu_ms = tasks[0].cpu_ms;
+    *evaluations = tasks[0].evaluations;
+    for (int i = 1; i < started; i++) {
+        pthread_join(workers[i], nullptr);
+        *cpu_ms += tasks[i].cpu_ms;
+        *evaluations += tasks[i].evaluations;
+    }
+
+    if (share_count > 0) {
+        gather_shares(shares, share_count, partials);
+        return plan->chunk_count;
+    }
+
+    const int claimed = atomic_load(&next_chunk);
+    return claimed < plan->chunk_count ? claimed : plan->chunk_count;
+}
+
+
+/**
+ * @brief Estimates the value of a method from the chunks completed before the
+ * integration was stopped.
+ *
+ * The sum over the completed chunks is extrapolated to the whole interval by
+ * their mean height. The error is estimated as the width of the remaining
+ * part times the spread of the mean heights of the completed chunks. This is
+ * an estimate rather than a bound: it only holds if the mean height of every
+ * remaining chunk lies within the range observed on the completed ones. Since
+ * the chunks are handed out interleaved, the completed ones are at least
+ * spread over the whole interval.
+ *
+ * @param plan The chunk plan of the interval.
+ * @param order The order the chunks were handed out in.
+ * @param partials The partial sums, indexed by chunk.
+ * @param completed The number of completed chunks, a prefix of `order`.
+ * @param result Output pointer for the estimate and its error.
+ */
+static void estimate_partial(const ChunkPlan* plan, const int order[],
+                             const double partials[], const int completed,
+                             MethodResult* result) {
+    if (completed == 0) {
+        result->value = 0;
+        result->error_bound = INFINITY;
+        return;
+    }
+
+    double covered_sum = 0;
+    double covered_width = 0;
+    double lowest = INFINITY;
+    double highest = -INFINITY;
+    for (int i = 0; i < completed; i++) {
+        const int chunk = order[i];
+        const double width = (double)chunk_length(plan, chunk) * plan->dx;
+        const double height = partials[chunk] / width;
+        covered_sum += partials[chunk];
+        covered_width += width;
+        lowest = fmin(lowest, height);
+        highest = fmax(highest, height);
+    }
+
+    const double remaining =
+        fmax((double)plan->subintervals * plan->dx - covered_width, 0);
+    result->value = covered_sum + remaining * (covered_sum / covered_width);
+    result->error_bound = remaining * (highest - lowest);
+}
+
+
+/**
+ * @brief Counts the subintervals of the completed chunks of a plan.
+ *
+ * @param plan The chunk plan of the interval.
+ * @param order The order the chunks were handed out in, or NULL for chunk
+ * order.
+ * @param completed The number of completed chunks, a prefix of the order.
+ * @return The number of subintervals.
+ */
+static long long completed_subintervals(const ChunkPlan* plan,
+                                        const int order[],
+                                        const int completed) {
+    if (completed == plan->chunk_count)
+        return plan->subintervals;
+
+    long long subintervals = 0;
+    for (int i = 0; i < completed; i++)
+        subintervals += chunk_length(plan, order != NULL ? order[i] : i);
+    return subintervals;
+}
+
+
+/**
+ * @brief Executes a calculation function and measures the CPU time taken.
+ *
+ * This helper runs a numerical calculation function over all chunks of a
+ * plan, recording the CPU time required by all participating threads, the
+ * elapsed real time, the number of evaluations, the subintervals of the
+ * completed chunks and the nodes the evaluations visited. The measurements
+ * are added to those already in the result, so repeated refinements
+ * accumulate.
+ *
+ * The partial sums are added up in chunk order, so the result does not depend
+ * on the number of threads. If the integration can be stopped, the chunks are
+ * handed out interleaved, and a stopped method gets an estimate from its
+ * completed chunks. A checkpointed method restores the chunks the checkpoint
+ * holds, and writes a final checkpoint if it is stopped.
+ *
+ * @param func Pointer to the calculation function to be timed.
+ * @param expression Parsed expression on which the calculation operates.
+ * @param plan The chunk plan of the interval.
+ * @param threads The number of threads to use.
+ * @param stop The stop conditions, or NULL.
+ * @param checkpoint The checkpoint of the integration, or NULL.
+ * @param progress The progress of the integration, or NULL.
+ * @param result Output pointer for the value and the measurements.
+ * @return true if every chunk was computed, false if the integration was
+ * stopped first.
+ */
+static bool calculate_with_cpu_time(const calculation_func func,
+                                    Node* expression, const ChunkPlan* plan,
+                                    const int threads, IntegrationStop* stop,
+                                    Checkpoint* checkpoint,
+                                    IntegrationProgress* progress,
+                                    MethodResult* result) {
+    struct timespec start_time, end_time;
+    double partials[CHUNK_MAX_COUNT];
+    int order[CHUNK_MAX_COUNT];
+    double cpu_ms;
+    long long evaluations;
+
+    if (stop != NULL)
+        interleave_chunks(order, plan->chunk_count);
+    if (checkpoint != NULL)
+        checkpoint_prepare(checkpoint, plan, partials);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    const int completed =
+        run_chunks(func, expression, plan, threads,
+                   stop != NULL ? order : nullptr, stop, checkpoint, progress,
+                   partials, &cpu_ms, &evaluations);
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+    if (checkpoint != NULL && completed < plan->chunk_count)
+        checkpoint_save(checkpoint, true);
+
+    if (completed == plan->chunk_count) {
+        double sum = 0;
+        for (int chunk = 0; chunk < plan->chunk_count; chunk++)
+            sum += partials[chunk];
+        result->value = sum;
+        result->error_bound = 0;
+    } else {
+        estimate_partial(plan, order, partials, completed, result);
+    }
+
+    result->time_ms += cpu_ms;
+    result->wall_ms += timespec_diff_ms(&start_time, &end_time);
+    result->evaluations += evaluations;
+    result->subintervals += completed_subintervals(
+        plan, stop != NULL ? order : nullptr, completed);
+    // evaluate() visits every node of the tree exactly once
+    result->node_visits += evaluations * count_nodes(expression);
+    // A method stopped before any of its chunks finished has no value
+    if (completed > 0)
+        result->computed = true;
+    return completed == plan->chunk_count;
 }
 
 /**
@@ -244,85 +1013,527 @@ static double Riemann_sum_adapter(Node* expression, const double start, const do
 
 
 /**
- * @brief Computes the numerical integral of a given mathematical expression.
+ * @brief The calculation functions of the methods, indexed by
+ * IntegrationMethod.
+ */
+static const calculation_func METHOD_FUNCTIONS[METHOD_COUNT] = {
+    Riemann_sum_adapter, calculate_lower_Darboux_sum,
+    calculate_upper_Darboux_sum};
+
+
+/**
+ * @brief Computes the partial sums of a range of chunks of a plan, the unit
+ * of work of a ChunkExecutor.
  *
- * This function performs numerical integration for a given mathematical
- * expression (`integrand`) over a specified interval (`interval`). It
- * validates the input, interprets the function, and calculates the
- * integral using numerical methods. If the input is invalid or any errors
- * occur during computation, the function will free the associated resources
- * and terminate gracefully.
+ * Every chunk is computed exactly as by the local threads of
+ * integrate_expression(), so partial sums computed in different processes can
+ * be combined without changing the result.
  *
- * The function allows integration over intervals, and handles cases where the
- * start of the interval is greater than the end by adjusting the interval and
- * returning the negated result as needed.
+ * @param expression Parsed expression on which the calculation operates.
+ * @param method The method.
+ * @param plan The chunk plan of the interval.
+ * @param first_chunk The first chunk of the range.
+ * @param end_chunk The chunk after the last one of the range.
+ * @param threads The number of threads to use, clamped to [1 ; MAX_THREADS].
+ * @param partials Output array for the partial sums, indexed by chunk; only
+ * the chunks of the range are written.
+ * @param cpu_ms Output pointer for the CPU time summed over all threads.
+ * @param evaluations Output pointer for the number of evaluations.
+ */
+void integrate_chunks(Node* expression, const IntegrationMethod method,
+                      const ChunkPlan* plan, const int first_chunk,
+                      const int end_chunk, int threads, double partials[],
+                      double* cpu_ms, long long* evaluations) {
+    int order[CHUNK_MAX_COUNT];
+    ChunkPlan range = *plan;
+    range.chunk_count = end_chunk - first_chunk;
+    for (int i = 0; i < range.chunk_count; i++)
+        order[i] = first_chunk + i;
+
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    run_chunks(METHOD_FUNCTIONS[method], expression, &range, threads, order,
+               nullptr, nullptr, nullptr, partials, cpu_ms, evaluations);
+}
+
+
+/**
+ * @brief Computes a method with the executor of a job and measures the
+ * elapsed time.
+ *
+ * The partial sums are added up in chunk order, exactly as in
+ * calculate_with_cpu_time(), and the measurements are added to those already
+ * in the result.
  *
- * @param integrand A string representing the mathematical function to be
- *                  integrated. The function is expected to be a valid
- *                  mathematical expression.
- * @param interval A string representing the interval over which the integral
- *                 is to be computed, formatted as "[start ; end]".
+ * @param executor The executor.
+ * @param expression Parsed expression on which the calculation operates.
+ * @param method The method.
+ * @param plan The chunk plan of the interval.
+ * @param result Output pointer for the value and the measurements.
+ * @return true on success, false if the executor failed.
  */
-void integrate(char* integrand, char* interval) {
-    remove_spaces(integrand);
+static bool calculate_with_executor(const ChunkExecutor* executor,
+                                    Node* expression,
+                                    const IntegrationMethod method,
+                                    const ChunkPlan* plan,
+                                    MethodResult* result) {
+    struct timespec start_time, end_time;
+    double partials[CHUNK_MAX_COUNT];
+    double cpu_ms = 0;
+    long long evaluations = 0;
 
-    if (!validate_integrand(integrand)) {
-        free_resources(integrand, interval, nullptr);
-        return;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    const bool computed = executor->run(executor->context, expression,
+                                        method, plan, partials, &cpu_ms,
+                                        &evaluations);
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    if (!computed)
+        return false;
+
+    double sum = 0;
+    for (int chunk = 0; chunk < plan->chunk_count; chunk++)
+        sum += partials[chunk];
+    result->value = sum;
+    result->error_bound = 0;
+    result->time_ms += cpu_ms;
+    result->wall_ms += timespec_diff_ms(&start_time, &end_time);
+    result->evaluations += evaluations;
+    result->subintervals += plan->subintervals;
+    result->node_visits += evaluations * count_nodes(expression);
+    result->computed = true;
+    return true;
+}
+
+
+/**
+ * @brief Short names of the methods, indexed by IntegrationMethod.
+ */
+static const char* const METHOD_NAMES[METHOD_COUNT] = {"riemann", "lower",
+                                                       "upper"};
+
+
+/**
+ * @brief Returns the short name of a method, as used on the command line and
+ * in machine-readable output.
+ *
+ * @param method The method.
+ * @return The name of the method.
+ */
+const char* method_name(const IntegrationMethod method) {
+    return METHOD_NAMES[method];
+}
+
+
+/**
+ * @brief Derives the throughput of a method from its measurements.
+ *
+ * @param result The result of the method.
+ * @return The throughput; rates without evaluations or time are zero.
+ */
+MethodMetrics method_metrics(const MethodResult* result) {
+    MethodMetrics metrics = {0};
+    if (result->evaluations <= 0)
+        return metrics;
+
+    const double evaluations = (double)result->evaluations;
+    if (result->wall_ms > 0)
+        metrics.evaluations_per_second =
+            evaluations / (result->wall_ms / 1E+03);
+    metrics.ns_per_evaluation = result->time_ms * 1E+06 / evaluations;
+    metrics.nodes_per_evaluation = (double)result->node_visits / evaluations;
+    if (result->node_visits > 0)
+        metrics.ns_per_node_visit =
+            result->time_ms * 1E+06 / (double)result->node_visits;
+    return metrics;
+}
+
+
+/**
+ * @brief Returns the name of an integration status, as used in
+ * machine-readable output.
+ *
+ * @param status The status.
+ * @return The name of the status.
+ */
+const char* status_name(const IntegrationStatus status) {
+    switch (status) {
+        case INTEGRATION_OK:
+            return "ok";
+        case INTEGRATION_INVALID_INTEGRAND:
+            return "invalid_integrand";
+        case INTEGRATION_INVALID_INTERVAL:
+            return "invalid_interval";
+        case INTEGRATION_INVALID_REFINEMENT:
+            return "invalid_refinement";
+        case INTEGRATION_NOT_CONVERGED:
+            return "not_converged";
+        case INTEGRATION_PARTIAL:
+            return "partial";
+        case INTEGRATION_REJECTED:
+            return "rejected";
+        default:
+            return "error";
     }
+}
 
-    double start, end;
 
-    if (!validate_interval(interval, &start, &end)) {
-        free_resources(integrand, interval, nullptr);
-        return;
+/**
+ * @brief Converts a list of method names to a method mask.
+ *
+ * The names may be separated by commas, plus signs or vertical bars, and "all"
+ * selects every method.
+ *
+ * @param text The list of method names.
+ * @param methods Output pointer for the mask of selected methods.
+ * @return true if every name is known and at least one method is selected,
+ * false otherwise.
+ */
+bool parse_methods(const char* text, unsigned* methods) {
+    *methods = 0;
+
+    while (*text != '\0') {
+        const size_t length = strcspn(text, ",+|");
+        bool known = length == 3 && strncmp(text, "all", 3) == 0;
+        if (known)
+            *methods |= METHOD_ALL;
+
+        for (int method = 0; method < METHOD_COUNT && !known; method++) {
+            if (strlen(METHOD_NAMES[method]) == length &&
+                strncmp(text, METHOD_NAMES[method], length) == 0) {
+                *methods |= METHOD_FLAG(method);
+                known = true;
+            }
+        }
+
+        if (!known)
+            return false;
+
+        text += length;
+        if (*text != '\0')
+            text++;
     }
 
-    // The number of subintervals for the partitioning of the interval
-    const int refinement = get_partition_refinement();
-    if (refinement == -1) {
-        free_resources(integrand, interval, nullptr);
-        return;
+    return *methods != 0;
+}
+
+
+/**
+ * @brief Clears a result and records the parameters of its job.
+ *
+ * @param result The result to initialise.
+ * @param job The job the result belongs to.
+ */
+static void begin_result(IntegrationResult* result, const IntegrationJob* job) {
+    memset(result, 0, sizeof(*result));
+    result->start = job->start;
+    result->end = job->end;
+    result->tolerance = job->tolerance;
+}
+
+
+/**
+ * @brief Prepares the stop conditions of a job.
+ *
+ * @param stop The stop conditions to initialise.
+ * @param job The job.
+ * @param start_time The time the integration started.
+ * @return `stop`, or NULL if the job has neither a deadline nor a
+ * cancellation token.
+ */
+static IntegrationStop* begin_stop(IntegrationStop* stop,
+                                   const IntegrationJob* job,
+                                   const struct timespec* start_time) {
+    if (job->cancel == NULL && !(job->deadline_ms > 0))
+        return nullptr;
+
+    stop->cancel = job->cancel;
+    stop->has_deadline = job->deadline_ms > 0;
+    atomic_init(&stop->stopped, false);
+
+    if (stop->has_deadline) {
+        // Budgets beyond a few decades cannot pass and would overflow.
+        const double budget_ms = fmin(job->deadline_ms, 1E+12);
+        const double seconds = floor(budget_ms / 1000.0);
+        long long nanoseconds = start_time->tv_nsec +
+                                llround((budget_ms - seconds * 1000.0) * 1E+06);
+        stop->deadline.tv_sec = start_time->tv_sec + (time_t)seconds;
+        if (nanoseconds >= 1000000000) {
+            stop->deadline.tv_sec++;
+            nanoseconds -= 1000000000;
+        }
+        stop->deadline.tv_nsec = (long)nanoseconds;
     }
 
-    Node* expression = parse(integrand);
-    if (!expression) {
-        perror("Error parsing expression.\n");
-        free_resources(integrand, interval, nullptr);
-        return;
+    return stop;
+}
+
+
+/**
+ * @brief Computes the requested methods of a job for a parsed expression.
+ *
+ * This is the non-interactive core of the integrator: it neither prompts nor
+ * prints. The interval of the job may be reversed, in which case the results
+ * are negated. If the job has a positive tolerance, the refinement is doubled
+ * until the Darboux sums are within the tolerance of each other, or until the
+ * maximum refinement would be exceeded or a subinterval would be narrower than
+ * EXTREMUM_STEP, below which the Darboux sums no longer scan the subintervals.
+ *
+ * If the deadline of the job passes or its token is cancelled, the threads
+ * finish the chunks in progress and the result is INTEGRATION_PARTIAL, with
+ * the best estimate so far and its error for every method:
+ *
+ * - If an earlier refinement towards the tolerance completed, its values are
+ *   returned, and the difference of its Darboux sums bounds how far any
+ *   method could still move.
+ * - Otherwise the methods completed before the stop keep their values, with
+ *   an error of 0, and the method that was stopped is extrapolated from its
+ *   completed chunks, see estimate_partial(). It is left out if none of them
+ *   finished, like the methods not started yet.
+ *
+ * A checkpointed job writes its progress to the checkpoint as it goes, and
+ * resuming a checkpoint of the same job skips the methods and chunks it
+ * holds. The partial sums are restored bit for bit, so a resumed integration
+ * returns the same values as an uninterrupted one. The checkpoint is removed
+ * once the integration has finished, unless it was stopped.
+ *
+ * If the job has a progress, every refinement adds the chunks of its methods
+ * to the total when it starts, and they are counted as they complete,
+ * including chunks restored from a checkpoint.
+ *
+ * @param expression The parsed expression to integrate.
+ * @param job The description of the integration.
+ * @param result Output pointer for the results.
+ * @return INTEGRATION_OK on success, INTEGRATION_INVALID_INTERVAL or
+ * INTEGRATION_INVALID_REFINEMENT for an invalid job, and
+ * INTEGRATION_NOT_CONVERGED if the tolerance could not be reached. In the last
+ * case the result holds the values of the finest refinement.
+ * INTEGRATION_PARTIAL is returned for a stopped integration and
+ * INTEGRATION_ERROR if the executor of the job failed. The status is also
+ * stored in the result.
+ */
+IntegrationStatus integrate_expression(Node* expression,
+                                       const IntegrationJob* job,
+                                       IntegrationResult* result) {
+    begin_result(result, job);
+
+    if (!isfinite(job->start) || !isfinite(job->end) ||
+        job->start == job->end)
+        return result->status = INTEGRATION_INVALID_INTERVAL;
+
+    if (job->refinement < MIN_REFINEMENT || job->refinement > MAX_REFINEMENT)
+        return result->status = INTEGRATION_INVALID_REFINEMENT;
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    IntegrationStop stop_conditions;
+    IntegrationStop* stop = job->executor == NULL
+                                ? begin_stop(&stop_conditions, job, &start_time)
+                                : nullptr;
+
+    const bool minus = job->start > job->end;
+    const double start = minus ? job->end : job->start;
+    const double end = minus ? job->start : job->end;
+
+    int threads = job->threads;
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    unsigned methods = job->methods ? job->methods : METHOD_ALL;
+    if (job->tolerance > 0)
+        methods |= METHOD_FLAG(METHOD_LOWER_DARBOUX) |
+                   METHOD_FLAG(METHOD_UPPER_DARBOUX);
+
+    IntegrationStatus status = INTEGRATION_OK;
+    int refinement = job->refinement;
+    double previous_values[METHOD_COUNT] = {0};
+    double previous_gap = 0;
+    int first_method = 0;
+
+    Checkpoint* checkpoint = job->executor == NULL ? job->checkpoint : nullptr;
+    if (checkpoint != NULL && !checkpoint_begin(checkpoint, expression, job))
+        checkpoint = nullptr;
+    if (checkpoint != NULL && checkpoint->resumed) {
+        const CheckpointFile* saved = &checkpoint->saved;
+        refinement = saved->refinement;
+        first_method = (int)saved->method;
+        memcpy(previous_values, saved->previous_values,
+               sizeof(previous_values));
+        previous_gap = saved->previous_gap;
+        memcpy(result->methods, saved->methods, sizeof(result->methods));
     }
 
-    bool minus = false;
-    if (start > end) {
-        const double temp = start;
-        start = end;
-        end = temp;
-        minus = true;
+    while (true) {
+        ChunkPlan plan;
+        plan_chunks(&plan, start, end, refinement, EXTREMUM_STEP);
+        if (job->progress != NULL) {
+            int remaining = 0;
+            for (int method = first_method; method < METHOD_COUNT; method++)
+                if (methods & METHOD_FLAG(method))
+                    remaining++;
+            atomic_fetch_add_explicit(&job->progress->chunks_total,
+                                      (long long)remaining * plan.chunk_count,
+                                      memory_order_relaxed);
+            atomic_store_explicit(&job->progress->refinement, refinement,
+                                  memory_order_relaxed);
+        }
+
+        bool complete = true;
+        bool failed = false;
+        for (int method = first_method;
+             method < METHOD_COUNT && complete && !failed; method++) {
+            if (!(methods & METHOD_FLAG(method)))
+                continue;
+            const long long span = trace_begin();
+            if (job->executor != NULL) {
+                failed = !calculate_with_executor(job->executor, expression,
+                                                  method, &plan,
+                                                  &result->methods[method]);
+                trace_end(span, "method", method_name(method), "refinement",
+                          refinement);
+                if (!failed)
+                    count_progress(job->progress, plan.chunk_count);
+                continue;
+            }
+
+            if (checkpoint != NULL)
+                checkpoint_track(checkpoint, result, refinement, method,
+                                 previous_values, previous_gap);
+            const long long evaluations = result->methods[method].evaluations;
+            if (job->perf != NULL)
+                perf_phase_begin(job->perf);
+            complete = calculate_with_cpu_time(
+                METHOD_FUNCTIONS[method], expression, &plan, threads, stop,
+                checkpoint, job->progress, &result->methods[method]);
+            if (job->perf != NULL)
+                perf_phase_end(job->perf, PERF_PHASE_OF_METHOD(method),
+                               result->methods[method].evaluations -
+                                   evaluations);
+            trace_end(span, "method", method_name(method), "refinement",
+                      refinement);
+            if (checkpoint != NULL && complete) {
+                checkpoint_track(checkpoint, result, refinement, method + 1,
+                                 previous_values, previous_gap);
+                checkpoint_save(checkpoint, false);
+            }
+        }
+        first_method = 0;
+
+        if (failed) {
+            status = INTEGRATION_ERROR;
+            break;
+        }
+
+        if (!complete) {
+            status = INTEGRATION_PARTIAL;
+            if (refinement == job->refinement) {
+                result->refinement = refinement;
+                break;
+            }
+
+            // The previous refinement is complete and brackets every method.
+            for (int method = 0; method < METHOD_COUNT; method++) {
+                result->methods[method].value = previous_values[method];
+                result->methods[method].error_bound = previous_gap;
+            }
+            break;
+        }
+        result->refinement = refinement;
+
+        if (job->tolerance <= 0)
+            break;
+
+        // Below the extremum step the Darboux sums only see the left end of
+        // each subinterval, so they agree whatever the integrand.
+        const bool scanned = (end - start) / refinement >= EXTREMUM_STEP;
+        const double gap =
+            fabs(result->methods[METHOD_UPPER_DARBOUX].value -
+                 result->methods[METHOD_LOWER_DARBOUX].value);
+        if (scanned && gap <= job->tolerance)
+            break;
+
+        if (!scanned || refinement > MAX_REFINEMENT / 2 ||
+            (end - start) / (2.0 * refinement) < EXTREMUM_STEP) {
+            status = INTEGRATION_NOT_CONVERGED;
+            break;
+        }
+
+        for (int method = 0; method < METHOD_COUNT; method++)
+            previous_values[method] = result->methods[method].value;
+        previous_gap = gap;
+        refinement *= 2;
     }
 
-    // Size of each subinterval
-    const double dx = (end - start) / refinement;
+    if (checkpoint != NULL)
+        checkpoint_finish(checkpoint, status);
 
-    double time_of_Riemann;
-    const double Riemann_sum = calculate_with_cpu_time(
-        Riemann_sum_adapter, expression, start, end, dx, 0, &time_of_Riemann);
+    if (minus)
+        for (int method = 0; method < METHOD_COUNT; method++)
+            result->methods[method].value = -result->methods[method].value;
 
-    constexpr double step = 1E-05; // The step size for evaluating the extremum
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    result->wall_ms = timespec_diff_ms(&start_time, &end_time);
+    return result->status = status;
+}
+
+
+/**
+ * @brief Validates, parses and integrates an integrand without any user
+ * interaction.
+ *
+ * The integrand is copied, so the caller keeps ownership of the string. All
+ * intermediate resources are released before returning. Exact repeats are
+ * served from the result cache if it is open.
+ *
+ * @param integrand The integrand in Reverse Polish Notation.
+ * @param job The description of the integration.
+ * @param result Output pointer for the results.
+ * @return The status of the integration, see integrate_expression().
+ * INTEGRATION_INVALID_INTEGRAND is returned for an integrand that is too long
+ * or is not a well-formed expression.
+ */
+IntegrationStatus integrate_job(const char* integrand,
+                                const IntegrationJob* job,
+                                IntegrationResult* result) {
+    begin_result(result, job);
 
-    double time_of_lower_Darboux;
-    const double lower_Darboux_sum = calculate_with_cpu_time(
-        calculate_lower_Darboux_sum, expression, start, end, dx, step,
-        &time_of_lower_Darboux);
+    char* expression_text = (char*)malloc(strlen(integrand) + 1);
+    if (expression_text == NULL) {
+        perror("Did not manage to allocate memory");
+        return result->status = INTEGRATION_ERROR;
+    }
+    strcpy(expression_text, integrand);
+    remove_spaces(expression_text);
 
-    double time_of_upper_Darboux;
-    const double upper_Darboux_sum = calculate_with_cpu_time(
-        calculate_upper_Darboux_sum, expression, start, end, dx, step,
-        &time_of_upper_Darboux);
+    if (job->perf != NULL)
+        perf_phase_begin(job->perf);
+    long long span = trace_begin();
+    const bool valid = validate_integrand(expression_text) &&
+                       validate_expression(expression_text);
+    trace_end(span, "integrand", "validate", TRACE_NO_ARGUMENT, 0);
+    span = trace_begin();
+    Node* expression = valid ? parse(expression_text) : nullptr;
+    trace_end(span, "integrand", "parse", TRACE_NO_ARGUMENT, 0);
+    if (job->perf != NULL)
+        perf_phase_end(job->perf, PERF_PHASE_PARSE, 0);
+
+    if (!valid) {
+        free(expression_text);
+        return result->status = INTEGRATION_INVALID_INTEGRAND;
+    }
 
-    const double time_spent[3] = {time_of_Riemann, time_of_lower_Darboux,
-                            time_of_upper_Darboux};
+    span = trace_begin();
+    const IntegrationStatus status =
+        integrate_cached(expression, job, result);
+    trace_end(span, "integration", "integrate", "refinement",
+              job->refinement);
 
-    log_integral_values(minus, Riemann_sum, lower_Darboux_sum,
-                        upper_Darboux_sum, time_spent);
-    free_resources(integrand, interval, expression);
+    free(expression_text);
+    free_tree(expression);
+    return status;
 }
@@ -3,7 +3,10 @@
  * @brief Header file for integral calculation functions.
  *
  * This file contains declarations for functions that compute Riemann sums,
- * Darboux sums, and perform integration based on user input.
+ * Darboux sums, and validate integrands and intervals. It also defines
+ * the job and result types of the non-interactive integration core, which
+ * splits the partition into fixed chunks that may be processed by several
+ * threads.
  */
 
 
@@ -13,25 +16,338 @@
 
 #include <ctype.h>
 #include <float.h>
+#include <limits.h>
 #include <math.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#include "controls.h"
 #include "expression_parser.h"
+#include "numa.h"
 
 
-#define INITIAL_SIZE 256
 #define MAX_INTEGRAND_LENGTH 100
 #define MIN_REFINEMENT 1
 #define MAX_REFINEMENT 20000000
+#define DEFAULT_REFINEMENT 1000
+#define EXTREMUM_STEP 1E-05
+#define METHOD_COUNT 3
+#define MAX_THREADS 256
+#define CHUNK_MAX_COUNT 1024
+#define CHUNK_MIN_EVALUATIONS 1024
+#define CHUNK_NUMA_MIN_SUBINTERVALS 1048576
+#define CHUNK_CACHE_LINE 64
 
 
 typedef double (*calculation_func)(Node*, double, double, double, double);
 
 
+/**
+ * @enum IntegrationMethod
+ * @brief The numerical methods computed by the integration core.
+ *
+ * The values index the `methods` array of an IntegrationResult. A set of
+ * methods is represented as a bit mask built with METHOD_FLAG().
+ */
+typedef enum IntegrationMethod {
+    METHOD_RIEMANN,
+    METHOD_LOWER_DARBOUX,
+    METHOD_UPPER_DARBOUX
+} IntegrationMethod;
+
+#define METHOD_FLAG(method) (1u << (method))
+#define METHOD_ALL                                                             \
+    (METHOD_FLAG(METHOD_RIEMANN) | METHOD_FLAG(METHOD_LOWER_DARBOUX) |         \
+     METHOD_FLAG(METHOD_UPPER_DARBOUX))
+
+
+/**
+ * @enum IntegrationStatus
+ * @brief The outcome of a non-interactive integration.
+ *
+ * INTEGRATION_PARTIAL marks a result that was stopped by its deadline or its
+ * cancellation token before completing, and INTEGRATION_REJECTED a job that a
+ * scheduler refused because its estimated cost exceeds the budget, see
+ * estimate_cost(). They follow INTEGRATION_ERROR so the values of the older
+ * statuses stay the same in stored results.
+ */
+typedef enum IntegrationStatus {
+    INTEGRATION_OK,
+    INTEGRATION_INVALID_INTEGRAND,
+    INTEGRATION_INVALID_INTERVAL,
+    INTEGRATION_INVALID_REFINEMENT,
+    INTEGRATION_NOT_CONVERGED,
+    INTEGRATION_ERROR,
+    INTEGRATION_PARTIAL,
+    INTEGRATION_REJECTED
+} IntegrationStatus;
+
+#define INTEGRATION_STATUS_COUNT (INTEGRATION_REJECTED + 1)
+
+
+/**
+ * @struct CancelToken
+ * @brief Lets another thread, or a signal handler, stop integrations.
+ *
+ * Any number of jobs may share a token. Once cancelled, a token stays
+ * cancelled until it is initialised again.
+ */
+typedef struct CancelToken {
+    atomic_bool cancelled;
+} CancelToken;
+
+
+/**
+ * @struct IntegrationProgress
+ * @brief Lets another thread follow an integration, e.g. for a progress bar.
+ *
+ * The chunks of every method of a refinement are added to `chunks_total`
+ * when the refinement starts, and every completed chunk is counted in
+ * `chunks_done`; with a tolerance the total grows with each refinement, and
+ * `refinement` is the refinement in progress. The counters may be read at
+ * any time.
+ */
+typedef struct IntegrationProgress {
+    atomic_llong chunks_done;
+    atomic_llong chunks_total;
+    atomic_int refinement;
+} IntegrationProgress;
+
+
+typedef struct ChunkExecutor ChunkExecutor;
+typedef struct Checkpoint Checkpoint;
+typedef struct PerfProfile PerfProfile;
+
+
+/**
+ * @struct IntegrationJob
+ * @brief Describes a single integration for the non-interactive core.
+ *
+ * If `tolerance` is positive, the refinement is doubled, starting from
+ * `refinement`, until the difference between the Darboux sums is at most the
+ * tolerance. The Darboux sums are always computed in that case. The doubling
+ * stops short of subintervals narrower than EXTREMUM_STEP, which the Darboux
+ * sums could not scan any more.
+ *
+ * If `deadline_ms` is positive, the integration stops once that many
+ * milliseconds have passed since it started; if `cancel` is not NULL, it
+ * stops once the token is cancelled. Both are checked between chunks, so the
+ * chunk in progress on each thread is finished first.
+ *
+ * If `executor` is not NULL, the chunks are computed by it instead of by
+ * `threads` local threads, e.g. on remote workers; such a job cannot be
+ * stopped, so its deadline and token are ignored.
+ *
+ * If `checkpoint` is not NULL, the progress of the integration is written to
+ * it periodically and a checkpoint of the same job may be resumed, see
+ * checkpoint.h. It is ignored for a job with an executor. If `progress` is
+ * not NULL, the completed chunks are counted in it.
+ *
+ * If `perf` is not NULL, hardware counters are read around the parsing of
+ * the integrand and around each method computed by local threads, see
+ * perf.h.
+ */
+typedef struct IntegrationJob {
+    double start;
+    double end;
+    int refinement;
+    double tolerance;
+    unsigned methods;
+    int threads;
+    double deadline_ms;
+    CancelToken* cancel;
+    const ChunkExecutor* executor;
+    Checkpoint* checkpoint;
+    IntegrationProgress* progress;
+    PerfProfile* perf;
+} IntegrationJob;
+
+
+/**
+ * @struct MethodResult
+ * @brief The value of a single method along with the time it took.
+ *
+ * `time_ms` is the CPU time summed over all threads that worked on the method,
+ * `wall_ms` is the elapsed real time. `evaluations` is the number of times the
+ * integrand was evaluated, `subintervals` the number of subintervals summed
+ * and `node_visits` the number of expression nodes visited by the
+ * evaluations. With a tolerance, the times and counters cover every
+ * refinement that was tried. method_metrics() derives the throughput.
+ *
+ * `error_bound` is zero for complete results. For a partial result it is the
+ * distance of `value` from the value the method would have had: zero for the
+ * methods that finished, and an estimate for the method that was stopped, see
+ * integrate_expression(). `computed` is set once at least one chunk of the
+ * method has finished.
+ */
+typedef struct MethodResult {
+    double value;
+    double error_bound;
+    double time_ms;
+    double wall_ms;
+    long long evaluations;
+    long long subintervals;
+    long long node_visits;
+    bool computed;
+} MethodResult;
+
+
+/**
+ * @struct MethodMetrics
+ * @brief The throughput of a method, derived from its MethodResult.
+ *
+ * `evaluations_per_second` relates the evaluations to the elapsed real time,
+ * `ns_per_evaluation` and `ns_per_node_visit` the CPU time to the
+ * evaluations and node visits. A rate whose denominator is zero is zero.
+ */
+typedef struct MethodMetrics {
+    double evaluations_per_second;
+    double ns_per_evaluation;
+    double ns_per_node_visit;
+    double nodes_per_evaluation;
+} MethodMetrics;
+
+
+/**
+ * @struct IntegrationResult
+ * @brief The structured result of an integration.
+ *
+ * Values are signed according to the direction of the interval, so a reversed
+ * interval yields negated sums. `refinement` is the refinement that was
+ * actually used, which differs from the requested one when a tolerance is set.
+ * The interval and the tolerance of the job are recorded along with the
+ * status, so a result can be reported on its own. `cached` is set for results
+ * served from the result cache; their times are those of the original
+ * computation.
+ */
+typedef struct IntegrationResult {
+    IntegrationStatus status;
+    double start;
+    double end;
+    double tolerance;
+    MethodResult methods[METHOD_COUNT];
+    int refinement;
+    double wall_ms;
+    bool cached;
+} IntegrationResult;
+
+
+/**
+ * @struct ChunkPlan
+ * @brief The partition of an interval into fixed chunks of subintervals.
+ *
+ * The chunk size depends only on the job, never on the number of threads,
+ * and the partial sums of the chunks are added up in chunk order. The results
+ * are therefore identical for any thread count.
+ */
+typedef struct ChunkPlan {
+    double start;
+    double dx;
+    double step;
+    long long subintervals;
+    long long chunk_size;
+    int chunk_count;
+} ChunkPlan;
+
+
+/**
+ * @struct IntegrationStop
+ * @brief The conditions under which the threads of an integration stop
+ * taking chunks.
+ *
+ * `stopped` is set by the first thread that finds the token cancelled or the
+ * deadline passed, so the others stop without reading the clock.
+ */
+typedef struct IntegrationStop {
+    const CancelToken* cancel;
+    bool has_deadline;
+    struct timespec deadline;
+    atomic_bool stopped;
+} IntegrationStop;
+
+
+/**
+ * @struct ChunkExecutor
+ * @brief Computes the chunks of a method somewhere other than on the threads
+ * of the calling process.
+ *
+ * `run` stores the partial sum of every chunk of the plan in `partials`,
+ * indexed by chunk, and the CPU time and evaluations it took in `cpu_ms` and
+ * `evaluations`. It returns false if it could not compute every chunk. The
+ * core adds the partial sums up in chunk order, so an executor that computes
+ * each chunk with integrate_chunks() yields the same values as the local
+ * threads.
+ */
+struct ChunkExecutor {
+    bool (*run)(void* context, Node* expression, IntegrationMethod method,
+                const ChunkPlan* plan, double partials[], double* cpu_ms,
+                long long* evaluations);
+    void* context;
+};
+
+
+/**
+ * @struct NodeShare
+ * @brief The contiguous range of chunks of a method assigned to one NUMA
+ * node.
+ *
+ * The chunks `[first_chunk ; end_chunk)` are handed out through `next_chunk`.
+ * `expression` is a replica of the expression tree and `partials` the partial
+ * sums of the range, both placed in `arena` on the node; if the arena could
+ * not be mapped, they point to the shared tree and output array instead.
+ * `node` is the index of the node in the topology.
+ */
+typedef struct NodeShare {
+    alignas(CHUNK_CACHE_LINE) atomic_int next_chunk;
+    int first_chunk;
+    int end_chunk;
+    int node;
+    Node* expression;
+    double* partials;
+    void* arena;
+    size_t arena_size;
+} NodeShare;
+
+
+/**
+ * @struct ChunkTask
+ * @brief The state shared by the threads working on the chunks of a method.
+ *
+ * Chunks are handed out dynamically through `next_chunk`, in the order of
+ * `order` if it is not NULL, and every task records the CPU time and the
+ * evaluation count of its own thread. `stop` is NULL for an integration that
+ * cannot be stopped. If `checkpoint` is not NULL, chunks restored from it are
+ * skipped and every completed chunk is reported to it. Completed chunks are
+ * also counted in `progress` if it is not NULL.
+ *
+ * A large integration on a machine with several NUMA nodes is split into
+ * `share_count` node shares instead: the thread works through the share
+ * `home` with its replica of the expression, then helps with the others.
+ * `pin` is the node the thread restricts itself to, or NULL.
+ */
+typedef struct ChunkTask {
+    calculation_func func;
+    Node* expression;
+    const ChunkPlan* plan;
+    double* partials;
+    const int* order;
+    IntegrationStop* stop;
+    Checkpoint* checkpoint;
+    IntegrationProgress* progress;
+    atomic_int* next_chunk;
+    NodeShare* shares;
+    int share_count;
+    int home;
+    const NumaNode* pin;
+    double cpu_ms;
+    long long evaluations;
+} ChunkTask;
+
+
 double calculate_Riemann_sum(Node* expression, double start, double end,
                              double dx);
 
@@ -45,7 +361,49 @@ double find_supremum(Node* expr, double start, double end, double step);
 double calculate_upper_Darboux_sum(Node* expression, double start, double end,
                                    double dx, double step);
 
-void integrate(char* integrand, char* interval);
+double timespec_diff_ms(const struct timespec* start,
+                        const struct timespec* end);
+
+bool validate_integrand(const char* integrand);
+
+bool validate_interval(const char* interval, double* start, double* end);
+
+const char* method_name(IntegrationMethod method);
+
+MethodMetrics method_metrics(const MethodResult* result);
+
+const char* status_name(IntegrationStatus status);
+
+bool parse_methods(const char* text, unsigned* methods);
+
+long long count_nodes(const Node* expression);
+
+double estimate_evaluations(const IntegrationJob* job);
+
+double estimate_cost(const Node* expression, const IntegrationJob* job);
+
+void cancel_token_init(CancelToken* token);
+
+void cancel_token_cancel(CancelToken* token);
+
+bool cancel_token_is_cancelled(const CancelToken* token);
+
+void integration_progress_init(IntegrationProgress* progress);
+
+double integration_progress_fraction(const IntegrationProgress* progress);
+
+void integrate_chunks(Node* expression, IntegrationMethod method,
+                      const ChunkPlan* plan, int first_chunk, int end_chunk,
+                      int threads, double partials[], double* cpu_ms,
+                      long long* evaluations);
+
+IntegrationStatus integrate_expression(Node* expression,
+                                       const IntegrationJob* job,
+                                       IntegrationResult* result);
+
+IntegrationStatus integrate_job(const char* integrand,
+                                const IntegrationJob* job,
+                                IntegrationResult* result);
 
 
 #endif /*INTEGRAL_H*/
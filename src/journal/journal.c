@@ -0,0 +1,605 @@
+/**
+ * @file journal.c
+ * @brief Implements the append-only results journal and its reader.
+ *
+ * The journal is a process-wide instance. Appending takes a mutex and copies
+ * the record into the active buffer; no system call is made on this path.
+ * The writer thread wakes up when `sync_records` records are pending, when
+ * the sync interval has elapsed with records pending, or when a flush is
+ * requested. It then writes the whole batch with one write and syncs it with
+ * one fdatasync.
+ *
+ * Both buffers are allocated and freed by the thread opening and closing the
+ * journal, so the writer thread never allocates memory.
+ */
+
+
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+#define CHECKSUM_SEED UINT64_C(0x9e3779b97f4a7c15)
+#define CHECKSUM_PRIME UINT64_C(0xff51afd7ed558ccd)
+
+
+/**
+ * The process-wide journal.
+ */
+static Journal journal = {.fd = -1};
+
+
+/**
+ * Computes the checksum of a record, which covers every byte after the
+ * checksum field. The record is processed in 64-bit words, so a scan of the
+ * journal is limited by the disk rather than by the checksum.
+ *
+ * @param record The record.
+ * @return The checksum of the record.
+ */
+static uint64_t record_checksum(const JournalRecord* record) {
+    const unsigned char* bytes = (const unsigned char*)record;
+    uint64_t hash = CHECKSUM_SEED;
+
+    for (size_t offset = sizeof(record->checksum); offset < sizeof(*record);
+         offset += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + offset, sizeof(word));
+        hash = (hash ^ word) * CHECKSUM_PRIME;
+        hash ^= hash >> 29;
+    }
+
+    return hash;
+}
+
+
+/**
+ * Copies a string into a NUL-padded field, truncating it if necessary.
+ *
+ * @param field The field.
+ * @param size The size of the field in bytes.
+ * @param text The string, NULL for an empty field.
+ */
+static void copy_field(char* field, const size_t size, const char* text) {
+    memset(field, 0, size);
+    if (text != NULL)
+        strncpy(field, text, size - 1);
+}
+
+
+/**
+ * Fills a journal record from a result record. The sequence number and the
+ * checksum are left for the appender.
+ *
+ * @param entry Output pointer for the journal record.
+ * @param record The result record.
+ */
+static void encode_record(JournalRecord* entry, const ResultRecord* record) {
+    const IntegrationResult* result = record->result;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    memset(entry, 0, sizeof(*entry));
+    entry->timestamp_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    entry->status = (uint8_t)result->status;
+    entry->flags = (result->cached ? JOURNAL_FLAG_CACHED : 0u) |
+                   (record->id_is_number ? JOURNAL_FLAG_NUMERIC_ID : 0u) |
+                   (record->label != NULL ? JOURNAL_FLAG_INVALID_JOB : 0u);
+    entry->refinement = result->refinement;
+    entry->start = result->start;
+    entry->end = result->end;
+    entry->tolerance = result->tolerance;
+    entry->wall_ms = result->wall_ms;
+
+    for (int method = 0; method < METHOD_COUNT; method++) {
+        const MethodResult* value = &result->methods[method];
+        if (!value->computed)
+            continue;
+        entry->methods |= (uint8_t)METHOD_FLAG(method);
+        entry->method_results[method] =
+            (JournalMethod){.value = value->value,
+                            .evaluations = (uint64_t)value->evaluations,
+                            .cpu_ms = value->time_ms,
+                            .wall_ms = value->wall_ms};
+    }
+
+    copy_field(entry->id, sizeof(entry->id), record->id);
+    copy_field(entry->integrand, sizeof(entry->integrand), record->integrand);
+}
+
+
+/**
+ * Converts a journal record back into a result.
+ *
+ * @param entry The journal record.
+ * @param result Output pointer for the result.
+ */
+static void decode_record(const JournalRecord* entry,
+                          IntegrationResult* result) {
+    memset(result, 0, sizeof(*result));
+    result->status = entry->status < INTEGRATION_STATUS_COUNT
+                         ? (IntegrationStatus)entry->status
+                         : INTEGRATION_ERROR;
+    result->start = entry->start;
+    result->end = entry->end;
+    result->tolerance = entry->tolerance;
+    result->refinement = entry->refinement;
+    result->wall_ms = entry->wall_ms;
+    result->cached = (entry->flags & JOURNAL_FLAG_CACHED) != 0;
+
+    for (int method = 0; method < METHOD_COUNT; method++) {
+        if (!(entry->methods & METHOD_FLAG(method)))
+            continue;
+        const JournalMethod* value = &entry->method_results[method];
+        result->methods[method] =
+            (MethodResult){.value = value->value,
+                           .time_ms = value->cpu_ms,
+                           .wall_ms = value->wall_ms,
+                           .evaluations = (long long)value->evaluations,
+                           .computed = true};
+    }
+}
+
+
+/**
+ * Writes a buffer completely, retrying after partial writes and interrupts.
+ *
+ * @param fd The file descriptor.
+ * @param data The bytes to write.
+ * @param length The number of bytes.
+ * @return true on success, false on a write error.
+ */
+static bool write_all(const int fd, const char* data, size_t length) {
+    while (length > 0) {
+        const ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+
+/**
+ * Computes the absolute time at which the sync interval ends.
+ *
+ * @param deadline Output pointer for the deadline on the monotonic clock.
+ * @param interval_ms The sync interval in milliseconds.
+ */
+static void interval_deadline(struct timespec* deadline,
+                              const int interval_ms) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += interval_ms / 1000;
+    deadline->tv_nsec += (long)(interval_ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+
+/**
+ * Thread routine of the journal writer, performing group commits until the
+ * journal is closed and every pending record is durable.
+ *
+ * @param argument Unused.
+ * @return Always NULL.
+ */
+static void* journal_writer(void* argument) {
+    (void)argument;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&journal.lock);
+    interval_deadline(&deadline, journal.sync_interval_ms);
+
+    while (true) {
+        while (!journal.stopping && !journal.flush_requested &&
+               journal.active_count < journal.sync_records) {
+            const int status = pthread_cond_timedwait(
+                &journal.work_available, &journal.lock, &deadline);
+            if (status == ETIMEDOUT) {
+                if (journal.active_count > 0)
+                    break;
+                interval_deadline(&deadline, journal.sync_interval_ms);
+            }
+        }
+
+        if (journal.active_count == 0) {
+            journal.flush_requested = false;
+            pthread_cond_broadcast(&journal.batch_durable);
+            if (journal.stopping)
+                break;
+            continue;
+        }
+
+        JournalRecord* batch = journal.active;
+        const size_t count = journal.active_count;
+        journal.active = batch == journal.buffers[0] ? journal.buffers[1]
+                                                     : journal.buffers[0];
+        journal.active_count = 0;
+        journal.flush_requested = false;
+        pthread_cond_broadcast(&journal.space_available);
+        pthread_mutex_unlock(&journal.lock);
+
+        const bool written =
+            write_all(journal.fd, (const char*)batch,
+                      count * sizeof(JournalRecord)) &&
+            fdatasync(journal.fd) == 0;
+        if (!written)
+            perror("Error writing the results journal");
+
+        pthread_mutex_lock(&journal.lock);
+        journal.durable += count;
+        journal.failed |= !written;
+        pthread_cond_broadcast(&journal.batch_durable);
+        interval_deadline(&deadline, journal.sync_interval_ms);
+    }
+
+    pthread_mutex_unlock(&journal.lock);
+    return nullptr;
+}
+
+
+/**
+ * Checks the header of a journal file.
+ *
+ * @param header The header read from the file.
+ * @return true if the file was written by this version with the host byte
+ * order, false otherwise.
+ */
+static bool valid_header(const JournalHeader* header) {
+    return memcmp(header->magic, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) == 0 &&
+           header->version == JOURNAL_VERSION &&
+           header->record_size == JOURNAL_RECORD_SIZE &&
+           header->byte_order == JOURNAL_BYTE_ORDER;
+}
+
+
+/**
+ * Prepares the journal file for appending: writes the header of an empty
+ * file, cuts off an incomplete or torn record left by a crash, and determines
+ * the next sequence number.
+ *
+ * @param fd The file descriptor of the journal file.
+ * @param next_sequence Output pointer for the next sequence number.
+ * @return true on success, false if the file is not a journal or cannot be
+ * repaired.
+ */
+static bool recover_file(const int fd, uint64_t* next_sequence) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror("Error reading the results journal");
+        return false;
+    }
+
+    *next_sequence = 1;
+    if (info.st_size == 0) {
+        JournalHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE);
+        header.version = JOURNAL_VERSION;
+        header.record_size = JOURNAL_RECORD_SIZE;
+        header.byte_order = JOURNAL_BYTE_ORDER;
+        return write_all(fd, (const char*)&header, sizeof(header));
+    }
+
+    JournalHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        !valid_header(&header)) {
+        fprintf(stderr, "Error: The file is not a results journal.\n");
+        return false;
+    }
+
+    off_t records = (info.st_size - JOURNAL_HEADER_SIZE) / JOURNAL_RECORD_SIZE;
+    JournalRecord last;
+    while (records > 0) {
+        const off_t offset =
+            JOURNAL_HEADER_SIZE + (records - 1) * JOURNAL_RECORD_SIZE;
+        if (pread(fd, &last, sizeof(last), offset) == (ssize_t)sizeof(last) &&
+            last.checksum == record_checksum(&last)) {
+            *next_sequence = last.sequence + 1;
+            break;
+        }
+        records--;
+    }
+
+    const off_t size = JOURNAL_HEADER_SIZE + records * JOURNAL_RECORD_SIZE;
+    if (size != info.st_size && ftruncate(fd, size) != 0) {
+        perror("Error repairing the results journal");
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Opens the process-wide results journal and starts its writer thread.
+ *
+ * @param path The path of the journal file.
+ * @param sync_interval_ms The longest time in milliseconds a record may wait
+ * before it is made durable.
+ * @param sync_records The number of pending records that triggers a group
+ * commit right away, at most `JOURNAL_BUFFER_RECORDS`.
+ * @return true if the journal is open, false otherwise.
+ */
+bool journal_open(const char* path, const int sync_interval_ms,
+                  const int sync_records) {
+    if (journal.fd >= 0)
+        journal_close();
+
+    const int fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("Error opening the results journal");
+        return false;
+    }
+
+    uint64_t next_sequence;
+    JournalRecord* first = (JournalRecord*)malloc(
+        JOURNAL_BUFFER_RECORDS * sizeof(JournalRecord));
+    JournalRecord* second = (JournalRecord*)malloc(
+        JOURNAL_BUFFER_RECORDS * sizeof(JournalRecord));
+    if (first == NULL || second == NULL || !recover_file(fd, &next_sequence)) {
+        if (first == NULL || second == NULL)
+            perror("Did not manage to allocate memory");
+        free(first);
+        free(second);
+        close(fd);
+        return false;
+    }
+
+    journal = (Journal){
+        .fd = fd,
+        .buffers = {first, second},
+        .active = first,
+        .active_count = 0,
+        .next_sequence = next_sequence,
+        .appended = 0,
+        .durable = 0,
+        .sync_interval_ms = sync_interval_ms > 0 ? sync_interval_ms : 1,
+        .sync_records = sync_records > 0 &&
+                                sync_records <= JOURNAL_BUFFER_RECORDS
+                            ? (size_t)sync_records
+                            : JOURNAL_BUFFER_RECORDS,
+        .flush_requested = false,
+        .stopping = false,
+        .failed = false};
+
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_mutex_init(&journal.lock, nullptr);
+    pthread_cond_init(&journal.work_available, &attributes);
+    pthread_cond_init(&journal.space_available, nullptr);
+    pthread_cond_init(&journal.batch_durable, nullptr);
+    pthread_condattr_destroy(&attributes);
+
+    if (pthread_create(&journal.writer, nullptr, journal_writer, nullptr) !=
+        0) {
+        fprintf(stderr, "Error: Could not start the journal writer.\n");
+        pthread_mutex_destroy(&journal.lock);
+        pthread_cond_destroy(&journal.work_available);
+        pthread_cond_destroy(&journal.space_available);
+        pthread_cond_destroy(&journal.batch_durable);
+        free(first);
+        free(second);
+        close(fd);
+        journal.fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Tells whether the results journal is open.
+ *
+ * @return true if the journal is open.
+ */
+bool journal_is_open(void) {
+    return journal.fd >= 0;
+}
+
+
+/**
+ * Appends a result to the journal. The record becomes durable with the next
+ * group commit. If the active buffer is full, waits until the writer thread
+ * has taken it over. Does nothing while the journal is closed.
+ *
+ * This function may be called from any thread.
+ *
+ * @param record The result record to append.
+ */
+void journal_append(const ResultRecord* record) {
+    if (journal.fd < 0)
+        return;
+
+    JournalRecord entry;
+    encode_record(&entry, record);
+
+    pthread_mutex_lock(&journal.lock);
+    while (journal.active_count == JOURNAL_BUFFER_RECORDS) {
+        pthread_cond_signal(&journal.work_available);
+        pthread_cond_wait(&journal.space_available, &journal.lock);
+    }
+
+    entry.sequence = journal.next_sequence++;
+    entry.checksum = record_checksum(&entry);
+    journal.active[journal.active_count++] = entry;
+    journal.appended++;
+
+    if (journal.active_count == journal.sync_records)
+        pthread_cond_signal(&journal.work_available);
+    pthread_mutex_unlock(&journal.lock);
+}
+
+
+/**
+ * Waits until every record appended so far is durable.
+ *
+ * @return true if the journal is closed or every write succeeded, false if a
+ * batch could not be written.
+ */
+bool journal_flush(void) {
+    if (journal.fd < 0)
+        return true;
+
+    pthread_mutex_lock(&journal.lock);
+    const uint64_t target = journal.appended;
+    journal.flush_requested = true;
+    pthread_cond_signal(&journal.work_available);
+    while (journal.durable < target)
+        pthread_cond_wait(&journal.batch_durable, &journal.lock);
+    const bool success = !journal.failed;
+    pthread_mutex_unlock(&journal.lock);
+
+    return success;
+}
+
+
+/**
+ * Makes every pending record durable, stops the writer thread and closes the
+ * journal.
+ *
+ * @return true if every write succeeded, false otherwise.
+ */
+bool journal_close(void) {
+    if (journal.fd < 0)
+        return true;
+
+    pthread_mutex_lock(&journal.lock);
+    journal.stopping = true;
+    pthread_cond_signal(&journal.work_available);
+    pthread_mutex_unlock(&journal.lock);
+    pthread_join(journal.writer, nullptr);
+
+    const bool success = !journal.failed;
+    pthread_mutex_destroy(&journal.lock);
+    pthread_cond_destroy(&journal.work_available);
+    pthread_cond_destroy(&journal.space_available);
+    pthread_cond_destroy(&journal.batch_durable);
+    free(journal.buffers[0]);
+    free(journal.buffers[1]);
+    close(journal.fd);
+    journal.fd = -1;
+
+    return success;
+}
+
+
+/**
+ * Counts a valid record and, if a machine-readable writer is given, writes it.
+ *
+ * @param entry The record.
+ * @param writer The result writer, or NULL.
+ * @param scan The counters of the scan.
+ * @return true on success, false if the record could not be written.
+ */
+static bool scan_record(const JournalRecord* entry, ResultWriter* writer,
+                        JournalScan* scan) {
+    IntegrationResult result;
+    decode_record(entry, &result);
+
+    scan->records++;
+    if (entry->flags & JOURNAL_FLAG_INVALID_JOB)
+        scan->invalid_jobs++;
+    else
+        scan->statuses[result.status]++;
+    if (result.cached)
+        scan->cached++;
+
+    if (writer == NULL)
+        return true;
+
+    char id[JOURNAL_ID_SIZE + 1];
+    char integrand[JOURNAL_INTEGRAND_SIZE + 1];
+    memcpy(id, entry->id, JOURNAL_ID_SIZE);
+    id[JOURNAL_ID_SIZE] = '\0';
+    memcpy(integrand, entry->integrand, JOURNAL_INTEGRAND_SIZE);
+    integrand[JOURNAL_INTEGRAND_SIZE] = '\0';
+
+    const ResultRecord record = {
+        .id = id[0] != '\0' ? id : nullptr,
+        .id_is_number = (entry->flags & JOURNAL_FLAG_NUMERIC_ID) != 0,
+        .integrand = integrand[0] != '\0' ? integrand : nullptr,
+        .label = (entry->flags & JOURNAL_FLAG_INVALID_JOB) ? "invalid_job"
+                                                           : nullptr,
+        .result = &result};
+    return report_write(writer, &record);
+}
+
+
+/**
+ * Scans a journal file, verifying the checksum of every record.
+ *
+ * The file is mapped into memory and read sequentially, so the scan runs at
+ * the speed of the disk or the page cache. Records with a wrong checksum are
+ * counted and skipped.
+ *
+ * @param path The path of the journal file.
+ * @param writer The writer receiving every valid record, or NULL to only
+ * count them.
+ * @param scan Output pointer for the counters of the scan.
+ * @return true if the whole file was scanned, false if it could not be read
+ * or is not a journal.
+ */
+bool journal_scan(const char* path, ResultWriter* writer, JournalScan* scan) {
+    memset(scan, 0, sizeof(*scan));
+
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("Error opening the results journal");
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < JOURNAL_HEADER_SIZE) {
+        fprintf(stderr, "Error: The file is not a results journal.\n");
+        close(fd);
+        return false;
+    }
+
+    const size_t size = (size_t)info.st_size;
+    const char* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Error mapping the results journal");
+        return false;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    JournalHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (!valid_header(&header)) {
+        fprintf(stderr, "Error: The file is not a results journal.\n");
+        munmap((void*)data, size);
+        return false;
+    }
+
+    bool success = true;
+    size_t offset = JOURNAL_HEADER_SIZE;
+    for (; offset + JOURNAL_RECORD_SIZE <= size && success;
+         offset += JOURNAL_RECORD_SIZE) {
+        JournalRecord entry;
+        memcpy(&entry, data + offset, sizeof(entry));
+        if (entry.checksum != record_checksum(&entry))
+            scan->corrupt++;
+        else
+            success = scan_record(&entry, writer, scan);
+    }
+
+    scan->trailing_bytes = success ? (long long)(size - offset) : 0;
+    scan->bytes = (long long)size;
+    munmap((void*)data, size);
+    return success;
+}
@@ -0,0 +1,164 @@
+/**
+ * @file journal.h
+ * @brief Header file for the results journal, an append-only binary file
+ * recording every completed integration.
+ *
+ * Records have a fixed layout and carry a checksum. Appending only copies the
+ * record into a memory buffer; a writer thread writes whole batches with a
+ * single system call and makes them durable with one fdatasync per batch
+ * (group commit), either when enough records are pending or when the sync
+ * interval has elapsed.
+ */
+
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "integral.h"
+#include "report.h"
+
+
+#define JOURNAL_DEFAULT_PATH "results.journal"
+#define JOURNAL_MAGIC "NIJOURNL"
+#define JOURNAL_MAGIC_SIZE 8
+#define JOURNAL_VERSION 1
+#define JOURNAL_BYTE_ORDER UINT32_C(0x01020304)
+#define JOURNAL_HEADER_SIZE 64
+#define JOURNAL_RECORD_SIZE 384
+#define JOURNAL_ID_SIZE 80
+#define JOURNAL_INTEGRAND_SIZE 144
+#define JOURNAL_BUFFER_RECORDS 2048
+#define JOURNAL_DEFAULT_SYNC_INTERVAL_MS 100
+#define JOURNAL_DEFAULT_SYNC_RECORDS 1024
+#define JOURNAL_FLAG_CACHED 0x01u
+#define JOURNAL_FLAG_NUMERIC_ID 0x02u
+#define JOURNAL_FLAG_INVALID_JOB 0x04u
+
+
+/**
+ * @struct JournalMethod
+ * @brief The result of a single method in a journal record.
+ */
+typedef struct JournalMethod {
+    double value;
+    uint64_t evaluations;
+    double cpu_ms;
+    double wall_ms;
+} JournalMethod;
+
+
+/**
+ * @struct JournalRecord
+ * @brief A journal record, written to the file exactly as laid out here.
+ *
+ * `checksum` covers every other byte of the record. `sequence` numbers the
+ * records appended by one writer, starting after the last record found in the
+ * file. `methods` is the mask of the computed methods; the entries of the
+ * other methods are zero. `id` and `integrand` are NUL-padded.
+ */
+typedef struct JournalRecord {
+    uint64_t checksum;
+    uint64_t sequence;
+    int64_t timestamp_ns;
+    uint8_t status;
+    uint8_t methods;
+    uint8_t flags;
+    uint8_t reserved;
+    int32_t refinement;
+    double start;
+    double end;
+    double tolerance;
+    double wall_ms;
+    JournalMethod method_results[METHOD_COUNT];
+    char id[JOURNAL_ID_SIZE];
+    char integrand[JOURNAL_INTEGRAND_SIZE];
+} JournalRecord;
+
+static_assert(sizeof(JournalRecord) == JOURNAL_RECORD_SIZE,
+              "journal records must have a fixed size");
+
+
+/**
+ * @struct JournalHeader
+ * @brief The header at the beginning of the journal file.
+ *
+ * `byte_order` is `JOURNAL_BYTE_ORDER` as written by the host, so a reader
+ * can tell whether the file was written with its own byte order.
+ */
+typedef struct JournalHeader {
+    char magic[JOURNAL_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t byte_order;
+    char reserved[JOURNAL_HEADER_SIZE - JOURNAL_MAGIC_SIZE -
+                  3 * sizeof(uint32_t)];
+} JournalHeader;
+
+
+/**
+ * @struct Journal
+ * @brief The state of an open journal.
+ *
+ * Appenders fill the `active` buffer under `lock`. The writer thread swaps it
+ * with the idle buffer and writes it out without holding the lock, so appends
+ * continue while a batch is being written and synced. `appended` and
+ * `durable` count the records of this session.
+ */
+typedef struct Journal {
+    int fd;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t space_available;
+    pthread_cond_t batch_durable;
+    JournalRecord* buffers[2];
+    JournalRecord* active;
+    size_t active_count;
+    uint64_t next_sequence;
+    uint64_t appended;
+    uint64_t durable;
+    int sync_interval_ms;
+    size_t sync_records;
+    bool flush_requested;
+    bool stopping;
+    bool failed;
+} Journal;
+
+
+/**
+ * @struct JournalScan
+ * @brief Counters of a journal scan.
+ *
+ * `corrupt` counts records whose checksum does not match, `trailing_bytes`
+ * the bytes of an incomplete record at the end of the file.
+ */
+typedef struct JournalScan {
+    long long records;
+    long long corrupt;
+    long long statuses[INTEGRATION_STATUS_COUNT];
+    long long invalid_jobs;
+    long long cached;
+    long long trailing_bytes;
+    long long bytes;
+} JournalScan;
+
+
+bool journal_open(const char* path, int sync_interval_ms, int sync_records);
+
+bool journal_is_open(void);
+
+void journal_append(const ResultRecord* record);
+
+bool journal_flush(void);
+
+bool journal_close(void);
+
+bool journal_scan(const char* path, ResultWriter* writer, JournalScan* scan);
+
+
+#endif /* JOURNAL_H */
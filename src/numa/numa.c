@@ -0,0 +1,304 @@
+/**
+ * @file numa.c
+ * @brief Implements the NUMA topology, thread placement and node-local
+ * memory on sysfs and raw system calls.
+ *
+ * The affinity, getcpu and mbind system calls are invoked directly, so
+ * neither libnuma nor the glibc CPU set macros are needed.
+ */
+
+
+#define _GNU_SOURCE // syscall
+
+#include "numa.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * The mbind mode that prefers a node and falls back to others when it is
+ * full, as defined by the kernel.
+ */
+#define NUMA_MPOL_PREFERRED 1
+
+#define NUMA_BITS_PER_WORD (8 * sizeof(unsigned long))
+
+
+static NumaTopology system_topology;
+static pthread_once_t system_topology_once = PTHREAD_ONCE_INIT;
+
+
+/**
+ * Sets a bit of a processor or node mask.
+ *
+ * @param mask The mask.
+ * @param bit The bit.
+ */
+static void mask_set(unsigned long mask[], const int bit) {
+    mask[bit / NUMA_BITS_PER_WORD] |= 1UL << (bit % NUMA_BITS_PER_WORD);
+}
+
+
+/**
+ * Tells whether a bit of a mask is set.
+ *
+ * @param mask The mask.
+ * @param bit The bit.
+ * @return true if the bit is set.
+ */
+static bool mask_test(const unsigned long mask[], const int bit) {
+    return (mask[bit / NUMA_BITS_PER_WORD] >> (bit % NUMA_BITS_PER_WORD)) & 1UL;
+}
+
+
+/**
+ * Parses a sysfs list such as "0-3,8-11" into a mask.
+ *
+ * @param text The list.
+ * @param mask The mask to set the listed bits in.
+ * @param limit The number of bits of the mask.
+ * @return The number of bits set, or -1 if the list is malformed.
+ */
+static int parse_list(const char* text, unsigned long mask[], const int limit) {
+    int count = 0;
+    const char* cursor = text;
+
+    while (*cursor != '\0' && *cursor != '\n') {
+        char* end;
+        const long first = strtol(cursor, &end, 10);
+        if (end == cursor || first < 0)
+            return -1;
+
+        long last = first;
+        cursor = end;
+        if (*cursor == '-') {
+            last = strtol(cursor + 1, &end, 10);
+            if (end == cursor + 1 || last < first)
+                return -1;
+            cursor = end;
+        }
+
+        for (long bit = first; bit <= last && bit < limit; bit++) {
+            if (!mask_test(mask, (int)bit))
+                count++;
+            mask_set(mask, (int)bit);
+        }
+
+        if (*cursor == ',')
+            cursor++;
+        else if (*cursor != '\0' && *cursor != '\n')
+            return -1;
+    }
+
+    return count;
+}
+
+
+/**
+ * Reads the first line of a sysfs file.
+ *
+ * @param path The path of the file.
+ * @param line Output buffer for the line.
+ * @param size The size of the buffer.
+ * @return true if a line was read.
+ */
+static bool read_line(const char* path, char* line, const size_t size) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    const bool read = fgets(line, (int)size, file) != NULL;
+    fclose(file);
+    return read;
+}
+
+
+/**
+ * Reads the topology of the machine from the node directories of sysfs.
+ *
+ * Nodes without processors, such as memory-only nodes, are left out. If no
+ * node can be read, the topology has a single node without a processor mask.
+ *
+ * @param topology Output pointer for the topology.
+ * @param root The node directory of sysfs, NUMA_SYSFS_NODES on a real system.
+ * @return true if at least one node with processors was found.
+ */
+bool numa_load(NumaTopology* topology, const char* root) {
+    memset(topology, 0, sizeof(*topology));
+
+    char path[512];
+    char line[4096];
+    unsigned long online[NUMA_MAX_NODES / NUMA_BITS_PER_WORD + 1];
+    memset(online, 0, sizeof(online));
+
+    snprintf(path, sizeof(path), "%s/online", root);
+    if (!read_line(path, line, sizeof(line)) ||
+        parse_list(line, online, NUMA_MAX_NODES) <= 0) {
+        topology->node_count = 1;
+        return false;
+    }
+
+    for (int id = 0; id < NUMA_MAX_NODES; id++) {
+        if (!mask_test(online, id))
+            continue;
+
+        NumaNode* node = &topology->nodes[topology->node_count];
+        memset(node, 0, sizeof(*node));
+        snprintf(path, sizeof(path), "%s/node%d/cpulist", root, id);
+        if (!read_line(path, line, sizeof(line)))
+            continue;
+
+        const int cpus = parse_list(line, node->cpus, NUMA_MAX_CPUS);
+        if (cpus <= 0)
+            continue;
+
+        node->id = id;
+        node->cpu_count = cpus;
+        topology->node_count++;
+    }
+
+    if (topology->node_count == 0) {
+        memset(topology, 0, sizeof(*topology));
+        topology->node_count = 1;
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Loads the topology of the running system.
+ */
+static void load_system_topology(void) {
+    numa_load(&system_topology, NUMA_SYSFS_NODES);
+}
+
+
+/**
+ * Replaces the topology used by the integration engine and the worker pool,
+ * e.g. to read it from a copy of sysfs. Must be called before any thread
+ * uses the topology.
+ *
+ * @param root The node directory to read, or NULL for NUMA_SYSFS_NODES.
+ */
+void numa_init(const char* root) {
+    pthread_once(&system_topology_once, load_system_topology);
+    if (root != NULL)
+        numa_load(&system_topology, root);
+}
+
+
+/**
+ * Returns the topology of the system, reading it from sysfs on first use.
+ *
+ * @return The topology.
+ */
+const NumaTopology* numa_topology(void) {
+    pthread_once(&system_topology_once, load_system_topology);
+    return &system_topology;
+}
+
+
+/**
+ * Returns the node of the processor the calling thread is running on.
+ *
+ * @param topology The topology.
+ * @return The index of the node in the topology, or -1 if it is not known.
+ */
+int numa_current_node(const NumaTopology* topology) {
+    unsigned cpu;
+    unsigned node;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 ||
+        cpu >= NUMA_MAX_CPUS)
+        return -1;
+
+    for (int i = 0; i < topology->node_count; i++)
+        if (mask_test(topology->nodes[i].cpus, (int)cpu))
+            return i;
+    return -1;
+}
+
+
+/**
+ * Reads the processor affinity of the calling thread.
+ *
+ * @param mask Output mask.
+ * @return true on success.
+ */
+bool numa_get_affinity(unsigned long mask[NUMA_MASK_WORDS]) {
+    memset(mask, 0, NUMA_MASK_WORDS * sizeof(unsigned long));
+    return syscall(SYS_sched_getaffinity, 0,
+                   NUMA_MASK_WORDS * sizeof(unsigned long), mask) > 0;
+}
+
+
+/**
+ * Sets the processor affinity of the calling thread.
+ *
+ * @param mask The processors the thread may run on.
+ * @return true on success.
+ */
+bool numa_set_affinity(const unsigned long mask[NUMA_MASK_WORDS]) {
+    return syscall(SYS_sched_setaffinity, 0,
+                   NUMA_MASK_WORDS * sizeof(unsigned long), mask) == 0;
+}
+
+
+/**
+ * Restricts the calling thread to the processors of a node. The scheduler
+ * moves it there before the call returns.
+ *
+ * @param node The node.
+ * @return true on success, false if the node has no processor mask or the
+ * affinity could not be set.
+ */
+bool numa_pin_thread(const NumaNode* node) {
+    return node->cpu_count > 0 && numa_set_affinity(node->cpus);
+}
+
+
+/**
+ * Maps zeroed memory placed on a node. The pages are preferred on the node
+ * and touched by the calling thread, so they are local to the node even if
+ * the preference cannot be set, as long as the caller runs on the node.
+ *
+ * @param node The node.
+ * @param size The number of bytes.
+ * @return The memory, to be released with numa_free(), or NULL on failure.
+ */
+void* numa_alloc_local(const NumaNode* node, const size_t size) {
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return nullptr;
+
+    unsigned long nodes[NUMA_MAX_NODES / NUMA_BITS_PER_WORD + 1];
+    memset(nodes, 0, sizeof(nodes));
+    mask_set(nodes, node->id);
+    // A kernel without NUMA support refuses mbind; first touch still applies.
+    syscall(SYS_mbind, memory, size, NUMA_MPOL_PREFERRED, nodes,
+            (unsigned long)(sizeof(nodes) * 8), 0);
+
+    memset(memory, 0, size);
+    return memory;
+}
+
+
+/**
+ * Releases memory mapped by numa_alloc_local().
+ *
+ * @param memory The memory, or NULL.
+ * @param size The size passed to numa_alloc_local().
+ */
+void numa_free(void* memory, const size_t size) {
+    if (memory != NULL)
+        munmap(memory, size);
+}
@@ -0,0 +1,75 @@
+/**
+ * @file numa.h
+ * @brief Header file for the NUMA topology, thread placement and node-local
+ * memory, implemented on sysfs and raw system calls without libnuma.
+ *
+ * The topology is read from the node directories of sysfs: every online node
+ * with processors becomes a NumaNode with its processor mask. Threads are
+ * pinned with sched_setaffinity and memory is mapped anonymously, preferred
+ * on a node with mbind and placed there by the first touch of a thread
+ * running on it. On machines with a single node every function degrades to
+ * a no-op, so callers need no special case.
+ */
+
+
+#ifndef NUMA_H
+#define NUMA_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+#define NUMA_SYSFS_NODES "/sys/devices/system/node"
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS 4096
+#define NUMA_MASK_WORDS (NUMA_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+
+/**
+ * @struct NumaNode
+ * @brief An online node with processors.
+ *
+ * `id` is the kernel's node number and `cpus` the processor mask in the
+ * layout of the affinity system calls.
+ */
+typedef struct NumaNode {
+    int id;
+    int cpu_count;
+    unsigned long cpus[NUMA_MASK_WORDS];
+} NumaNode;
+
+
+/**
+ * @struct NumaTopology
+ * @brief The nodes of the machine, in ascending order of their id.
+ *
+ * If sysfs cannot be read, the topology has a single node without a
+ * processor mask, which disables placement.
+ */
+typedef struct NumaTopology {
+    int node_count;
+    NumaNode nodes[NUMA_MAX_NODES];
+} NumaTopology;
+
+
+bool numa_load(NumaTopology* topology, const char* root);
+
+void numa_init(const char* root);
+
+const NumaTopology* numa_topology(void);
+
+int numa_current_node(const NumaTopology* topology);
+
+bool numa_pin_thread(const NumaNode* node);
+
+bool numa_get_affinity(unsigned long mask[NUMA_MASK_WORDS]);
+
+bool numa_set_affinity(const unsigned long mask[NUMA_MASK_WORDS]);
+
+void* numa_alloc_local(const NumaNode* node, size_t size);
+
+void numa_free(void* memory, size_t size);
+
+
+#endif /* NUMA_H */
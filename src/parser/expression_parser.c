@@ -217,6 +217,85 @@ Func find_function(const char* name) {
 }
 
 
+/**
+ * Checks whether a string is a well-formed expression in Reverse Polish
+ * Notation without building the expression tree.
+ *
+ * The tokens are classified exactly as parse() classifies them, and the depth
+ * of the node stack is simulated. An expression accepted by this function can
+ * be parsed without parse() terminating the program, and it yields exactly one
+ * tree.
+ *
+ * @param expression A null-terminated string containing the expression, with
+ * tokens separated by spaces. The string is not modified.
+ * @return true if the expression is well-formed, false otherwise. The reason
+ * is reported on the standard error stream.
+ */
+bool validate_expression(const char* expression) {
+    int depth = 0;
+    const char* cursor = expression;
+
+    while (*cursor != '\0') {
+        if (*cursor == ' ') {
+            cursor++;
+            continue;
+        }
+
+        const size_t length = strcspn(cursor, " ");
+        char token[TOKEN_MAX + 1];
+        if (length > TOKEN_MAX) {
+            fprintf(stderr, "Error: Token '%.*s' is too long.\n", (int)length,
+                    cursor);
+            return false;
+        }
+        memcpy(token, cursor, length);
+        token[length] = '\0';
+        cursor += length;
+
+        int required = 0, produced = 1;
+        if (strcmp(token, "x") == 0) {
+            required = 0;
+        } else if (strpbrk(OPERATORS, token) != NULL) {
+            if (strchr(OPERATORS, token[0]) == NULL) {
+                fprintf(stderr, "Error: Invalid operator '%s' in expression.\n",
+                        token);
+                return false;
+            }
+            required = 2;
+        } else if (find_function(token) != NULL) {
+            required = 1;
+        } else {
+            char* endptr;
+            strtod(token, &endptr);
+            if (*endptr != '\0') {
+                fprintf(stderr, "Error: Invalid token '%s' in expression.\n",
+                        token);
+                return false;
+            }
+        }
+
+        if (depth < required) {
+            fprintf(stderr, "Error: Stack underflow.\n");
+            return false;
+        }
+
+        depth += produced - required;
+        if (depth > STACK_SIZE - 1) {
+            fprintf(stderr, "Error: Stack overflow.\n");
+            return false;
+        }
+    }
+
+    if (depth != 1) {
+        fprintf(stderr,
+                "Error: The expression must reduce to a single value.\n");
+        return false;
+    }
+
+    return true;
+}
+
+
 /**
  * Parses a mathematical expression in Reverse Polish Notation (RPN) and
  * constructs the corresponding abstract syntax tree (AST).
@@ -320,3 +399,130 @@ double evaluate(Node* head, const double x) {
             exit(1);
     }
 }
+
+
+/**
+ * Evaluates an expression at up to EVALUATE_BATCH_MAX values of the variable
+ * at once.
+ *
+ * Unlike `evaluate`, which walks the whole syntax tree once per value, the
+ * tree is walked once per batch and every node is applied to all the values
+ * in a tight loop, keeping the intermediate values of a level on the stack.
+ * Every value goes through the same operations as in `evaluate`, so the
+ * results are bitwise identical.
+ *
+ * @param head Pointer to the root node of the syntax tree.
+ * @param xs The values of the variable.
+ * @param values The array receiving the value of the expression at each of
+ * `xs`.
+ * @param count The number of values, at most EVALUATE_BATCH_MAX.
+ */
+void evaluate_batch(Node* head, const double xs[], double values[],
+                    const int count) {
+    if (!head) {
+        for (int i = 0; i < count; i++)
+            values[i] = 0.0;
+        return;
+    }
+
+    switch (head->type) {
+        case NODE_VARIABLE:
+            memcpy(values, xs, (size_t)count * sizeof(double));
+            return;
+
+        case NODE_NUMBER:
+            for (int i = 0; i < count; i++)
+                values[i] = head->data.number.value;
+            return;
+
+        case NODE_FUNCTION:
+            evaluate_batch(head->left, xs, values, count);
+            for (int i = 0; i < count; i++)
+                values[i] = head->data.function.func(values[i]);
+            return;
+
+        case NODE_OPERATOR: {
+            double right[EVALUATE_BATCH_MAX];
+            evaluate_batch(head->left, xs, values, count);
+            evaluate_batch(head->right, xs, right, count);
+
+            switch (head->data.operator.symbol) {
+                case '+':
+                    for (int i = 0; i < count; i++)
+                        values[i] += right[i];
+                    return;
+                case '-':
+                    for (int i = 0; i < count; i++)
+                        values[i] -= right[i];
+                    return;
+                case '*':
+                    for (int i = 0; i < count; i++)
+                        values[i] *= right[i];
+                    return;
+                case '/':
+                    for (int i = 0; i < count; i++)
+                        values[i] /= right[i];
+                    return;
+                case '^':
+                    for (int i = 0; i < count; i++)
+                        values[i] = pow(values[i], right[i]);
+                    return;
+                default:
+                    fprintf(stderr, "Error: Unknown operator '%c'.\n",
+                            head->data.operator.symbol);
+                    exit(1);
+            }
+        }
+
+        default:
+            fprintf(stderr, "Error: Unknown node type.\n");
+            exit(1);
+    }
+}
+
+
+/**
+ * Recursively deallocates memory associated with nodes of a binary tree.
+ * This function traverses the binary tree in a post-order manner,
+ * freeing memory for each left subtree, right subtree, and finally the parent
+ * node.
+ *
+ * @param node Pointer to the root node of the binary tree to be freed.
+ */
+void free_tree(Node* node) {
+    if (node) {
+        free_tree(node->left);
+        free_tree(node->right);
+        free(node);
+        node = nullptr;
+    }
+}
+
+
+/**
+ * @brief Removes leading and trailing spaces from a given string and compresses
+ * the string. The trimmed string is stored in the same memory location as the
+ * input string.
+ *
+ * @param str The input string from which spaces are to be removed.
+ *            After execution, the string will no longer contain leading or
+ * trailing spaces.
+ */
+void remove_spaces(char* str) {
+    if (str[0] == '\0')
+        return;
+
+    size_t start = 0;
+    size_t end = strlen(str) - 1;
+
+    while (isspace(str[start]))
+        start++;
+
+    while (end > start && isspace(str[end]))
+        end--;
+
+    size_t i, j;
+    for (i = start, j = 0; i <= end; i++, j++)
+        str[j] = str[i];
+    str[j] = '\0';
+}
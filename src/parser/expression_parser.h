@@ -18,6 +18,7 @@
 
 #include <ctype.h>
 #include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +26,8 @@
 
 #define STACK_SIZE 50
 #define FUNCTION_NAME_MAX 10
+#define TOKEN_MAX 64
+#define EVALUATE_BATCH_MAX 256 // Most values evaluate_batch() computes at once
 #define OPERATORS "+-*/^" // Supported operators
 #define NEW_NODE(TYPE) ((Node*)malloc(sizeof(Node)))
 
@@ -180,9 +183,17 @@ Node* create_function(const char* name, Func func);
 
 Node* create_operator(char symbol);
 
+bool validate_expression(const char* expression);
+
 Node* parse(char* expression);
 
 double evaluate(Node* head, double x);
 
+void evaluate_batch(Node* head, const double xs[], double values[], int count);
+
+void free_tree(Node* node);
+
+void remove_spaces(char* str);
+
 
 #endif /* EXPRESSION_PARSER_H */
@@ -0,0 +1,284 @@
+/**
+ * @file perf.c
+ * @brief Implementation of hardware performance counters around the phases
+ * of an integration.
+ */
+
+
+#define _GNU_SOURCE // syscall
+
+#include "perf.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+#define PERF_CACHE_MISS(cache)                                                 \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |                            \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+
+/**
+ * @struct PerfEvent
+ * @brief The perf_event_open(2) type and configuration of a counter.
+ */
+typedef struct PerfEvent {
+    uint32_t type;
+    uint64_t config;
+} PerfEvent;
+
+
+/**
+ * The events of the counters, indexed by PerfCounter.
+ */
+static const PerfEvent EVENTS[PERF_COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
+
+
+/**
+ * The names of the counters, indexed by PerfCounter.
+ */
+static const char* const COUNTER_NAMES[PERF_COUNTER_COUNT] = {
+    "cycles", "instructions", "L1D misses", "LLC misses", "branch misses"};
+
+
+/**
+ * The names of the phases, indexed by PerfPhase.
+ */
+static const char* const PHASE_NAMES[PERF_PHASE_COUNT] = {"parse", "riemann",
+                                                          "lower", "upper"};
+
+
+/**
+ * Initialises a profile without any measurement. Install it into a job to
+ * measure the integration.
+ *
+ * @param profile The profile.
+ */
+void perf_profile_init(PerfProfile* profile) {
+    memset(profile, 0, sizeof(*profile));
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+        profile->fds[counter] = -1;
+}
+
+
+/**
+ * Opens and starts the counters of a phase. They count the calling thread
+ * and every thread it starts until perf_phase_end(), in user space only, so
+ * they are available with the default perf_event_paranoid setting.
+ *
+ * @param profile The profile.
+ * @return true if at least one counter is counting.
+ */
+bool perf_phase_begin(PerfProfile* profile) {
+    bool counting = false;
+
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = EVENTS[counter].type;
+        attr.config = EVENTS[counter].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        profile->fds[counter] = (int)syscall(SYS_perf_event_open, &attr, 0,
+                                             -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (profile->fds[counter] < 0) {
+            if (profile->error == 0)
+                profile->error = errno;
+            continue;
+        }
+        counting = true;
+    }
+
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+        if (profile->fds[counter] >= 0)
+            ioctl(profile->fds[counter], PERF_EVENT_IOC_ENABLE, 0);
+    return counting;
+}
+
+
+/**
+ * Stops the counters of a phase, adds them to the phase and closes them.
+ *
+ * @param profile The profile.
+ * @param phase The phase that has ended.
+ * @param evaluations The number of integrand evaluations of the phase.
+ */
+void perf_phase_end(PerfProfile* profile, const PerfPhase phase,
+                    const long long evaluations) {
+    PerfPhaseCounts* counts = &profile->phases[phase];
+    if (!counts->measured)
+        for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+            counts->available[counter] = true;
+
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+        const int fd = profile->fds[counter];
+        uint64_t reading[3]; // value, time enabled, time running
+        const bool counted =
+            fd >= 0 && ioctl(fd, PERF_EVENT_IOC_DISABLE, 0) == 0 &&
+            read(fd, reading, sizeof(reading)) == (ssize_t)sizeof(reading) &&
+            reading[2] > 0;
+
+        if (counted)
+            counts->values[counter] +=
+                (double)reading[0] * ((double)reading[1] / (double)reading[2]);
+        else
+            counts->available[counter] = false;
+
+        if (fd >= 0)
+            close(fd);
+        profile->fds[counter] = -1;
+    }
+
+    counts->measured = true;
+    counts->evaluations += evaluations;
+}
+
+
+/**
+ * Returns the instructions per cycle of a phase.
+ *
+ * @param counts The counters of the phase.
+ * @return The instructions per cycle, or NAN if either counter is
+ * unavailable.
+ */
+double perf_ipc(const PerfPhaseCounts* counts) {
+    if (!counts->measured || !counts->available[PERF_CYCLES] ||
+        !counts->available[PERF_INSTRUCTIONS] ||
+        counts->values[PERF_CYCLES] <= 0)
+        return NAN;
+    return counts->values[PERF_INSTRUCTIONS] / counts->values[PERF_CYCLES];
+}
+
+
+/**
+ * Returns a counter of a phase per integrand evaluation.
+ *
+ * @param counts The counters of the phase.
+ * @param counter The counter.
+ * @return The count per evaluation, or NAN if the counter is unavailable or
+ * the phase did not evaluate the integrand.
+ */
+double perf_per_evaluation(const PerfPhaseCounts* counts,
+                           const PerfCounter counter) {
+    if (!counts->measured || !counts->available[counter] ||
+        counts->evaluations <= 0)
+        return NAN;
+    return counts->values[counter] / (double)counts->evaluations;
+}
+
+
+/**
+ * Returns the name of a phase.
+ *
+ * @param phase The phase.
+ * @return The name.
+ */
+const char* perf_phase_name(const PerfPhase phase) {
+    return PHASE_NAMES[phase];
+}
+
+
+/**
+ * Returns the name of a counter.
+ *
+ * @param counter The counter.
+ * @return The name.
+ */
+const char* perf_counter_name(const PerfCounter counter) {
+    return COUNTER_NAMES[counter];
+}
+
+
+/**
+ * Prints a value of the table, or "n/a" if it is not a number.
+ *
+ * @param stream The stream.
+ * @param width The width of the column.
+ * @param precision The number of significant digits.
+ * @param value The value.
+ */
+static void print_value(FILE* stream, const int width, const int precision,
+                        const double value) {
+    if (isnan(value))
+        fprintf(stream, " %*s", width, "n/a");
+    else
+        fprintf(stream, " %*.*g", width, precision, value);
+}
+
+
+/**
+ * Prints the measured phases of a profile as a table: cycles, instructions
+ * and instructions per cycle, and the misses per evaluation. If no counter
+ * was available, the reason is printed instead.
+ *
+ * @param profile The profile.
+ * @param stream The stream to print to.
+ */
+void perf_profile_print(const PerfProfile* profile, FILE* stream) {
+    bool any = false;
+    for (int phase = 0; phase < PERF_PHASE_COUNT; phase++)
+        for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+            any = any || (profile->phases[phase].measured &&
+                          profile->phases[phase].available[counter]);
+
+    if (!any) {
+        fprintf(stream, "Hardware counters are unavailable: %s.\n",
+                profile->error != 0 ? strerror(profile->error)
+                                    : "nothing was measured");
+        if (profile->error == EACCES || profile->error == EPERM)
+            fprintf(stream, "Lower /proc/sys/kernel/perf_event_paranoid to "
+                            "2 or below to allow them.\n");
+        else if (profile->error == ENOENT || profile->error == EOPNOTSUPP)
+            fprintf(stream, "The CPU, or the virtual machine, does not expose "
+                            "these events.\n");
+        return;
+    }
+
+    fprintf(stream, "%-8s %14s %14s %6s %12s %12s %12s\n", "phase",
+            "cycles", "instructions", "IPC", "L1D/eval", "LLC/eval",
+            "branch/eval");
+    for (int phase = 0; phase < PERF_PHASE_COUNT; phase++) {
+        const PerfPhaseCounts* counts = &profile->phases[phase];
+        if (!counts->measured)
+            continue;
+
+        fprintf(stream, "%-8s", PHASE_NAMES[phase]);
+        print_value(stream, 14, 6,
+                    counts->available[PERF_CYCLES]
+                        ? counts->values[PERF_CYCLES] : NAN);
+        print_value(stream, 14, 6,
+                    counts->available[PERF_INSTRUCTIONS]
+                        ? counts->values[PERF_INSTRUCTIONS] : NAN);
+        print_value(stream, 6, 3, perf_ipc(counts));
+        print_value(stream, 12, 4,
+                    perf_per_evaluation(counts, PERF_L1D_MISSES));
+        print_value(stream, 12, 4,
+                    perf_per_evaluation(counts, PERF_LLC_MISSES));
+        print_value(stream, 12, 4,
+                    perf_per_evaluation(counts, PERF_BRANCH_MISSES));
+        fprintf(stream, "\n");
+    }
+
+    if (profile->error != 0)
+        fprintf(stream, "Some counters are unavailable: %s.\n",
+                strerror(profile->error));
+}
@@ -0,0 +1,116 @@
+/**
+ * @file perf.h
+ * @brief Header file for hardware performance counters around the phases of
+ * an integration.
+ *
+ * A PerfProfile installed into a job counts CPU cycles, instructions, L1 data
+ * cache misses, last-level cache misses and branch misses with
+ * perf_event_open(2) while the integrand is parsed and while each method is
+ * computed. The counters of a phase are opened when it begins and inherited
+ * by the chunk threads it starts, so they cover every thread working on the
+ * phase. From them, the profile derives the instructions per cycle and the
+ * misses per evaluation of the integrand, which tell whether an integrand is
+ * bound by dispatching the expression tree, by the math functions or by
+ * memory.
+ *
+ * Counters the kernel refuses, because perf events are restricted or the
+ * CPU lacks an event, are marked unavailable; the integration runs the same
+ * either way.
+ */
+
+
+#ifndef PERF_H
+#define PERF_H
+
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "integral.h"
+
+
+#define PERF_COUNTER_COUNT 5
+
+
+/**
+ * @enum PerfCounter
+ * @brief The hardware events counted.
+ */
+typedef enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES
+} PerfCounter;
+
+
+/**
+ * @enum PerfPhase
+ * @brief The phases of an integration that are measured. The phases of the
+ * methods follow the order of IntegrationMethod.
+ */
+typedef enum PerfPhase {
+    PERF_PHASE_PARSE,
+    PERF_PHASE_RIEMANN,
+    PERF_PHASE_LOWER_DARBOUX,
+    PERF_PHASE_UPPER_DARBOUX,
+    PERF_PHASE_COUNT
+} PerfPhase;
+
+#define PERF_PHASE_OF_METHOD(method)                                           \
+    ((PerfPhase)(PERF_PHASE_RIEMANN + (method)))
+
+
+/**
+ * @struct PerfPhaseCounts
+ * @brief The counters of a phase, summed over every time it ran.
+ *
+ * `values` are scaled up by the fraction of time a counter was actually
+ * scheduled, in case the kernel had to multiplex them. A counter is
+ * `available` if it counted during every run of the phase. `evaluations` is
+ * the number of integrand evaluations of the phase.
+ */
+typedef struct PerfPhaseCounts {
+    bool measured;
+    bool available[PERF_COUNTER_COUNT];
+    double values[PERF_COUNTER_COUNT];
+    long long evaluations;
+} PerfPhaseCounts;
+
+
+/**
+ * @struct PerfProfile
+ * @brief The hardware counters of an integration, installed into its job.
+ *
+ * `fds` are the counters of the phase in progress, -1 where a counter could
+ * not be opened. `error` is the errno of the first counter that could not be
+ * opened, 0 if every counter was available.
+ */
+struct PerfProfile {
+    PerfPhaseCounts phases[PERF_PHASE_COUNT];
+    int fds[PERF_COUNTER_COUNT];
+    int error;
+};
+
+
+void perf_profile_init(PerfProfile* profile);
+
+bool perf_phase_begin(PerfProfile* profile);
+
+void perf_phase_end(PerfProfile* profile, PerfPhase phase,
+                    long long evaluations);
+
+double perf_ipc(const PerfPhaseCounts* counts);
+
+double perf_per_evaluation(const PerfPhaseCounts* counts,
+                           PerfCounter counter);
+
+const char* perf_phase_name(PerfPhase phase);
+
+const char* perf_counter_name(PerfCounter counter);
+
+void perf_profile_print(const PerfProfile* profile, FILE* stream);
+
+
+#endif /* PERF_H */
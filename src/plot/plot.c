@@ -0,0 +1,309 @@
+/**
+ * @file plot.c
+ * @brief Implementation of the level-of-detail reduction behind the plot of
+ * an integrand.
+ */
+
+
+#include "plot.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debugmalloc.h"
+
+
+#define PLOT_TILE_SAMPLES (PLOT_TILE_COLUMNS * PLOT_SAMPLES_PER_COLUMN)
+
+
+/**
+ * Allocates the tile cache of a plot. The plot has no integrand until one is
+ * set with plot_set_function().
+ *
+ * @param plot The plot to initialise.
+ * @return true on success, false if memory could not be allocated.
+ */
+bool plot_init(Plot* plot) {
+    memset(plot, 0, sizeof(*plot));
+    plot->tiles = malloc(PLOT_CACHE_TILES * sizeof(PlotTile));
+    plot->xs = malloc(PLOT_TILE_SAMPLES * sizeof(double));
+    plot->values = malloc(PLOT_TILE_SAMPLES * sizeof(double));
+
+    if (plot->tiles == NULL || plot->xs == NULL || plot->values == NULL) {
+        perror("Did not manage to allocate memory");
+        plot_destroy(plot);
+        return false;
+    }
+
+    for (int i = 0; i < PLOT_CACHE_TILES; i++)
+        plot->tiles[i].valid = false;
+    return true;
+}
+
+
+/**
+ * Removes the integrand of a plot and empties its tile cache.
+ *
+ * @param plot The plot.
+ */
+void plot_clear(Plot* plot) {
+    free_tree(plot->expression);
+    plot->expression = nullptr;
+    plot->clock = plot->evaluations = 0;
+    plot->tile_hits = plot->tile_misses = 0;
+
+    if (plot->tiles != NULL)
+        for (int i = 0; i < PLOT_CACHE_TILES; i++)
+            plot->tiles[i].valid = false;
+}
+
+
+/**
+ * Sets the integrand, interval and partition of a plot, emptying its tile
+ * cache.
+ *
+ * @param plot The plot.
+ * @param integrand The integrand in postfix notation.
+ * @param start One end of the interval.
+ * @param end The other end of the interval; the ends may come in any order.
+ * @param refinement The number of subintervals of the partition.
+ * @return true on success, false if the integrand or the interval is
+ * invalid, in which case the plot is left empty.
+ */
+bool plot_set_function(Plot* plot, const char* integrand, const double start,
+                       const double end, const int refinement) {
+    plot_clear(plot);
+    if (!isfinite(start) || !isfinite(end) || start == end || refinement < 1)
+        return false;
+
+    char* text = malloc(strlen(integrand) + 1);
+    if (text == NULL) {
+        perror("Did not manage to allocate memory");
+        return false;
+    }
+    strcpy(text, integrand);
+    remove_spaces(text);
+
+    if (validate_integrand(text) && validate_expression(text))
+        plot->expression = parse(text);
+    free(text);
+    if (plot->expression == NULL)
+        return false;
+
+    plot->start = fmin(start, end);
+    plot->end = fmax(start, end);
+    plot->subintervals = refinement;
+    plot->dx = (plot->end - plot->start) / refinement;
+    return true;
+}
+
+
+/**
+ * Reduces a set of samples to a column, leaving out the non-finite ones.
+ *
+ * @param values The samples.
+ * @param count The number of samples.
+ * @return The column.
+ */
+static PlotColumn reduce(const double values[], const int count) {
+    PlotColumn column = {INFINITY, -INFINITY, 0.0};
+    int finite = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (!isfinite(values[i]))
+            continue;
+        column.min = fmin(column.min, values[i]);
+        column.max = fmax(column.max, values[i]);
+        column.mean += values[i];
+        finite++;
+    }
+
+    if (finite == 0)
+        return (PlotColumn){NAN, NAN, NAN};
+    column.mean /= finite;
+    return column;
+}
+
+
+/**
+ * Computes the columns of a tile. A column samples the partition points
+ * within it, evenly strided down to at most PLOT_SAMPLES_PER_COLUMN; a column
+ * narrower than a subinterval, which holds no partition point, samples the
+ * integrand at its centre.
+ *
+ * @param plot The plot.
+ * @param tile The tile, with its level and index set.
+ */
+static void compute_tile(Plot* plot, PlotTile* tile) {
+    const double columns = ldexp(PLOT_TILE_COLUMNS, tile->level);
+    const double width = (plot->end - plot->start) / columns;
+    const double points_per_column = (double)plot->subintervals / columns;
+    int offsets[PLOT_TILE_COLUMNS + 1];
+    int count = 0;
+
+    for (int i = 0; i < PLOT_TILE_COLUMNS; i++) {
+        const double column = (double)tile->index * PLOT_TILE_COLUMNS + i;
+        const long long first = (long long)ceil(column * points_per_column);
+        long long last = (long long)ceil((column + 1) * points_per_column) - 1;
+        if (column + 1 >= columns)
+            last = plot->subintervals;
+
+        offsets[i] = count;
+        if (last < first) {
+            plot->xs[count++] = plot->start + (column + 0.5) * width;
+            continue;
+        }
+
+        const long long points = last - first + 1;
+        const long long stride =
+            (points + PLOT_SAMPLES_PER_COLUMN - 1) / PLOT_SAMPLES_PER_COLUMN;
+        for (long long point = first; point <= last; point += stride)
+            plot->xs[count++] = plot->start + (double)point * plot->dx;
+    }
+    offsets[PLOT_TILE_COLUMNS] = count;
+
+    for (int i = 0; i < count; i += EVALUATE_BATCH_MAX) {
+        const int batch =
+            count - i < EVALUATE_BATCH_MAX ? count - i : EVALUATE_BATCH_MAX;
+        evaluate_batch(plot->expression, plot->xs + i, plot->values + i, batch);
+    }
+    plot->evaluations += (unsigned long long)count;
+
+    for (int i = 0; i < PLOT_TILE_COLUMNS; i++)
+        tile->columns[i] = reduce(plot->values + offsets[i],
+                                  offsets[i + 1] - offsets[i]);
+    tile->valid = true;
+}
+
+
+/**
+ * Returns a tile from the cache, computing it in place of the least recently
+ * used tile if it is not cached.
+ *
+ * @param plot The plot.
+ * @param level The level of detail.
+ * @param index The index of the tile within the level.
+ * @return The tile.
+ */
+static const PlotTile* fetch_tile(Plot* plot, const int level,
+                                  const long long index) {
+    PlotTile* victim = &plot->tiles[0];
+
+    for (int i = 0; i < PLOT_CACHE_TILES; i++) {
+        PlotTile* tile = &plot->tiles[i];
+        if (tile->valid && tile->level == level && tile->index == index) {
+            tile->used = ++plot->clock;
+            plot->tile_hits++;
+            return tile;
+        }
+        if (victim->valid && (!tile->valid || tile->used < victim->used))
+            victim = tile;
+    }
+
+    victim->level = level;
+    victim->index = index;
+    victim->used = ++plot->clock;
+    compute_tile(plot, victim);
+    plot->tile_misses++;
+    return victim;
+}
+
+
+/**
+ * Chooses the coarsest level of detail whose columns are no wider than the
+ * pixels of a view.
+ *
+ * @param plot The plot.
+ * @param view_width The width of the view in units of x.
+ * @param width The width of the view in pixels.
+ * @return The level.
+ */
+static int choose_level(const Plot* plot, const double view_width,
+                        const int width) {
+    const double columns =
+        (double)width * (plot->end - plot->start) / view_width;
+    int level = 0;
+    while (level < PLOT_MAX_LEVEL &&
+           ldexp(PLOT_TILE_COLUMNS, level) < columns)
+        level++;
+    return level;
+}
+
+
+/**
+ * Computes the min/max envelope of the integrand over the pixels of a view.
+ * Pixel `p` covers `[view_start + p * w ; view_start + (p + 1) * w)`, where
+ * `w` is the width of a pixel in units of x, and merges the columns within
+ * it. Pixels outside the interval, or without a finite sample, are NAN.
+ *
+ * @param plot The plot.
+ * @param view_start The left end of the view.
+ * @param view_end The right end of the view.
+ * @param width The width of the view in pixels, at most PLOT_MAX_WIDTH.
+ * @param pixels The array receiving the envelope, one entry per pixel.
+ * @return true on success, false if the plot has no integrand or the view is
+ * invalid.
+ */
+bool plot_view(Plot* plot, const double view_start, const double view_end,
+               const int width, PlotColumn pixels[]) {
+    if (plot->expression == NULL || width < 1 || width > PLOT_MAX_WIDTH ||
+        !(view_end > view_start))
+        return false;
+
+    const int level = choose_level(plot, view_end - view_start, width);
+    const double columns = ldexp(PLOT_TILE_COLUMNS, level);
+    const double column_width = (plot->end - plot->start) / columns;
+    const double pixel_width = (view_end - view_start) / width;
+    const PlotTile* tile = nullptr;
+
+    for (int p = 0; p < width; p++) {
+        const double left = view_start + p * pixel_width;
+        const double right = left + pixel_width;
+        const double first =
+            fmax(floor((left - plot->start) / column_width), 0.0);
+        const double last =
+            fmin(ceil((right - plot->start) / column_width) - 1, columns - 1);
+
+        PlotColumn pixel = {INFINITY, -INFINITY, 0.0};
+        int merged = 0;
+        for (double c = first; c <= last; c++) {
+            const long long index = (long long)(c / PLOT_TILE_COLUMNS);
+            if (tile == NULL || tile->level != level || tile->index != index)
+                tile = fetch_tile(plot, level, index);
+
+            const PlotColumn* column =
+                &tile->columns[(long long)c - index * PLOT_TILE_COLUMNS];
+            if (isnan(column->mean))
+                continue;
+            pixel.min = fmin(pixel.min, column->min);
+            pixel.max = fmax(pixel.max, column->max);
+            pixel.mean += column->mean;
+            merged++;
+        }
+
+        if (merged == 0)
+            pixels[p] = (PlotColumn){NAN, NAN, NAN};
+        else {
+            pixel.mean /= merged;
+            pixels[p] = pixel;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Frees the integrand and the tile cache of a plot.
+ *
+ * @param plot The plot.
+ */
+void plot_destroy(Plot* plot) {
+    plot_clear(plot);
+    free(plot->tiles);
+    free(plot->xs);
+    free(plot->values);
+    plot->tiles = nullptr;
+    plot->xs = plot->values = nullptr;
+}
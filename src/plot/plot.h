@@ -0,0 +1,112 @@
+/**
+ * @file plot.h
+ * @brief Header file for the level-of-detail reduction behind the plot of an
+ * integrand.
+ *
+ * A plot never evaluates the integrand at every point of the partition, which
+ * may hold twenty million of them. The interval is instead divided into
+ * columns at a level of detail fine enough for the view, and every column is
+ * reduced to the minimum, maximum and mean of at most PLOT_SAMPLES_PER_COLUMN
+ * partition points, evaluated in batches. A view of any width then merges
+ * the columns under each of its pixels into a min/max envelope, which is all
+ * the drawing needs: the vertical span of a pixel covers every sample in it,
+ * so narrow spikes are not lost to decimation.
+ *
+ * Columns are computed in tiles of PLOT_TILE_COLUMNS and the most recently
+ * used tiles are cached, so zooming and panning only evaluate the tiles that
+ * newly come into view.
+ *
+ * A plot must only be used from one thread.
+ */
+
+
+#ifndef PLOT_H
+#define PLOT_H
+
+
+#include <stdbool.h>
+
+#include "expression_parser.h"
+#include "integral.h"
+
+
+#define PLOT_TILE_COLUMNS 256
+#define PLOT_SAMPLES_PER_COLUMN 16
+#define PLOT_CACHE_TILES 64
+#define PLOT_MAX_LEVEL 32
+#define PLOT_MAX_WIDTH 4096
+
+
+/**
+ * @struct PlotColumn
+ * @brief The reduction of the samples of a column, or of the columns of a
+ * pixel.
+ *
+ * Non-finite samples are left out; a column without a finite sample has
+ * NAN in every field.
+ */
+typedef struct PlotColumn {
+    double min;
+    double max;
+    double mean;
+} PlotColumn;
+
+
+/**
+ * @struct PlotTile
+ * @brief PLOT_TILE_COLUMNS consecutive columns of a level of detail.
+ *
+ * At level `level` the interval is divided into 2^level tiles, and this one
+ * is the `index`th of them. `used` is the clock of the plot when the tile was
+ * last used, for evicting the least recently used tile.
+ */
+typedef struct PlotTile {
+    int level;
+    long long index;
+    unsigned long long used;
+    bool valid;
+    PlotColumn columns[PLOT_TILE_COLUMNS];
+} PlotTile;
+
+
+/**
+ * @struct Plot
+ * @brief The integrand, interval and partition of a plot, and its tile
+ * cache.
+ *
+ * `start` and `end` are the interval in increasing order and `dx` the width
+ * of a subinterval of the partition into `subintervals` parts. `xs` and
+ * `values` are scratch buffers for the samples of one tile. `evaluations`,
+ * `tile_hits` and `tile_misses` count the work done since the integrand was
+ * set.
+ */
+typedef struct Plot {
+    Node* expression;
+    double start;
+    double end;
+    long long subintervals;
+    double dx;
+    PlotTile* tiles;
+    unsigned long long clock;
+    double* xs;
+    double* values;
+    unsigned long long evaluations;
+    unsigned long long tile_hits;
+    unsigned long long tile_misses;
+} Plot;
+
+
+bool plot_init(Plot* plot);
+
+bool plot_set_function(Plot* plot, const char* integrand, double start,
+                       double end, int refinement);
+
+void plot_clear(Plot* plot);
+
+bool plot_view(Plot* plot, double view_start, double view_end, int width,
+               PlotColumn pixels[]);
+
+void plot_destroy(Plot* plot);
+
+
+#endif /* PLOT_H */
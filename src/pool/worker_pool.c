@@ -0,0 +1,379 @@
+/**
+ * @file worker_pool.c
+ * @brief Implementation of the worker pool running integration tasks.
+ *
+ * Every worker thread takes the next pending task chosen by the scheduler,
+ * integrates it with the non-interactive integration core and moves it to the
+ * completion queue. All memory management stays with the owner thread, which
+ * keeps the workers free of allocations.
+ */
+
+
+#include "worker_pool.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * The names of the priority classes, indexed by PoolPriority.
+ */
+static const char* const PRIORITY_NAMES[POOL_PRIORITY_COUNT] = {
+    "interactive", "normal", "bulk"};
+
+
+/**
+ * Appends a task to the end of a queue.
+ *
+ * @param queue The queue to append to.
+ * @param task The task to append.
+ */
+static void queue_push(TaskQueue* queue, PoolTask* task) {
+    task->next = nullptr;
+    if (queue->tail)
+        queue->tail->next = task;
+    else
+        queue->head = task;
+    queue->tail = task;
+}
+
+
+/**
+ * Removes the first task of a queue.
+ *
+ * @param queue The queue to remove from.
+ * @return The removed task, or NULL if the queue is empty.
+ */
+static PoolTask* queue_pop(TaskQueue* queue) {
+    PoolTask* task = queue->head;
+    if (task) {
+        queue->head = task->next;
+        if (queue->head == NULL)
+            queue->tail = nullptr;
+        task->next = nullptr;
+    }
+    return task;
+}
+
+
+/**
+ * Queues a submitted task with its client in its priority class. The client
+ * joins the back of the class if it had no pending task there yet. Called
+ * with the lock held.
+ *
+ * @param pool The pool.
+ * @param task The task.
+ */
+static void schedule(WorkerPool* pool, PoolTask* task) {
+    if (task->priority < 0 || task->priority >= POOL_PRIORITY_COUNT)
+        task->priority = POOL_PRIORITY_NORMAL;
+    const int priority = task->priority;
+    PoolClient* client =
+        task->client != NULL ? task->client : &pool->shared_client;
+    PoolClass* class = &pool->classes[priority];
+
+    queue_push(&client->queues[priority], task);
+    if (!client->active[priority]) {
+        client->active[priority] = true;
+        client->next_active[priority] = nullptr;
+        if (class->tail != NULL)
+            class->tail->next_active[priority] = client;
+        else
+            class->head = client;
+        class->tail = client;
+    }
+
+    if (class->pending++ == 0)
+        class->skipped = 0;
+    pool->pending++;
+}
+
+
+/**
+ * Chooses the class to take the next task from: the most urgent class with
+ * pending tasks, unless a less urgent one has been passed over
+ * `POOL_STARVATION_LIMIT` times. Called with the lock held and at least one
+ * pending task.
+ *
+ * @param pool The pool.
+ * @return The priority of the chosen class.
+ */
+static int choose_class(WorkerPool* pool) {
+    int chosen = 0;
+    while (pool->classes[chosen].pending == 0)
+        chosen++;
+
+    for (int priority = chosen + 1; priority < POOL_PRIORITY_COUNT;
+         priority++) {
+        if (pool->classes[priority].pending > 0 &&
+            pool->classes[priority].skipped >= POOL_STARVATION_LIMIT) {
+            chosen = priority;
+            break;
+        }
+    }
+
+    for (int priority = chosen + 1; priority < POOL_PRIORITY_COUNT; priority++)
+        if (pool->classes[priority].pending > 0)
+            pool->classes[priority].skipped++;
+    pool->classes[chosen].skipped = 0;
+    return chosen;
+}
+
+
+/**
+ * Removes the next task to integrate: the oldest task of the client at the
+ * head of the chosen class, which then moves to the back of the class if it
+ * has more tasks there. Called with the lock held.
+ *
+ * @param pool The pool.
+ * @return The task, or NULL if no task is pending.
+ */
+static PoolTask* take_task(WorkerPool* pool) {
+    if (pool->pending == 0)
+        return nullptr;
+
+    const int priority = choose_class(pool);
+    PoolClass* class = &pool->classes[priority];
+    PoolClient* client = class->head;
+    PoolTask* task = queue_pop(&client->queues[priority]);
+
+    class->head = client->next_active[priority];
+    if (class->head == NULL)
+        class->tail = nullptr;
+    client->next_active[priority] = nullptr;
+
+    if (client->queues[priority].head != NULL) {
+        if (class->tail != NULL)
+            class->tail->next_active[priority] = client;
+        else
+            class->head = client;
+        class->tail = client;
+    } else {
+        client->active[priority] = false;
+    }
+
+    class->pending--;
+    pool->pending--;
+    return task;
+}
+
+
+/**
+ * Thread routine of a worker: integrates pending tasks until the pool is shut
+ * down and no pending task is left. On a machine with several NUMA nodes, the
+ * workers are pinned to the nodes in turn.
+ *
+ * @param argument Pointer to the WorkerPool.
+ * @return Always NULL.
+ */
+static void* pool_worker(void* argument) {
+    WorkerPool* pool = (WorkerPool*)argument;
+    const NumaTopology* topology = numa_topology();
+
+    pthread_mutex_lock(&pool->lock);
+    const int index = pool->placed++;
+    if (topology->node_count > 1)
+        numa_pin_thread(&topology->nodes[index % topology->node_count]);
+
+    while (true) {
+        while (pool->pending == 0 && !pool->shutting_down)
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+
+        PoolTask* task = take_task(pool);
+        if (task == NULL)
+            break;
+
+        pthread_mutex_unlock(&pool->lock);
+        for (PoolTask* member = task; member != NULL; member = member->batch)
+            member->status = integrate_expression(
+                member->expression, &member->job, &member->result);
+        pthread_mutex_lock(&pool->lock);
+
+        queue_push(&pool->completed, task);
+        pthread_cond_signal(&pool->completion_available);
+
+        if (pool->completion_fd >= 0) {
+            const uint64_t increment = 1;
+            if (write(pool->completion_fd, &increment, sizeof(increment)) !=
+                (ssize_t)sizeof(increment))
+                perror("Error signalling a completed task");
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return nullptr;
+}
+
+
+/**
+ * Initialises a worker pool and starts its threads.
+ *
+ * @param pool The pool to initialise.
+ * @param threads The number of worker threads, clamped to [1 ; MAX_THREADS].
+ * @return true if at least one worker thread was started, false otherwise.
+ */
+bool pool_init(WorkerPool* pool, int threads) {
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    pool->thread_count = 0;
+    pool->placed = 0;
+    memset(pool->classes, 0, sizeof(pool->classes));
+    pool_client_init(&pool->shared_client);
+    pool->pending = 0;
+    pool->completed = (TaskQueue){nullptr, nullptr};
+    pool->in_flight = 0;
+    pool->completion_fd = -1;
+    pool->shutting_down = false;
+    pthread_mutex_init(&pool->lock, nullptr);
+    pthread_cond_init(&pool->work_available, nullptr);
+    pthread_cond_init(&pool->completion_available, nullptr);
+
+    while (pool->thread_count < threads &&
+           pthread_create(&pool->threads[pool->thread_count], nullptr,
+                          pool_worker, pool) == 0)
+        pool->thread_count++;
+
+    if (pool->thread_count == 0) {
+        fprintf(stderr, "Error: Could not start any worker thread.\n");
+        pool_destroy(pool);
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Initialises a client of the pool without pending tasks.
+ *
+ * @param client The client.
+ */
+void pool_client_init(PoolClient* client) {
+    memset(client, 0, sizeof(*client));
+}
+
+
+/**
+ * Converts the name of a priority class to a PoolPriority.
+ *
+ * @param text "interactive", "normal" or "bulk".
+ * @param priority Output pointer for the class.
+ * @return true if the name is known.
+ */
+bool parse_pool_priority(const char* text, PoolPriority* priority) {
+    for (int i = 0; i < POOL_PRIORITY_COUNT; i++) {
+        if (strcmp(text, PRIORITY_NAMES[i]) == 0) {
+            *priority = (PoolPriority)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Returns the name of a priority class.
+ *
+ * @param priority The class.
+ * @return The name, or "unknown".
+ */
+const char* pool_priority_name(const PoolPriority priority) {
+    if (priority < 0 || priority >= POOL_PRIORITY_COUNT)
+        return "unknown";
+    return PRIORITY_NAMES[priority];
+}
+
+
+/**
+ * Makes the workers signal every completed task on an eventfd, so the owner
+ * can wait for completions together with other file descriptors.
+ *
+ * @param pool The pool.
+ * @param fd The eventfd to signal, or -1 to stop signalling.
+ */
+void pool_set_completion_fd(WorkerPool* pool, const int fd) {
+    pthread_mutex_lock(&pool->lock);
+    pool->completion_fd = fd;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * Submits a task to the pool. The task must not be touched by the owner until
+ * it is returned by pool_collect().
+ *
+ * @param pool The pool to submit to.
+ * @param task The task to integrate.
+ */
+void pool_submit(WorkerPool* pool, PoolTask* task) {
+    pthread_mutex_lock(&pool->lock);
+    schedule(pool, task);
+    pool->in_flight++;
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * Collects a completed task, in the order in which tasks finished.
+ *
+ * @param pool The pool to collect from.
+ * @param wait If true and tasks are in flight, blocks until one completes.
+ * @return The completed task, or NULL if none is available.
+ */
+PoolTask* pool_collect(WorkerPool* pool, const bool wait) {
+    pthread_mutex_lock(&pool->lock);
+
+    while (wait && pool->completed.head == NULL && pool->in_flight > 0)
+        pthread_cond_wait(&pool->completion_available, &pool->lock);
+
+    PoolTask* task = queue_pop(&pool->completed);
+    if (task)
+        pool->in_flight--;
+
+    pthread_mutex_unlock(&pool->lock);
+    return task;
+}
+
+
+/**
+ * Returns the number of tasks submitted to the pool but not collected yet.
+ *
+ * @param pool The pool.
+ * @return The number of tasks in flight.
+ */
+size_t pool_in_flight(WorkerPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    const size_t in_flight = pool->in_flight;
+    pthread_mutex_unlock(&pool->lock);
+    return in_flight;
+}
+
+
+/**
+ * Stops the worker threads after the pending tasks are integrated and releases
+ * the synchronisation primitives of the pool. Completed tasks that were not
+ * collected remain owned by the caller.
+ *
+ * @param pool The pool to destroy.
+ */
+void pool_destroy(WorkerPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], nullptr);
+    pool->thread_count = 0;
+
+    pthread_cond_destroy(&pool->completion_available);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_mutex_destroy(&pool->lock);
+}
@@ -0,0 +1,167 @@
+/**
+ * @file worker_pool.h
+ * @brief Header file for the worker pool, which runs integration tasks on a
+ * fixed set of threads.
+ *
+ * Tasks are submitted by a single owner thread and handed back to it through a
+ * completion queue in the order they finish. The pool never allocates memory:
+ * tasks are linked through their own `next` field, so the owner decides how
+ * many tasks may be in flight at once.
+ *
+ * Pending tasks are scheduled by priority class, and within a class fairly
+ * between the clients that submitted them, so one client's large batch does
+ * not delay the interactive requests of others.
+ */
+
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "integral.h"
+#include "numa.h"
+
+
+#define POOL_STARVATION_LIMIT 8
+
+
+/**
+ * @enum PoolPriority
+ * @brief The priority classes of pending tasks, the most urgent first.
+ */
+typedef enum PoolPriority {
+    POOL_PRIORITY_INTERACTIVE,
+    POOL_PRIORITY_NORMAL,
+    POOL_PRIORITY_BULK
+} PoolPriority;
+
+#define POOL_PRIORITY_COUNT (POOL_PRIORITY_BULK + 1)
+
+
+struct PoolClient;
+
+
+/**
+ * @struct PoolTask
+ * @brief An integration to be run by the worker pool.
+ *
+ * The owner fills in `expression`, `job` and `context` before submitting the
+ * task, and optionally `priority` and `client`; tasks without a client share
+ * one. The pool stores the outcome in `status` and `result`. The expression is
+ * only read by the worker, so it must stay alive until the task is collected.
+ *
+ * Small tasks may be chained through `batch`: the worker that takes the first
+ * task of the chain integrates all of them one after the other, and the chain
+ * is completed and collected as a whole through its first task.
+ */
+typedef struct PoolTask {
+    Node* expression;
+    IntegrationJob job;
+    IntegrationResult result;
+    IntegrationStatus status;
+    void* context;
+    PoolPriority priority;
+    struct PoolClient* client;
+    struct PoolTask* batch;
+    struct PoolTask* next;
+} PoolTask;
+
+
+/**
+ * @struct TaskQueue
+ * @brief An intrusive first-in first-out queue of tasks.
+ */
+typedef struct TaskQueue {
+    PoolTask* head;
+    PoolTask* tail;
+} TaskQueue;
+
+
+/**
+ * @struct PoolClient
+ * @brief The pending tasks of one client of the pool, one queue per class.
+ *
+ * A client with pending tasks in a class is linked into the round-robin list
+ * of that class through `next_active`. The owner embeds a client in its own
+ * per-client state and must keep it alive while it has tasks in the pool.
+ */
+typedef struct PoolClient {
+    TaskQueue queues[POOL_PRIORITY_COUNT];
+    struct PoolClient* next_active[POOL_PRIORITY_COUNT];
+    bool active[POOL_PRIORITY_COUNT];
+} PoolClient;
+
+
+/**
+ * @struct PoolClass
+ * @brief The clients with pending tasks in one priority class, in the order
+ * they are served.
+ *
+ * `skipped` counts the tasks taken from more urgent classes while this class
+ * was waiting.
+ */
+typedef struct PoolClass {
+    PoolClient* head;
+    PoolClient* tail;
+    size_t pending;
+    int skipped;
+} PoolClass;
+
+
+/**
+ * @struct WorkerPool
+ * @brief A fixed set of threads consuming a queue of pending tasks.
+ *
+ * `in_flight` counts the tasks that were submitted but not collected yet.
+ * If `completion_fd` is not -1, workers add 1 to that eventfd after every
+ * completed task, so an owner waiting in an event loop is woken up.
+ *
+ * Workers take the next task of the most urgent class with pending tasks,
+ * from the client at the head of that class, which then moves to the back.
+ * A class passed over `POOL_STARVATION_LIMIT` times in a row is served once,
+ * so bulk work still progresses under a steady interactive load.
+ *
+ * `placed` counts the workers that have started; worker `i` is pinned to
+ * NUMA node `i % node_count` when the machine has several nodes.
+ */
+typedef struct WorkerPool {
+    pthread_t threads[MAX_THREADS];
+    int thread_count;
+    int placed;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t completion_available;
+    PoolClass classes[POOL_PRIORITY_COUNT];
+    PoolClient shared_client;
+    size_t pending;
+    TaskQueue completed;
+    size_t in_flight;
+    int completion_fd;
+    bool shutting_down;
+} WorkerPool;
+
+
+bool pool_init(WorkerPool* pool, int threads);
+
+void pool_client_init(PoolClient* client);
+
+bool parse_pool_priority(const char* text, PoolPriority* priority);
+
+const char* pool_priority_name(PoolPriority priority);
+
+void pool_set_completion_fd(WorkerPool* pool, int fd);
+
+void pool_submit(WorkerPool* pool, PoolTask* task);
+
+PoolTask* pool_collect(WorkerPool* pool, bool wait);
+
+size_t pool_in_flight(WorkerPool* pool);
+
+void pool_destroy(WorkerPool* pool);
+
+
+#endif /* WORKER_POOL_H */
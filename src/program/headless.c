@@ -0,0 +1,26 @@
+/**
+ * @file headless.c
+ * @brief Entry point of the headless executable of the numerical integration
+ * program.
+ *
+ * The headless executable only links the computation core and the
+ * command-line mode, so it starts without loading GTK or any other library of
+ * the graphical user interface. It accepts the same arguments as the headless
+ * mode of the interactive program.
+ */
+
+
+#include "cli.h"
+#include "debugmalloc.h"
+
+
+/**
+ * @brief Entry point of the headless executable.
+ *
+ * The integration is described by the command-line arguments, or read from
+ * the standard input if no integrand is given, and the outcome is reported by
+ * the exit status.
+ */
+int main(const int argc, char* argv[]) {
+    return run_cli(argc, argv);
+}
@@ -11,7 +11,10 @@
  */
 
 
+#include "cache.h"
+#include "cli.h"
 #include "controls.h"
+#include "journal.h"
 #include "debugmalloc.h"
 
 
@@ -21,11 +24,24 @@
  *
  * This function interacts with the user by displaying rules and a menu
  * interface. It allows the user to choose between performing numerical
- * integration, viewing saved functions from a file, or exiting the program.
- * User inputs are processed in a loop until an exit condition is met.
+ * integration, viewing saved functions from a file, integrating or listing
+ * saved functions by their number, searching them, or exiting the program.
+ * User inputs are processed in a loop until an exit condition is met. Results
+ * are memoized in the result cache, so repeated integrations are answered
+ * immediately, and recorded in the results journal.
+ *
+ * If any command-line arguments are given, the program runs in headless mode
+ * instead: the integration is described by the arguments, no prompt is shown,
+ * GTK is never initialised and the outcome is reported by the exit status.
  */
 int main(const int argc, char* argv[]) {
+    if (argc > 1)
+        return run_cli(argc, argv);
+
     print_rules();
+    cache_open(CACHE_DEFAULT_PATH, CACHE_DEFAULT_ENTRIES);
+    journal_open(JOURNAL_DEFAULT_PATH, JOURNAL_DEFAULT_SYNC_INTERVAL_MS,
+                 JOURNAL_DEFAULT_SYNC_RECORDS);
     int num;
 
     do {
@@ -47,10 +63,24 @@ int main(const int argc, char* argv[]) {
                 log_file_content(filename);
                 break;
 
+            case 4:
+                integrate_saved(filename);
+                break;
+
+            case 5:
+                list_saved_range(filename);
+                break;
+
+            case 6:
+                search_saved(filename);
+                break;
+
             default:
                 break;
         }
-    } while (num == 1 || num == 2 || num == 3);
+    } while (num >= 1 && num <= 6);
 
+    cache_close();
+    journal_close();
     return 0;
 }
@@ -0,0 +1,186 @@
+/**
+ * @file protocol.c
+ * @brief Encodes and decodes the messages of the daemon protocol.
+ *
+ * The messages are plain structures written to the socket as they are laid
+ * out in memory; these functions only fill them in from the job and result
+ * types of the integration core and check their headers.
+ */
+
+
+#include "protocol.h"
+
+#include <math.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * Fills in the header of a request.
+ *
+ * @param request The request to fill in.
+ * @param type The type of the request.
+ * @param tag The tag echoed in the response.
+ * @param job The description of the integration, or NULL for requests other
+ * than integrations.
+ * @param integrand_length The length of the integrand following the header.
+ */
+void protocol_encode_request(ProtocolRequest* request, const ProtocolType type,
+                             const uint64_t tag, const IntegrationJob* job,
+                             const size_t integrand_length) {
+    memset(request, 0, sizeof(*request));
+    request->magic = PROTOCOL_REQUEST_MAGIC;
+    request->version = PROTOCOL_VERSION;
+    request->type = (uint16_t)type;
+    request->tag = tag;
+    request->integrand_length = (uint32_t)integrand_length;
+
+    if (job != NULL) {
+        request->start = job->start;
+        request->end = job->end;
+        request->tolerance = job->tolerance;
+        request->refinement = job->refinement;
+        request->methods = job->methods;
+        // Rounded up, so a deadline is never shortened to none
+        if (job->deadline_ms > 0)
+            request->deadline_ms =
+                (uint32_t)ceil(fmin(job->deadline_ms, (double)UINT32_MAX));
+    }
+}
+
+
+/**
+ * Checks the header of a received request.
+ *
+ * @param request The request header.
+ * @return true if the header belongs to a known request of this protocol
+ * version, false if the connection should be dropped.
+ */
+bool protocol_check_request(const ProtocolRequest* request) {
+    if (request->magic != PROTOCOL_REQUEST_MAGIC ||
+        request->version != PROTOCOL_VERSION)
+        return false;
+
+    switch (request->type) {
+        case PROTOCOL_PING:
+        case PROTOCOL_STATS:
+        case PROTOCOL_ATTACH:
+            return request->integrand_length == 0;
+        case PROTOCOL_INTEGRATE:
+            return request->integrand_length <= PROTOCOL_INTEGRAND_MAX;
+        default:
+            return false;
+    }
+}
+
+
+/**
+ * Fills in the header of a response and clears its body.
+ *
+ * @param response The response to fill in.
+ * @param type The type of the request answered.
+ * @param tag The tag of the request answered.
+ */
+void protocol_begin_response(ProtocolResponse* response,
+                             const ProtocolType type, const uint64_t tag) {
+    memset(response, 0, sizeof(*response));
+    response->magic = PROTOCOL_RESPONSE_MAGIC;
+    response->version = PROTOCOL_VERSION;
+    response->type = (uint16_t)type;
+    response->tag = tag;
+}
+
+
+/**
+ * Fills in the response to an integration request.
+ *
+ * @param response The response to fill in.
+ * @param tag The tag of the request answered.
+ * @param result The result of the integration.
+ * @param flags A combination of the PROTOCOL_FLAG_* values. The cached flag
+ * is also set if the result says it was served from the cache.
+ */
+void protocol_encode_result(ProtocolResponse* response, const uint64_t tag,
+                            const IntegrationResult* result,
+                            const unsigned flags) {
+    protocol_begin_response(response, PROTOCOL_INTEGRATE, tag);
+    ProtocolResult* body = &response->body.result;
+
+    body->status = (int32_t)result->status;
+    body->flags =
+        (uint8_t)(flags | (result->cached ? PROTOCOL_FLAG_CACHED : 0));
+    body->refinement = result->refinement;
+    body->start = result->start;
+    body->end = result->end;
+    body->tolerance = result->tolerance;
+    body->wall_ms = result->wall_ms;
+
+    for (int method = 0; method < METHOD_COUNT; method++) {
+        const MethodResult* source = &result->methods[method];
+        if (!source->computed)
+            continue;
+
+        body->methods |= (uint8_t)METHOD_FLAG(method);
+        body->method_results[method] =
+            (ProtocolMethod){.value = source->value,
+                             .error_bound = source->error_bound,
+                             .evaluations = (uint64_t)source->evaluations,
+                             .subintervals = (uint64_t)source->subintervals,
+                             .node_visits = (uint64_t)source->node_visits,
+                             .cpu_ms = source->time_ms,
+                             .wall_ms = source->wall_ms};
+    }
+}
+
+
+/**
+ * Checks the header of a received response.
+ *
+ * @param response The response.
+ * @return true if it is a response of this protocol version.
+ */
+bool protocol_check_response(const ProtocolResponse* response) {
+    return response->magic == PROTOCOL_RESPONSE_MAGIC &&
+           response->version == PROTOCOL_VERSION;
+}
+
+
+/**
+ * Converts the response to an integration request into a result of the
+ * integration core.
+ *
+ * @param response The response.
+ * @param result Output pointer for the result.
+ * @return The status of the integration.
+ */
+IntegrationStatus protocol_decode_result(const ProtocolResponse* response,
+                                         IntegrationResult* result) {
+    const ProtocolResult* body = &response->body.result;
+
+    memset(result, 0, sizeof(*result));
+    result->status = (IntegrationStatus)body->status;
+    result->start = body->start;
+    result->end = body->end;
+    result->tolerance = body->tolerance;
+    result->refinement = body->refinement;
+    result->wall_ms = body->wall_ms;
+    result->cached = (body->flags & PROTOCOL_FLAG_CACHED) != 0;
+
+    for (int method = 0; method < METHOD_COUNT; method++) {
+        if (!(body->methods & METHOD_FLAG(method)))
+            continue;
+
+        const ProtocolMethod* source = &body->method_results[method];
+        result->methods[method] =
+            (MethodResult){.value = source->value,
+                           .error_bound = source->error_bound,
+                           .time_ms = source->cpu_ms,
+                           .wall_ms = source->wall_ms,
+                           .evaluations = (long long)source->evaluations,
+                           .subintervals = (long long)source->subintervals,
+                           .node_visits = (long long)source->node_visits,
+                           .computed = true};
+    }
+
+    return result->status;
+}
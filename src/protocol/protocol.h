@@ -0,0 +1,203 @@
+/**
+ * @file protocol.h
+ * @brief Header file for the binary protocol spoken between the integration
+ * daemon and its clients over a Unix domain socket.
+ *
+ * Every request is a fixed-size header, followed by the integrand for
+ * integration requests. Every response has the same fixed size, so a client
+ * can read responses without parsing a length. All fields use the byte order
+ * of the host, as both ends always run on the same machine.
+ *
+ * The same structures are exchanged through the shared-memory rings of the
+ * ring module once a client has attached them.
+ */
+
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "integral.h"
+
+
+#define PROTOCOL_REQUEST_MAGIC UINT32_C(0x5152494e)  // "NIRQ"
+#define PROTOCOL_RESPONSE_MAGIC UINT32_C(0x5352494e) // "NIRS"
+#define PROTOCOL_VERSION 4
+#define PROTOCOL_INTEGRAND_MAX 1024
+#define PROTOCOL_FLAG_CACHED 0x01u
+#define PROTOCOL_FLAG_COMPILED 0x02u
+#define PROTOCOL_FLAG_COALESCED 0x04u
+#define PROTOCOL_FLAG_DOWNGRADED 0x08u
+
+
+/**
+ * @enum ProtocolType
+ * @brief The kinds of requests, echoed in the type of their responses.
+ */
+typedef enum ProtocolType {
+    PROTOCOL_PING = 1,
+    PROTOCOL_INTEGRATE = 2,
+    PROTOCOL_STATS = 3,
+    PROTOCOL_ATTACH = 4
+} ProtocolType;
+
+
+/**
+ * @struct ProtocolRequest
+ * @brief The header of a request.
+ *
+ * `tag` is chosen by the client and echoed in the response, so a client may
+ * pipeline requests and match the responses, which arrive in completion
+ * order. An integration request is followed by `integrand_length` bytes of the
+ * integrand, without a terminating NUL. `deadline_ms` is the deadline of the
+ * job in whole milliseconds, or 0 for none, and `priority` the PoolPriority
+ * class the client asks for.
+ */
+typedef struct ProtocolRequest {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    uint64_t tag;
+    double start;
+    double end;
+    double tolerance;
+    int32_t refinement;
+    uint32_t methods;
+    uint32_t integrand_length;
+    uint32_t deadline_ms;
+    uint32_t priority;
+    uint32_t reserved;
+} ProtocolRequest;
+
+static_assert(sizeof(ProtocolRequest) == 64,
+              "protocol requests must have a fixed layout");
+
+
+/**
+ * @struct ProtocolMethod
+ * @brief The result of a single method in a response. `error_bound` is only
+ * nonzero in partial results.
+ */
+typedef struct ProtocolMethod {
+    double value;
+    double error_bound;
+    uint64_t evaluations;
+    uint64_t subintervals;
+    uint64_t node_visits;
+    double cpu_ms;
+    double wall_ms;
+} ProtocolMethod;
+
+
+/**
+ * @struct ProtocolResult
+ * @brief The body of the response to an integration request.
+ *
+ * `status` is an IntegrationStatus and `methods` the mask of the computed
+ * methods. `PROTOCOL_FLAG_CACHED` is set if the result was served from the
+ * result cache, `PROTOCOL_FLAG_COMPILED` if the parsed integrand was reused
+ * and `PROTOCOL_FLAG_COALESCED` if the result was computed for an identical
+ * request in flight at the same time. `PROTOCOL_FLAG_DOWNGRADED` is set if the
+ * job was moved to the bulk class because of its estimated cost.
+ */
+typedef struct ProtocolResult {
+    int32_t status;
+    uint8_t methods;
+    uint8_t flags;
+    uint16_t reserved;
+    int32_t refinement;
+    uint32_t padding;
+    double start;
+    double end;
+    double tolerance;
+    double wall_ms;
+    ProtocolMethod method_results[METHOD_COUNT];
+} ProtocolResult;
+
+
+/**
+ * @struct ProtocolStats
+ * @brief The body of the response to a statistics request: counters of the
+ * daemon since it was started.
+ */
+typedef struct ProtocolStats {
+    uint64_t requests;
+    uint64_t integrations;
+    uint64_t result_cache_hits;
+    uint64_t expression_hits;
+    uint64_t expression_misses;
+    uint64_t batches;
+    uint64_t batched_jobs;
+    uint64_t connections;
+    uint64_t open_connections;
+    uint64_t in_flight;
+    uint64_t workers;
+    uint64_t protocol_errors;
+    uint64_t ring_clients;
+    uint64_t ring_requests;
+    uint64_t coalesced;
+    uint64_t largest_coalesced_group;
+    uint64_t rejected;
+    uint64_t downgraded;
+} ProtocolStats;
+
+
+/**
+ * @struct ProtocolAttach
+ * @brief The body of the response to an attach request.
+ *
+ * If `status` is zero, the descriptor of the shared-memory segment of `size`
+ * bytes with rings of `entries` entries accompanies the response as
+ * SCM_RIGHTS ancillary data; otherwise it is an errno value.
+ */
+typedef struct ProtocolAttach {
+    int32_t status;
+    uint32_t entries;
+    uint64_t size;
+} ProtocolAttach;
+
+
+/**
+ * @struct ProtocolResponse
+ * @brief A response. Its body depends on its type; ping responses have an
+ * empty body.
+ */
+typedef struct ProtocolResponse {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    uint64_t tag;
+    union {
+        ProtocolResult result;
+        ProtocolStats stats;
+        ProtocolAttach attach;
+    } body;
+} ProtocolResponse;
+
+static_assert(sizeof(ProtocolResponse) == 232,
+              "protocol responses must have a fixed layout");
+
+
+void protocol_encode_request(ProtocolRequest* request, ProtocolType type,
+                             uint64_t tag, const IntegrationJob* job,
+                             size_t integrand_length);
+
+bool protocol_check_request(const ProtocolRequest* request);
+
+void protocol_begin_response(ProtocolResponse* response, ProtocolType type,
+                             uint64_t tag);
+
+void protocol_encode_result(ProtocolResponse* response, uint64_t tag,
+                            const IntegrationResult* result, unsigned flags);
+
+bool protocol_check_response(const ProtocolResponse* response);
+
+IntegrationStatus protocol_decode_result(const ProtocolResponse* response,
+                                         IntegrationResult* result);
+
+
+#endif /* PROTOCOL_H */
@@ -0,0 +1,585 @@
+/**
+ * @file report.c
+ * @brief Functions writing integration results as text, JSON Lines, CSV or
+ * compact binary records.
+ *
+ * Every record is first encoded into a RecordBuffer and then handed to the
+ * stream with a single fwrite(), so a record is never interleaved with other
+ * output of the same stream.
+ */
+
+
+#include "report.h"
+
+#include <stdarg.h>
+
+#include "trace.h"
+
+#include "debugmalloc.h"
+
+
+/**
+ * The names of the formats, indexed by ReportFormat.
+ */
+static const char* const FORMAT_NAMES[] = {"text", "value", "json", "csv",
+                                           "binary"};
+
+
+/**
+ * The labels of the methods in the text report, indexed by IntegrationMethod.
+ */
+static const char* const TEXT_LABELS[METHOD_COUNT] = {
+    "Riemann-sum", "Lower Darboux-sum", "Upper Darboux-sum"};
+
+
+/**
+ * The names of the methods in the timing lines of the text report, indexed by
+ * IntegrationMethod.
+ */
+static const char* const TEXT_TIME_LABELS[METHOD_COUNT] = {
+    "Riemann-sum", "lower Darboux-sum", "upper Darboux-sum"};
+
+
+/**
+ * The header line of the CSV format.
+ */
+static const char CSV_HEADER[] =
+    "id,integrand,status,cached,start,end,tolerance,refinement,method,value,"
+    "hex,evaluations,cpu_ms,wall_ms,error_bound,subintervals,node_visits,"
+    "evaluations_per_sec,ns_per_evaluation\n";
+
+
+/**
+ * Converts the name of a format to a ReportFormat.
+ *
+ * @param text The name of the format.
+ * @param format Output pointer for the format.
+ * @return true if the name is known, false otherwise.
+ */
+bool parse_report_format(const char* text, ReportFormat* format) {
+    for (size_t i = 0; i < sizeof(FORMAT_NAMES) / sizeof(FORMAT_NAMES[0]);
+         i++) {
+        if (strcmp(text, FORMAT_NAMES[i]) == 0) {
+            *format = (ReportFormat)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Tells whether a format is one of the machine-readable formats.
+ *
+ * @param format The format.
+ * @return true for JSON, CSV and binary, false for the text formats.
+ */
+bool report_is_machine_readable(const ReportFormat format) {
+    return format == REPORT_JSON || format == REPORT_CSV ||
+           format == REPORT_BINARY;
+}
+
+
+/**
+ * Appends formatted text to a record buffer. Text that does not fit is
+ * truncated.
+ *
+ * @param buffer The record buffer.
+ * @param format The printf-style format string.
+ */
+static void append_format(RecordBuffer* buffer, const char* format, ...) {
+    const size_t available = sizeof(buffer->data) - buffer->length;
+    va_list arguments;
+    va_start(arguments, format);
+    const int written =
+        vsnprintf(buffer->data + buffer->length, available, format, arguments);
+    va_end(arguments);
+
+    if (written < 0)
+        return;
+    buffer->length += (size_t)written < available ? (size_t)written
+                                                  : available - 1;
+}
+
+
+/**
+ * Appends raw bytes to a record buffer. Bytes that do not fit are dropped.
+ *
+ * @param buffer The record buffer.
+ * @param data The bytes to append.
+ * @param size The number of bytes.
+ */
+static void append_bytes(RecordBuffer* buffer, const void* data, size_t size) {
+    const size_t available = sizeof(buffer->data) - buffer->length;
+    if (size > available)
+        size = available;
+    memcpy(buffer->data + buffer->length, data, size);
+    buffer->length += size;
+}
+
+
+/**
+ * Appends an unsigned integer to a record buffer in little-endian byte order.
+ *
+ * @param buffer The record buffer.
+ * @param value The value to append.
+ * @param size The number of bytes of the encoded value.
+ */
+static void append_unsigned(RecordBuffer* buffer, uint64_t value,
+                            const size_t size) {
+    unsigned char bytes[sizeof(uint64_t)];
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = (unsigned char)(value & 0xFF);
+        value >>= 8;
+    }
+    append_bytes(buffer, bytes, size);
+}
+
+
+/**
+ * Appends a double to a record buffer as its IEEE 754 bit pattern in
+ * little-endian byte order.
+ *
+ * @param buffer The record buffer.
+ * @param value The value to append.
+ */
+static void append_double(RecordBuffer* buffer, const double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    append_unsigned(buffer, bits, sizeof(bits));
+}
+
+
+/**
+ * Appends a string as a JSON string literal. At most `REPORT_TEXT_MAX`
+ * characters of the string are used.
+ *
+ * @param buffer The record buffer.
+ * @param text The string to append.
+ */
+static void append_json_string(RecordBuffer* buffer, const char* text) {
+    append_bytes(buffer, "\"", 1);
+    for (size_t i = 0; text[i] != '\0' && i < REPORT_TEXT_MAX; i++) {
+        const unsigned char character = (unsigned char)text[i];
+        if (character == '"' || character == '\\')
+            append_format(buffer, "\\%c", character);
+        else if (character < 0x20)
+            append_format(buffer, "\\u%04x", character);
+        else
+            append_bytes(buffer, &character, 1);
+    }
+    append_bytes(buffer, "\"", 1);
+}
+
+
+/**
+ * Appends a string as a CSV field, quoted if it contains a separator, a quote
+ * or a line break. At most `REPORT_TEXT_MAX` characters of the string are
+ * used.
+ *
+ * @param buffer The record buffer.
+ * @param text The string to append, NULL for an empty field.
+ */
+static void append_csv_field(RecordBuffer* buffer, const char* text) {
+    if (text == NULL)
+        return;
+
+    const size_t length = strnlen(text, REPORT_TEXT_MAX);
+    if (strcspn(text, ",\"\r\n") >= length) {
+        append_bytes(buffer, text, length);
+        return;
+    }
+
+    append_bytes(buffer, "\"", 1);
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '"')
+            append_bytes(buffer, "\"", 1);
+        append_bytes(buffer, &text[i], 1);
+    }
+    append_bytes(buffer, "\"", 1);
+}
+
+
+/**
+ * Returns the status label of a record.
+ *
+ * @param record The record.
+ * @return The label of the record if it has one, the status name otherwise.
+ */
+static const char* record_status(const ResultRecord* record) {
+    return record->label != NULL ? record->label
+                                 : status_name(record->result->status);
+}
+
+
+/**
+ * Encodes a record as the human-readable report of the interactive mode.
+ *
+ * If all three methods were computed, the differences between the sums are
+ * reported as well.
+ *
+ * @param buffer The record buffer.
+ * @param record The record to encode.
+ */
+static void encode_text(RecordBuffer* buffer, const ResultRecord* record) {
+    const IntegrationResult* result = record->result;
+    const MethodResult* methods = result->methods;
+
+    const bool partial = result->status == INTEGRATION_PARTIAL;
+
+    if (result->cached)
+        append_format(buffer, "Result served from the cache.\n\n");
+    if (partial)
+        append_format(buffer, "Partial result, the integration was stopped "
+                              "before completing.\n\n");
+    if (result->tolerance > 0)
+        append_format(buffer, "Refinement = %d\n\n", result->refinement);
+
+    for (int method = 0; method < METHOD_COUNT; method++) {
+        if (!methods[method].computed)
+            continue;
+        if (partial)
+            append_format(buffer, "%s = %.8f (+/- %.3g)\n",
+                          TEXT_LABELS[method], methods[method].value,
+                          methods[method].error_bound);
+        else
+            append_format(buffer, "%s = %.8f\n", TEXT_LABELS[method],
+                          methods[method].value);
+        append_format(buffer,
+                      "Time spent on %s calculation = %.4f ms (= %.6f sec)\n",
+                      TEXT_TIME_LABELS[method], methods[method].time_ms,
+                      methods[method].time_ms / 1000.0);
+        const MethodMetrics metrics = method_metrics(&methods[method]);
+        append_format(buffer,
+                      "Evaluations = %lld (%.4g per sec, %.2f ns each), "
+                      "subintervals = %lld\n\n",
+                      methods[method].evaluations,
+                      metrics.evaluations_per_second,
+                      metrics.ns_per_evaluation, methods[method].subintervals);
+    }
+
+    if (!methods[METHOD_RIEMANN].computed ||
+        !methods[METHOD_LOWER_DARBOUX].computed ||
+        !methods[METHOD_UPPER_DARBOUX].computed)
+        return;
+
+    const double lower = methods[METHOD_LOWER_DARBOUX].value;
+    const double upper = methods[METHOD_UPPER_DARBOUX].value;
+    const double average = (upper + lower) / 2;
+
+    append_format(buffer, "Difference between Darboux-sums = %.6f\n",
+                  fabs(upper - lower));
+    append_format(buffer, "Average of the Darboux-sums = %.6f\n\n", average);
+    append_format(buffer,
+                  "Difference between Riemann-sum and average of the "
+                  "Darboux-sums = %.6f\n\n",
+                  fabs(average - methods[METHOD_RIEMANN].value));
+}
+
+
+/**
+ * Encodes the value of every computed method on its own line, with enough
+ * digits to be read back exactly.
+ *
+ * @param buffer The record buffer.
+ * @param record The record to encode.
+ */
+static void encode_values(RecordBuffer* buffer, const ResultRecord* record) {
+    for (int method = 0; method < METHOD_COUNT; method++)
+        if (record->result->methods[method].computed)
+            append_format(buffer, "%.17g\n",
+                          record->result->methods[method].value);
+}
+
+
+/**
+ * Encodes a record as a JSON object on its own line.
+ *
+ * Every computed method has its value as a JSON number (null if it is not
+ * finite) and as an exact hexadecimal floating-point string. The methods of a
+ * partial result carry their error bound as well.
+ *
+ * @param buffer The record buffer.
+ * @param record The record to encode.
+ */
+static void encode_json(RecordBuffer* buffer, const ResultRecord* record) {
+    const IntegrationResult* result = record->result;
+
+    append_format(buffer, "{\"id\":");
+    if (record->id == NULL)
+        append_format(buffer, "null");
+    else if (record->id_is_number)
+        append_format(buffer, "%s", record->id);
+    else
+        append_json_string(buffer, record->id);
+
+    if (record->integrand != NULL) {
+        append_format(buffer, ",\"integrand\":");
+        append_json_string(buffer, record->integrand);
+    }
+
+    append_format(buffer, ",\"status\":\"%s\",\"cached\":%s",
+                  record_status(record), result->cached ? "true" : "false");
+    if (isfinite(result->start) && isfinite(result->end))
+        append_format(buffer, ",\"start\":%.17g,\"end\":%.17g", result->start,
+                      result->end);
+    if (result->tolerance > 0)
+        append_format(buffer, ",\"tolerance\":%.17g", result->tolerance);
+    append_format(buffer, ",\"refinement\":%d,\"wall_ms\":%.6f",
+                  result->refinement, result->wall_ms);
+
+    append_format(buffer, ",\"methods\":{");
+    bool first = true;
+    for (int method = 0; method < METHOD_COUNT; method++) {
+        const MethodResult* value = &result->methods[method];
+        if (!value->computed)
+            continue;
+
+        append_format(buffer, "%s\"%s\":{", first ? "" : ",",
+                      method_name(method));
+        if (isfinite(value->value))
+            append_format(buffer, "\"value\":%.17g", value->value);
+        else
+            append_format(buffer, "\"value\":null");
+        const MethodMetrics metrics = method_metrics(value);
+        append_format(buffer,
+                      ",\"hex\":\"%a\",\"evaluations\":%lld,\"cpu_ms\":%.6f,"
+                      "\"wall_ms\":%.6f,\"subintervals\":%lld,"
+                      "\"node_visits\":%lld,\"evaluations_per_sec\":%.6g,"
+                      "\"ns_per_evaluation\":%.6g",
+                      value->value, value->evaluations, value->time_ms,
+                      value->wall_ms, value->subintervals, value->node_visits,
+                      metrics.evaluations_per_second,
+                      metrics.ns_per_evaluation);
+        if (result->status == INTEGRATION_PARTIAL &&
+            isfinite(value->error_bound))
+            append_format(buffer, ",\"error_bound\":%.17g",
+                          value->error_bound);
+        else if (result->status == INTEGRATION_PARTIAL)
+            append_format(buffer, ",\"error_bound\":null");
+        append_format(buffer, "}");
+        first = false;
+    }
+    append_format(buffer, "}}\n");
+}
+
+
+/**
+ * Encodes the columns of a CSV row that identify the job.
+ *
+ * @param buffer The record buffer.
+ * @param record The record to encode.
+ */
+static void encode_csv_job(RecordBuffer* buffer, const ResultRecord* record) {
+    const IntegrationResult* result = record->result;
+
+    append_csv_field(buffer, record->id);
+    append_bytes(buffer, ",", 1);
+    append_csv_field(buffer, record->integrand);
+    append_format(buffer, ",%s,%s,", record_status(record),
+                  result->cached ? "true" : "false");
+    if (isfinite(result->start) && isfinite(result->end))
+        append_format(buffer, "%.17g,%.17g", result->start, result->end);
+    else
+        append_bytes(buffer, ",", 1);
+    append_format(buffer, ",%.17g,%d,", result->tolerance,
+                  result->refinement);
+}
+
+
+/**
+ * Encodes a record as CSV rows, one per computed method. A record without any
+ * computed method is written as a single row with empty method columns.
+ *
+ * @param buffer The record buffer.
+ * @param record The record to encode.
+ */
+static void encode_csv(RecordBuffer* buffer, const ResultRecord* record) {
+    bool any = false;
+
+    for (int method = 0; method < METHOD_COUNT; method++) {
+        const MethodResult* value = &record->result->methods[method];
+        if (!value->computed)
+            continue;
+
+        const MethodMetrics metrics = method_metrics(value);
+        encode_csv_job(buffer, record);
+        append_format(buffer,
+                      "%s,%.17g,%a,%lld,%.6f,%.6f,%.17g,%lld,%lld,%.6g,%.6g\n",
+                      method_name(method), value->value, value->value,
+                      value->evaluations, value->time_ms, value->wall_ms,
+                      value->error_bound, value->subintervals,
+                      value->node_visits, metrics.evaluations_per_second,
+                      metrics.ns_per_evaluation);
+        any = true;
+    }
+
+    if (!any) {
+        encode_csv_job(buffer, record);
+        append_format(buffer, ",,,,,,,,,,\n");
+    }
+}
+
+
+/**
+ * Encodes a record in the compact binary format.
+ *
+ * All integers and doubles are little-endian. A record starts with its size,
+ * not counting the size field itself, followed by the fixed part, one block per
+ * computed method in method order, and finally the id and the integrand
+ * without terminators. See the README of the module for the exact layout.
+ *
+ * @param buffer The record buffer.
+ * @param record The record to encode.
+ */
+static void encode_binary(RecordBuffer* buffer, const ResultRecord* record) {
+    const IntegrationResult* result = record->result;
+    const size_t id_length =
+        record->id != NULL ? strnlen(record->id, REPORT_TEXT_MAX) : 0;
+    const size_t integrand_length =
+        record->integrand != NULL ? strnlen(record->integrand, REPORT_TEXT_MAX)
+                                  : 0;
+
+    unsigned methods = 0;
+    for (int method = 0; method < METHOD_COUNT; method++)
+        if (result->methods[method].computed)
+            methods |= METHOD_FLAG(method);
+
+    // The size field is filled in once the record is complete
+    append_unsigned(buffer, 0, sizeof(uint32_t));
+    append_unsigned(buffer, record->label != NULL ? UINT8_MAX : result->status,
+                    sizeof(uint8_t));
+    append_unsigned(buffer, methods, sizeof(uint8_t));
+    append_unsigned(buffer, id_length, sizeof(uint16_t));
+    append_unsigned(buffer, integrand_length, sizeof(uint16_t));
+    append_unsigned(buffer,
+                    (record->id_is_number ? REPORT_FLAG_NUMERIC_ID : 0u) |
+                        (result->cached ? REPORT_FLAG_CACHED : 0u),
+                    sizeof(uint16_t));
+    append_unsigned(buffer, (uint32_t)result->refinement, sizeof(uint32_t));
+    append_double(buffer, result->start);
+    append_double(buffer, result->end);
+    append_double(buffer, result->tolerance);
+    append_double(buffer, result->wall_ms);
+
+    for (int method = 0; method < METHOD_COUNT; method++) {
+        const MethodResult* value = &result->methods[method];
+        if (!value->computed)
+            continue;
+        append_double(buffer, value->value);
+        append_unsigned(buffer, (uint64_t)value->evaluations,
+                        sizeof(uint64_t));
+        append_double(buffer, value->time_ms);
+        append_double(buffer, value->wall_ms);
+    }
+
+    append_bytes(buffer, record->id, id_length);
+    append_bytes(buffer, record->integrand, integrand_length);
+
+    const size_t length = buffer->length;
+    buffer->length = 0;
+    append_unsigned(buffer, length - sizeof(uint32_t), sizeof(uint32_t));
+    buffer->length = length;
+}
+
+
+/**
+ * Writes the contents of a record buffer to the stream of a writer.
+ *
+ * @param writer The writer.
+ * @param buffer The record buffer.
+ * @return true on success, false if the stream reported an error.
+ */
+static bool write_buffer(ResultWriter* writer, const RecordBuffer* buffer) {
+    if (fwrite(buffer->data, 1, buffer->length, writer->stream) !=
+        buffer->length) {
+        perror("Error writing results");
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Prepares a writer and writes the header of its format, if any.
+ *
+ * For the machine-readable formats the stream is made fully buffered, so it
+ * must not have been used yet. The text formats keep the buffering of the
+ * stream, since they share it with the interactive prompts.
+ *
+ * @param writer The writer to prepare.
+ * @param stream The stream to write to.
+ * @param format The format of the records.
+ * @return true on success, false if the header could not be written.
+ */
+bool report_begin(ResultWriter* writer, FILE* stream,
+                  const ReportFormat format) {
+    writer->stream = stream;
+    writer->format = format;
+
+    if (!report_is_machine_readable(format))
+        return true;
+
+    setvbuf(stream, nullptr, _IOFBF, REPORT_BUFFER_SIZE);
+
+    RecordBuffer buffer = {.length = 0};
+    if (format == REPORT_CSV) {
+        append_bytes(&buffer, CSV_HEADER, sizeof(CSV_HEADER) - 1);
+    } else if (format == REPORT_BINARY) {
+        append_bytes(&buffer, REPORT_BINARY_MAGIC, REPORT_BINARY_MAGIC_SIZE);
+        append_unsigned(&buffer, REPORT_BINARY_VERSION, sizeof(uint32_t));
+    }
+
+    return write_buffer(writer, &buffer);
+}
+
+
+/**
+ * Writes a result record in the format of the writer.
+ *
+ * @param writer The writer.
+ * @param record The record to write.
+ * @return true on success, false if the stream reported an error.
+ */
+bool report_write(ResultWriter* writer, const ResultRecord* record) {
+    const long long span = trace_begin();
+    RecordBuffer buffer = {.length = 0};
+
+    switch (writer->format) {
+        case REPORT_TEXT:
+            encode_text(&buffer, record);
+            break;
+        case REPORT_VALUE:
+            encode_values(&buffer, record);
+            break;
+        case REPORT_JSON:
+            encode_json(&buffer, record);
+            break;
+        case REPORT_CSV:
+            encode_csv(&buffer, record);
+            break;
+        case REPORT_BINARY:
+            encode_binary(&buffer, record);
+            break;
+    }
+
+    const bool success = write_buffer(writer, &buffer);
+    trace_end(span, "output", "write", TRACE_NO_ARGUMENT, 0);
+    return success;
+}
+
+
+/**
+ * Hands the buffered records of a writer to the operating system.
+ *
+ * @param writer The writer.
+ * @return true on success, false if the stream reported an error.
+ */
+bool report_flush(ResultWriter* writer) {
+    const long long span = trace_begin();
+    const bool success = fflush(writer->stream) == 0;
+    trace_end(span, "output", "flush", TRACE_NO_ARGUMENT, 0);
+    if (!success)
+        perror("Error writing results");
+    return success;
+}
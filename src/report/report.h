@@ -0,0 +1,100 @@
+/**
+ * @file report.h
+ * @brief Header file for the result writers, which report integration results
+ * as human-readable text or in machine-readable formats.
+ *
+ * Besides the text report of the interactive mode, results can be written as
+ * JSON Lines, CSV or compact binary records. The machine-readable formats carry
+ * the exact values as hexadecimal floating-point literals along with the
+ * timings and evaluation counts of every method, and are written to a fully
+ * buffered stream.
+ */
+
+
+#ifndef REPORT_H
+#define REPORT_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "integral.h"
+
+
+#define REPORT_BUFFER_SIZE (1 << 16)
+#define REPORT_RECORD_MAX 8192
+#define REPORT_TEXT_MAX 256
+#define REPORT_BINARY_MAGIC "NIRESULT"
+#define REPORT_BINARY_MAGIC_SIZE 8
+#define REPORT_BINARY_VERSION 1
+#define REPORT_FLAG_NUMERIC_ID 0x0001u
+#define REPORT_FLAG_CACHED 0x0002u
+
+
+/**
+ * @enum ReportFormat
+ * @brief Formats in which results can be written.
+ *
+ * REPORT_TEXT is the human-readable report of the interactive mode,
+ * REPORT_VALUE writes the value of every computed method on its own line with
+ * full precision. The others are the machine-readable formats.
+ */
+typedef enum ReportFormat {
+    REPORT_TEXT,
+    REPORT_VALUE,
+    REPORT_JSON,
+    REPORT_CSV,
+    REPORT_BINARY
+} ReportFormat;
+
+
+/**
+ * @struct ResultRecord
+ * @brief A result together with the identification of its job.
+ *
+ * `id` and `integrand` may be NULL. If `id_is_number` is set, the id is
+ * written as a number in JSON. `label` replaces the status name, e.g. for
+ * jobs that could not be parsed at all.
+ */
+typedef struct ResultRecord {
+    const char* id;
+    bool id_is_number;
+    const char* integrand;
+    const char* label;
+    const IntegrationResult* result;
+} ResultRecord;
+
+
+/**
+ * @struct ResultWriter
+ * @brief Writes result records in one format to a stream.
+ */
+typedef struct ResultWriter {
+    FILE* stream;
+    ReportFormat format;
+} ResultWriter;
+
+
+/**
+ * @struct RecordBuffer
+ * @brief A single encoded record, written to the stream with one call.
+ */
+typedef struct RecordBuffer {
+    char data[REPORT_RECORD_MAX];
+    size_t length;
+} RecordBuffer;
+
+
+bool parse_report_format(const char* text, ReportFormat* format);
+
+bool report_is_machine_readable(ReportFormat format);
+
+bool report_begin(ResultWriter* writer, FILE* stream, ReportFormat format);
+
+bool report_write(ResultWriter* writer, const ResultRecord* record);
+
+bool report_flush(ResultWriter* writer);
+
+
+#endif /* REPORT_H */
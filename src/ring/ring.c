@@ -0,0 +1,192 @@
+/**
+ * @file ring.c
+ * @brief Implementation of the shared-memory segment and its doorbells.
+ *
+ * The futexes live in memory shared between processes, so the shared (not
+ * process-private) futex operations are used.
+ */
+
+
+#define _GNU_SOURCE // memfd_create
+
+#include "ring.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * Invokes the futex system call, which has no glibc wrapper.
+ *
+ * @param word The futex word.
+ * @param operation FUTEX_WAIT or FUTEX_WAKE.
+ * @param value The expected value for FUTEX_WAIT, the number of waiters to
+ * wake for FUTEX_WAKE.
+ * @return The result of the system call.
+ */
+static long futex(_Atomic uint32_t* word, const int operation,
+                  const uint32_t value) {
+    return syscall(SYS_futex, (uint32_t*)word, operation, value, nullptr,
+                   nullptr, 0);
+}
+
+
+/**
+ * Creates a zeroed segment in a new memfd and maps it.
+ *
+ * @param fd Output pointer for the descriptor of the memfd, to be passed to
+ * the client.
+ * @return The mapped segment, or NULL on failure.
+ */
+RingSegment* ring_create(int* fd) {
+    *fd = memfd_create("numint-ring", MFD_CLOEXEC);
+    if (*fd < 0) {
+        perror("Error creating shared memory");
+        return nullptr;
+    }
+
+    if (ftruncate(*fd, sizeof(RingSegment)) != 0) {
+        perror("Error sizing shared memory");
+        close(*fd);
+        *fd = -1;
+        return nullptr;
+    }
+
+    RingSegment* segment = mmap(nullptr, sizeof(RingSegment),
+                                PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+    if (segment == MAP_FAILED) {
+        perror("Error mapping shared memory");
+        close(*fd);
+        *fd = -1;
+        return nullptr;
+    }
+
+    // A new memfd reads as zeros, so only the header needs to be written.
+    segment->magic = RING_MAGIC;
+    segment->version = RING_VERSION;
+    segment->entries = RING_ENTRIES;
+    segment->size = sizeof(RingSegment);
+    return segment;
+}
+
+
+/**
+ * Maps a segment received from the daemon and checks its header.
+ *
+ * @param fd The descriptor of the memfd.
+ * @return The mapped segment, or NULL if it cannot be mapped or has a layout
+ * this build does not understand.
+ */
+RingSegment* ring_map(const int fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(RingSegment)) {
+        fprintf(stderr, "Error: The shared memory segment is too small.\n");
+        return nullptr;
+    }
+
+    RingSegment* segment = mmap(nullptr, sizeof(RingSegment),
+                                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED) {
+        perror("Error mapping shared memory");
+        return nullptr;
+    }
+
+    if (segment->magic != RING_MAGIC || segment->version != RING_VERSION ||
+        segment->entries != RING_ENTRIES ||
+        segment->size != sizeof(RingSegment)) {
+        fprintf(stderr, "Error: Incompatible shared memory segment.\n");
+        ring_unmap(segment);
+        return nullptr;
+    }
+
+    return segment;
+}
+
+
+/**
+ * Unmaps a segment.
+ *
+ * @param segment The segment, may be NULL.
+ */
+void ring_unmap(RingSegment* segment) {
+    if (segment != NULL)
+        munmap(segment, sizeof(RingSegment));
+}
+
+
+/**
+ * Wakes every thread sleeping on a doorbell, whether or not it is armed.
+ *
+ * @param doorbell The doorbell.
+ */
+void ring_wake(RingDoorbell* doorbell) {
+    atomic_fetch_add_explicit(&doorbell->sequence, 1, memory_order_release);
+    futex(&doorbell->sequence, FUTEX_WAKE, INT_MAX);
+}
+
+
+/**
+ * Wakes the other side after publishing a change to the rings, but only if
+ * it has armed its doorbell. While the other side is awake this costs a
+ * fence and a load, without a system call.
+ *
+ * The fence orders the publication before the load of `waiting`; ring_arm()
+ * orders the store of `waiting` before the caller checks the rings, so at
+ * least one side sees the other.
+ *
+ * @param doorbell The doorbell of the other side.
+ */
+void ring_notify(RingDoorbell* doorbell) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&doorbell->waiting, memory_order_relaxed))
+        ring_wake(doorbell);
+}
+
+
+/**
+ * Announces that the caller is about to sleep. The caller must check the
+ * rings again afterwards and either sleep with the returned sequence or
+ * disarm the doorbell.
+ *
+ * @param doorbell The doorbell of the caller.
+ * @return The sequence to pass to ring_sleep().
+ */
+uint32_t ring_arm(RingDoorbell* doorbell) {
+    const uint32_t sequence =
+        atomic_load_explicit(&doorbell->sequence, memory_order_acquire);
+    atomic_store_explicit(&doorbell->waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    return sequence;
+}
+
+
+/**
+ * Announces that the caller is awake again.
+ *
+ * @param doorbell The doorbell of the caller.
+ */
+void ring_disarm(RingDoorbell* doorbell) {
+    atomic_store_explicit(&doorbell->waiting, 0, memory_order_relaxed);
+}
+
+
+/**
+ * Sleeps until the doorbell is rung after `sequence` was read. Returns at
+ * once if it already was; may also return spuriously.
+ *
+ * @param doorbell The doorbell.
+ * @param sequence The sequence returned by ring_arm() or read before.
+ */
+void ring_sleep(RingDoorbell* doorbell, const uint32_t sequence) {
+    if (futex(&doorbell->sequence, FUTEX_WAIT, sequence) != 0 &&
+        errno != EAGAIN && errno != EINTR)
+        perror("Error waiting on futex");
+}
@@ -0,0 +1,117 @@
+/**
+ * @file ring.h
+ * @brief Header file for the shared-memory rings between the integration
+ * daemon and co-located clients.
+ *
+ * A segment in a memfd holds two lock-free single-producer single-consumer
+ * rings: the client submits requests into one and the daemon publishes
+ * responses into the other. Both sides only touch shared memory while the
+ * other side is awake; a side that goes to sleep sets the `waiting` flag of
+ * its doorbell and waits on a futex, and the other side only makes the wake-up
+ * system call when it finds that flag set.
+ */
+
+
+#ifndef RING_H
+#define RING_H
+
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "protocol.h"
+
+
+#define RING_MAGIC UINT32_C(0x474e4952) // "RING"
+#define RING_VERSION 3
+#define RING_ENTRIES 256
+#define RING_CACHE_LINE 64
+
+
+/**
+ * @struct RingRequest
+ * @brief A submission ring entry: a request header and its integrand.
+ */
+typedef struct RingRequest {
+    ProtocolRequest header;
+    char integrand[PROTOCOL_INTEGRAND_MAX];
+} RingRequest;
+
+
+/**
+ * @struct RingDoorbell
+ * @brief The wake-up state of one side of a segment.
+ *
+ * The sleeping side sets `waiting` and waits on `sequence` with a futex. The
+ * other side increments `sequence` and wakes it, but only if `waiting` is set.
+ */
+typedef struct RingDoorbell {
+    _Atomic uint32_t waiting;
+    _Atomic uint32_t sequence;
+} RingDoorbell;
+
+
+/**
+ * @struct RingSegment
+ * @brief The layout of the shared-memory segment.
+ *
+ * Ring positions are free-running counters; an entry lives at the position
+ * modulo `RING_ENTRIES`. Every counter has a single writer and sits on its own
+ * cache line: the client writes `submit_head` and `complete_tail`, the daemon
+ * `submit_tail` and `complete_head`. `daemon` is the doorbell of the daemon,
+ * `client` the doorbell of the client. `closed` is set by the daemon when it
+ * detaches the segment.
+ */
+typedef struct RingSegment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entries;
+    uint32_t size;
+    alignas(RING_CACHE_LINE) _Atomic uint32_t submit_head;
+    alignas(RING_CACHE_LINE) _Atomic uint32_t submit_tail;
+    alignas(RING_CACHE_LINE) _Atomic uint32_t complete_head;
+    alignas(RING_CACHE_LINE) _Atomic uint32_t complete_tail;
+    alignas(RING_CACHE_LINE) RingDoorbell daemon;
+    alignas(RING_CACHE_LINE) RingDoorbell client;
+    alignas(RING_CACHE_LINE) _Atomic uint32_t closed;
+    alignas(RING_CACHE_LINE) RingRequest requests[RING_ENTRIES];
+    ProtocolResponse responses[RING_ENTRIES];
+} RingSegment;
+
+static_assert((RING_ENTRIES & (RING_ENTRIES - 1)) == 0,
+              "the number of ring entries must be a power of two");
+
+
+/**
+ * Tells the processor that the caller is spinning, without a system call.
+ */
+static inline void ring_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+
+RingSegment* ring_create(int* fd);
+
+RingSegment* ring_map(int fd);
+
+void ring_unmap(RingSegment* segment);
+
+void ring_wake(RingDoorbell* doorbell);
+
+void ring_notify(RingDoorbell* doorbell);
+
+uint32_t ring_arm(RingDoorbell* doorbell);
+
+void ring_disarm(RingDoorbell* doorbell);
+
+void ring_sleep(RingDoorbell* doorbell, uint32_t sequence);
+
+
+#endif /* RING_H */
@@ -0,0 +1,871 @@
+/**
+ * @file shard.c
+ * @brief Implementation of the shard workers and of the coordinator that
+ * distributes the chunks of an integration across them.
+ *
+ * A worker serves its coordinators one request at a time from a poll loop;
+ * every request is computed by integrate_chunks() on the worker's own
+ * threads. The coordinator keeps one range in flight per worker and hands the
+ * next range to whichever worker answers first; the ranges of a worker whose
+ * connection fails go to the others, and once no worker is left the
+ * coordinator computes the remaining ranges itself.
+ */
+
+
+#define _GNU_SOURCE // accept4
+
+#include "shard.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * The eventfd the handler of SIGINT and SIGTERM signals a worker through.
+ */
+static int worker_signal_fd = -1;
+
+
+/**
+ * Stores an unsigned integer of `size` bytes in little-endian byte order.
+ *
+ * @param frame The destination.
+ * @param value The value.
+ * @param size The number of bytes.
+ */
+static void put_le(unsigned char* frame, uint64_t value, const size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        frame[i] = (unsigned char)(value & 0xff);
+        value >>= 8;
+    }
+}
+
+
+/**
+ * Loads an unsigned integer of `size` bytes in little-endian byte order.
+ *
+ * @param frame The source.
+ * @param size The number of bytes.
+ * @return The value.
+ */
+static uint64_t get_le(const unsigned char* frame, const size_t size) {
+    uint64_t value = 0;
+    for (size_t i = size; i > 0; i--)
+        value = value << 8 | frame[i - 1];
+    return value;
+}
+
+
+/**
+ * Stores a double as its IEEE 754 bit pattern in little-endian byte order.
+ *
+ * @param frame The destination.
+ * @param value The value.
+ */
+static void put_double(unsigned char* frame, const double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_le(frame, bits, 8);
+}
+
+
+/**
+ * Loads a double stored by put_double().
+ *
+ * @param frame The source.
+ * @return The value.
+ */
+static double get_double(const unsigned char* frame) {
+    const uint64_t bits = get_le(frame, 8);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+/**
+ * Encodes a request header.
+ *
+ * @param frame Output buffer for the header.
+ * @param request The request.
+ */
+void shard_encode_request(unsigned char frame[SHARD_REQUEST_SIZE],
+                          const ShardRequest* request) {
+    put_le(frame, SHARD_REQUEST_MAGIC, 4);
+    put_le(frame + 4, SHARD_VERSION, 2);
+    put_le(frame + 6, (uint64_t)request->method, 2);
+    put_le(frame + 8, request->tag, 8);
+    put_double(frame + 16, request->plan.start);
+    put_double(frame + 24, request->plan.dx);
+    put_double(frame + 32, request->plan.step);
+    put_le(frame + 40, (uint64_t)request->plan.subintervals, 8);
+    put_le(frame + 48, (uint64_t)request->plan.chunk_size, 8);
+    put_le(frame + 56, (uint32_t)request->plan.chunk_count, 4);
+    put_le(frame + 60, (uint32_t)request->first_chunk, 4);
+    put_le(frame + 64, (uint32_t)request->end_chunk, 4);
+    put_le(frame + 68, request->integrand_length, 4);
+}
+
+
+/**
+ * Decodes and validates a request header.
+ *
+ * The plan must describe at most `MAX_REFINEMENT` subintervals in at most
+ * `CHUNK_MAX_COUNT` chunks, so a request cannot make a worker compute more
+ * than a local integration could.
+ *
+ * @param frame The header.
+ * @param request Output pointer for the request.
+ * @return true if the header is a valid request of this version.
+ */
+bool shard_decode_request(const unsigned char frame[SHARD_REQUEST_SIZE],
+                          ShardRequest* request) {
+    if (get_le(frame, 4) != SHARD_REQUEST_MAGIC ||
+        get_le(frame + 4, 2) != SHARD_VERSION)
+        return false;
+
+    const uint64_t method = get_le(frame + 6, 2);
+    request->tag = get_le(frame + 8, 8);
+    request->plan.start = get_double(frame + 16);
+    request->plan.dx = get_double(frame + 24);
+    request->plan.step = get_double(frame + 32);
+    request->plan.subintervals = (long long)get_le(frame + 40, 8);
+    request->plan.chunk_size = (long long)get_le(frame + 48, 8);
+    request->plan.chunk_count = (int32_t)get_le(frame + 56, 4);
+    request->first_chunk = (int32_t)get_le(frame + 60, 4);
+    request->end_chunk = (int32_t)get_le(frame + 64, 4);
+    request->integrand_length = (uint32_t)get_le(frame + 68, 4);
+
+    const ChunkPlan* plan = &request->plan;
+    if (method >= METHOD_COUNT || !isfinite(plan->start) ||
+        !(plan->dx > 0) || !isfinite(plan->dx) || !(plan->step > 0) ||
+        !isfinite(plan->step) || plan->subintervals < MIN_REFINEMENT ||
+        plan->subintervals > MAX_REFINEMENT || plan->chunk_size < 1 ||
+        plan->chunk_count < 1 || plan->chunk_count > CHUNK_MAX_COUNT ||
+        (plan->subintervals + plan->chunk_size - 1) / plan->chunk_size !=
+            plan->chunk_count ||
+        request->first_chunk < 0 ||
+        request->end_chunk <= request->first_chunk ||
+        request->end_chunk > plan->chunk_count ||
+        request->integrand_length > MAX_INTEGRAND_LENGTH)
+        return false;
+
+    request->method = (IntegrationMethod)method;
+    return true;
+}
+
+
+/**
+ * Encodes a response header.
+ *
+ * @param frame Output buffer for the header.
+ * @param response The response.
+ */
+void shard_encode_response(unsigned char frame[SHARD_RESPONSE_SIZE],
+                           const ShardResponse* response) {
+    put_le(frame, SHARD_RESPONSE_MAGIC, 4);
+    put_le(frame + 4, SHARD_VERSION, 2);
+    put_le(frame + 6, (uint64_t)response->status, 2);
+    put_le(frame + 8, response->tag, 8);
+    put_le(frame + 16, (uint32_t)response->first_chunk, 4);
+    put_le(frame + 20, (uint32_t)response->end_chunk, 4);
+    put_le(frame + 24, response->evaluations, 8);
+    put_double(frame + 32, response->cpu_ms);
+}
+
+
+/**
+ * Decodes a response header.
+ *
+ * @param frame The header.
+ * @param response Output pointer for the response.
+ * @return true if the header is a response of this version.
+ */
+bool shard_decode_response(const unsigned char frame[SHARD_RESPONSE_SIZE],
+                           ShardResponse* response) {
+    if (get_le(frame, 4) != SHARD_RESPONSE_MAGIC ||
+        get_le(frame + 4, 2) != SHARD_VERSION)
+        return false;
+
+    const uint64_t status = get_le(frame + 6, 2);
+    if (status >= INTEGRATION_STATUS_COUNT)
+        return false;
+
+    response->status = (IntegrationStatus)status;
+    response->tag = get_le(frame + 8, 8);
+    response->first_chunk = (int32_t)get_le(frame + 16, 4);
+    response->end_chunk = (int32_t)get_le(frame + 20, 4);
+    response->evaluations = get_le(frame + 24, 8);
+    response->cpu_ms = get_double(frame + 32);
+    return true;
+}
+
+
+/**
+ * Sends a whole buffer over a socket.
+ *
+ * @param fd The socket.
+ * @param buffer The data.
+ * @param length The number of bytes.
+ * @return true on success, false if the connection failed.
+ */
+static bool send_all(const int fd, const void* buffer, const size_t length) {
+    const unsigned char* bytes = buffer;
+    size_t sent = 0;
+
+    while (sent < length) {
+        const ssize_t written =
+            send(fd, bytes + sent, length - sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        sent += (size_t)written;
+    }
+    return true;
+}
+
+
+/**
+ * Receives exactly `length` bytes from a socket.
+ *
+ * @param fd The socket.
+ * @param buffer Output buffer.
+ * @param length The number of bytes.
+ * @return true on success, false if the connection failed or was closed.
+ */
+static bool receive_all(const int fd, void* buffer, const size_t length) {
+    unsigned char* bytes = buffer;
+    size_t received = 0;
+
+    while (received < length) {
+        const ssize_t count = recv(fd, bytes + received, length - received, 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        received += (size_t)count;
+    }
+    return true;
+}
+
+
+/**
+ * Splits an address of the form "host:port" or "port". A bare port means the
+ * loopback interface.
+ *
+ * @param address The address.
+ * @param host Output buffer for the host.
+ * @param port Output pointer for the port, pointing into `address`.
+ * @return true if the address is well-formed.
+ */
+static bool split_address(const char* address, char host[SHARD_ADDRESS_MAX],
+                          const char** port) {
+    const char* colon = strrchr(address, ':');
+    if (colon == NULL) {
+        strcpy(host, "127.0.0.1");
+        *port = address;
+    } else {
+        const size_t length = (size_t)(colon - address);
+        if (length == 0 || length >= SHARD_ADDRESS_MAX)
+            return false;
+        memcpy(host, address, length);
+        host[length] = '\0';
+        *port = colon + 1;
+    }
+
+    return **port != '\0' && strspn(*port, "0123456789") == strlen(*port);
+}
+
+
+/**
+ * Resolves an address and creates a TCP socket bound or connected to it.
+ *
+ * @param address The address, "host:port" or "port".
+ * @param listening true to bind and listen, false to connect.
+ * @return The socket, or -1 on failure.
+ */
+static int open_socket(const char* address, const bool listening) {
+    char host[SHARD_ADDRESS_MAX];
+    const char* port;
+    if (!split_address(address, host, &port)) {
+        fprintf(stderr, "Error: Invalid shard address '%s'.\n", address);
+        return -1;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+    struct addrinfo* addresses;
+    const int error = getaddrinfo(host, port, &hints, &addresses);
+    if (error != 0) {
+        fprintf(stderr, "Error resolving %s: %s\n", address,
+                gai_strerror(error));
+        return -1;
+    }
+
+    int fd = -1;
+    for (const struct addrinfo* candidate = addresses; candidate != NULL;
+         candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family,
+                    candidate->ai_socktype | SOCK_CLOEXEC,
+                    candidate->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        const int enable = 1;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+            if (bind(fd, candidate->ai_addr, candidate->ai_addrlen) == 0 &&
+                listen(fd, SOMAXCONN) == 0)
+                break;
+        } else if (connect(fd, candidate->ai_addr, candidate->ai_addrlen) ==
+                   0) {
+            // Requests and responses are small and strictly alternate.
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            break;
+        }
+
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+
+    if (fd < 0)
+        fprintf(stderr, "Error: Could not %s %s: %s\n",
+                listening ? "listen on" : "connect to", address,
+                strerror(errno));
+    return fd;
+}
+
+
+/**
+ * Prints the address a worker listens on, which tells the port chosen by the
+ * system if port 0 was asked for.
+ *
+ * @param fd The listening socket.
+ */
+static void announce_worker(const int fd) {
+    struct sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    char host[SHARD_ADDRESS_MAX];
+    char port[16];
+
+    if (getsockname(fd, (struct sockaddr*)&address, &length) != 0 ||
+        getnameinfo((struct sockaddr*)&address, length, host, sizeof(host),
+                    port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+        return;
+
+    fprintf(stderr, "Shard worker listening on %s:%s\n", host, port);
+}
+
+
+/**
+ * Forwards SIGINT and SIGTERM to the poll loop of a worker.
+ *
+ * @param signal The number of the signal.
+ */
+static void handle_worker_signal(const int signal) {
+    (void)signal;
+    const int saved_errno = errno;
+    const uint64_t increment = 1;
+    if (write(worker_signal_fd, &increment, sizeof(increment)) < 0) {
+        // The counter cannot overflow from signals alone; nothing to do.
+    }
+    errno = saved_errno;
+}
+
+
+/**
+ * @struct WorkerState
+ * @brief The parsed integrand a worker keeps between requests, since a
+ * coordinator sends the same integrand with every range.
+ */
+typedef struct WorkerState {
+    char integrand[MAX_INTEGRAND_LENGTH + 1];
+    Node* expression;
+    int threads;
+} WorkerState;
+
+
+/**
+ * Makes the integrand of a request the current expression of a worker,
+ * parsing it unless it is the one parsed last.
+ *
+ * @param state The state of the worker.
+ * @param integrand The integrand of the request, NUL-terminated.
+ * @return true if the integrand is a valid expression.
+ */
+static bool use_integrand(WorkerState* state, const char* integrand) {
+    if (state->expression != NULL && strcmp(state->integrand, integrand) == 0)
+        return true;
+
+    if (state->expression != NULL) {
+        free_tree(state->expression);
+        state->expression = nullptr;
+    }
+
+    char text[MAX_INTEGRAND_LENGTH + 1];
+    strcpy(text, integrand);
+    if (!validate_integrand(text) || !validate_expression(text))
+        return false;
+
+    state->expression = parse(text);
+    if (state->expression == NULL)
+        return false;
+    strcpy(state->integrand, integrand);
+    return true;
+}
+
+
+/**
+ * Reads and answers one request of a coordinator.
+ *
+ * @param state The state of the worker.
+ * @param fd The connection of the coordinator.
+ * @return true if the connection stays open, false if it was closed or
+ * violated the protocol.
+ */
+static bool serve_request(WorkerState* state, const int fd) {
+    unsigned char header[SHARD_REQUEST_SIZE];
+    ShardRequest request;
+    char integrand[MAX_INTEGRAND_LENGTH + 1];
+
+    if (!receive_all(fd, header, sizeof(header)))
+        return false;
+    if (!shard_decode_request(header, &request)) {
+        fprintf(stderr, "Error: Invalid request from a shard coordinator.\n");
+        return false;
+    }
+    if (!receive_all(fd, integrand, request.integrand_length))
+        return false;
+    integrand[request.integrand_length] = '\0';
+
+    unsigned char frame[SHARD_RESPONSE_SIZE + CHUNK_MAX_COUNT * 8];
+    double partials[CHUNK_MAX_COUNT];
+    ShardResponse response = {.tag = request.tag,
+                              .status = INTEGRATION_OK,
+                              .first_chunk = request.first_chunk,
+                              .end_chunk = request.end_chunk,
+                              .evaluations = 0,
+                              .cpu_ms = 0};
+    size_t length = SHARD_RESPONSE_SIZE;
+
+    if (use_integrand(state, integrand)) {
+        long long evaluations;
+        integrate_chunks(state->expression, request.method, &request.plan,
+                         request.first_chunk, request.end_chunk,
+                         state->threads, partials, &response.cpu_ms,
+                         &evaluations);
+        response.evaluations = (uint64_t)evaluations;
+        for (int chunk = request.first_chunk; chunk < request.end_chunk;
+             chunk++, length += 8)
+            put_double(frame + length, partials[chunk]);
+    } else {
+        response.status = INTEGRATION_INVALID_INTEGRAND;
+    }
+
+    shard_encode_response(frame, &response);
+    return send_all(fd, frame, length);
+}
+
+
+/**
+ * Runs a shard worker: listens on a TCP address and computes the ranges
+ * coordinators send until SIGINT or SIGTERM arrives.
+ *
+ * Requests are answered one at a time, in the order their connections become
+ * readable, each on `threads` threads. Up to `SHARD_MAX_CONNECTIONS`
+ * coordinators may be connected at once.
+ *
+ * @param address The address to listen on, "host:port" or "port" for the
+ * loopback interface. Port 0 lets the system choose; the address is printed
+ * to the standard error stream either way.
+ * @param threads The number of threads computing each request.
+ * @return true if the worker shut down normally, false if it could not start.
+ */
+bool run_shard_worker(const char* address, const int threads) {
+    const int listen_fd = open_socket(address, true);
+    if (listen_fd < 0)
+        return false;
+
+    worker_signal_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (worker_signal_fd < 0) {
+        perror("Error creating the signal eventfd");
+        close(listen_fd);
+        return false;
+    }
+
+    struct sigaction action, previous[2];
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_worker_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, &previous[0]);
+    sigaction(SIGTERM, &action, &previous[1]);
+
+    announce_worker(listen_fd);
+
+    WorkerState state = {.expression = nullptr, .threads = threads};
+    struct pollfd fds[2 + SHARD_MAX_CONNECTIONS];
+    nfds_t count = 2;
+    fds[0] = (struct pollfd){.fd = listen_fd, .events = POLLIN};
+    fds[1] = (struct pollfd){.fd = worker_signal_fd, .events = POLLIN};
+
+    while (true) {
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Error waiting for shard requests");
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+            break;
+
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0 && count < 2 + SHARD_MAX_CONNECTIONS) {
+                const int enable = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable,
+                           sizeof(enable));
+                fds[count++] = (struct pollfd){.fd = fd, .events = POLLIN};
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        for (nfds_t i = 2; i < count; i++) {
+            if (fds[i].revents == 0 || serve_request(&state, fds[i].fd))
+                continue;
+            close(fds[i].fd);
+            fds[i--] = fds[--count];
+        }
+    }
+
+    for (nfds_t i = 2; i < count; i++)
+        close(fds[i].fd);
+    if (state.expression != NULL)
+        free_tree(state.expression);
+
+    sigaction(SIGINT, &previous[0], nullptr);
+    sigaction(SIGTERM, &previous[1], nullptr);
+    close(worker_signal_fd);
+    worker_signal_fd = -1;
+    close(listen_fd);
+    return true;
+}
+
+
+/**
+ * Closes the connection of a coordinator to a worker that failed. Its range
+ * in flight, if any, is left for the caller to hand out again.
+ *
+ * @param peer The peer.
+ * @param reason What went wrong.
+ */
+static void drop_peer(ShardPeer* peer, const char* reason) {
+    fprintf(stderr,
+            "Warning: Shard worker %s failed (%s); its work is "
+            "redistributed.\n",
+            peer->address, reason);
+    close(peer->fd);
+    peer->fd = -1;
+}
+
+
+/**
+ * Sends a range of chunks to a worker.
+ *
+ * @param coordinator The coordinator.
+ * @param peer The idle worker.
+ * @param method The method.
+ * @param plan The chunk plan of the interval.
+ * @param first_chunk The first chunk of the range.
+ * @param end_chunk The chunk after the last one of the range.
+ * @return true if the request was sent.
+ */
+static bool send_range(ShardCoordinator* coordinator, ShardPeer* peer,
+                       const IntegrationMethod method, const ChunkPlan* plan,
+                       const int first_chunk, const int end_chunk) {
+    unsigned char frame[SHARD_REQUEST_SIZE + MAX_INTEGRAND_LENGTH];
+    peer->tag = coordinator->next_tag++;
+    const ShardRequest request = {
+        .tag = peer->tag,
+        .method = method,
+        .plan = *plan,
+        .first_chunk = first_chunk,
+        .end_chunk = end_chunk,
+        .integrand_length = (uint32_t)coordinator->integrand_length};
+
+    shard_encode_request(frame, &request);
+    memcpy(frame + SHARD_REQUEST_SIZE, coordinator->integrand,
+           coordinator->integrand_length);
+    return send_all(peer->fd, frame,
+                    SHARD_REQUEST_SIZE + coordinator->integrand_length);
+}
+
+
+/**
+ * Receives the partial sums of the range a worker was sent.
+ *
+ * @param peer The worker.
+ * @param first_chunk The first chunk of the range.
+ * @param end_chunk The chunk after the last one of the range.
+ * @param partials Output array for the partial sums, indexed by chunk.
+ * @param cpu_ms Incremented by the CPU time the worker reported.
+ * @param evaluations Incremented by the evaluations the worker reported.
+ * @return NULL on success, or a description of the failure.
+ */
+static const char* receive_range(const ShardPeer* peer, const int first_chunk,
+                                 const int end_chunk, double partials[],
+                                 double* cpu_ms, long long* evaluations) {
+    unsigned char frame[SHARD_RESPONSE_SIZE + CHUNK_MAX_COUNT * 8];
+    ShardResponse response;
+
+    if (!receive_all(peer->fd, frame, SHARD_RESPONSE_SIZE))
+        return "connection lost";
+    if (!shard_decode_response(frame, &response) ||
+        response.tag != peer->tag || response.first_chunk != first_chunk ||
+        response.end_chunk != end_chunk)
+        return "unexpected response";
+    if (response.status != INTEGRATION_OK)
+        return status_name(response.status);
+
+    const size_t length = (size_t)(end_chunk - first_chunk) * 8;
+    if (!receive_all(peer->fd, frame + SHARD_RESPONSE_SIZE, length))
+        return "connection lost";
+
+    for (int chunk = first_chunk; chunk < end_chunk; chunk++)
+        partials[chunk] = get_double(
+            frame + SHARD_RESPONSE_SIZE + (size_t)(chunk - first_chunk) * 8);
+    *cpu_ms += response.cpu_ms;
+    *evaluations += (long long)response.evaluations;
+    return nullptr;
+}
+
+
+/**
+ * The ChunkExecutor of a coordinator: splits the chunks of a method into up
+ * to `SHARD_RANGES_PER_WORKER` ranges per connected worker and hands them out
+ * one per worker at a time. Ranges of failed workers are handed out again;
+ * once no worker is left, the coordinator computes the remaining ranges on
+ * its own threads.
+ *
+ * @param context The ShardCoordinator.
+ * @param expression Parsed expression, used for ranges computed locally.
+ * @param method The method.
+ * @param plan The chunk plan of the interval.
+ * @param partials Output array for the partial sums, indexed by chunk.
+ * @param cpu_ms Output pointer for the CPU time summed over all processes.
+ * @param evaluations Output pointer for the number of evaluations.
+ * @return Always true; every range is computed somewhere.
+ */
+static bool run_sharded(void* context, Node* expression,
+                        const IntegrationMethod method, const ChunkPlan* plan,
+                        double partials[], double* cpu_ms,
+                        long long* evaluations) {
+    ShardCoordinator* coordinator = context;
+    int live = 0;
+    for (int i = 0; i < coordinator->peer_count; i++)
+        if (coordinator->peers[i].fd >= 0)
+            live++;
+
+    int ranges = (live > 0 ? live : 1) * SHARD_RANGES_PER_WORKER;
+    if (ranges > plan->chunk_count)
+        ranges = plan->chunk_count;
+
+    // Ranges waiting to be sent, popped from the end, lowest first
+    int waiting[CHUNK_MAX_COUNT];
+    int waiting_count = 0;
+    for (int range = ranges - 1; range >= 0; range--)
+        waiting[waiting_count++] = range;
+    int remaining = ranges;
+
+    *cpu_ms = 0;
+    *evaluations = 0;
+
+    while (remaining > 0) {
+        struct pollfd fds[SHARD_MAX_WORKERS];
+        ShardPeer* polled[SHARD_MAX_WORKERS];
+        nfds_t busy = 0;
+
+        for (int i = 0; i < coordinator->peer_count; i++) {
+            ShardPeer* peer = &coordinator->peers[i];
+            if (peer->fd >= 0 && peer->range < 0 && waiting_count > 0) {
+                const int range = waiting[--waiting_count];
+                if (send_range(coordinator, peer, method, plan,
+                               plan->chunk_count * range / ranges,
+                               plan->chunk_count * (range + 1) / ranges)) {
+                    peer->range = range;
+                } else {
+                    waiting[waiting_count++] = range;
+                    drop_peer(peer, "connection lost");
+                }
+            }
+
+            if (peer->fd >= 0 && peer->range >= 0) {
+                fds[busy] = (struct pollfd){.fd = peer->fd, .events = POLLIN};
+                polled[busy++] = peer;
+            }
+        }
+
+        if (busy == 0) {
+            // No worker is left: compute the remaining ranges here
+            while (waiting_count > 0) {
+                const int range = waiting[--waiting_count];
+                double local_ms;
+                long long local_evaluations;
+                integrate_chunks(expression, method, plan,
+                                 plan->chunk_count * range / ranges,
+                                 plan->chunk_count * (range + 1) / ranges,
+                                 coordinator->threads, partials, &local_ms,
+                                 &local_evaluations);
+                *cpu_ms += local_ms;
+                *evaluations += local_evaluations;
+                remaining--;
+            }
+            break;
+        }
+
+        if (poll(fds, busy, -1) < 0) {
+            if (errno != EINTR)
+                perror("Error waiting for shard workers");
+            continue;
+        }
+
+        for (nfds_t i = 0; i < busy; i++) {
+            if (fds[i].revents == 0)
+                continue;
+
+            ShardPeer* peer = polled[i];
+            const int range = peer->range;
+            const char* failure = receive_range(
+                peer, plan->chunk_count * range / ranges,
+                plan->chunk_count * (range + 1) / ranges, partials, cpu_ms,
+                evaluations);
+            peer->range = -1;
+            if (failure != NULL) {
+                waiting[waiting_count++] = range;
+                drop_peer(peer, failure);
+                continue;
+            }
+            remaining--;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Connects a coordinator to its workers. Workers that cannot be reached are
+ * reported and left out.
+ *
+ * @param coordinator The coordinator to initialise.
+ * @param addresses Comma separated list of worker addresses, each "host:port"
+ * or "port" for the loopback interface; at most `SHARD_MAX_WORKERS`.
+ * @param threads The number of local threads for ranges no worker can take.
+ * @return true if at least one worker is connected.
+ */
+bool shard_connect(ShardCoordinator* coordinator, const char* addresses,
+                   const int threads) {
+    memset(coordinator, 0, sizeof(*coordinator));
+    coordinator->threads = threads;
+    coordinator->next_tag = 1;
+    coordinator->executor =
+        (ChunkExecutor){.run = run_sharded, .context = coordinator};
+
+    int connected = 0;
+    const char* cursor = addresses;
+    while (*cursor != '\0') {
+        const size_t length = strcspn(cursor, ",");
+        if (coordinator->peer_count == SHARD_MAX_WORKERS ||
+            length >= SHARD_ADDRESS_MAX) {
+            fprintf(stderr, "Error: Too many or too long shard addresses.\n");
+            shard_close(coordinator);
+            return false;
+        }
+
+        ShardPeer* peer = &coordinator->peers[coordinator->peer_count++];
+        memcpy(peer->address, cursor, length);
+        peer->address[length] = '\0';
+        peer->range = -1;
+        peer->fd = open_socket(peer->address, false);
+        if (peer->fd >= 0)
+            connected++;
+
+        cursor += length;
+        if (*cursor == ',')
+            cursor++;
+    }
+
+    if (connected == 0) {
+        fprintf(stderr, "Error: No shard worker could be reached.\n");
+        shard_close(coordinator);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Integrates a function with its chunks computed by the workers of a
+ * coordinator. The job is handled exactly like integrate_job() handles it,
+ * including the result cache, and yields bitwise the same values; only its
+ * deadline and cancellation token are ignored.
+ *
+ * @param coordinator The connected coordinator.
+ * @param integrand The integrand in Reverse Polish Notation.
+ * @param job The description of the integration.
+ * @param result Output pointer for the results.
+ * @return The status of the integration, see integrate_job().
+ */
+IntegrationStatus shard_integrate(ShardCoordinator* coordinator,
+                                  const char* integrand,
+                                  const IntegrationJob* job,
+                                  IntegrationResult* result) {
+    IntegrationJob sharded = *job;
+    sharded.executor = &coordinator->executor;
+    sharded.deadline_ms = 0;
+    sharded.cancel = nullptr;
+
+    // Too long to ship; integrate_job() rejects it
+    if (strlen(integrand) > MAX_INTEGRAND_LENGTH)
+        return integrate_job(integrand, &sharded, result);
+
+    strcpy(coordinator->integrand, integrand);
+    remove_spaces(coordinator->integrand);
+    coordinator->integrand_length = strlen(coordinator->integrand);
+    return integrate_job(coordinator->integrand, &sharded, result);
+}
+
+
+/**
+ * Closes the connections of a coordinator.
+ *
+ * @param coordinator The coordinator.
+ */
+void shard_close(ShardCoordinator* coordinator) {
+    for (int i = 0; i < coordinator->peer_count; i++) {
+        if (coordinator->peers[i].fd >= 0)
+            close(coordinator->peers[i].fd);
+        coordinator->peers[i].fd = -1;
+    }
+    coordinator->peer_count = 0;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file shard.h
+ * @brief Header file for sharding integrations across worker processes
+ * connected over TCP.
+ *
+ * A coordinator splits the chunks of every method into contiguous ranges and
+ * hands them out to shard workers, which may run on other machines. A request
+ * ships the integrand string, the chunk plan and the range; the response
+ * carries the partial sum of every chunk of the range. The coordinator stores
+ * the partial sums by chunk and the core adds them up in chunk order, so the
+ * reduction does not depend on which worker computed which range, or when,
+ * and the result is bitwise identical to a local integration.
+ *
+ * Unlike the daemon protocol, messages are encoded field by field in
+ * little-endian byte order, doubles as their IEEE 754 bit patterns, so
+ * coordinator and workers may run on different machines.
+ */
+
+
+#ifndef SHARD_H
+#define SHARD_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "expression_parser.h"
+#include "integral.h"
+
+
+#define SHARD_REQUEST_MAGIC UINT32_C(0x5148534e)  // "NSHQ"
+#define SHARD_RESPONSE_MAGIC UINT32_C(0x5348534e) // "NSHS"
+#define SHARD_VERSION 1
+#define SHARD_REQUEST_SIZE 72
+#define SHARD_RESPONSE_SIZE 40
+#define SHARD_MAX_WORKERS 64
+#define SHARD_MAX_CONNECTIONS 64
+#define SHARD_RANGES_PER_WORKER 4
+#define SHARD_ADDRESS_MAX 256
+
+
+/**
+ * @struct ShardRequest
+ * @brief A request to compute the chunks `[first_chunk ; end_chunk)` of a
+ * method.
+ *
+ * `plan` is the chunk plan of the whole interval, so the worker computes the
+ * chunks exactly as the coordinator would. The request is followed by
+ * `integrand_length` bytes of the integrand, without spaces and without a
+ * terminating NUL.
+ */
+typedef struct ShardRequest {
+    uint64_t tag;
+    IntegrationMethod method;
+    ChunkPlan plan;
+    int first_chunk;
+    int end_chunk;
+    uint32_t integrand_length;
+} ShardRequest;
+
+
+/**
+ * @struct ShardResponse
+ * @brief The response to a ShardRequest.
+ *
+ * If `status` is INTEGRATION_OK, the response is followed by the partial sums
+ * of the chunks `[first_chunk ; end_chunk)` of the request, 8 bytes each.
+ */
+typedef struct ShardResponse {
+    uint64_t tag;
+    IntegrationStatus status;
+    int first_chunk;
+    int end_chunk;
+    uint64_t evaluations;
+    double cpu_ms;
+} ShardResponse;
+
+
+/**
+ * @struct ShardPeer
+ * @brief The connection of a coordinator to a shard worker.
+ *
+ * A peer has at most one range in flight, `range`, or -1 if it is idle, and
+ * `tag` is the tag of the request for that range. A peer whose connection
+ * failed is closed (`fd` is -1) and its range is given to the others.
+ */
+typedef struct ShardPeer {
+    int fd;
+    char address[SHARD_ADDRESS_MAX];
+    int range;
+    uint64_t tag;
+} ShardPeer;
+
+
+/**
+ * @struct ShardCoordinator
+ * @brief The workers an integration is sharded across.
+ *
+ * `integrand` is the integrand of the integration in progress, shipped with
+ * every request. `threads` is the number of local threads computing the
+ * ranges left over when no worker is reachable any more. `executor` is the
+ * ChunkExecutor installed into the jobs by shard_integrate().
+ */
+typedef struct ShardCoordinator {
+    ShardPeer peers[SHARD_MAX_WORKERS];
+    int peer_count;
+    int threads;
+    uint64_t next_tag;
+    char integrand[MAX_INTEGRAND_LENGTH + 1];
+    size_t integrand_length;
+    ChunkExecutor executor;
+} ShardCoordinator;
+
+
+void shard_encode_request(unsigned char frame[SHARD_REQUEST_SIZE],
+                          const ShardRequest* request);
+
+bool shard_decode_request(const unsigned char frame[SHARD_REQUEST_SIZE],
+                          ShardRequest* request);
+
+void shard_encode_response(unsigned char frame[SHARD_RESPONSE_SIZE],
+                           const ShardResponse* response);
+
+bool shard_decode_response(const unsigned char frame[SHARD_RESPONSE_SIZE],
+                           ShardResponse* response);
+
+bool run_shard_worker(const char* address, int threads);
+
+bool shard_connect(ShardCoordinator* coordinator, const char* addresses,
+                   int threads);
+
+IntegrationStatus shard_integrate(ShardCoordinator* coordinator,
+                                  const char* integrand,
+                                  const IntegrationJob* job,
+                                  IntegrationResult* result);
+
+void shard_close(ShardCoordinator* coordinator);
+
+
+#endif /* SHARD_H */
@@ -0,0 +1,290 @@
+/**
+ * @file trace.c
+ * @brief Implementation of the trace of the integration pipeline on
+ * per-thread buffers mapped once when the trace is opened.
+ *
+ * The buffers are mapped anonymously rather than allocated, so claiming one
+ * from any thread needs neither the allocator nor a lock, and only the pages
+ * actually written are ever backed by memory.
+ */
+
+
+#define _GNU_SOURCE // syscall
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debugmalloc.h"
+
+
+/**
+ * @struct Tracer
+ * @brief The state of the process-wide trace.
+ *
+ * `generation` is incremented every time the trace is opened, so a thread
+ * still holding a buffer of an earlier trace claims a new one. `origin_ns`
+ * is the time the trace was opened. `unclaimed` counts the spans of threads
+ * that found every buffer owned.
+ */
+typedef struct Tracer {
+    atomic_bool open;
+    atomic_uint generation;
+    FILE* file;
+    TraceBuffer* buffers;
+    size_t size;
+    long long origin_ns;
+    atomic_llong unclaimed;
+} Tracer;
+
+
+/**
+ * The process-wide trace.
+ */
+static Tracer tracer = {.file = nullptr};
+
+
+/**
+ * The buffer owned by the calling thread, the generation of the trace it was
+ * claimed from, and the kernel thread id.
+ */
+static thread_local TraceBuffer* thread_buffer = nullptr;
+static thread_local unsigned thread_generation = 0;
+static thread_local int thread_tid = 0;
+
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return The time in nanoseconds.
+ */
+static long long now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/**
+ * Opens the trace: the trace file is created and the buffers are mapped. A
+ * trace that is already open is closed first.
+ *
+ * @param path The trace file.
+ * @return true if the trace is open, false if the file could not be created
+ * or the buffers could not be mapped.
+ */
+bool trace_open(const char* path) {
+    if (trace_is_open())
+        trace_close();
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        perror("Error opening the trace file");
+        return false;
+    }
+
+    const size_t size = TRACE_MAX_BUFFERS * sizeof(TraceBuffer);
+    TraceBuffer* buffers =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (buffers == MAP_FAILED) {
+        perror("Did not manage to map the trace buffers");
+        fclose(file);
+        return false;
+    }
+
+    tracer.file = file;
+    tracer.buffers = buffers;
+    tracer.size = size;
+    tracer.origin_ns = now_ns();
+    atomic_store(&tracer.unclaimed, 0);
+    atomic_fetch_add(&tracer.generation, 1);
+    atomic_store_explicit(&tracer.open, true, memory_order_release);
+    return true;
+}
+
+
+/**
+ * Tells whether the trace is open.
+ *
+ * @return true if spans are being recorded.
+ */
+bool trace_is_open(void) {
+    return atomic_load_explicit(&tracer.open, memory_order_acquire);
+}
+
+
+/**
+ * Starts a span.
+ *
+ * @return The start of the span to pass to trace_end(), or 0 if the trace is
+ * closed.
+ */
+long long trace_begin(void) {
+    if (!atomic_load_explicit(&tracer.open, memory_order_relaxed))
+        return 0;
+    return now_ns();
+}
+
+
+/**
+ * Returns the buffer of the calling thread, claiming the first free one of
+ * the pool if the thread has none in the current trace.
+ *
+ * @return The buffer, or NULL if every buffer is owned by another thread.
+ */
+static TraceBuffer* claim_buffer(void) {
+    const unsigned generation =
+        atomic_load_explicit(&tracer.generation, memory_order_acquire);
+    if (thread_buffer != NULL && thread_generation == generation)
+        return thread_buffer;
+
+    thread_buffer = nullptr;
+    if (thread_tid == 0)
+        thread_tid = (int)syscall(SYS_gettid);
+
+    for (int i = 0; i < TRACE_MAX_BUFFERS; i++) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong_explicit(
+                &tracer.buffers[i].owned, &expected, true,
+                memory_order_acquire, memory_order_relaxed)) {
+            thread_buffer = &tracer.buffers[i];
+            thread_generation = generation;
+            break;
+        }
+    }
+    return thread_buffer;
+}
+
+
+/**
+ * Ends a span and records it in the buffer of the calling thread. Does
+ * nothing if the span was started while the trace was closed.
+ *
+ * This function may be called from any thread; it takes no lock.
+ *
+ * @param start The start of the span, from trace_begin().
+ * @param category The category of the span, e.g. "method".
+ * @param name The name of the span.
+ * @param argument_name The name of the argument of the span, or
+ * TRACE_NO_ARGUMENT.
+ * @param argument The argument, e.g. the index of a chunk.
+ */
+void trace_end(const long long start, const char* category, const char* name,
+               const char* argument_name, const long long argument) {
+    if (start == 0 || !atomic_load_explicit(&tracer.open, memory_order_relaxed))
+        return;
+
+    const long long end = now_ns();
+    TraceBuffer* buffer = claim_buffer();
+    if (buffer == NULL) {
+        atomic_fetch_add_explicit(&tracer.unclaimed, 1, memory_order_relaxed);
+        return;
+    }
+
+    const int count =
+        atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    if (count == TRACE_BUFFER_EVENTS) {
+        buffer->dropped++;
+        return;
+    }
+
+    buffer->events[count] = (TraceEvent){.name = name,
+                                         .category = category,
+                                         .argument_name = argument_name,
+                                         .argument = argument,
+                                         .start_ns = start - tracer.origin_ns,
+                                         .duration_ns = end - start,
+                                         .tid = thread_tid};
+    atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+}
+
+
+/**
+ * Gives the buffer of the calling thread back to the pool, for threads that
+ * are about to exit. The events stay in the buffer; a thread recording again
+ * afterwards claims a buffer anew.
+ */
+void trace_release_thread(void) {
+    if (thread_buffer != NULL && trace_is_open() &&
+        thread_generation == atomic_load(&tracer.generation))
+        atomic_store_explicit(&thread_buffer->owned, false,
+                              memory_order_release);
+    thread_buffer = nullptr;
+}
+
+
+/**
+ * Writes a span as a complete event of the trace file, following an earlier
+ * event.
+ *
+ * @param file The trace file.
+ * @param event The span.
+ * @param pid The process id.
+ */
+static void write_event(FILE* file, const TraceEvent* event, const int pid) {
+    fprintf(file,
+            ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+            "\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+            event->name, event->category,
+            (double)event->start_ns / 1000.0,
+            (double)event->duration_ns / 1000.0, pid, event->tid);
+    if (event->argument_name != NULL)
+        fprintf(file, ",\"args\":{\"%s\":%lld}", event->argument_name,
+                event->argument);
+    fputc('}', file);
+}
+
+
+/**
+ * Stops recording, writes every recorded span to the trace file and unmaps
+ * the buffers. Must be called once no other thread records spans any more,
+ * e.g. after the workers have been joined.
+ *
+ * @return true if the trace was closed or written completely, false if
+ * writing the file failed.
+ */
+bool trace_close(void) {
+    if (!trace_is_open())
+        return true;
+    atomic_store_explicit(&tracer.open, false, memory_order_release);
+
+    const int pid = (int)getpid();
+    long long dropped = atomic_load(&tracer.unclaimed);
+
+    fprintf(tracer.file,
+            "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"numint\"}}",
+            pid, pid);
+
+    for (int i = 0; i < TRACE_MAX_BUFFERS; i++) {
+        const TraceBuffer* buffer = &tracer.buffers[i];
+        const int count =
+            atomic_load_explicit(&buffer->count, memory_order_acquire);
+        for (int event = 0; event < count; event++)
+            write_event(tracer.file, &buffer->events[event], pid);
+        dropped += buffer->dropped;
+    }
+
+    fprintf(tracer.file, "\n],\"otherData\":{\"dropped_events\":%lld}}\n",
+            dropped);
+    bool success = !ferror(tracer.file);
+    if (fclose(tracer.file) != 0)
+        success = false;
+    if (!success)
+        perror("Error writing the trace file");
+    if (dropped > 0)
+        fprintf(stderr, "Warning: %lld spans did not fit in the trace "
+                        "buffers.\n", dropped);
+
+    munmap(tracer.buffers, tracer.size);
+    tracer.file = nullptr;
+    tracer.buffers = nullptr;
+    thread_buffer = nullptr;
+    return success;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file trace.h
+ * @brief Header file for the trace of the integration pipeline, written as
+ * Chrome trace-event JSON for Perfetto or chrome://tracing.
+ *
+ * While the process-wide trace is open, the pipeline records spans: the
+ * validation and parsing of the integrand, every method, every chunk on the
+ * thread that computed it, and the output of the results. Each thread records
+ * into a buffer of its own, claimed from a preallocated pool the first time it
+ * records, so recording a span takes no lock and allocates nothing. The
+ * buffers are written to the trace file when it is closed, one complete event
+ * per span, so stragglers and idle workers stand out on the timeline.
+ *
+ * A span is measured by taking trace_begin() before the work and passing it
+ * to trace_end() afterwards; both do nothing but read a flag while the trace
+ * is closed.
+ */
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+
+#define TRACE_MAX_BUFFERS 64
+#define TRACE_BUFFER_EVENTS 32768
+#define TRACE_NO_ARGUMENT nullptr
+
+
+/**
+ * @struct TraceEvent
+ * @brief A span recorded by a thread.
+ *
+ * `name`, `category` and `argument_name` must be string literals or otherwise
+ * outlive the trace. `start_ns` is measured from the opening of the trace.
+ * `tid` is the kernel thread id of the recording thread, so threads sharing a
+ * buffer one after the other still get a track each.
+ */
+typedef struct TraceEvent {
+    const char* name;
+    const char* category;
+    const char* argument_name;
+    long long argument;
+    long long start_ns;
+    long long duration_ns;
+    int tid;
+} TraceEvent;
+
+
+/**
+ * @struct TraceBuffer
+ * @brief The events recorded by the thread owning the buffer.
+ *
+ * A buffer is owned by at most one thread at a time, which alone appends to
+ * it. A thread gives its buffer back with trace_release_thread() before it
+ * exits, and the next thread claiming it continues after its events. Events
+ * that do not fit are counted in `dropped`.
+ */
+typedef struct TraceBuffer {
+    atomic_bool owned;
+    atomic_int count;
+    long long dropped;
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+} TraceBuffer;
+
+
+bool trace_open(const char* path);
+
+bool trace_is_open(void);
+
+long long trace_begin(void);
+
+void trace_end(long long start, const char* category, const char* name,
+               const char* argument_name, long long argument);
+
+void trace_release_thread(void);
+
+bool trace_close(void);
+
+
+#endif /* TRACE_H */
@@ -7,10 +7,36 @@
  * mathematical functions, specifying integration intervals, and calculating
  * results. It includes functionality for reading from files, inserting text
  * into entry fields, and managing button interactions.
+ *
+ * The integration runs on the worker of an asynchronous engine, so the window
+ * stays open and responsive: a progress bar follows the completed chunks, a
+ * Cancel button stops the job at the next chunk boundary, and the results are
+ * shown in the window.
+ *
+ * While the function and the interval are edited, a live estimate of the
+ * integral is computed in the background from coarse to fine partitions, and
+ * every edit cancels the estimate in progress.
+ *
+ * Below the results, the integrand is plotted over the interval with the area
+ * under the curve shaded. The plot draws a min/max envelope per pixel, so a
+ * partition of millions of points draws in milliseconds; it zooms with the
+ * scroll wheel, pans by dragging, and optionally overlays the rectangles of
+ * the Darboux sums.
  */
 
 
+#define _GNU_SOURCE // fmemopen
+
 #include "gui.h"
+
+#include <glib-unix.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "journal.h"
+#include "report.h"
+
 #include "debugmalloc.h"
 
 
@@ -57,6 +83,342 @@ void apply_styling(const char* css_file_path) {
 }
 
 
+/**
+ * @brief Stops the integration in progress when the window is closed, and
+ * leaves the main loop.
+ *
+ * @param widget The window being destroyed.
+ * @param user_data A pointer to the Computation of the window.
+ */
+static void close_window(GtkWidget* widget, gpointer user_data) {
+    Computation* computation = (Computation*)user_data;
+    LiveEstimate* live = computation->live;
+    computation->closing = true;
+    if (computation->handle != NULL)
+        async_cancel(computation->handle);
+
+    live->closing = true;
+    if (live->delay_source != 0)
+        g_source_remove(live->delay_source);
+    live->delay_source = 0;
+    if (live->handle != NULL)
+        async_cancel(live->handle);
+    gtk_main_quit();
+}
+
+
+/**
+ * @brief Delivers the completed integrations once the eventfd of an engine
+ * becomes readable. Called by the main loop.
+ *
+ * @param fd The eventfd of the engine.
+ * @param condition The condition of the descriptor.
+ * @param user_data A pointer to the AsyncEngine.
+ * @return G_SOURCE_CONTINUE, to keep watching the engine.
+ */
+static gboolean dispatch_completions(gint fd, GIOCondition condition,
+                                     gpointer user_data) {
+    async_dispatch((AsyncEngine*)user_data, false);
+    return G_SOURCE_CONTINUE;
+}
+
+
+/**
+ * @brief Maps a value of the integrand to a vertical pixel position.
+ *
+ * @param y The value.
+ * @param low The value at the bottom of the plot.
+ * @param high The value at the top of the plot.
+ * @param height The height of the plot in pixels.
+ * @return The position, from the top.
+ */
+static double plot_y(const double y, const double low, const double high,
+                     const int height) {
+    return height - (y - low) / (high - low) * height;
+}
+
+
+/**
+ * @brief Draws the rectangles of the lower and upper Darboux sums within the
+ * view, if they are at least GUI_PLOT_MIN_RECTANGLE_PIXELS wide.
+ *
+ * The infimum and supremum over a subinterval are read off the envelope of
+ * the pixels it covers, so they are estimates as fine as the plot.
+ *
+ * @param plot_area The plot.
+ * @param cr The cairo context of the drawing area.
+ * @param width The width of the plot in pixels.
+ * @param low The value at the bottom of the plot.
+ * @param high The value at the top of the plot.
+ * @param height The height of the plot in pixels.
+ */
+static void draw_darboux(const PlotArea* plot_area, cairo_t* cr,
+                         const int width, const double low, const double high,
+                         const int height) {
+    const Plot* plot = &plot_area->plot;
+    const double pixel_width =
+        (plot_area->view_end - plot_area->view_start) / width;
+    if (plot->dx / pixel_width < GUI_PLOT_MIN_RECTANGLE_PIXELS)
+        return;
+
+    const double zero = plot_y(0.0, low, high, height);
+    const long long first = (long long)fmax(
+        floor((plot_area->view_start - plot->start) / plot->dx), 0.0);
+    const long long last = (long long)fmin(
+        ceil((plot_area->view_end - plot->start) / plot->dx),
+        (double)plot->subintervals);
+
+    cairo_set_line_width(cr, 1.0);
+    for (long long k = first; k < last; k++) {
+        // Clamped, as a rectangle may be far wider than the view when zoomed in
+        const double offset =
+            (plot->start + k * plot->dx - plot_area->view_start) / pixel_width;
+        const double left = fmax(offset, -1.0);
+        const double right = fmin(offset + plot->dx / pixel_width, width + 1.0);
+        double infimum = INFINITY, supremum = -INFINITY;
+
+        for (int p = (int)fmax(floor(left), 0.0);
+             p < (int)fmin(ceil(right), width); p++) {
+            if (isnan(plot_area->pixels[p].mean))
+                continue;
+            infimum = fmin(infimum, plot_area->pixels[p].min);
+            supremum = fmax(supremum, plot_area->pixels[p].max);
+        }
+        if (infimum > supremum)
+            continue;
+
+        const double upper = plot_y(supremum, low, high, height);
+        const double lower = plot_y(infimum, low, high, height);
+        cairo_set_source_rgba(cr, 0.85, 0.35, 0.15, 0.9);
+        cairo_rectangle(cr, left, fmin(upper, zero), right - left,
+                        fabs(zero - upper));
+        cairo_stroke(cr);
+        cairo_set_source_rgba(cr, 0.15, 0.6, 0.3, 0.35);
+        cairo_rectangle(cr, left, fmin(lower, zero), right - left,
+                        fabs(zero - lower));
+        cairo_fill(cr);
+    }
+}
+
+
+/**
+ * @brief Draws the plot: the area between the curve and the x axis shaded,
+ * the curve as the min/max span of every pixel, and optionally the Darboux
+ * rectangles. Called by GTK whenever the drawing area needs redrawing.
+ *
+ * @param widget The drawing area.
+ * @param cr The cairo context to draw with.
+ * @param user_data A pointer to the PlotArea.
+ * @return FALSE, to let other handlers draw as well.
+ */
+static gboolean draw_plot(GtkWidget* widget, cairo_t* cr, gpointer user_data) {
+    PlotArea* plot_area = (PlotArea*)user_data;
+    int width = gtk_widget_get_allocated_width(widget);
+    const int height = gtk_widget_get_allocated_height(widget);
+    if (width > PLOT_MAX_WIDTH)
+        width = PLOT_MAX_WIDTH;
+
+    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+    cairo_paint(cr);
+    if (!plot_area->plot_ready ||
+        !plot_view(&plot_area->plot, plot_area->view_start,
+                   plot_area->view_end, width, plot_area->pixels))
+        return FALSE;
+
+    const PlotColumn* pixels = plot_area->pixels;
+    double low = 0.0, high = 0.0;
+    for (int p = 0; p < width; p++) {
+        if (isnan(pixels[p].mean))
+            continue;
+        low = fmin(low, pixels[p].min);
+        high = fmax(high, pixels[p].max);
+    }
+    if (high - low < 1E-12)
+        high = low + 1.0;
+    const double margin = 0.05 * (high - low);
+    low -= margin;
+    high += margin;
+
+    const double zero = plot_y(0.0, low, high, height);
+    cairo_set_source_rgba(cr, 0.2, 0.45, 0.85, 0.3);
+    for (int p = 0; p < width; p++) {
+        if (isnan(pixels[p].mean))
+            continue;
+        const double mean = plot_y(pixels[p].mean, low, high, height);
+        cairo_rectangle(cr, p, fmin(mean, zero), 1.0, fabs(zero - mean));
+    }
+    cairo_fill(cr);
+
+    cairo_set_source_rgb(cr, 0.6, 0.6, 0.6);
+    cairo_set_line_width(cr, 1.0);
+    cairo_move_to(cr, 0, zero);
+    cairo_line_to(cr, width, zero);
+    cairo_stroke(cr);
+
+    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(plot_area->darboux)))
+        draw_darboux(plot_area, cr, width, low, high, height);
+
+    // Each span reaches the previous pixel too, so steep parts stay connected
+    cairo_set_source_rgb(cr, 0.1, 0.2, 0.6);
+    for (int p = 0; p < width; p++) {
+        if (isnan(pixels[p].mean))
+            continue;
+        double top = pixels[p].max, bottom = pixels[p].min;
+        if (p > 0 && !isnan(pixels[p - 1].mean)) {
+            top = fmax(top, pixels[p - 1].mean);
+            bottom = fmin(bottom, pixels[p - 1].mean);
+        }
+        const double y_top = plot_y(top, low, high, height);
+        const double y_bottom = plot_y(bottom, low, high, height);
+        cairo_rectangle(cr, p, y_top, 1.0, fmax(y_bottom - y_top, 1.0));
+    }
+    cairo_fill(cr);
+
+    gchar* range = g_strdup_printf("x: [%.6g ; %.6g]   y: [%.4g ; %.4g]",
+                                   plot_area->view_start, plot_area->view_end,
+                                   low, high);
+    cairo_set_source_rgb(cr, 0.3, 0.3, 0.3);
+    cairo_set_font_size(cr, 11.0);
+    cairo_move_to(cr, 6.0, 14.0);
+    cairo_show_text(cr, range);
+    g_free(range);
+    return FALSE;
+}
+
+
+/**
+ * @brief Shows the whole interval of the plot.
+ *
+ * @param plot_area The plot.
+ */
+static void reset_view(PlotArea* plot_area) {
+    plot_area->view_start = plot_area->plot.start;
+    plot_area->view_end = plot_area->plot.end;
+    plot_area->dragging = false;
+    gtk_widget_queue_draw(plot_area->area);
+}
+
+
+/**
+ * @brief Zooms the plot in or out around the pointer on a scroll event.
+ *
+ * @param widget The drawing area.
+ * @param event The scroll event.
+ * @param user_data A pointer to the PlotArea.
+ * @return TRUE, as the event is handled.
+ */
+static gboolean zoom_plot(GtkWidget* widget, GdkEventScroll* event,
+                          gpointer user_data) {
+    PlotArea* plot_area = (PlotArea*)user_data;
+    if (!plot_area->plot_ready || plot_area->plot.expression == NULL)
+        return TRUE;
+
+    double factor;
+    if (event->direction == GDK_SCROLL_UP)
+        factor = 1 / GUI_PLOT_ZOOM;
+    else if (event->direction == GDK_SCROLL_DOWN)
+        factor = GUI_PLOT_ZOOM;
+    else if (event->direction == GDK_SCROLL_SMOOTH && event->delta_y != 0)
+        factor = pow(GUI_PLOT_ZOOM, event->delta_y);
+    else
+        return TRUE;
+
+    const double span = plot_area->view_end - plot_area->view_start;
+    const double interval = plot_area->plot.end - plot_area->plot.start;
+    const double zoomed = fmin(fmax(span * factor, interval * 1E-12),
+                               interval * 1E+03);
+    const double anchor =
+        event->x / gtk_widget_get_allocated_width(widget);
+    const double x = plot_area->view_start + anchor * span;
+
+    plot_area->view_start = x - anchor * zoomed;
+    plot_area->view_end = plot_area->view_start + zoomed;
+    gtk_widget_queue_draw(widget);
+    return TRUE;
+}
+
+
+/**
+ * @brief Starts dragging the plot with the first button, or shows the whole
+ * interval on a double click.
+ *
+ * @param widget The drawing area.
+ * @param event The button event.
+ * @param user_data A pointer to the PlotArea.
+ * @return TRUE, as the event is handled.
+ */
+static gboolean press_plot(GtkWidget* widget, GdkEventButton* event,
+                           gpointer user_data) {
+    PlotArea* plot_area = (PlotArea*)user_data;
+    if (!plot_area->plot_ready || plot_area->plot.expression == NULL ||
+        event->button != 1)
+        return TRUE;
+
+    if (event->type == GDK_2BUTTON_PRESS) {
+        reset_view(plot_area);
+        return TRUE;
+    }
+
+    plot_area->dragging = true;
+    plot_area->drag_x = event->x;
+    plot_area->drag_start = plot_area->view_start;
+    return TRUE;
+}
+
+
+/**
+ * @brief Pans the plot while it is dragged.
+ *
+ * @param widget The drawing area.
+ * @param event The motion event.
+ * @param user_data A pointer to the PlotArea.
+ * @return TRUE, as the event is handled.
+ */
+static gboolean drag_plot(GtkWidget* widget, GdkEventMotion* event,
+                          gpointer user_data) {
+    PlotArea* plot_area = (PlotArea*)user_data;
+    if (!plot_area->dragging)
+        return TRUE;
+
+    const double span = plot_area->view_end - plot_area->view_start;
+    plot_area->view_start =
+        plot_area->drag_start + (plot_area->drag_x - event->x) /
+                                    gtk_widget_get_allocated_width(widget) *
+                                    span;
+    plot_area->view_end = plot_area->view_start + span;
+    gtk_widget_queue_draw(widget);
+    return TRUE;
+}
+
+
+/**
+ * @brief Stops dragging the plot.
+ *
+ * @param widget The drawing area.
+ * @param event The button event.
+ * @param user_data A pointer to the PlotArea.
+ * @return TRUE, as the event is handled.
+ */
+static gboolean release_plot(GtkWidget* widget, GdkEventButton* event,
+                             gpointer user_data) {
+    PlotArea* plot_area = (PlotArea*)user_data;
+    plot_area->dragging = false;
+    return TRUE;
+}
+
+
+/**
+ * @brief Redraws the plot when the Darboux rectangles are switched on or off.
+ *
+ * @param button The check button.
+ * @param user_data A pointer to the PlotArea.
+ */
+static void toggle_darboux(GtkWidget* button, gpointer user_data) {
+    const PlotArea* plot_area = (const PlotArea*)user_data;
+    gtk_widget_queue_draw(plot_area->area);
+}
+
+
 /**
  * @brief Initializes and runs a GTK graphical user interface for numerical
  * integration.
@@ -66,16 +428,28 @@ void apply_styling(const char* css_file_path) {
  * results. It includes input fields, buttons for mathematical operators, and
  * grid-based layouts for organizing the components.
  *
+ * The window stays open while integrating: the job runs in the background,
+ * and its progress and results are shown below the interval, above a plot
+ * of the integrand. Closing the window cancels a job in progress.
+ *
  * @param argc Pointer to the argument count (usually provided from the main
  * function).
  * @param argv Pointer to the argument vector (usually provided from the main
  * function).
+ * @param filename The saved functions file the records are appended to.
  */
-void run_gui(int* argc, char*** argv) {
+void run_gui(int* argc, char*** argv, const char* filename) {
     Grids grids;
     Buttons buttons;
     Entries entries;
     Labels labels;
+    PlotArea plot_area = {.plot_ready = false, .dragging = false};
+    LiveEstimate live = {.engine_ready = false,
+                         .handle = nullptr,
+                         .delay_source = 0,
+                         .ready_source = 0,
+                         .closing = false,
+                         .entries = &entries};
 
     const char* button_labels[] = {"+",   "-",   "*",  "/",   "^",  "x",
                                    "sin", "cos", "tg", "ctg", "ln", "exp"};
@@ -85,15 +459,45 @@ void run_gui(int* argc, char*** argv) {
         "operator",      "operator",      "math-function", "math-function",
         "math-function", "math-function", "math-function", "math-function"};
 
+    Computation computation = {.engine_ready = false,
+                               .handle = nullptr,
+                               .progress_source = 0,
+                               .ready_source = 0,
+                               .closing = false,
+                               .entries = &entries,
+                               .buttons = &buttons,
+                               .labels = &labels,
+                               .plot_area = &plot_area,
+                               .live = &live};
+
+    entries.integrand = nullptr;
+    entries.filename = filename;
+
     gtk_init(argc, argv);
 
+    plot_area.pixels = malloc(PLOT_MAX_WIDTH * sizeof(PlotColumn));
+    plot_area.plot_ready =
+        plot_area.pixels != NULL && plot_init(&plot_area.plot);
+
+    computation.engine_ready = async_init(&computation.engine, 1);
+    if (computation.engine_ready)
+        computation.ready_source =
+            g_unix_fd_add(async_fd(&computation.engine), G_IO_IN,
+                          dispatch_completions, &computation.engine);
+
+    // A second engine, so live estimates never queue behind a full run
+    live.engine_ready = async_init(&live.engine, 1);
+    if (live.engine_ready)
+        live.ready_source = g_unix_fd_add(async_fd(&live.engine), G_IO_IN,
+                                          dispatch_completions, &live.engine);
+
     // Apply modern CSS styling from external file
     apply_styling("../src/ui/styles.css");
 
     GtkWidget* window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_title(GTK_WINDOW(window),
                          "✨ Numerical Integration Calculator");
-    gtk_window_set_default_size(GTK_WINDOW(window), 650, 550);
+    gtk_window_set_default_size(GTK_WINDOW(window), 650, 1000);
     gtk_window_set_resizable(GTK_WINDOW(window), FALSE);
     gtk_window_set_position(GTK_WINDOW(window), GTK_WIN_POS_CENTER);
 
@@ -103,7 +507,8 @@ void run_gui(int* argc, char*** argv) {
         g_object_unref(icon);
     }
 
-    g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
+    g_signal_connect(window, "destroy", G_CALLBACK(close_window),
+                     &computation);
 
     GtkWidget* main_container = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
     gtk_container_add(GTK_CONTAINER(window), main_container);
@@ -196,23 +601,115 @@ void run_gui(int* argc, char*** argv) {
     gtk_entry_set_placeholder_text(GTK_ENTRY(entries.end), "Upper bound (b)");
     gtk_widget_set_hexpand(entries.end, TRUE);
 
+    entries.refinement = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entries.refinement),
+                                   "Scale of refinement (subintervals)");
+    gchar* default_refinement = g_strdup_printf("%d", DEFAULT_REFINEMENT);
+    gtk_entry_set_text(GTK_ENTRY(entries.refinement), default_refinement);
+    g_free(default_refinement);
+    gtk_widget_set_hexpand(entries.refinement, TRUE);
+
     buttons.okInterval = gtk_button_new_with_label("🚀 Calculate Integral");
     GtkStyleContext* calc_context =
         gtk_widget_get_style_context(buttons.okInterval);
     gtk_style_context_add_class(calc_context, "ok-button");
 
+    buttons.cancel = gtk_button_new_with_label("✖ Cancel");
+    gtk_widget_set_sensitive(buttons.cancel, FALSE);
+
     gtk_grid_attach(GTK_GRID(grids.interval), entries.start, 0, 0, 1, 1);
     gtk_grid_attach_next_to(GTK_GRID(grids.interval), entries.end,
                             entries.start, GTK_POS_RIGHT, 1, 1);
-    gtk_grid_attach(GTK_GRID(grids.interval), buttons.okInterval, 0, 1, 2, 1);
+    gtk_grid_attach(GTK_GRID(grids.interval), entries.refinement, 0, 1, 2, 1);
+    gtk_grid_attach(GTK_GRID(grids.interval), buttons.okInterval, 0, 2, 1, 1);
+    gtk_grid_attach_next_to(GTK_GRID(grids.interval), buttons.cancel,
+                            buttons.okInterval, GTK_POS_RIGHT, 1, 1);
+
+    labels.live = gtk_label_new("");
+    live.label = labels.live;
+    GtkStyleContext* live_context = gtk_widget_get_style_context(labels.live);
+    gtk_style_context_add_class(live_context, "live");
+    gtk_box_pack_start(GTK_BOX(main_container), labels.live, FALSE, FALSE, 4);
+
+    computation.progress_bar = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(computation.progress_bar),
+                                   TRUE);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(computation.progress_bar), "");
+    gtk_box_pack_start(GTK_BOX(main_container), computation.progress_bar,
+                       FALSE, FALSE, 6);
+
+    labels.result = gtk_label_new("");
+    gtk_label_set_selectable(GTK_LABEL(labels.result), TRUE);
+    GtkStyleContext* result_context =
+        gtk_widget_get_style_context(labels.result);
+    gtk_style_context_add_class(result_context, "result");
+    gtk_box_pack_start(GTK_BOX(main_container), labels.result, FALSE, FALSE,
+                       6);
+
+    plot_area.area = gtk_drawing_area_new();
+    gtk_widget_set_size_request(plot_area.area, GUI_PLOT_WIDTH,
+                                GUI_PLOT_HEIGHT);
+    gtk_widget_set_tooltip_text(plot_area.area,
+                                "Scroll to zoom, drag to pan, double-click "
+                                "to show the whole interval");
+    gtk_widget_add_events(plot_area.area,
+                          GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK |
+                              GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK |
+                              GDK_BUTTON1_MOTION_MASK);
+    gtk_box_pack_start(GTK_BOX(main_container), plot_area.area, FALSE, FALSE,
+                       6);
+
+    plot_area.darboux =
+        gtk_check_button_new_with_label("Show Darboux rectangles");
+    gtk_box_pack_start(GTK_BOX(main_container), plot_area.darboux, FALSE,
+                       FALSE, 4);
+
+    g_signal_connect(plot_area.area, "draw", G_CALLBACK(draw_plot),
+                     &plot_area);
+    g_signal_connect(plot_area.area, "scroll-event", G_CALLBACK(zoom_plot),
+                     &plot_area);
+    g_signal_connect(plot_area.area, "button-press-event",
+                     G_CALLBACK(press_plot), &plot_area);
+    g_signal_connect(plot_area.area, "motion-notify-event",
+                     G_CALLBACK(drag_plot), &plot_area);
+    g_signal_connect(plot_area.area, "button-release-event",
+                     G_CALLBACK(release_plot), &plot_area);
+    g_signal_connect(plot_area.darboux, "toggled", G_CALLBACK(toggle_darboux),
+                     &plot_area);
 
     g_signal_connect(buttons.okInterval, "clicked", G_CALLBACK(save_interval),
                      &entries);
-    g_signal_connect(buttons.okInterval, "clicked", G_CALLBACK(over), window);
+    g_signal_connect(buttons.okInterval, "clicked",
+                     G_CALLBACK(start_integration), &computation);
+    g_signal_connect(buttons.cancel, "clicked",
+                     G_CALLBACK(cancel_integration), &computation);
+    g_signal_connect(entries.func, "changed",
+                     G_CALLBACK(schedule_live_estimate), &live);
+    g_signal_connect(entries.start, "changed",
+                     G_CALLBACK(schedule_live_estimate), &live);
+    g_signal_connect(entries.end, "changed",
+                     G_CALLBACK(schedule_live_estimate), &live);
 
     gtk_widget_show_all(window);
     gtk_main();
 
+    // A job still running was cancelled with the window; wait for it
+    if (computation.progress_source != 0)
+        g_source_remove(computation.progress_source);
+    if (computation.ready_source != 0)
+        g_source_remove(computation.ready_source);
+    computation.progress_source = 0;
+    if (computation.engine_ready)
+        async_destroy(&computation.engine);
+    if (live.ready_source != 0)
+        g_source_remove(live.ready_source);
+    if (live.engine_ready)
+        async_destroy(&live.engine);
+    if (plot_area.plot_ready)
+        plot_destroy(&plot_area.plot);
+    free(plot_area.pixels);
+
+    g_free(entries.integrand);
     free(buttons.matrix);
 }
 
@@ -252,12 +749,13 @@ void insert_text(GtkWidget* button, gpointer user_data) {
 
 
 /**
- * @brief Saves the text from the GtkEntry widget associated with the specified
- * button into a file named "functions.txt".
+ * @brief Keeps the confirmed integrand until the interval is entered.
  *
- * This function is typically connected to a button click signal to save user
- * input from a GtkEntry widget to a predefined file. The file is opened in
- * append mode, so new entries are added to the end of the file.
+ * This function is connected to the confirmation button of the integrand. The
+ * integrand is not written to the saved functions file yet: it is stored in the
+ * Entries structure, and save_interval() appends it together with the interval
+ * as a single record, so records of concurrently running instances never
+ * interleave.
  *
  * @param button The GtkWidget pointer representing the button that triggered
  * the signal.
@@ -266,17 +764,11 @@ void insert_text(GtkWidget* button, gpointer user_data) {
  * be saved.
  */
 void save_to_file(GtkWidget* button, gpointer user_data) {
-    const Entries* entry = (Entries*)user_data;
+    Entries* entry = (Entries*)user_data;
     const gchar* text_to_save = gtk_entry_get_text(GTK_ENTRY(entry->func));
-    const char* filename = "functions.txt";
 
-    FILE* file = fopen(filename, "a");
-    if (file) {
-        fprintf(file, "%s\n", text_to_save);
-        fclose(file);
-    } else {
-        perror("Could not open the file.\n");
-    }
+    g_free(entry->integrand);
+    entry->integrand = g_strdup(text_to_save);
 }
 
 
@@ -285,8 +777,10 @@ void save_to_file(GtkWidget* button, gpointer user_data) {
  *
  * This function is triggered upon a button click in the GUI to read the start
  * and end interval values from the provided GtkEntry widgets, and appends them
- * as an interval to a file named "functions.txt". If the file cannot be opened,
- * an error message is displayed.
+ * together with the confirmed integrand as one record to the saved functions
+ * file of the Entries. The record is written atomically and indexed by the
+ * history module. If the integrand has not been confirmed or the record
+ * cannot be written, an error message is displayed.
  *
  * @param button The GtkWidget pointer representing the button that triggered
  * the callback.
@@ -298,16 +792,16 @@ void save_interval(GtkWidget* button, gpointer user_data) {
     const Entries* entry = (Entries*)user_data;
     const gchar* text1 = gtk_entry_get_text(GTK_ENTRY(entry->start));
     const gchar* text2 = gtk_entry_get_text(GTK_ENTRY(entry->end));
-    const char* filename = "functions.txt";
 
-    FILE* file = fopen(filename, "a");
-    if (file) {
-        fprintf(file, "[%s ; ", text1);
-        fprintf(file, "%s]\n", text2);
-        fclose(file);
-    } else {
-        perror("Could not open the file.\n");
+    if (entry->integrand == NULL) {
+        fprintf(stderr, "Error: The function has not been confirmed.\n");
+        return;
     }
+
+    gchar* interval = g_strdup_printf("[%s ; %s]", text1, text2);
+    if (!history_append(entry->filename, entry->integrand, interval))
+        fprintf(stderr, "Error: The function could not be saved.\n");
+    g_free(interval);
 }
 
 
@@ -324,14 +818,440 @@ void disable_button(GtkWidget* button, gpointer user_data) {
 
 
 /**
- * @brief Destroys a GTK widget.
+ * @brief Shows the completed chunks of the integration in progress in the
+ * progress bar. Called periodically by the main loop while a job runs.
+ *
+ * @param user_data A pointer to the Computation of the window.
+ * @return G_SOURCE_CONTINUE, to keep updating the progress bar.
+ */
+static gboolean update_progress(gpointer user_data) {
+    const Computation* computation = (const Computation*)user_data;
+    const double fraction =
+        integration_progress_fraction(&computation->progress);
+
+    gchar* text = g_strdup_printf("%.0f %%", 100 * fraction);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(computation->progress_bar),
+                                  fraction);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(computation->progress_bar),
+                              text);
+    g_free(text);
+    return G_SOURCE_CONTINUE;
+}
+
+
+/**
+ * @brief Writes the text shown for the result of an integration.
+ *
+ * The values are written in the text format of the command-line mode; a
+ * failed integration is described by an error message instead.
+ *
+ * @param record The record of the integration.
+ * @param text Output buffer for the text.
+ * @param size The size of the buffer.
+ */
+static void describe_result(const ResultRecord* record, char* text,
+                            const size_t size) {
+    const IntegrationStatus status = record->result->status;
+    text[0] = '\0';
+
+    switch (status) {
+        case INTEGRATION_OK:
+        case INTEGRATION_NOT_CONVERGED:
+        case INTEGRATION_PARTIAL: {
+            FILE* stream = fmemopen(text, size, "w");
+            if (stream == NULL)
+                break;
+            ResultWriter writer;
+            if (report_begin(&writer, stream, REPORT_TEXT)) {
+                report_write(&writer, record);
+                report_flush(&writer);
+            }
+            if (status == INTEGRATION_PARTIAL)
+                fprintf(stream, "Cancelled: the values are estimates.");
+            fclose(stream);
+            break;
+        }
+        case INTEGRATION_INVALID_INTEGRAND:
+            snprintf(text, size, "Error: The function is not a valid "
+                                 "expression.");
+            break;
+        case INTEGRATION_INVALID_INTERVAL:
+            snprintf(text, size, "Error: The interval is invalid.");
+            break;
+        case INTEGRATION_INVALID_REFINEMENT:
+            snprintf(text, size,
+                     "Error: The scale of refinement must be between %d and "
+                     "%d.",
+                     MIN_REFINEMENT, MAX_REFINEMENT);
+            break;
+        default:
+            snprintf(text, size, "Error: The integration failed (%s).",
+                     status_name(status));
+            break;
+    }
+}
+
+
+/**
+ * @brief Records and shows the result of a completed integration. Called on
+ * the main thread by async_dispatch().
+ *
+ * The result is appended to the results journal and, unless the window has
+ * been closed, shown in the result label, and the buttons are reset for the
+ * next integration.
+ *
+ * @param handle The handle of the completed job.
+ * @param result The result of the job.
+ * @param user_data A pointer to the Computation of the window.
+ */
+static void show_result(AsyncHandle* handle, const IntegrationResult* result,
+                        void* user_data) {
+    Computation* computation = (Computation*)user_data;
+    computation->handle = nullptr;
+    if (computation->progress_source != 0) {
+        g_source_remove(computation->progress_source);
+        computation->progress_source = 0;
+    }
+
+    const ResultRecord record = {.id = nullptr,
+                                 .id_is_number = false,
+                                 .integrand = computation->integrand,
+                                 .label = nullptr,
+                                 .result = result};
+    journal_append(&record);
+
+    if (computation->closing)
+        return;
+
+    char text[GUI_RESULT_MAX];
+    describe_result(&record, text, sizeof(text));
+    gtk_label_set_text(GTK_LABEL(computation->labels->result), text);
+
+    update_progress(computation);
+    gtk_widget_set_sensitive(computation->buttons->okInterval, TRUE);
+    gtk_widget_set_sensitive(computation->buttons->cancel, FALSE);
+}
+
+
+/**
+ * @brief Starts integrating the confirmed function over the entered interval
+ * in the background.
+ *
+ * The job is handed to the worker of the engine, with one thread per online
+ * CPU computing its chunks, and the function returns at once. While the job
+ * runs, the progress bar follows its completed chunks and only the Cancel
+ * button is enabled; show_result() reports the outcome. The plot switches to
+ * the integrand and interval of the job. Invalid input is reported in the
+ * result label without starting a job.
+ *
+ * @param button The GtkWidget pointer representing the button that triggered
+ * the callback.
+ * @param user_data A pointer to the Computation of the window.
+ */
+void start_integration(GtkWidget* button, gpointer user_data) {
+    Computation* computation = (Computation*)user_data;
+    const Entries* entries = computation->entries;
+    GtkLabel* result_label = GTK_LABEL(computation->labels->result);
+
+    if (computation->handle != NULL || !computation->engine_ready)
+        return;
+
+    if (entries->integrand == NULL) {
+        gtk_label_set_text(result_label,
+                           "Error: The function has not been confirmed.");
+        return;
+    }
+
+    gchar* interval = g_strdup_printf(
+        "[%s ; %s]", gtk_entry_get_text(GTK_ENTRY(entries->start)),
+        gtk_entry_get_text(GTK_ENTRY(entries->end)));
+    double start, end;
+    const bool valid_interval = validate_interval(interval, &start, &end);
+    g_free(interval);
+    if (!valid_interval) {
+        gtk_label_set_text(result_label, "Error: The interval is invalid.");
+        return;
+    }
+
+    const char* refinement_text =
+        gtk_entry_get_text(GTK_ENTRY(entries->refinement));
+    char* refinement_end;
+    const long refinement = strtol(refinement_text, &refinement_end, 10);
+    if (refinement_end == refinement_text || *refinement_end != '\0' ||
+        refinement < MIN_REFINEMENT || refinement > MAX_REFINEMENT) {
+        gchar* message = g_strdup_printf(
+            "Error: The scale of refinement must be between %d and %d.",
+            MIN_REFINEMENT, MAX_REFINEMENT);
+        gtk_label_set_text(result_label, message);
+        g_free(message);
+        return;
+    }
+
+    PlotArea* plot_area = computation->plot_area;
+    if (plot_area->plot_ready) {
+        plot_set_function(&plot_area->plot, entries->integrand, start, end,
+                          (int)refinement);
+        reset_view(plot_area);
+    }
+
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    const IntegrationJob job = {.start = start,
+                                .end = end,
+                                .refinement = (int)refinement,
+                                .tolerance = 0,
+                                .methods = METHOD_ALL,
+                                .threads = (int)threads,
+                                .progress = &computation->progress};
+    integration_progress_init(&computation->progress);
+    g_strlcpy(computation->integrand, entries->integrand,
+              sizeof(computation->integrand));
+
+    computation->handle = async_submit(&computation->engine,
+                                       entries->integrand, &job, show_result,
+                                       computation);
+    if (computation->handle == NULL) {
+        gtk_label_set_text(result_label,
+                           "Error: The integration could not be started.");
+        return;
+    }
+
+    gtk_widget_set_sensitive(computation->buttons->okInterval, FALSE);
+    gtk_widget_set_sensitive(computation->buttons->cancel, TRUE);
+    gtk_label_set_text(result_label, "Integrating...");
+    update_progress(computation);
+    computation->progress_source =
+        g_timeout_add(GUI_PROGRESS_INTERVAL_MS, update_progress, computation);
+}
+
+
+/**
+ * @brief Cancels the integration in progress. The job stops at its next
+ * chunk boundary and show_result() reports the estimates so far.
+ *
+ * @param button The GtkWidget pointer representing the button that triggered
+ * the callback.
+ * @param user_data A pointer to the Computation of the window.
+ */
+void cancel_integration(GtkWidget* button, gpointer user_data) {
+    const Computation* computation = (const Computation*)user_data;
+    if (computation->handle == NULL)
+        return;
+
+    async_cancel(computation->handle);
+    gtk_widget_set_sensitive(button, FALSE);
+    gtk_label_set_text(GTK_LABEL(computation->labels->result),
+                       "Cancelling...");
+}
+
+
+/**
+ * @brief Shows the text of the live estimate.
  *
- * This function destroys the GTK widget passed as user_data.
+ * @param live The live estimate.
+ * @param text The text.
+ */
+static void show_live_text(const LiveEstimate* live, const char* text) {
+    gchar* message = g_strdup_printf("Live estimate: %s", text);
+    gtk_label_set_text(GTK_LABEL(live->label), message);
+    g_free(message);
+}
+
+
+static void show_live(AsyncHandle* handle, const IntegrationResult* result,
+                      void* user_data);
+
+
+/**
+ * @brief Returns the refinement of the next live estimate job: the current
+ * one, except that the bracketing job is capped at subintervals of
+ * EXTREMUM_STEP width, below which the Darboux sums would only see the left
+ * end of each subinterval.
  *
- * @param button The GTK widget that triggers the function, generally a button.
- * @param user_data A pointer to the GTK widget to be destroyed (typically a
- * window or another widget).
+ * @param live The live estimate.
+ * @return The number of subintervals.
  */
-void over(GtkWidget* button, gpointer user_data) {
-    gtk_widget_destroy(GTK_WIDGET(user_data));
+static int live_refinement(const LiveEstimate* live) {
+    const double scanned = fabs(live->end - live->start) / EXTREMUM_STEP;
+    if (!live->bracketing || live->refinement <= scanned)
+        return live->refinement;
+    return scanned < MIN_REFINEMENT ? MIN_REFINEMENT : (int)scanned;
+}
+
+
+/**
+ * @brief Starts the live estimate job with the current refinement on every
+ * online CPU. The refining jobs compute the Riemann sum only, which is cheap
+ * at any refinement; the bracketing job computes the Darboux sums, whose
+ * extremum scan costs the same at every refinement.
+ *
+ * @param live The live estimate.
+ */
+static void submit_live(LiveEstimate* live) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    const IntegrationJob job = {.start = live->start,
+                                .end = live->end,
+                                .refinement = live_refinement(live),
+                                .tolerance = 0,
+                                .methods =
+                                    live->bracketing
+                                        ? METHOD_FLAG(METHOD_LOWER_DARBOUX) |
+                                              METHOD_FLAG(METHOD_UPPER_DARBOUX)
+                                        : METHOD_FLAG(METHOD_RIEMANN),
+                                .threads = (int)threads};
+    live->handle = async_submit(&live->engine, live->integrand, &job,
+                                show_live, live);
+    if (live->handle == NULL)
+        show_live_text(live, "could not be started.");
+}
+
+
+/**
+ * @brief Shows a completed live estimate job and starts the next one: a
+ * finer Riemann sum until two successive ones agree, then the bracketing
+ * Darboux sums. Called on the main thread by async_dispatch(). Completions of
+ * jobs cancelled by a later edit are ignored.
+ *
+ * @param handle The handle of the completed job.
+ * @param result The result of the job.
+ * @param user_data A pointer to the LiveEstimate.
+ */
+static void show_live(AsyncHandle* handle, const IntegrationResult* result,
+                      void* user_data) {
+    LiveEstimate* live = (LiveEstimate*)user_data;
+    if (handle != live->handle)
+        return;
+    live->handle = nullptr;
+    if (live->closing)
+        return;
+
+    if (result->status == INTEGRATION_INVALID_INTEGRAND) {
+        show_live_text(live, "the function is not a valid expression.");
+        return;
+    }
+    if (result->status != INTEGRATION_OK) {
+        gchar* text = g_strdup_printf("the integration failed (%s).",
+                                      status_name(result->status));
+        show_live_text(live, text);
+        g_free(text);
+        return;
+    }
+
+    gchar* text;
+    if (live->bracketing) {
+        const double gap = fabs(result->methods[METHOD_UPPER_DARBOUX].value -
+                                result->methods[METHOD_LOWER_DARBOUX].value);
+        text = g_strdup_printf("%.12g ± %.3g (%d subintervals, Darboux sums "
+                               "at %d)",
+                               live->value, gap / 2, live->refinement,
+                               live_refinement(live));
+        show_live_text(live, text);
+        g_free(text);
+        return;
+    }
+
+    const double value = result->methods[METHOD_RIEMANN].value;
+    const bool converged =
+        live->refinement > GUI_LIVE_FIRST_REFINEMENT &&
+        fabs(value - live->previous) <=
+            GUI_LIVE_TOLERANCE * fmax(1.0, fabs(value));
+    const bool finest = live->refinement >= GUI_LIVE_MAX_REFINEMENT;
+
+    if (converged || finest) {
+        text = g_strdup_printf("%.12g (%s at %d subintervals, bracketing...)",
+                               value, converged ? "converged" : "stopped",
+                               live->refinement);
+        live->value = value;
+        live->bracketing = true;
+    } else {
+        text = g_strdup_printf("%.12g (%d subintervals, refining...)", value,
+                               live->refinement);
+        live->previous = value;
+        live->refinement *= GUI_LIVE_GROWTH;
+        if (live->refinement > GUI_LIVE_MAX_REFINEMENT)
+            live->refinement = GUI_LIVE_MAX_REFINEMENT;
+    }
+    show_live_text(live, text);
+    g_free(text);
+    submit_live(live);
+}
+
+
+/**
+ * @brief Starts a live estimate of the integral in the entries once they
+ * have been left alone for GUI_LIVE_DELAY_MS. Called by the main loop.
+ *
+ * An incomplete function or interval clears the estimate without starting a
+ * job; the function is validated by the engine.
+ *
+ * @param user_data A pointer to the LiveEstimate.
+ * @return G_SOURCE_REMOVE, as the delay is restarted by every edit.
+ */
+static gboolean start_live_estimate(gpointer user_data) {
+    LiveEstimate* live = (LiveEstimate*)user_data;
+    const Entries* entries = live->entries;
+    live->delay_source = 0;
+    if (!live->engine_ready)
+        return G_SOURCE_REMOVE;
+
+    const gchar* integrand = gtk_entry_get_text(GTK_ENTRY(entries->func));
+    if (integrand[0] == '\0' ||
+        strlen(integrand) >= sizeof(live->integrand)) {
+        gtk_label_set_text(GTK_LABEL(live->label), "");
+        return G_SOURCE_REMOVE;
+    }
+
+    gchar* interval = g_strdup_printf(
+        "[%s ; %s]", gtk_entry_get_text(GTK_ENTRY(entries->start)),
+        gtk_entry_get_text(GTK_ENTRY(entries->end)));
+    const bool valid_interval =
+        validate_interval(interval, &live->start, &live->end);
+    g_free(interval);
+    if (!valid_interval) {
+        gtk_label_set_text(GTK_LABEL(live->label), "");
+        return G_SOURCE_REMOVE;
+    }
+
+    g_strlcpy(live->integrand, integrand, sizeof(live->integrand));
+    live->refinement = GUI_LIVE_FIRST_REFINEMENT;
+    live->bracketing = false;
+    show_live_text(live, "computing...");
+    submit_live(live);
+    return G_SOURCE_REMOVE;
+}
+
+
+/**
+ * @brief Restarts the live estimate after an edit of the function or the
+ * interval.
+ *
+ * The estimate in progress is cancelled at once, as it no longer matches the
+ * entries, and a new one starts once the entries have been left alone for
+ * GUI_LIVE_DELAY_MS, so typing does not start a job per keystroke.
+ *
+ * @param entry The edited entry.
+ * @param user_data A pointer to the LiveEstimate.
+ */
+void schedule_live_estimate(GtkWidget* entry, gpointer user_data) {
+    LiveEstimate* live = (LiveEstimate*)user_data;
+    if (live->closing)
+        return;
+
+    if (live->handle != NULL) {
+        async_cancel(live->handle);
+        live->handle = nullptr;
+    }
+    if (live->delay_source != 0)
+        g_source_remove(live->delay_source);
+    live->delay_source =
+        g_timeout_add(GUI_LIVE_DELAY_MS, start_live_estimate, live);
 }
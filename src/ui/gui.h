@@ -16,6 +16,23 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "async.h"
+#include "integral.h"
+#include "plot.h"
+
+
+#define GUI_PROGRESS_INTERVAL_MS 100
+#define GUI_RESULT_MAX 1024
+#define GUI_PLOT_WIDTH 620
+#define GUI_PLOT_HEIGHT 260
+#define GUI_PLOT_ZOOM 1.25
+#define GUI_PLOT_MIN_RECTANGLE_PIXELS 4
+#define GUI_LIVE_DELAY_MS 300
+#define GUI_LIVE_FIRST_REFINEMENT 16
+#define GUI_LIVE_GROWTH 4
+#define GUI_LIVE_MAX_REFINEMENT 4194304
+#define GUI_LIVE_TOLERANCE 1E-06
+
 
 /**
  * @struct Grids
@@ -43,6 +60,7 @@ typedef struct Buttons {
     GtkWidget* okFunc;
     GtkWidget** matrix;
     GtkWidget* okInterval;
+    GtkWidget* cancel;
 } Buttons;
 
 
@@ -51,13 +69,17 @@ typedef struct Buttons {
  *
  * A structure used to manage input entries related to the function and interval
  * specification in the GUI for the numerical integral application. It holds
- * widgets for inputting the function expression and defining the integration
- * interval (start and end points).
+ * widgets for inputting the function expression, defining the integration
+ * interval (start and end points) and the scale of refinement. `filename` is
+ * the saved functions file the confirmed records are appended to.
  */
 typedef struct Entries {
     GtkWidget* func;
     GtkWidget* start;
     GtkWidget* end;
+    GtkWidget* refinement;
+    gchar* integrand;
+    const char* filename;
 } Entries;
 
 
@@ -66,18 +88,110 @@ typedef struct Entries {
  *
  * A structure that holds label widgets used in the GUI to display titles and
  * prompts for user input, such as the title of the application and labels for
- * start and end interval inputs.
+ * start and end interval inputs, the label the results are shown in, and
+ * the label of the live estimate.
  */
 typedef struct Labels {
     GtkWidget* title;
     GtkWidget* start;
     GtkWidget* end;
+    GtkWidget* result;
+    GtkWidget* live;
 } Labels;
 
 
+/**
+ * @struct LiveEstimate
+ *
+ * The estimate of the integral kept up to date while the function and the
+ * interval are edited. Every edit restarts `delay_source`, so a job is only
+ * started once the entries have been left alone for GUI_LIVE_DELAY_MS, and
+ * cancels the job in progress, `handle`. A job integrates `integrand` over
+ * `[start ; end]` with `refinement` subintervals on the worker of `engine`;
+ * each completed job shows its Riemann sum and starts the next, GUI_LIVE_GROWTH
+ * times finer, until it is within GUI_LIVE_TOLERANCE of `previous`, the sum of
+ * the job before, or GUI_LIVE_MAX_REFINEMENT is reached. Then `value` is kept
+ * and a last, `bracketing` job computes the Darboux sums once, to tell how far
+ * it may be from the integral. Completions of cancelled jobs are ignored, as
+ * their handle is no longer `handle`.
+ */
+typedef struct LiveEstimate {
+    AsyncEngine engine;
+    bool engine_ready;
+    AsyncHandle* handle;
+    guint delay_source;
+    guint ready_source;
+    char integrand[MAX_INTEGRAND_LENGTH + 1];
+    double start;
+    double end;
+    int refinement;
+    double previous;
+    double value;
+    bool bracketing;
+    bool closing;
+    Entries* entries;
+    GtkWidget* label;
+} LiveEstimate;
+
+
+/**
+ * @struct PlotArea
+ *
+ * The plot of the integrand over the interval of the last integration, drawn
+ * into `area` from the min/max envelope `pixels` computed by `plot`;
+ * `plot_ready` tells whether both could be allocated. The view
+ * shows `[view_start ; view_end]`; while the plot is dragged, `drag_x` and
+ * `drag_start` are the pointer position and the start of the view when the
+ * drag began. `darboux` is the check button overlaying the rectangles of the
+ * Darboux sums.
+ */
+typedef struct PlotArea {
+    Plot plot;
+    bool plot_ready;
+    PlotColumn* pixels;
+    double view_start;
+    double view_end;
+    bool dragging;
+    double drag_x;
+    double drag_start;
+    GtkWidget* area;
+    GtkWidget* darboux;
+} PlotArea;
+
+
+/**
+ * @struct Computation
+ *
+ * The integration running in the background while the window stays open. The
+ * job runs on the worker of `engine`, whose completions are watched by the
+ * main loop through `ready_source`; `handle` is the job in progress, or NULL.
+ * `progress` is counted by the integration core and shown in `progress_bar`
+ * by `progress_source`. `integrand` is the integrand of the job, recorded in
+ * the journal with its result. Once `closing` is set, the window is gone and
+ * completions no longer touch the widgets. `plot_area` is replotted for
+ * every job started, and `live` is the estimate shown while editing.
+ */
+typedef struct Computation {
+    AsyncEngine engine;
+    bool engine_ready;
+    AsyncHandle* handle;
+    IntegrationProgress progress;
+    guint progress_source;
+    guint ready_source;
+    char integrand[MAX_INTEGRAND_LENGTH + 1];
+    bool closing;
+    Entries* entries;
+    Buttons* buttons;
+    Labels* labels;
+    GtkWidget* progress_bar;
+    PlotArea* plot_area;
+    LiveEstimate* live;
+} Computation;
+
+
 void apply_styling(const char* css_file_path);
 
-void run_gui(int* argc, char*** argv);
+void run_gui(int* argc, char*** argv, const char* filename);
 
 void insert_text(GtkWidget* button, gpointer user_data);
 
@@ -87,7 +201,11 @@ void save_interval(GtkWidget* button, gpointer user_data);
 
 void disable_button(GtkWidget* button, gpointer user_data);
 
-void over(GtkWidget* button, gpointer user_data);
+void start_integration(GtkWidget* button, gpointer user_data);
+
+void cancel_integration(GtkWidget* button, gpointer user_data);
+
+void schedule_live_estimate(GtkWidget* entry, gpointer user_data);
 
 
 #endif /* GUI_H */
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+# Measures the start-up time of the executables in a build directory.
+#
+# Every executable is started RUNS times with --help, which parses the
+# arguments and exits before any integration, so the measured time is the
+# time spent loading the executable and its shared libraries. With
+# --drop-caches (root only) the page cache is dropped before the first run,
+# which is reported separately as the cold start.
+#
+# Usage: tools/startup_time.sh [--drop-caches] [BUILD_DIR] [RUNS]
+
+set -euo pipefail
+
+drop_caches=false
+if [[ "${1:-}" == "--drop-caches" ]]; then
+    drop_caches=true
+    shift
+fi
+
+build_dir="${1:-build}"
+runs="${2:-200}"
+
+now_ns() {
+    date +%s%N
+}
+
+measure() {
+    local executable="$1"
+
+    if $drop_caches; then
+        sync
+        echo 3 > /proc/sys/vm/drop_caches
+    fi
+
+    local start end
+    start=$(now_ns)
+    "$executable" --help > /dev/null
+    end=$(now_ns)
+    local first_us=$(( (end - start) / 1000 ))
+
+    local total=0 best=0
+    for (( i = 0; i < runs; i++ )); do
+        start=$(now_ns)
+        "$executable" --help > /dev/null
+        end=$(now_ns)
+        local elapsed=$(( (end - start) / 1000 ))
+        total=$(( total + elapsed ))
+        if (( best == 0 || elapsed < best )); then
+            best=$elapsed
+        fi
+    done
+
+    local objects
+    objects=$(ldd "$executable" | wc -l)
+    printf "%-20s %8d %12d %10d %10d\n" "$(basename "$executable")" \
+           "$objects" "$first_us" "$(( total / runs ))" "$best"
+}
+
+printf "%-20s %8s %12s %10s %10s\n" "Executable" "Objects" "First (us)" \
+       "Mean (us)" "Best (us)"
+
+found=false
+for name in numint numerical_integral; do
+    if [[ -x "$build_dir/$name" ]]; then
+        measure "$build_dir/$name"
+        found=true
+    fi
+done
+
+if ! $found; then
+    echo "No executables found in $build_dir" >&2
+    exit 1
+fi